@@ -435,21 +435,10 @@ public:
 		int boundaryType=BSplineElements< 2 >::NONE , XForm4x4< Real > xForm=XForm4x4< Real >::Identity , bool makeComplete=false );
 	
 
-
-	//////////////////////////////////////////////////////////////////////////
-	// Liangliang: I added this function
-	template< class PointReal >
-	int SetTree(const std::list<PointReal>& points, const std::list<PointReal>& normals,  
-		int minDepth , int maxDepth , int fullDepth , int splatDepth , Real samplesPerNode ,
-		Real scaleFactor , bool useConfidence , bool useNormalWeight , Real constraintWeight , int adaptiveExponent ,
-		PointInfo& pointInfo , NormalInfo& normalInfo , std::vector< Real >& kernelDensityWeights , std::vector< Real >& centerWeights ,
-		int boundaryType=BSplineElements< 2 >::NONE, XForm4x4<Real> xForm=XForm4x4<Real>::Identity(), bool makeComplete=false );
-
-	//////////////////////////////////////////////////////////////////////////
-
-
 	Pointer( Real ) SetLaplacianConstraints( const NormalInfo& normalInfo );
-	Pointer( Real ) SolveSystem( PointInfo& pointInfo , Pointer( Real ) constraints , bool showResidual , int iters , int maxSolveDepth , int cgDepth=0 , double cgAccuracy=0 );
+	// If not NULL, $totalIters$ receives the number of iterations (summed over the depths) and $relResidual$
+	// the relative residual ||b-Mx||/||b|| at the finest solved depth (-1 if not available).
+	Pointer( Real ) SolveSystem( PointInfo& pointInfo , Pointer( Real ) constraints , bool showResidual , int iters , int maxSolveDepth , int cgDepth=0 , double cgAccuracy=0 , int* totalIters=NULL , double* relResidual=NULL );
 
 	Real GetIsoValue( ConstPointer( Real ) solution , const std::vector< Real >& centerWeights );
 	template< class Vertex >
@@ -465,5 +454,4 @@ void Reset( void )
 #include "MultiGridOctreeData.inl"
 #include "MultiGridOctreeData.SortedTreeNodes.inl"
 #include "MultiGridOctreeData.IsoSurface.inl"
-#include "mySetTree.inl"
 #endif // MULTI_GRID_OCTREE_DATA_INCLUDED
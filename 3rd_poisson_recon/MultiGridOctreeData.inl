@@ -1678,7 +1678,7 @@ int Octree< Real >::GetMatrixAndUpdateConstraints( const PointInfo& pointInfo ,
 }
 
 template< class Real >
-Pointer( Real ) Octree< Real >::SolveSystem( PointInfo& pointInfo , Pointer( Real ) constraints , bool showResidual , int iters , int maxSolveDepth , int cgDepth , double accuracy )
+Pointer( Real ) Octree< Real >::SolveSystem( PointInfo& pointInfo , Pointer( Real ) constraints , bool showResidual , int iters , int maxSolveDepth , int cgDepth , double accuracy , int* totalIters , double* relResidual )
 {
 	int iter=0;
 	typename BSplineData< 2 >::Integrator integrator;
@@ -1692,18 +1692,29 @@ Pointer( Real ) Octree< Real >::SolveSystem( PointInfo& pointInfo , Pointer( Rea
 	solution[0] = 0;
 
 	std::vector< Real > metSolution( _sNodes.nodeCount[ _sNodes.maxDepth-1 ] , 0 );
+	// the residual is only evaluated at the finest solved depth (it costs an additional matrix-vector product)
+	int residualDepth = std::min< int >( maxSolveDepth , _sNodes.maxDepth-1 );
+	std::vector< double > bNorm2( _sNodes.maxDepth , 0 ) , outRNorm2( _sNodes.maxDepth , 0 );
 	for( int d=_minDepth ; d<_sNodes.maxDepth ; d++ )
 	{
 		//DumpOutput( "Depth[%d/%d]: %d\n" , _boundaryType==0 ? d-1 : d , _boundaryType==0 ? _sNodes.maxDepth-2 : _sNodes.maxDepth-1 , _sNodes.nodeCount[d+1]-_sNodes.nodeCount[d] );
+		double* b = ( relResidual && d==residualDepth ) ? &bNorm2[0] : NULL;
+		double* r = ( relResidual && d==residualDepth ) ? &outRNorm2[0] : NULL;
 		if( d==_minDepth )
-			_SolveSystemCG( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , _sNodes.nodeCount[_minDepth+1]-_sNodes.nodeCount[_minDepth] , true , showResidual, NULL , NULL , NULL );
+			iter += _SolveSystemCG( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , _sNodes.nodeCount[_minDepth+1]-_sNodes.nodeCount[_minDepth] , true , showResidual, b , NULL , r );
 		else
 		{
-			if( d>cgDepth ) iter += _SolveSystemGS( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , d>maxSolveDepth ? 0 : iters , true , showResidual , NULL , NULL , NULL );
-			else            iter += _SolveSystemCG( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , d>maxSolveDepth ? 0 : iters , true , showResidual , NULL , NULL , NULL , accuracy );
+			if( d>cgDepth ) iter += _SolveSystemGS( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , d>maxSolveDepth ? 0 : iters , true , showResidual , b , NULL , r );
+			else            iter += _SolveSystemCG( pointInfo , d , integrator , _sNodes , solution , constraints , GetPointer( metSolution ) , d>maxSolveDepth ? 0 : iters , true , showResidual , b , NULL , r , accuracy );
 		}
 	}
 
+	if( totalIters ) *totalIters = iter;
+	if( relResidual )
+	{
+		if( residualDepth>=_minDepth && bNorm2[residualDepth]>0 ) *relResidual = sqrt( outRNorm2[residualDepth] / bNorm2[residualDepth] );
+		else                                                      *relResidual = -1;
+	}
 	return solution;
 }
 template< class Real >
@@ -4,6 +4,7 @@
 #include <QSplitter>
 #include <QTextEdit>
 #include <time.h>
+#include <algorithm>
 
 #include "main_window.h"
 #include "paint_canvas.h"
@@ -16,8 +17,11 @@
 #include "../../file_io/point_set_io.h"
 #include "../../file_io/point_set_serializer_ply.h"
 #include "../../kinect_io/depth_basic.h"
+#include "../../kinect_io/kinect_frame_source.h"
+#include "../../kinect_io/depth_frame_replay.h"
+#include "../../kinect_io/depth_frame_recorder.h"
+#include "../../kinect_io/capture_pipeline.h"
 #include "../../algo/point_set_normal_estimation.h"
-#include "../../image/my_image.h"
 
 MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
@@ -82,6 +86,15 @@ MainWindow::MainWindow(QWidget *parent)
 
 	depthbc = new CDepthBasics();
 	scanthread = new ScanThread();
+	kinect_source_ = new KinectFrameSource(depthbc);
+	replay_source_ = nil;
+	frame_source_ = nil;
+	recorder_ = new DepthFrameRecorder("scan");
+	// about 30 MB/s when recording the Kinect: the file is allocated ahead, a few seconds at a time
+	recorder_->writer().set_preallocation(256 * 1024 * 1024);
+	capture_ = new CapturePipeline;
+	capture_->set_sink(recorder_);
+	scan_points_ = nil;
 
 	/////////////////////////////////////////////////////////////////////
 	//createMenus();
@@ -95,6 +108,11 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+	delete capture_;	// stops it
+	delete recorder_;
+	delete replay_source_;
+	delete kinect_source_;
+
 	Progress::instance()->set_client(nil);
 	Logger::instance()->unregister_client(this);
 	Logger::terminate();
@@ -162,6 +180,7 @@ void MainWindow::createActionsForFileMenu() {
 	connect(ui.actionExit, SIGNAL(triggered()), this, SLOT(close()));
 	connect(ui.actionExportSequentialSnapshots, SIGNAL(triggered()), this, SLOT(export_sequential_snapshots()));
 	connect(ui.actionScanByKinect2, SIGNAL(triggered()), this, SLOT(scan_by_kinect2()));
+	connect(ui.actionReplayScan, SIGNAL(triggered()), this, SLOT(replay_scan()));
 	connect(ui.actionStopScan, SIGNAL(triggered()), this, SLOT(stopScan()));
 	connect(ui.actionSaveWhenScanning, SIGNAL(toggled(bool)), this, SLOT(set_save_when_scan_flag(bool)));
 	connect(ui.actionComputeNormalsForFrames, SIGNAL(triggered()), this, SLOT(computeNormalsForFrames()));
@@ -432,105 +451,149 @@ void MainWindow::scan_by_kinect2(){
 	seqSlider->setVisible(false);
 	allFileNames.clear();
 
-	if (is_save_when_scanning){
-		QDir dir1("scan/depth_image");
-		QFileInfoList file_list1 = dir1.entryInfoList(QDir::Files);
-
-		for (int i = 0; i < file_list1.size(); ++i) {
-			QFileInfo fileInfo = file_list1.at(i);
-			QFile::remove("scan/depth_image/" + fileInfo.fileName());
-		}
+	// the sequence of the previous scan may still be written, and is replaced by
+	// the new one (the per-frame files of the older recordings are kept)
+	stopRunningScan();
 
-		QDir dir2("scan/rgb_image");
-		QFileInfoList file_list2 = dir2.entryInfoList(QDir::Files);
+	startScan(kinect_source_);
+}
 
-		for (int i = 0; i < file_list2.size(); ++i) {
-			QFileInfo fileInfo = file_list2.at(i);
-			QFile::remove("scan/rgb_image/" + fileInfo.fileName());
-		}
+//replay the frames recorded when scanning (see DepthFrameReplay)
+void MainWindow::replay_scan(){
+	QString dir = QFileDialog::getExistingDirectory(this,
+		tr("Choose the directory of the recorded scan"),
+		"scan");
 
-		QDir dir3("scan/point_cloud");
-		QFileInfoList file_list3 = dir3.entryInfoList(QDir::Files);
+	if (dir.isEmpty()){
+		return;
+	}
 
-		for (int i = 0; i < file_list3.size(); ++i) {
-			QFileInfo fileInfo = file_list3.at(i);
-			QFile::remove("scan/point_cloud/" + fileInfo.fileName());
-		}
+	DepthFrameReplay* replay = new DepthFrameReplay(dir.toStdString(), true);
+	if (!replay->open()){
+		delete replay;
+		return;
 	}
 
+	seqSlider->setVisible(false);
+	allFileNames.clear();
+
+	// the source of the running scan may be the one replaced
+	stopRunningScan();
+	delete replay_source_;
+	replay_source_ = replay;
+	startScan(replay_source_);
+}
+
+void MainWindow::startScan(DepthFrameSource* source){
 	qglviewer::Vec vmin(-2.5f, -2.5f, 0.5f);
 	qglviewer::Vec vmax(2.5f, 2.5f, 5.5f);
 	canvas()->setSceneBoundingBox(vmin, vmax);
 	canvas()->showEntireScene();
 
-	cdepthbasic()->openScanner();
+	frame_source_ = source;
+	if (!frame_source_->open()){
+		frame_source_ = nil;
+		return;
+	}
+
+	// the frames of the scanner: no allocation during the capture
+	if (source == kinect_source_){
+		capture_->reserve(cdepthbasic()->getDepthWidth(), cdepthbasic()->getDepthHeight(), cdepthbasic()->getRGBWidth(), cdepthbasic()->getRGBHeight());
+	}
+	// the recorded frames are not recorded again
+	capture_->set_recording(is_save_when_scanning && source == kinect_source_);
+	capture_->set_source(frame_source_);
+	capture_->start();
 	scanthread->start();
 }
 
-//HaoLi:scanning
-void MainWindow::doScan(){
-	PointSet* pointSet = new PointSet;
-	ushort *depth_data = new ushort[512 * 424];
-	uchar *rgb_data = new uchar[1920 * 1080 * 4];
-	uchar *rgb_resize_data = new uchar[640 * 360 * 4];
-	
-	//cdepthbasic()->GetPointsOfOneFrame(pointSet);
-	bool isSucceed = cdepthbasic()->GetDataOfOneFrame(pointSet, depth_data, rgb_data);
-	
-	//printf("points num:%d\n", pointSet->size_of_vertices());
-
-	if (isSucceed){
-		Object* obj = nil;
-
-		if (pointSet->size_of_vertices() > 100){
-			obj = pointSet;
-		}
-
-		if (obj) {
-			removeAllObjects();
-
-			if (is_save_when_scanning){
-				clock_t nowtime = clock();
-
-				std::stringstream stream1;
-				stream1 << "scan/" << "point_cloud/" << nowtime << ".ply";
-				std::string pcfilename = stream1.str();
+//stops the scan in progress (if any), the capture and the thread
+void MainWindow::stopRunningScan(){
+	if (capture_->is_running() || scanthread->isRunning()){
+		stopScan();
+		scanthread->wait();
+	}
+}
 
-				std::stringstream stream2;
-				stream2 << "scan/" << "depth_image/" << nowtime << ".depth";
-				std::string depthfilename = stream2.str();
+//HaoLi:scanning (displays the newest frame of the capture)
+void MainWindow::doScan(){
+	if (!capture_->is_running()){
+		return;
+	}
 
-				std::stringstream stream3;
-				stream3 << "scan/" << "rgb_image/" << nowtime << ".rgb";
-				std::string rgbfilename = stream3.str();
+	if (capture_->finished()){
+		stopScan();
+		status_message("end of the recorded frames", 500);
+		return;
+	}
 
-				//doSavePointCloud(obj, pcfilename);
-				doSaveDepthImage(depth_data, 512 , 424, depthfilename);
+	// the points are updated in place, unless the object has been removed meanwhile
+	const std::vector<Object*>& objects = canvas()->objectsManager()->objects();
+	bool shown = scan_points_ && std::find(objects.begin(), objects.end(), scan_points_) != objects.end();
+	if (!shown){
+		scan_points_ = new PointSet;
+	}
 
-				MyImage mi;
-				mi.image_resize(rgb_data, 1920, 1080, rgb_resize_data, 640, 360);
-				doSaveRGBImage(rgb_resize_data, 640, 360, rgbfilename);
-			}
+	if (!capture_->take_latest(scan_points_)){
+		if (!shown){
+			delete scan_points_;
+			scan_points_ = nil;
+		}
+		return;
+	}
 
-			addObject(obj, true, false);
+	if (!shown){
+		removeAllObjects();
+		addObject(scan_points_, true, false);
+	}
+	else {
+		canvas()->updateGL();
+	}
 
-			status_message("scanning", 500);
-		}
-		else {
-			status_message("Failed", 500);
-		}
+	if (scan_points_->size_of_vertices() > 100){
+		status_message("scanning", 500);
 	}
 	else {
 		status_message("Failed", 500);
 	}
-
-	delete[]rgb_data;
 }
 
 //HaoLi:stop scan
 void MainWindow::stopScan(){
 	scanthread->stopScan();
-	cdepthbasic()->closeScanner();
+	if (capture_->is_running()){
+		capture_->stop();
+
+		CaptureStatistics stats = capture_->statistics();
+		Logger::out("Scan") << stats.nb_acquired << " frames in " << stats.elapsed << " seconds (" << stats.frame_rate() << " fps), " 
+			<< stats.nb_dropped << " dropped, " << stats.nb_saved << " saved (" << stats.nb_save_failures << " failed), "
+			<< stats.nb_displayed << " displayed" << std::endl;
+		Logger::out("Scan") << "latency (mean/max, ms): acquisition " << stats.acquisition.mean() * 1000 << "/" << stats.acquisition.worst * 1000
+			<< ", processing " << stats.processing.mean() * 1000 << "/" << stats.processing.worst * 1000
+			<< ", persistence " << stats.persistence.mean() * 1000 << "/" << stats.persistence.worst * 1000
+			<< ", display " << stats.display.mean() * 1000 << "/" << stats.display.worst * 1000
+			<< ", capture to display " << stats.total.mean() * 1000 << "/" << stats.total.worst * 1000 << std::endl;
+
+		if (stats.nb_saved > 0){
+			// the sequence has been finished by stop()
+			FrameWriterStatistics io = recorder_->writer().statistics();
+			const DepthSequenceWriter& sequence = recorder_->sequence();
+			if (sequence.encoded_depth_bytes() > 0){
+				Logger::out("Scan") << "depths compressed " << double(sequence.depth_bytes()) / sequence.encoded_depth_bytes() << " times ("
+					<< sequence.encoding_time() * 1000 / std::max(sequence.nb_frames(), 1u) << " ms per frame)" << std::endl;
+			}
+			Logger::out("Scan") << recorder_->nb_frames() << " frames recorded in \'" << recorder_->file_name() << "\': "
+				<< io.bytes_written / (1024 * 1024) << " MB in " << io.nb_writes << " writes (" << io.write_rate() / (1024 * 1024) << " MB/s), "
+				<< io.bytes_durable / (1024 * 1024) << " MB durable after " << io.nb_syncs << " syncs, backlog up to "
+				<< io.worst_backlog / (1024 * 1024) << " MB, " << io.nb_stalls << " stalls (" << io.stall_time << " s)" << std::endl;
+		}
+	}
+	if (frame_source_){
+		frame_source_->close();
+		frame_source_ = nil;
+	}
+	// the last frame stays shown, the next scan uses a new point set
+	scan_points_ = nil;
 	//if (is_save_when_scanning){
 	//	computeNormalForEachFrame();
 	//}
@@ -539,6 +602,7 @@ void MainWindow::stopScan(){
 //HaoLi:set saving flag when scanning
 void MainWindow::set_save_when_scan_flag(bool flag){
 	is_save_when_scanning = flag;
+	capture_->set_recording(is_save_when_scanning && frame_source_ == kinect_source_);
 }
 
 //HaoLi:savePointCloud
@@ -556,24 +620,6 @@ bool MainWindow::doSavePointCloud(Object* obj, std::string filename){
 	return bo;
 }
 
-//HaoLi:saveDepthImage
-bool MainWindow::doSaveDepthImage(ushort *depth_data, int depth_width, int depth_height, std::string filename){
-	SaveDepthThread *sdt = new SaveDepthThread(depth_data, depth_width, depth_height, filename);
-	connect(sdt, SIGNAL(releaseSelf(SaveDepthThread*)), this, SLOT(releaseDepthThread(SaveDepthThread*)));
-	sdt->start();
-
-	return true;
-}
-
-//HaoLi:saveRGBImage
-bool MainWindow::doSaveRGBImage(uchar *rgb_data, int rgb_width, int rgb_height, std::string filename){
-	SaveRGBThread *srgbt = new SaveRGBThread(rgb_data, rgb_width, rgb_height, filename);
-	connect(srgbt, SIGNAL(releaseSelf(SaveRGBThread*)), this, SLOT(releaseRGBThread(SaveRGBThread*)));
-	srgbt->start();
-
-	return true;
-}
-
 //HaoLi:compute normal for each frame
 void  MainWindow::computeNormalsForFrames(){
 	QStringList fileNames = QFileDialog::getOpenFileNames(this,
@@ -603,13 +649,3 @@ void  MainWindow::computeNormalsForFrames(){
 		pset = NULL;
 	}
 }
-
-//HaoLi:release saveDepthThread
-void  MainWindow::releaseDepthThread(SaveDepthThread* sdt){
-	delete sdt;
-}
-
-//HaoLi:release saveRGBThread
-void  MainWindow::releaseRGBThread(SaveRGBThread* srgbt){
-	delete srgbt;
-}
\ No newline at end of file
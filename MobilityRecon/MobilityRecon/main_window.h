@@ -16,9 +16,12 @@ class Object;
 class PointSet;
 class QSplitter;
 class CDepthBasics;
+class DepthFrameSource;
+class KinectFrameSource;
+class DepthFrameReplay;
+class DepthFrameRecorder;
+class CapturePipeline;
 class ScanThread;
-class SaveDepthThread;
-class SaveRGBThread;
 
 class MainWindow
 	: public QMainWindow
@@ -58,6 +61,7 @@ public:
 	void snapshot();
 	void export_sequential_snapshots();
 	void scan_by_kinect2();
+	void replay_scan();
 	void computeNormalsForFrames();
 	//bool save();
 
@@ -65,8 +69,6 @@ public:
 	void doScan();
 	void stopScan();
 	void set_save_when_scan_flag(bool flag);
-	void releaseDepthThread(SaveDepthThread* sdt);
-	void releaseRGBThread(SaveRGBThread* srgbt);
 
 
 private:
@@ -84,9 +86,10 @@ private:
 	void showAllObjects();
 	void removeAllObjects();
 
+	void startScan(DepthFrameSource* source);
+	void stopRunningScan();
+
 	bool doSavePointCloud(Object* obj, std::string filename);
-	bool MainWindow::doSaveDepthImage(ushort *depth_data, int depth_width, int depth_height, std::string filename);
-	bool MainWindow::doSaveRGBImage(uchar *rgb_data, int rgb_width, int rgb_height, std::string filename);
 
 private:
 	Ui::MainWindowClass ui;
@@ -101,6 +104,15 @@ private:
 	CDepthBasics* depthbc;
 	ScanThread* scanthread;
 
+	// the frames shown when scanning come from the scanner or from a recording,
+	// through the capture pipeline (the scan thread only triggers the display)
+	KinectFrameSource*	kinect_source_;
+	DepthFrameReplay*	replay_source_;
+	DepthFrameSource*	frame_source_;
+	CapturePipeline*	capture_;
+	DepthFrameRecorder*	recorder_;
+	PointSet*			scan_points_;	// the displayed frame (owned by the canvas)
+
 	QStringList		recentFiles_;
 	QString			curFileName_;
 	QString			curDataDirectory_;
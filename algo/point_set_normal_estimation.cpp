@@ -1,36 +1,64 @@
 #include "point_set_normal_estimation.h"
+#include "point_set_normal_orientation.h"
 #include "../geom/point_set.h"
 #include "../geom/iterators.h"
+#include "../basic/logger.h"
+#include "../math/eigen_solver_3.h"
 #include "../kd_tree/kdtree_search_eth.h"
 
+#include <vector>
+#include <cmath>
 
-void PointSetNormalEstimation::apply(PointSet* pointSet, bool smooth, unsigned int K_nei/* = 10*/, unsigned int K_nor/* = 10*/)
+
+void PointSetNormalEstimation::apply(PointSet* pointSet, bool smooth, unsigned int K_nei/* = 10*/, unsigned int K_nor/* = 10*/, bool propagate_orientation/* = false*/)
 {
-	PointSetNormal normals;
-	if (!normals.is_defined(pointSet)) {
-		normals.bind(pointSet);
-	}
+	PointSetNormal normals(pointSet);	// found or created
 	
 	KdTreeSearch_ETH kd_eth;	
+	kd_eth.set_parallel_build(true);
 	kd_eth.add_vertex_set(pointSet);
 	kd_eth.end();
 
-	FOR_EACH_VERTEX_CONST(PointSet, pointSet, it) {
+	KdTreeNeighbors neighbors;
+	kd_eth.find_all_closest_K_points(K_nei, neighbors);
+
+	// Each normal is the eigenvector of the smallest eigenvalue of the covariance
+	// matrix of the neighbors. The matrix is accumulated in place (relative to the 
+	// point itself, which keeps the one-pass formula accurate) and solved in closed 
+	// form, so nothing is allocated per point and the points are processed in parallel.
+	int num = static_cast<int>(neighbors.size());
+	int num_failed = 0;
+#pragma omp parallel for schedule(dynamic, 1024) reduction(+:num_failed)
+	for (int i = 0; i < num; ++i) {
+		PointSet::Vertex* it = kd_eth.vertex(i);
 		const vec3& p = it->point();
 
-		std::vector<PointSet::Vertex*> neighbors;
-		std::vector<vec3> points;
-		kd_eth.find_closest_K_points(p, K_nei, neighbors);
+		vec3 sum(0.0, 0.0, 0.0);
+		double cov[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		for (unsigned int j = neighbors.offsets[i]; j < neighbors.offsets[i + 1]; j++) {
+			vec3 q = kd_eth.vertex(neighbors.indices[j])->point() - p;
+			sum += q;
+			cov[0] += q.x * q.x;	cov[1] += q.x * q.y;	cov[2] += q.x * q.z;
+			cov[3] += q.y * q.y;	cov[4] += q.y * q.z;
+			cov[5] += q.z * q.z;
+		}
 
-		for (unsigned int j = 0; j < neighbors.size(); j++) {
-			points.push_back(neighbors[j]->point());
+		vec3 normal_plane;
+		double eigen_values[3];
+		unsigned int n = neighbors.size_of_neighbors(i);
+		bool ok = (n >= 3);
+		if (ok) {
+			vec3 c = sum / n;
+			cov[0] = cov[0] / n - c.x * c.x;	cov[1] = cov[1] / n - c.x * c.y;	cov[2] = cov[2] / n - c.x * c.z;
+			cov[3] = cov[3] / n - c.y * c.y;	cov[4] = cov[4] / n - c.y * c.z;
+			cov[5] = cov[5] / n - c.z * c.z;
+			ok = SymmetricEigenSolver3<double>::smallest_eigen_vector(cov, eigen_values, normal_plane);
 		}
 
-		GenericPlane3<Numeric::float64> plane;
-		if (plane.FitToPoints(points)) {
-			vec3 normal_plane = plane.normal();
-			vec3 normal_tem(p[0], p[1], p[2]);
-			if (normal_tem[0] * normal_plane[0] + normal_tem[1] * normal_plane[1] + normal_tem[2] * normal_plane[2]>0){
+		if (ok) {
+			// the sensor is at the origin: make the normal point to it (for merged 
+			// multi-view point sets, this is only the initial guess, see below)
+			if (dot(p, normal_plane) > 0) {
 				normals[it] = -normal_plane;
 			}
 			else{
@@ -39,12 +67,248 @@ void PointSetNormalEstimation::apply(PointSet* pointSet, bool smooth, unsigned i
 		}
 		else {
 			normals[it] = vec3(1.0, 0.0, 0.0);
-			std::cout << "Compute normals: wrong!!!!!!!" << std::endl;
+			++num_failed;
 		}
 	}
 
+	if (num_failed > 0)
+		Logger::warn(title()) << "normal undefined for " << num_failed << " points" << std::endl;
+
 	if (smooth) {
-		// smooth the normals!!!!!!!!!!
+		// Each normal is replaced by the average of the normals of its $K_nor$ neighbors,
+		// which are first flipped to agree with it (so the orientation is not changed). 
+		KdTreeNeighbors smoothing_neighbors;
+		if (K_nor != K_nei)
+			kd_eth.find_all_closest_K_points(K_nor, smoothing_neighbors);
+		const KdTreeNeighbors& nor = (K_nor != K_nei) ? smoothing_neighbors : neighbors;
+
+		std::vector<vec3> smoothed(num);
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < num; ++i) {
+			const vec3& n = normals[kd_eth.vertex(i)];
+			vec3 sum(0.0, 0.0, 0.0);
+			for (unsigned int j = nor.offsets[i]; j < nor.offsets[i + 1]; j++) {
+				const vec3& m = normals[kd_eth.vertex(nor.indices[j])];
+				if (dot(n, m) < 0)
+					sum -= m;
+				else
+					sum += m;
+			}
+			double len = sum.length();
+			smoothed[i] = (len > 0) ? (sum / len) : n;
+		}
+#pragma omp parallel for
+		for (int i = 0; i < num; ++i)
+			normals[kd_eth.vertex(i)] = smoothed[i];
 	}
+
+	// the Riemannian graph of the orientation is the neighborhood of the estimation
+	if (propagate_orientation)
+		PointSetNormalOrientation::apply(pointSet, kd_eth, neighbors);
 	kd_eth.begin();
-}
\ No newline at end of file
+}
+
+
+// The normal of the plane fitted to the points of the window of $r$ pixels around 
+// pixel ($x$, $y$), from the integral images (10 sums per entry, see below), 
+// oriented towards the sensor (at the origin).
+static bool window_normal(
+	const std::vector<double>& integral, int W, int width, int height, 
+	int x, int y, int r, const vec3& p, vec3& normal
+	) 
+{
+	const int nb_sums = 10;
+	int x0 = std::max(0, x - r), x1 = std::min(width, x + r + 1);
+	int y0 = std::max(0, y - r), y1 = std::min(height, y + r + 1);
+	const double* a = &integral[std::size_t(nb_sums) * (y0 * W + x0)];
+	const double* b = &integral[std::size_t(nb_sums) * (y0 * W + x1)];
+	const double* c = &integral[std::size_t(nb_sums) * (y1 * W + x0)];
+	const double* d = &integral[std::size_t(nb_sums) * (y1 * W + x1)];
+	double s[nb_sums];
+	for (int k = 0; k < nb_sums; ++k)
+		s[k] = d[k] - b[k] - c[k] + a[k];
+
+	double n = s[0];
+	if (n < 3)
+		return false;
+
+	vec3 m(s[1] / n, s[2] / n, s[3] / n);
+	double cov[6] = { 
+		s[4] / n - m.x * m.x,	s[5] / n - m.x * m.y,	s[6] / n - m.x * m.z,
+		s[7] / n - m.y * m.y,	s[8] / n - m.y * m.z,
+		s[9] / n - m.z * m.z 
+	};
+	vec3 normal_plane;
+	double eigen_values[3];
+	if (!SymmetricEigenSolver3<double>::smallest_eigen_vector(cov, eigen_values, normal_plane))
+		return false;
+
+	// the sensor is at the origin: make the normal point to it
+	normal = (dot(p, normal_plane) > 0) ? -normal_plane : normal_plane;
+	return true;
+}
+
+
+void PointSetNormalEstimation::apply_organized(PointSet* pointSet, int image_width, int image_height, unsigned int window_size/* = 9*/, double max_depth_change/* = 0.02*/)
+{
+	PointSetPixel pixel;
+	if (!pixel.bind_if_defined(pointSet)) {
+		Logger::err(title()) << "the points have no pixel (not a depth image)" << std::endl;
+		return;
+	}
+	PointSetNormal normals(pointSet);	// found or created
+
+	const int width = image_width;
+	const int height = image_height;
+	const int size = width * height;
+
+	// the point of each pixel, and the center of the points
+	std::vector<PointSet::Vertex*> grid(size, nil);
+	int num_failed = 0;
+	vec3 center(0.0, 0.0, 0.0);
+	FOR_EACH_VERTEX(PointSet, pointSet, it) {
+		int p = pixel[it];
+		if (p >= 0 && p < size && grid[p] == nil) {
+			grid[p] = it;
+			center += it->point();
+		}
+		else {
+			normals[it] = vec3(1.0, 0.0, 0.0);
+			++num_failed;
+		}
+	}
+	int num = pointSet->size_of_vertices() - num_failed;
+	if (num == 0)
+		return;
+	center = center / num;
+
+	// The distance (in pixels, chessboard metric) from each pixel to the closest 
+	// pixel without point or at a depth discontinuity: the windows are shrunk to it.
+	const int infinite = width + height;
+	std::vector<int> dist(size);
+#pragma omp parallel for
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			int i = y * width + x;
+			bool edge = (grid[i] == nil);
+			if (!edge) {
+				double z = grid[i]->point().z;
+				double threshold = max_depth_change * z;
+				// the 8 neighbors, as the windows (and the distance below) are squares
+				for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1) && !edge; ++ny) {
+					for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1) && !edge; ++nx) {
+						const PointSet::Vertex* q = grid[ny * width + nx];
+						edge = (q && std::fabs(q->point().z - z) > threshold);
+					}
+				}
+			}
+			dist[i] = edge ? 0 : infinite;
+		}
+	}
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			int& d = dist[y * width + x];
+			if (x > 0)						d = std::min(d, dist[y * width + x - 1] + 1);
+			if (y > 0) {
+				if (x > 0)					d = std::min(d, dist[(y - 1) * width + x - 1] + 1);
+											d = std::min(d, dist[(y - 1) * width + x] + 1);
+				if (x < width - 1)			d = std::min(d, dist[(y - 1) * width + x + 1] + 1);
+			}
+		}
+	}
+	for (int y = height - 1; y >= 0; --y) {
+		for (int x = width - 1; x >= 0; --x) {
+			int& d = dist[y * width + x];
+			if (x < width - 1)				d = std::min(d, dist[y * width + x + 1] + 1);
+			if (y < height - 1) {
+				if (x < width - 1)			d = std::min(d, dist[(y + 1) * width + x + 1] + 1);
+											d = std::min(d, dist[(y + 1) * width + x] + 1);
+				if (x > 0)					d = std::min(d, dist[(y + 1) * width + x - 1] + 1);
+			}
+		}
+	}
+
+	// The integral images of the number of points, of their coordinates and of the
+	// products of their coordinates (relative to the center, which keeps the one-pass
+	// formula accurate): entry (x, y) is the sum over the pixels above and to the left
+	// of pixel (x, y), i.e., (x', y') with x' < x and y' < y.
+	const int nb_sums = 10;
+	const int W = width + 1;
+	std::vector<double> integral(std::size_t(nb_sums) * W * (height + 1), 0.0);
+	for (int y = 0; y < height; ++y) {
+		double row[nb_sums] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		const double* above = &integral[std::size_t(nb_sums) * (y * W + 1)];
+		double* current = &integral[std::size_t(nb_sums) * ((y + 1) * W + 1)];
+		for (int x = 0; x < width; ++x) {
+			PointSet::Vertex* v = grid[y * width + x];
+			if (v) {
+				vec3 q = v->point() - center;
+				row[0] += 1.0;
+				row[1] += q.x;	row[2] += q.y;	row[3] += q.z;
+				row[4] += q.x * q.x;	row[5] += q.x * q.y;	row[6] += q.x * q.z;
+				row[7] += q.y * q.y;	row[8] += q.y * q.z;
+				row[9] += q.z * q.z;
+			}
+			for (int k = 0; k < nb_sums; ++k)
+				current[k] = above[k] + row[k];
+			above += nb_sums;
+			current += nb_sums;
+		}
+	}
+
+	// the points at the depth discontinuities (distance 0) are done afterwards
+	const int half = std::max(1, static_cast<int>(window_size) / 2);
+	std::vector<vec3> result(size);
+	std::vector<char> done(size, 0);
+#pragma omp parallel for schedule(dynamic, 8)
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			int i = y * width + x;
+			if (grid[i] && dist[i] > 0)
+				done[i] = window_normal(integral, W, width, height, x, y, std::min(half, dist[i]), grid[i]->point(), result[i]);
+		}
+	}
+
+	// A window around a point at a depth discontinuity would contain the points of 
+	// both sides: the point gets the normal of its closest neighbor on its side.
+	// If there is none, the normal of its 3x3 window is used.
+#pragma omp parallel for schedule(dynamic, 8)
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			int i = y * width + x;
+			if (!grid[i] || dist[i] > 0)
+				continue;
+			double z = grid[i]->point().z;
+			double best = max_depth_change * z;
+			int closest = -1;
+			for (int y2 = std::max(0, y - 1); y2 <= std::min(height - 1, y + 1); ++y2) {
+				for (int x2 = std::max(0, x - 1); x2 <= std::min(width - 1, x + 1); ++x2) {
+					int j = y2 * width + x2;
+					if (done[j] && dist[j] > 0 && std::fabs(grid[j]->point().z - z) <= best) {
+						best = std::fabs(grid[j]->point().z - z);
+						closest = j;
+					}
+				}
+			}
+			if (closest >= 0)
+				result[i] = result[closest];
+			else if (!window_normal(integral, W, width, height, x, y, 1, grid[i]->point(), result[i]))
+				continue;
+			done[i] = 1;
+		}
+	}
+
+	for (int i = 0; i < size; ++i) {
+		if (!grid[i])
+			continue;
+		if (done[i])
+			normals[grid[i]] = result[i];
+		else {
+			normals[grid[i]] = vec3(1.0, 0.0, 0.0);
+			++num_failed;
+		}
+	}
+
+	if (num_failed > 0)
+		Logger::warn(title()) << "normal undefined for " << num_failed << " points" << std::endl;
+}
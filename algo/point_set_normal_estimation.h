@@ -16,7 +16,22 @@ public:
 
 	//////////////////////////////////////////////////////////////////////////
 
-	static void apply(PointSet* pointSet, bool smooth, unsigned int K_nei = 10, unsigned int K_nor = 10);
+	// Each normal is fitted to the $K_nei$ nearest neighbors of its point. If $smooth$ is true,
+	// it is then averaged over the $K_nor$ nearest neighbors.
+	// The normals are oriented toward the sensor, assumed at the origin (a single frame). For
+	// merged multi-view point sets, set $propagate_orientation$: the orientation is then made
+	// consistent by propagation along a minimum spanning tree (see PointSetNormalOrientation)
+	// of the graph of the $K_nei$ nearest neighbors.
+	static void apply(PointSet* pointSet, bool smooth, unsigned int K_nei = 10, unsigned int K_nor = 10, bool propagate_orientation = false);
+
+	// For the points of a depth image of $image_width$ x $image_height$ pixels (e.g.,
+	// a frame of the Kinect), with the "pixel" attribute (see PointSetPixel). The 
+	// neighbors of a point are the points of a window of $window_size$ x $window_size$
+	// pixels around it, and the covariance matrix of each window is obtained in 
+	// constant time from integral images: there is no neighbor search at all. The 
+	// windows are shrunk so as not to cross the depth discontinuities (a change of
+	// more than $max_depth_change$ times the depth between adjacent pixels).
+	static void apply_organized(PointSet* pointSet, int image_width, int image_height, unsigned int window_size = 9, double max_depth_change = 0.02);
 };
 
 #endif
\ No newline at end of file
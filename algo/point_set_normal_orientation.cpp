@@ -0,0 +1,331 @@
+#include "point_set_normal_orientation.h"
+#include "../geom/point_set.h"
+#include "../geom/point_set_geometry.h"
+#include "../geom/iterators.h"
+#include "../basic/logger.h"
+#include "../basic/stop_watch.h"
+#include "../kd_tree/kdtree_search_eth.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+
+namespace {
+
+	const unsigned int NO_EDGE = std::numeric_limits<unsigned int>::max();
+
+	// An edge (a, b) of the Riemannian graph, with a < b. Ties in the weights are
+	// broken by the indices, so all the edges are totally ordered. That guarantees
+	// Boruvka's algorithm does not create cycles.
+	struct GraphEdge {
+		GraphEdge() : w(std::numeric_limits<float>::max()), a(NO_EDGE), b(NO_EDGE) {}
+		GraphEdge(float weight, unsigned int i, unsigned int j)
+			: w(weight), a(i < j ? i : j), b(i < j ? j : i) {}
+
+		bool is_valid() const { return a != NO_EDGE; }
+
+		bool operator<(const GraphEdge& e) const {
+			if (w != e.w)	return w < e.w;
+			if (a != e.a)	return a < e.a;
+			return b < e.b;
+		}
+
+		float			w;
+		unsigned int	a, b;
+	};
+
+
+	// Disjoint sets with union by size. find() does not modify the structure,
+	// so it can be called from several threads between two unions.
+	class DisjointSets {
+	public:
+		DisjointSets(unsigned int n) : parent_(n), size_(n, 1) {
+			for (unsigned int i = 0; i < n; ++i)
+				parent_[i] = i;
+		}
+
+		unsigned int find(unsigned int i) const {
+			while (parent_[i] != i)
+				i = parent_[i];
+			return i;
+		}
+
+		// returns false if $i$ and $j$ are already in the same set
+		bool unite(unsigned int i, unsigned int j) {
+			i = find(i);
+			j = find(j);
+			if (i == j)
+				return false;
+			if (size_[i] < size_[j])
+				std::swap(i, j);
+			parent_[j] = i;
+			size_[i] += size_[j];
+			return true;
+		}
+
+	private:
+		std::vector<unsigned int> parent_;
+		std::vector<unsigned int> size_;
+	};
+
+
+	inline float edge_weight(const vec3& n1, const vec3& n2) {
+		return 1.0f - static_cast<float>(std::fabs(dot(n1, n2)));
+	}
+
+
+	// Makes the directed kNN graph symmetric (i.e., j is a neighbor of i iff i is
+	// a neighbor of j), which is required by Boruvka's algorithm: each component
+	// must see all its incident edges. Edges found in both directions are kept twice,
+	// which is harmless.
+	void symmetrize(const KdTreeNeighbors& knn, std::vector<unsigned int>& offsets, std::vector<unsigned int>& adjacency) {
+		unsigned int num = knn.size();
+		std::vector<unsigned int> degree(num, 0);
+		for (unsigned int i = 0; i < num; ++i) {
+			degree[i] += knn.size_of_neighbors(i);
+			for (unsigned int j = knn.offsets[i]; j < knn.offsets[i + 1]; ++j)
+				++degree[knn.indices[j]];
+		}
+
+		offsets.resize(num + 1);
+		offsets[0] = 0;
+		for (unsigned int i = 0; i < num; ++i)
+			offsets[i + 1] = offsets[i] + degree[i];
+
+		adjacency.resize(offsets[num]);
+		for (unsigned int i = 0; i < num; ++i)
+			degree[i] = offsets[i];		// now the insertion position
+		for (unsigned int i = 0; i < num; ++i) {
+			for (unsigned int j = knn.offsets[i]; j < knn.offsets[i + 1]; ++j) {
+				unsigned int k = knn.indices[j];
+				adjacency[degree[i]++] = k;
+				adjacency[degree[k]++] = i;
+			}
+		}
+	}
+
+
+	// Computes the minimum spanning forest of the Riemannian graph with Boruvka's
+	// algorithm. In each round every vertex looks for its lightest edge leaving its
+	// component (in parallel), then the lightest of them is selected for each
+	// component and the components are merged. The number of components at least
+	// halves in each round, so there are at most log(n) rounds.
+	void minimum_spanning_forest(
+		const std::vector<vec3>& normals,
+		const std::vector<unsigned int>& offsets,
+		const std::vector<unsigned int>& adjacency,
+		std::vector<GraphEdge>& tree_edges)
+	{
+		int num = static_cast<int>(normals.size());
+		DisjointSets sets(num);
+		std::vector<unsigned int> component(num);
+		for (int i = 0; i < num; ++i)
+			component[i] = i;
+
+		std::vector<GraphEdge> vertex_best(num);
+		std::vector<GraphEdge> component_best(num);
+
+		tree_edges.clear();
+		tree_edges.reserve(num);
+		while (true) {
+#pragma omp parallel for schedule(dynamic, 4096)
+			for (int i = 0; i < num; ++i) {
+				GraphEdge best;
+				unsigned int ci = component[i];
+				for (unsigned int j = offsets[i]; j < offsets[i + 1]; ++j) {
+					unsigned int k = adjacency[j];
+					if (component[k] == ci)
+						continue;
+					GraphEdge e(edge_weight(normals[i], normals[k]), i, k);
+					if (e < best)
+						best = e;
+				}
+				vertex_best[i] = best;
+			}
+
+			for (int i = 0; i < num; ++i) {
+				const GraphEdge& e = vertex_best[i];
+				if (e.is_valid() && e < component_best[component[i]])
+					component_best[component[i]] = e;
+			}
+
+			std::size_t old_size = tree_edges.size();
+			for (int i = 0; i < num; ++i) {
+				if (component[i] != static_cast<unsigned int>(i))	// not a component
+					continue;
+				GraphEdge& e = component_best[i];
+				if (e.is_valid()) {
+					// the same edge can be selected by the two components it connects
+					if (sets.unite(e.a, e.b))
+						tree_edges.push_back(e);
+					e = GraphEdge();
+				}
+			}
+
+			if (tree_edges.size() == old_size)
+				break;
+
+#pragma omp parallel for
+			for (int i = 0; i < num; ++i)
+				component[i] = sets.find(i);
+		}
+	}
+
+
+	// Propagates the orientation along the tree (breadth first). Each connected
+	// component is seeded with its point farthest from $center$.
+	unsigned int propagate_orientation(
+		const std::vector<vec3>& points,
+		std::vector<vec3>& normals,
+		const std::vector<GraphEdge>& tree_edges,
+		const vec3& center)
+	{
+		unsigned int num = static_cast<unsigned int>(points.size());
+
+		std::vector<unsigned int> offsets(num + 1, 0);
+		for (std::size_t i = 0; i < tree_edges.size(); ++i) {
+			++offsets[tree_edges[i].a + 1];
+			++offsets[tree_edges[i].b + 1];
+		}
+		for (unsigned int i = 0; i < num; ++i)
+			offsets[i + 1] += offsets[i];
+		std::vector<unsigned int> adjacency(offsets[num]);
+		std::vector<unsigned int> pos(offsets.begin(), offsets.end() - 1);
+		for (std::size_t i = 0; i < tree_edges.size(); ++i) {
+			const GraphEdge& e = tree_edges[i];
+			adjacency[pos[e.a]++] = e.b;
+			adjacency[pos[e.b]++] = e.a;
+		}
+		std::vector<unsigned int>().swap(pos);
+
+		// visit the points from the farthest to the nearest, so that the first point
+		// reached in each component is its seed.
+		std::vector< std::pair<double, unsigned int> > order(num);
+		for (unsigned int i = 0; i < num; ++i)
+			order[i] = std::make_pair(-distance2(points[i], center), i);
+		std::sort(order.begin(), order.end());
+
+		unsigned int num_flipped = 0;
+		std::vector<bool> visited(num, false);
+		std::vector<unsigned int> queue;
+		queue.reserve(num);
+		for (unsigned int s = 0; s < num; ++s) {
+			unsigned int seed = order[s].second;
+			if (visited[seed])
+				continue;
+
+			if (dot(normals[seed], points[seed] - center) < 0) {
+				normals[seed] = -normals[seed];
+				++num_flipped;
+			}
+
+			queue.clear();
+			queue.push_back(seed);
+			visited[seed] = true;
+			for (std::size_t head = 0; head < queue.size(); ++head) {
+				unsigned int i = queue[head];
+				for (unsigned int j = offsets[i]; j < offsets[i + 1]; ++j) {
+					unsigned int k = adjacency[j];
+					if (visited[k])
+						continue;
+					if (dot(normals[i], normals[k]) < 0) {
+						normals[k] = -normals[k];
+						++num_flipped;
+					}
+					visited[k] = true;
+					queue.push_back(k);
+				}
+			}
+		}
+
+		return num_flipped;
+	}
+
+}
+
+
+bool PointSetNormalOrientation::apply(PointSet* pset, unsigned int K /* = 10 */) {
+	if (!PointSetNormal::is_defined(pset)) {
+		Logger::warn(title()) << "point set has no normals" << std::endl;
+		return false;
+	}
+	if (pset->size_of_vertices() == 0)
+		return true;
+
+	KdTreeSearch_ETH kd_eth;
+	kd_eth.set_parallel_build(true);
+	kd_eth.begin();
+	kd_eth.add_vertex_set(pset);
+	kd_eth.end();
+
+	KdTreeNeighbors knn;
+	kd_eth.find_all_closest_K_points(K, knn, true);	// exclude the point itself
+	return apply(pset, kd_eth, knn);
+}
+
+
+bool PointSetNormalOrientation::apply(PointSet* pset, const KdTreeSearch& kd_eth, const KdTreeNeighbors& knn) {
+	if (!PointSetNormal::is_defined(pset)) {
+		Logger::warn(title()) << "point set has no normals" << std::endl;
+		return false;
+	}
+	if (kd_eth.size_of_points() == 0)
+		return true;
+
+	StopWatch w;
+
+	// the edges of a point to itself are never selected (same component)
+	std::vector<unsigned int> offsets, adjacency;
+	symmetrize(knn, offsets, adjacency);
+
+	PointSetNormal normals(pset);
+	int num = static_cast<int>(kd_eth.size_of_points());
+	std::vector<vec3> points(num), nmls(num);
+#pragma omp parallel for
+	for (int i = 0; i < num; ++i) {
+		PointSet::Vertex* v = kd_eth.vertex(i);
+		points[i] = v->point();
+		nmls[i] = normals[v];
+	}
+
+	std::vector<GraphEdge> tree_edges;
+	minimum_spanning_forest(nmls, offsets, adjacency, tree_edges);
+	std::vector<unsigned int>().swap(offsets);
+	std::vector<unsigned int>().swap(adjacency);
+
+	unsigned int num_components = num - static_cast<unsigned int>(tree_edges.size());
+	unsigned int num_flipped = propagate_orientation(points, nmls, tree_edges, Geom::bounding_box(pset).center());
+
+#pragma omp parallel for
+	for (int i = 0; i < num; ++i)
+		normals[kd_eth.vertex(i)] = nmls[i];
+
+	Logger::out(title()) << num_flipped << " normals flipped (" << num_components << " components). "
+		<< "Time: " << w.elapsed() << " seconds" << std::endl;
+	return true;
+}
+
+
+bool PointSetNormalOrientation::apply(PointSet* pset, const vec3& viewpoint) {
+	if (!PointSetNormal::is_defined(pset)) {
+		Logger::warn(title()) << "point set has no normals" << std::endl;
+		return false;
+	}
+
+	std::vector<PointSet::Vertex*> vertices;
+	vertices.reserve(pset->size_of_vertices());
+	FOR_EACH_VERTEX(PointSet, pset, it)
+		vertices.push_back(it);
+
+	PointSetNormal normals(pset);
+	int num = static_cast<int>(vertices.size());
+#pragma omp parallel for
+	for (int i = 0; i < num; ++i) {
+		PointSet::Vertex* v = vertices[i];
+		vec3& n = normals[v];
+		if (dot(n, viewpoint - v->point()) < 0)
+			n = -n;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef _ALGOS_POINT_SET_NORMAL_ORIENTATION_H_
+#define _ALGOS_POINT_SET_NORMAL_ORIENTATION_H_
+
+#include "algo_common.h"
+#include "../math/math_types.h"
+#include <string>
+
+class PointSet;
+class KdTreeSearch;
+class KdTreeNeighbors;
+
+
+/***********************************************************************
+ Consistent orientation of the normals of a point set.
+
+ The general method is the one of Hoppe et al. 1992 ("Surface reconstruction
+ from unorganized points"):
+   1) the Riemannian graph connects each point to its K nearest neighbors,
+      with weight 1 - |n_i . n_j| (i.e., cheap where the normals are parallel);
+   2) the minimum spanning tree of this graph is computed with Boruvka's
+      algorithm, whose rounds are processed in parallel;
+   3) the orientation is propagated from a seed point by a traversal of the
+      tree, flipping a normal whenever it disagrees with its parent.
+ Each connected component of the graph gets its own seed: the point farthest
+ from the center of the point set, whose normal is made to point outward.
+
+ If the position of the sensor is known (e.g., a single Kinect frame, for
+ which the sensor is at the origin), the viewpoint version is much faster:
+ each normal is simply flipped toward the sensor.
+
+ The point set must already have normals (see PointSetNormalEstimation).
+************************************************************************/
+
+class ALGO_API PointSetNormalOrientation
+{
+public:
+	static std::string title() { return "NormalOrientation"; }
+
+	// Orients the normals by propagation along the minimum spanning tree.
+	// @K: number of nearest neighbors used to build the Riemannian graph.
+	// Returns false if the point set has no normals.
+	static bool apply(PointSet* pset, unsigned int K = 10);
+
+	// The same, with a Riemannian graph already known: $knn$ is the neighborhood of each
+	// point of $kd$ (a tree of all the points of $pset$, see find_all_closest_K_points()).
+	// The point itself may be one of its neighbors.
+	static bool apply(PointSet* pset, const KdTreeSearch& kd, const KdTreeNeighbors& knn);
+
+	// Orients the normals toward the given viewpoint (the sensor position).
+	// Returns false if the point set has no normals.
+	static bool apply(PointSet* pset, const vec3& viewpoint);
+};
+
+#endif
@@ -4,66 +4,195 @@
 #include "../basic/logger.h"
 #include "../kd_tree/kdtree_search_eth.h"
 
+#include <cmath>
+#include <limits>
+#include <omp.h>
+
+
+namespace {
+
+	// The integer coordinates of a grid cell (64-bit: a small epsilon on large
+	// coordinates easily exceeds the range of an int)
+	struct GridCell {
+		Numeric::int64 x, y, z;
+		bool operator==(const GridCell& c) const { return x == c.x && y == c.y && z == c.z; }
+	};
+
+	inline Numeric::int64 grid_coordinate(double v, double inv_epsilon) {
+		const double limit = 4611686018427387904.0;	// 2^62
+		double c = std::floor(v * inv_epsilon);
+		if (!(c > -limit))	// also NaN
+			c = -limit;
+		else if (c > limit)
+			c = limit;
+		return static_cast<Numeric::int64>(c);
+	}
+
+	inline GridCell grid_cell(const vec3& p, double inv_epsilon) {
+		GridCell c;
+		c.x = grid_coordinate(p.x, inv_epsilon);
+		c.y = grid_coordinate(p.y, inv_epsilon);
+		c.z = grid_coordinate(p.z, inv_epsilon);
+		return c;
+	}
 
-/// Utility class for grid_simplify_point_set():
-/// LessEpsilonPoints defines a 3D points order: two points are equal
-/// iff they belong to the same cell of a grid of cell size = epsilon.
-template <class Vertex>
-class LessEpsilonPoints {
-public:
-	LessEpsilonPoints (double epsilon) : m_epsilon (epsilon) {
-		ogf_assert(epsilon > 0);
+	inline unsigned int grid_hash(const GridCell& c) {
+		unsigned long long h = 
+			static_cast<unsigned long long>(c.x) * 0x9E3779B97F4A7C15ull ^
+			static_cast<unsigned long long>(c.y) * 0xC2B2AE3D27D4EB4Full ^
+			static_cast<unsigned long long>(c.z) * 0x165667B19E3779F9ull;
+		h ^= h >> 29;
+		h *= 0xBF58476D1CE4E5B9ull;
+		h ^= h >> 32;
+		return static_cast<unsigned int>(h);
 	}
 
-	// Round points to multiples of m_epsilon, then compare.
-	bool operator() (const Vertex* a, const Vertex* b) const {
-		const vec3& a_n = a->point();
-		const vec3& b_n = b->point();
-
-		vec3 rounded_a(round_epsilon(a_n.x, m_epsilon), round_epsilon(a_n.y, m_epsilon), round_epsilon(a_n.z, m_epsilon));
-		vec3 rounded_b(round_epsilon(b_n.x, m_epsilon), round_epsilon(b_n.y, m_epsilon), round_epsilon(b_n.z, m_epsilon));
-
-		//return (rounded_a < rounded_b);
-		if (rounded_a.x < rounded_b.x)
-			return true;
-		else if (rounded_a.x == rounded_b.x) {
-			if (rounded_a.y < rounded_b.y)
-				return true;
-			else if (rounded_a.y == rounded_b.y) {
-				if (rounded_a.z < rounded_b.z)
-					return true;
+	// The partition of a cell, from the high bits of its hash: the slot of the cell in
+	// the table of the partition comes from the low bits (see GridCellTable), which
+	// must not be the same for all the cells of a partition.
+	inline int grid_partition(unsigned int hash, int num_partitions) {
+		return static_cast<int>((Numeric::uint64(hash) * Numeric::uint64(num_partitions)) >> 32);
+	}
+
+
+	// An open addressing (linear probing) hash table from the cells to the indices
+	// of their representative points. It never grows: it is sized for the number of
+	// points to insert.
+	class GridCellTable {
+	public:
+		GridCellTable(std::size_t max_size) {
+			std::size_t n = 16;
+			while (n < 2 * max_size)
+				n *= 2;
+			mask_ = static_cast<unsigned int>(n - 1);
+			slots_.assign(n, -1);
+		}
+
+		// Returns the index of the cell (i.e., its position in cells()), inserting it
+		// if it is new.
+		unsigned int find_or_insert(const GridCell& c, unsigned int hash) {
+			unsigned int s = hash & mask_;
+			while (slots_[s] != -1) {
+				if (cells_[slots_[s]] == c)
+					return slots_[s];
+				s = (s + 1) & mask_;
 			}
+			slots_[s] = static_cast<int>(cells_.size());
+			cells_.push_back(c);
+			return slots_[s];
 		}
 
-		return false;
-	}
+		unsigned int size() const { return static_cast<unsigned int>(cells_.size()); }
 
-private:
-	// Round number to multiples of epsilon
-	static inline double round_epsilon(double value, double epsilon) {
-		return std::floor(value/epsilon) * epsilon;
-	}
+	private:
+		unsigned int			mask_;
+		std::vector<int>		slots_;
+		std::vector<GridCell>	cells_;
+	};
 
-private:
-	double m_epsilon;
-};
+}
 
 
 //////////////////////////////////////////////////////////////////////////
 
 
-std::vector<PointSet::Vertex*> PointSetSimplification::grid_simplification(PointSet* pset, double epsilon) {
+std::vector<PointSet::Vertex*> PointSetSimplification::grid_simplification(
+	PointSet* pset, double epsilon, 
+	GridRepresentative representative /* = GR_ARBITRARY */,
+	bool parallel /* = true */) 
+{
 	ogf_assert(epsilon > 0);
 
-	// Merges points which belong to the same cell of a grid of cell size = epsilon.
-	// points_to_keep will contain 1 point per cell; the others will be in points_to_remove.
-    std::set< PointSet::Vertex*, LessEpsilonPoints<PointSet::Vertex> > points_to_keep(epsilon);
+	std::vector<PointSet::Vertex*> vertices;
+	vertices.reserve(pset->size_of_vertices());
+	FOR_EACH_VERTEX(PointSet, pset, it)
+		vertices.push_back(it);
+	int num = static_cast<int>(vertices.size());
+
+	// Each thread owns the cells whose hash falls in its partition, and processes the
+	// points of its partition in the order of the point set, so the result is the same 
+	// for any number of threads.
+	int num_partitions = parallel ? omp_get_max_threads() : 1;
+
+	double inv_epsilon = 1.0 / epsilon;
+	std::vector<GridCell>		cells(num);
+	std::vector<unsigned int>	hashes(num);
+	std::vector<int>			partition_offsets(num_partitions + 1, 0);
+#pragma omp parallel for if (parallel)
+	for (int i = 0; i < num; ++i) {
+		cells[i] = grid_cell(vertices[i]->point(), inv_epsilon);
+		hashes[i] = grid_hash(cells[i]);
+	}
+
+	// the points sorted by partition (counting sort, so each partition keeps the
+	// order of the point set)
+	for (int i = 0; i < num; ++i)
+		++partition_offsets[grid_partition(hashes[i], num_partitions) + 1];
+	for (int p = 0; p < num_partitions; ++p)
+		partition_offsets[p + 1] += partition_offsets[p];
+	std::vector<unsigned int> partition_points(num);
+	{
+		std::vector<int> next(partition_offsets.begin(), partition_offsets.end() - 1);
+		for (int i = 0; i < num; ++i)
+			partition_points[next[grid_partition(hashes[i], num_partitions)]++] = i;
+	}
+
+	// the representative of the cell of each point
+	std::vector<unsigned int> representatives(num);
+
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+	for (int p = 0; p < num_partitions; ++p) {
+		// the points of the partition (in order)
+		const unsigned int* members = num > 0 ? &partition_points[0] + partition_offsets[p] : nil;
+		std::size_t nb_members = partition_offsets[p + 1] - partition_offsets[p];
+
+		GridCellTable table(nb_members);
+		std::vector<unsigned int> cell_of_member;
+		cell_of_member.reserve(nb_members);
+		std::vector<unsigned int> cell_representatives;
+		std::vector<vec3> sums;
+		std::vector<unsigned int> counts;
+
+		for (std::size_t k = 0; k < nb_members; ++k) {
+			unsigned int i = members[k];
+			unsigned int c = table.find_or_insert(cells[i], hashes[i]);
+			if (c == cell_representatives.size()) {	// new cell
+				cell_representatives.push_back(i);
+				sums.push_back(vec3(0.0, 0.0, 0.0));
+				counts.push_back(0);
+			}
+			cell_of_member.push_back(c);
+			if (representative != GR_ARBITRARY) {
+				sums[c] += vertices[i]->point();
+				++counts[c];
+			}
+		}
+
+		if (representative == GR_CENTROID) {
+			for (unsigned int c = 0; c < table.size(); ++c)
+				vertices[cell_representatives[c]]->set_point(sums[c] / counts[c]);
+		}
+		else if (representative == GR_CLOSEST_TO_CENTROID) {
+			std::vector<double> best_distances(table.size(), std::numeric_limits<double>::max());
+			for (std::size_t k = 0; k < nb_members; ++k) {
+				unsigned int i = members[k];
+				unsigned int c = cell_of_member[k];
+				double d = distance2(vertices[i]->point(), sums[c] / counts[c]);
+				if (d < best_distances[c]) {
+					best_distances[c] = d;
+					cell_representatives[c] = i;
+				}
+			}
+		}
+
+		for (std::size_t k = 0; k < nb_members; ++k)
+			representatives[members[k]] = cell_representatives[cell_of_member[k]];
+	}
+
 	std::vector<PointSet::Vertex*> points_to_remove;
-	FOR_EACH_VERTEX(PointSet, pset, it) {
-		PointSet::Vertex* p = it;
-        std::pair< std::set<PointSet::Vertex*, LessEpsilonPoints<PointSet::Vertex> >::iterator, bool> result = points_to_keep.insert(p);
-		if (!result.second) // if not inserted
-			points_to_remove.push_back(p);
+	for (int i = 0; i < num; ++i) {
+		if (representatives[i] != static_cast<unsigned int>(i))
+			points_to_remove.push_back(vertices[i]);
 	}
 
 	return points_to_remove;
@@ -74,25 +203,26 @@ std::vector<PointSet::Vertex*> PointSetSimplification::grid_simplification(Point
 double PointSetSimplification::average_sapcing(PointSet* pset, int k/* = 6*/) {
  	KdTreeSearch_var kdtree = new KdTreeSearch_ETH;
 
+	kdtree->set_parallel_build(true);
 	kdtree->begin();
 	kdtree->add_vertex_set(pset);
 	kdtree->end();
 
+	KdTreeNeighbors neighbors;
+	kdtree->find_all_closest_K_points(k, neighbors, true);	// exclude the point itself
+
 	double total = 0;
-	FOR_EACH_VERTEX_CONST(PointSet, pset, it) {
-		const vec3& p = it->point();
-		std::vector<PointSet::Vertex*> neighbors;
-		std::vector<double> sqr_distances;
-		kdtree->find_closest_K_points(p, k+1, neighbors, sqr_distances);  // k+1 to exclude itself
+	for (unsigned int i=0; i<neighbors.size(); ++i) {
+		unsigned int num = neighbors.size_of_neighbors(i);
+		if (num == 0)	// in case we get no neighbors
+			continue;
 
-		// in case we get less than k+1 neighbors
 		double avg = 0;
-		for (unsigned int i=1; i<sqr_distances.size(); ++i) { // starts from 1 to exclude itself
-			avg += std::sqrt(sqr_distances[i]);
+		for (unsigned int j=neighbors.offsets[i]; j<neighbors.offsets[i+1]; ++j) {
+			avg += std::sqrt(neighbors.squared_distances[j]);
 		}
-		total += (avg / neighbors.size());
+		total += (avg / num);
 	}
 
 	return (total / pset->size_of_vertices());
 }
-
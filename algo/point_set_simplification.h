@@ -4,6 +4,8 @@
 #include "algo_common.h"
 #include "../math/math_types.h"
 
+#include <vector>
+
 
 
 class PointSet;
@@ -17,12 +19,26 @@ public:
 	// @k: number of nearest neighbors.
 	static double	average_sapcing(PointSet* pset, int k = 6) ;
 
+	// how grid_simplification() chooses the point representing a cell
+	enum GridRepresentative {
+		GR_ARBITRARY,				// the first point of the cell (in the order of the point set)
+		GR_CENTROID,				// the first point of the cell, moved to the centroid of the cell
+		GR_CLOSEST_TO_CENTROID		// the point of the cell closest to its centroid
+	};
+
 	// considers a regular grid covering the bounding box of the input point set, and clusters 
-	// all points sharing the same cell of the grid by picking as representant one arbitrarily 
-	// chosen point.
+	// all points sharing the same cell of the grid by picking one representant (see 
+	// GridRepresentative).
+	// The cells are found in linear time with a hash table keyed by the integer cell 
+	// coordinates. If $parallel$ is true, the cells are distributed among the threads 
+	// according to their hash values. The result does not depend on the number of threads.
 	// @epsilon (or cell size): tolerance value when merging 3D points.
-	// return a list of vertices that can be removed.
-	static std::vector<PointSetTypes::Vertex*>	grid_simplification(PointSet* pset, double epsilon) ; 
+	// return a list of vertices that can be removed (in the order of the point set).
+	static std::vector<PointSetTypes::Vertex*>	grid_simplification(
+		PointSet* pset, double epsilon, 
+		GridRepresentative representative = GR_ARBITRARY, 
+		bool parallel = true
+		) ; 
 };
 
 #endif
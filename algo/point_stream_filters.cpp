@@ -0,0 +1,194 @@
+#include "point_stream_filters.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+
+void CropFilter::process(DensePointSet& chunk) {
+	std::vector<unsigned int> indices ;
+	indices.reserve(chunk.size()) ;
+
+	const float* p = chunk.positions() ;
+	for (unsigned int i = 0; i < chunk.size(); ++i, p += 3) {
+		if (p[0] >= box_.x_min() && p[0] <= box_.x_max() &&
+			p[1] >= box_.y_min() && p[1] <= box_.y_max() &&
+			p[2] >= box_.z_min() && p[2] <= box_.z_max())
+			indices.push_back(i) ;
+	}
+
+	if (indices.size() < chunk.size())
+		chunk.keep(indices) ;
+}
+
+
+//______________________________________________________________________
+
+
+namespace {
+
+	struct VoxelPoint {
+		Numeric::int64	x, y, z ;	// the cell
+		unsigned int	index ;		// the point
+
+		bool operator<(const VoxelPoint& rhs) const {
+			if (x != rhs.x)	return x < rhs.x ;
+			if (y != rhs.y)	return y < rhs.y ;
+			if (z != rhs.z)	return z < rhs.z ;
+			return index < rhs.index ;
+		}
+		bool same_cell(const VoxelPoint& rhs) const {
+			return x == rhs.x && y == rhs.y && z == rhs.z ;
+		}
+	} ;
+
+	// The cell coordinates are clamped to +-2^62, and kept in 64 bits since
+	// small cells and large coordinates easily exceed the range of an int.
+	inline Numeric::int64 voxel_coordinate(double v, double cell_size) {
+		const double limit = 4611686018427387904.0 ;	// 2^62
+		double c = std::floor(v / cell_size) ;
+		if (!(c > -limit))	// or NaN
+			c = -limit ;
+		else if (c > limit)
+			c = limit ;
+		return static_cast<Numeric::int64>(c) ;
+	}
+
+}
+
+
+void VoxelFilter::process(DensePointSet& chunk) {
+	unsigned int num = chunk.size() ;
+	float* p = chunk.positions() ;
+
+	std::vector<VoxelPoint> points(num) ;
+	for (unsigned int i = 0; i < num; ++i) {
+		const float* q = p + 3 * i ;
+		VoxelPoint& v = points[i] ;
+		v.x = voxel_coordinate(q[0], cell_size_) ;
+		v.y = voxel_coordinate(q[1], cell_size_) ;
+		v.z = voxel_coordinate(q[2], cell_size_) ;
+		v.index = i ;
+	}
+	// the points of a cell are consecutive, in the order of the chunk
+	std::sort(points.begin(), points.end()) ;
+
+	std::vector<unsigned int> indices ;
+	for (std::size_t begin = 0, end = 0; begin < points.size(); begin = end) {
+		end = begin + 1 ;
+		while (end < points.size() && points[end].same_cell(points[begin]))
+			++end ;
+
+		unsigned int first = points[begin].index ;
+		if (representative_ == PointSetSimplification::GR_ARBITRARY || end - begin == 1) {
+			indices.push_back(first) ;
+			continue ;
+		}
+
+		double c[3] = { 0.0, 0.0, 0.0 } ;
+		for (std::size_t i = begin; i < end; ++i) {
+			const float* q = p + 3 * points[i].index ;
+			c[0] += q[0] ;	c[1] += q[1] ;	c[2] += q[2] ;
+		}
+		double s = 1.0 / double(end - begin) ;
+		c[0] *= s ;	c[1] *= s ;	c[2] *= s ;
+
+		if (representative_ == PointSetSimplification::GR_CENTROID) {
+			float* q = p + 3 * first ;
+			q[0] = float(c[0]) ;	q[1] = float(c[1]) ;	q[2] = float(c[2]) ;
+			indices.push_back(first) ;
+		}
+		else {
+			unsigned int closest = first ;
+			double min_d2 = -1.0 ;
+			for (std::size_t i = begin; i < end; ++i) {
+				const float* q = p + 3 * points[i].index ;
+				double d2 = (q[0] - c[0]) * (q[0] - c[0]) + (q[1] - c[1]) * (q[1] - c[1]) + (q[2] - c[2]) * (q[2] - c[2]) ;
+				if (min_d2 < 0 || d2 < min_d2) {
+					min_d2 = d2 ;
+					closest = points[i].index ;
+				}
+			}
+			indices.push_back(closest) ;
+		}
+	}
+
+	if (indices.size() < num) {
+		std::sort(indices.begin(), indices.end()) ;
+		chunk.keep(indices) ;
+	}
+}
+
+
+//______________________________________________________________________
+
+
+TransformFilter::TransformFilter(const double* m) {
+	for (int i = 0; i < 12; ++i)
+		m_[i] = m[i] ;
+
+	// the cofactor matrix of M is det(M) times its inverse transpose
+	const double* a = m_ ;
+	n_[0] = a[5] * a[10] - a[6] * a[9] ;
+	n_[1] = a[6] * a[8]  - a[4] * a[10] ;
+	n_[2] = a[4] * a[9]  - a[5] * a[8] ;
+	n_[3] = a[2] * a[9]  - a[1] * a[10] ;
+	n_[4] = a[0] * a[10] - a[2] * a[8] ;
+	n_[5] = a[1] * a[8]  - a[0] * a[9] ;
+	n_[6] = a[1] * a[6]  - a[2] * a[5] ;
+	n_[7] = a[2] * a[4]  - a[0] * a[6] ;
+	n_[8] = a[0] * a[5]  - a[1] * a[4] ;
+	double det = a[0] * n_[0] + a[1] * n_[1] + a[2] * n_[2] ;
+	if (det < 0) {
+		for (int i = 0; i < 9; ++i)
+			n_[i] = -n_[i] ;
+	}
+}
+
+
+TransformFilter* TransformFilter::translation(const vec3& t) {
+	double m[12] = {
+		1, 0, 0, t.x,
+		0, 1, 0, t.y,
+		0, 0, 1, t.z
+	} ;
+	return new TransformFilter(m) ;
+}
+
+
+TransformFilter* TransformFilter::scaling(double s) {
+	double m[12] = {
+		s, 0, 0, 0,
+		0, s, 0, 0,
+		0, 0, s, 0
+	} ;
+	return new TransformFilter(m) ;
+}
+
+
+void TransformFilter::process(DensePointSet& chunk) {
+	int num = static_cast<int>(chunk.size()) ;
+
+	float* p = chunk.positions() ;
+	for (int i = 0; i < num; ++i, p += 3) {
+		double x = p[0], y = p[1], z = p[2] ;
+		p[0] = float(m_[0] * x + m_[1] * y + m_[2]  * z + m_[3]) ;
+		p[1] = float(m_[4] * x + m_[5] * y + m_[6]  * z + m_[7]) ;
+		p[2] = float(m_[8] * x + m_[9] * y + m_[10] * z + m_[11]) ;
+	}
+
+	float* n = chunk.normals() ;
+	if (n == nil)
+		return ;
+	for (int i = 0; i < num; ++i, n += 3) {
+		double x = n[0], y = n[1], z = n[2] ;
+		double nx = n_[0] * x + n_[1] * y + n_[2] * z ;
+		double ny = n_[3] * x + n_[4] * y + n_[5] * z ;
+		double nz = n_[6] * x + n_[7] * y + n_[8] * z ;
+		double len = std::sqrt(nx * nx + ny * ny + nz * nz) ;
+		if (len > 0) {
+			nx /= len ;	ny /= len ;	nz /= len ;
+		}
+		n[0] = float(nx) ;	n[1] = float(ny) ;	n[2] = float(nz) ;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef _ALGO_POINT_STREAM_FILTERS_H_
+#define _ALGO_POINT_STREAM_FILTERS_H_
+
+#include "algo_common.h"
+#include "point_set_simplification.h"
+#include "../geom/point_stream.h"
+#include "../math/math_types.h"
+#include "../basic/assertions.h"
+
+
+// Filters for the streaming pipeline (see PointPipeline). Each chunk is
+// processed independently of the others.
+
+
+// Removes the points outside a box.
+class ALGO_API CropFilter : public PointFilter
+{
+public:
+	CropFilter(const Box3d& box) : box_(box) {}
+
+	virtual void process(DensePointSet& chunk) ;
+
+private:
+	Box3d box_ ;
+} ;
+
+
+// Keeps one point per cell of a regular grid (see grid_simplification()). 
+// The grid is aligned with the origin, so it is the same for all the chunks,
+// but the points of a cell split between several chunks are not merged: the
+// result may have a few more points than the simplification of the whole
+// point cloud.
+class ALGO_API VoxelFilter : public PointFilter
+{
+public:
+	VoxelFilter(
+		double cell_size, 
+		PointSetSimplification::GridRepresentative representative = PointSetSimplification::GR_ARBITRARY
+		) 
+		: cell_size_(cell_size), representative_(representative) 
+	{
+		ogf_assert(cell_size > 0) ;
+	}
+
+	virtual void process(DensePointSet& chunk) ;
+
+private:
+	double cell_size_ ;
+	PointSetSimplification::GridRepresentative representative_ ;
+} ;
+
+
+// Applies an affine transformation p -> M * p + t to the points. The normals 
+// are transformed by the inverse transpose of M and normalized.
+class ALGO_API TransformFilter : public PointFilter
+{
+public:
+	// $m$: the 4x4 matrix (row-major) of the transformation. Only its first 3
+	// rows (12 values) are read, the last one is assumed to be (0, 0, 0, 1).
+	TransformFilter(const double* m) ;
+
+	static TransformFilter* translation(const vec3& t) ;
+	static TransformFilter* scaling(double s) ;
+
+	virtual void process(DensePointSet& chunk) ;
+
+private:
+	double m_[12] ;		// the first 3 rows of the matrix
+	double n_[9] ;		// the matrix of the normals
+} ;
+
+
+#endif
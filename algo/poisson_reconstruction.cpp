@@ -1,9 +1,12 @@
 #include "poisson_reconstruction.h"
 #include "../geom/map.h"
 #include "../geom/map_builder.h"
+#include "../geom/indexed_mesh.h"
 #include "../geom/point_set.h"
+#include "../geom/dense_point_set.h"
 #include "../basic/logger.h"
 #include "../basic/timer.h"
+#include "../basic/stop_watch.h"
 
 #include "../3rd_poisson_recon/MarchingCubes.h"
 #include "../3rd_poisson_recon/Octree.h"
@@ -12,6 +15,10 @@
 
 #ifdef _WIN32
 #include <omp.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
 #endif
 
 #define Real	float
@@ -21,6 +28,9 @@ PoissonReconstruction::PoissonReconstruction(void)
 : octree_depth_(8)
 , samples_per_node_(1.0f)
 , triangulate_mesh_(false)  // it seems the code has bugs, so I use my triangulation
+, out_of_core_(false)
+, memory_budget_(0)
+, keep_depth_(false)
 {
 	// other default parameters
 	full_depth_ = 5;
@@ -41,8 +51,160 @@ PoissonReconstruction::~PoissonReconstruction(void) {
 }
 
 
+// The points and normals given to the octree directly from the point sets
+// (the octree reads them three times).
+
+class PointSetStream : public PointStream<Real> {
+public:
+	PointSetStream(const PointSet* pset) 
+		: pset_(pset), normals_(const_cast<PointSet*>(pset)), current_(pset->vertices_begin()) {}
+
+	void reset() { current_ = pset_->vertices_begin(); }
+
+	bool nextPoint(Point3D<Real>& p, Point3D<Real>& n) {
+		if (current_ == pset_->vertices_end())
+			return false;
+		const vec3& q = current_->point();
+		const vec3& m = normals_[current_];
+		p = Point3D<Real>(Real(q.x), Real(q.y), Real(q.z));
+		n = Point3D<Real>(Real(m.x), Real(m.y), Real(m.z));
+		++current_;
+		return true;
+	}
+
+private:
+	const PointSet*		pset_;
+	PointSetNormal		normals_;
+	PointSet::Vertex_const_iterator current_;
+};
+
+
+class DensePointSetStream : public PointStream<Real> {
+public:
+	DensePointSetStream(const DensePointSet* points) 
+		: positions_(points->positions()), normals_(points->normals()), size_(points->size()), current_(0) {}
+
+	void reset() { current_ = 0; }
+
+	bool nextPoint(Point3D<Real>& p, Point3D<Real>& n) {
+		if (current_ >= size_)
+			return false;
+		const float* q = positions_ + 3 * current_;
+		const float* m = normals_ + 3 * current_;
+		p = Point3D<Real>(q[0], q[1], q[2]);
+		n = Point3D<Real>(m[0], m[1], m[2]);
+		++current_;
+		return true;
+	}
+
+private:
+	const float*	positions_;
+	const float*	normals_;
+	std::size_t		size_;
+	std::size_t		current_;
+};
+
+
+// The iso-surface kept in memory (instead of the temporary files of 
+// CoredFileMeshData). The polygons are appended without lock to a buffer
+// per thread, the buffers are gathered by convert_to_indexed_mesh(). The 
+// points are added by the extraction in a critical section (their index 
+// is the order of insertion), so they are stored in a single array.
+template <class Vertex>
+class MemoryMeshData : public CoredMeshData<Vertex> {
+public:
+	// the indices of the vertices, as in CoredVectorMeshData: i for the i-th
+	// in-core point, -i-1 for the i-th out-of-core point.
+	struct Polygons {
+		std::vector<int> sizes;
+		std::vector<int> indices;
+	};
+
+	MemoryMeshData(int nb_threads) : polygons_(std::max(nb_threads, 1)) { resetIterator(); }
+
+	void resetIterator() { point_index_ = 0; buffer_index_ = 0; polygon_index_ = 0; index_offset_ = 0; }
+
+	int addOutOfCorePoint(const Vertex& p) {
+		points_.push_back(p);
+		return int(points_.size()) - 1;
+	}
+	int addOutOfCorePoint_s(const Vertex& p) {
+		int idx;
+#pragma omp critical (MemoryMeshData_addOutOfCorePoint_s)
+		idx = addOutOfCorePoint(p);
+		return idx;
+	}
+
+	// the returned index is the index of the polygon in the buffer of the thread
+	int addPolygon(const std::vector<int>& vertices) {
+		Polygons& buffer = polygons_[omp_get_thread_num() % polygons_.size()];
+		buffer.sizes.push_back(int(vertices.size()));
+		buffer.indices.insert(buffer.indices.end(), vertices.begin(), vertices.end());
+		return int(buffer.sizes.size()) - 1;
+	}
+	int addPolygon(const std::vector<CoredVertexIndex>& vertices) {
+		Polygons& buffer = polygons_[omp_get_thread_num() % polygons_.size()];
+		buffer.sizes.push_back(int(vertices.size()));
+		for (std::size_t i=0; i<vertices.size(); ++i)
+			buffer.indices.push_back(vertices[i].inCore ? vertices[i].idx : -vertices[i].idx - 1);
+		return int(buffer.sizes.size()) - 1;
+	}
+	int addPolygon_s(const std::vector<int>& vertices) { return addPolygon(vertices); }
+	int addPolygon_s(const std::vector<CoredVertexIndex>& vertices) { return addPolygon(vertices); }
+
+	int nextOutOfCorePoint(Vertex& p) {
+		if (point_index_ >= points_.size())
+			return 0;
+		p = points_[point_index_++];
+		return 1;
+	}
+	int nextPolygon(std::vector<CoredVertexIndex>& vertices) {
+		while (buffer_index_ < polygons_.size() && polygon_index_ >= polygons_[buffer_index_].sizes.size()) {
+			++buffer_index_;
+			polygon_index_ = 0;
+			index_offset_ = 0;
+		}
+		if (buffer_index_ >= polygons_.size())
+			return 0;
+		const Polygons& buffer = polygons_[buffer_index_];
+		int size = buffer.sizes[polygon_index_++];
+		vertices.resize(size);
+		for (int i=0; i<size; ++i) {
+			int idx = buffer.indices[index_offset_ + i];
+			if (idx < 0) 
+				vertices[i].idx = -idx - 1, vertices[i].inCore = false;
+			else
+				vertices[i].idx = idx, vertices[i].inCore = true;
+		}
+		index_offset_ += size;
+		return 1;
+	}
+
+	int outOfCorePointCount() { return int(points_.size()); }
+	int polygonCount() {
+		std::size_t num = 0;
+		for (std::size_t i=0; i<polygons_.size(); ++i)
+			num += polygons_[i].sizes.size();
+		return int(num);
+	}
+
+	const std::vector<Vertex>& out_of_core_points() const { return points_; }
+	const std::vector<Polygons>& polygons() const { return polygons_; }
+
+private:
+	std::vector<Vertex>		points_;
+	std::vector<Polygons>	polygons_;
+
+	// for nextOutOfCorePoint()/nextPolygon()
+	std::size_t	point_index_;
+	std::size_t	buffer_index_;
+	std::size_t	polygon_index_;
+	std::size_t	index_offset_;
+};
+
+
 template<class Vertex>
-Map* convert_to_map(CoredFileMeshData<Vertex>& mesh, const std::string& density_attr_name) {
+IndexedMesh* convert_to_indexed_mesh(CoredMeshData<Vertex>& mesh, const std::string& density_attr_name) {
 	int num_ic_pts = mesh.inCorePoints.size();
 	int num_ooc_pts = mesh.outOfCorePointCount();
 	int num_face = mesh.polygonCount();
@@ -51,60 +213,120 @@ Map* convert_to_map(CoredFileMeshData<Vertex>& mesh, const std::string& density_
 		return nil;
 	}
 
-	Map* result = new Map;
-	MapVertexAttribute<float> density(result, density_attr_name);
-
-	MapBuilder builder(result);
-	builder.begin_surface();
+	IndexedMesh* result = new IndexedMesh;
+	result->resize_vertices(num_ic_pts + num_ooc_pts);
+	float* density = result->add_scalar_attribute(density_attr_name);
 
-	Real min_density = FLT_MAX;
-	Real max_density = -FLT_MAX;
 	mesh.resetIterator();
 	for (int i=0; i<num_ic_pts; ++i) {
 		const Vertex& v = mesh.inCorePoints[i];
 		const Point3D<Real>& pt = v.point;
-		builder.add_vertex(vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
-
-		density[builder.current_vertex()] = v.value;
-		min_density = std::min(min_density, v.value);
-		max_density = std::max(max_density, v.value);
+		result->set_point(i, vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
+		density[i] = v.value;
 	}
 	for (int i=0; i<num_ooc_pts; ++i) {
 		Vertex v;
 		mesh.nextOutOfCorePoint(v);
 		const Point3D<Real>& pt = v.point;
-		builder.add_vertex(vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
-
-		density[builder.current_vertex()] = v.value;
-		min_density = std::min(min_density, v.value);
-		max_density = std::max(max_density, v.value);
+		result->set_point(num_ic_pts + i, vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
+		density[num_ic_pts + i] = v.value;
 	}
 
+	result->reserve_facets(num_face, 3 * num_face);
+	std::vector<CoredVertexIndex> vertices;
+	std::vector<unsigned int> ids;
 	for (int i=0; i<num_face; ++i) {
-		std::vector<CoredVertexIndex> vertices;
 		mesh.nextPolygon(vertices);
-
-		builder.begin_facet();
+		ids.resize(vertices.size());
 		for (unsigned int j=0; j<vertices.size(); ++j) {
 			int id = vertices[j].idx;
 			if (!vertices[j].inCore)
 				id += num_ic_pts;
-			builder.add_vertex_to_facet(id);
+			ids[j] = id;
 		}
-		builder.end_facet();
+		result->add_facet(&ids[0], static_cast<unsigned int>(ids.size()));
 	}
 
-	builder.end_surface();
+	return result;
+}
 
+
+// Same as above, without reading the polygons one by one.
+template<class Vertex>
+IndexedMesh* convert_to_indexed_mesh(MemoryMeshData<Vertex>& mesh, const std::string& density_attr_name) {
+	int num_ic_pts = int(mesh.inCorePoints.size());
+	int num_ooc_pts = mesh.outOfCorePointCount();
+	int num_face = mesh.polygonCount();
+	if (num_face <=0) {
+		Logger::err("PoissonRecon") << "reconstructed mesh has 0 facet" << std::endl;
+		return nil;
+	}
+
+	IndexedMesh* result = new IndexedMesh;
+	result->resize_vertices(num_ic_pts + num_ooc_pts);
+	float* density = result->add_scalar_attribute(density_attr_name);
+	for (int i=0; i<num_ic_pts + num_ooc_pts; ++i) {
+		const Vertex& v = (i < num_ic_pts) ? mesh.inCorePoints[i] : mesh.out_of_core_points()[i - num_ic_pts];
+		const Point3D<Real>& pt = v.point;
+		result->set_point(i, vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
+		density[i] = v.value;
+	}
+
+	const std::vector< typename MemoryMeshData<Vertex>::Polygons >& polygons = mesh.polygons();
+	std::size_t num_indices = 0;
+	for (std::size_t i=0; i<polygons.size(); ++i)
+		num_indices += polygons[i].indices.size();
+	result->reserve_facets(num_face, static_cast<unsigned int>(num_indices));
+
+	std::vector<unsigned int> ids;
+	for (std::size_t i=0; i<polygons.size(); ++i) {
+		const std::vector<int>& sizes = polygons[i].sizes;
+		const int* indices = polygons[i].indices.empty() ? nil : &polygons[i].indices[0];
+		for (std::size_t j=0; j<sizes.size(); ++j) {
+			ids.resize(sizes[j]);
+			for (int k=0; k<sizes[j]; ++k) {
+				int id = indices[k];
+				ids[k] = (id < 0) ? (num_ic_pts - id - 1) : id;
+			}
+			result->add_facet(&ids[0], sizes[j]);
+			indices += sizes[j];
+		}
+	}
+
+	return result;
+}
+
+
+static void log_density_range(const IndexedMesh* mesh, const std::string& density_attr_name) {
+	const float* density = mesh->scalar_attribute(density_attr_name);
+	if (!density)
+		return;
+
+	Real min_density = FLT_MAX;
+	Real max_density = -FLT_MAX;
+	for (unsigned int i=0; i<mesh->nb_vertices(); ++i) {
+		min_density = std::min(min_density, density[i]);
+		max_density = std::max(max_density, density[i]);
+	}
  	Logger::out("PoissonRecon") 
  		<< "vertex attribute 'density' added. [" 
 		<< clip_precision(min_density, 2) << ", " << clip_precision(max_density, 2) << "]" << std::endl;
+}
+
 
+Map* PoissonReconstruction::apply(const PointSet* pset, const std::string& density_attr_name) {
+	IndexedMesh* mesh = apply_indexed(pset, density_attr_name);
+	if (!mesh)
+		return nil;
+
+	Map* result = new Map;
+	mesh->copy_to(result);
+	delete mesh;
 	return result;
 }
 
 
-Map* PoissonReconstruction::apply(const PointSet* pset, const std::string& density_attr_name) {
+IndexedMesh* PoissonReconstruction::apply_indexed(const PointSet* pset, const std::string& density_attr_name) {
 	if (!pset) {
 		Logger::err(title()) << "null point cloud" << std::endl;
 		return nil;
@@ -114,117 +336,448 @@ Map* PoissonReconstruction::apply(const PointSet* pset, const std::string& densi
 		Logger::err(title()) << "normals are required" << std::endl;
 		return nil;
 	}
-	PointSetNormal normals(const_cast<PointSet*>(pset));
 
- 	TreeNodeData::NodeCount = 0;
-	Octree<Real> tree;
-	tree.threads = threads_;
-	OctNode<TreeNodeData>::SetAllocator(MEMORY_ALLOCATOR_BLOCK_SIZE);
+	PointSetStream stream(pset);
+	return reconstruct(&stream, pset, density_attr_name);
+}
 
-	int maxSolveDepth = octree_depth_;
-	int kernelDepth = octree_depth_ - 2;
 
-	//////////////////////////////////////////////////////////////////////////
+IndexedMesh* PoissonReconstruction::apply_indexed(const DensePointSet* points, const std::string& density_attr_name) {
+	if (!points) {
+		Logger::err(title()) << "null point cloud" << std::endl;
+		return nil;
+	}
 
-	Timer t, t_total; t.start(), t_total.start();
-	Logger::out(title()) << "Running Screened Poisson Reconstruction (Version 6.13)" << std::endl;
+	if (!points->has_normals()) {
+		Logger::err(title()) << "normals are required" << std::endl;
+		return nil;
+	}
+
+	DensePointSetStream stream(points);
+	return reconstruct(&stream, points, density_attr_name);
+}
+
+
+// The peak memory (resident set) of the process since it started, in MB.
+static double peak_process_memory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return double(counters.PeakWorkingSetSize) / (1 << 20);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+		return double(usage.ru_maxrss) / (1 << 20);	// in bytes
+#else
+		return double(usage.ru_maxrss) / (1 << 10);	// in KB
+#endif
+#endif
+	return 0;
+}
 
-	//////////////////////////////////////////////////////////////////////////	
 
-	tree.maxMemoryUsage = 0;
+// Measures the stages of the reconstruction: wall time, user process time and 
+// peak memory of the process at the end of the stage.
+class StageMeter {
+public:
+	StageMeter() { cpu_.start(); start(); }
 
-    std::list< Point3D<Real> > pts;
-    std::list< Point3D<Real> > nms;
-	FOR_EACH_VERTEX_CONST(PointSet, pset, it) {
-		const vec3& p = it->point();
-		const vec3& n = normals[it];
-		Point3D<Real> pt(p.x, p.y, p.z);
-		Point3D<Real> nm(n.x, n.y, n.z);
-		pts.push_back(pt);
-		nms.push_back(nm);
+	void start() {
+		wall_.start();
+		cpu_.reset();	// the timer keeps running
 	}
 
-	Octree<Real>::PointInfo* pointInfo = new Octree<Real>::PointInfo();
-	Octree<Real>::NormalInfo* normalInfo = new Octree<Real>::NormalInfo();
-	std::vector<Real>* kernelDensityWeights = new std::vector<Real>();
-	std::vector<Real>* centerWeights = new std::vector<Real>();
+	// ends the current stage and starts the next one
+	PoissonReconstruction::Stage next(const std::string& name) {
+		PoissonReconstruction::Stage stage;
+		stage.name = name;
+		stage.wall_time = wall_.elapsed();
+		stage.cpu_time = cpu_.time();
+		stage.peak_memory = peak_process_memory();
+		start();
+		return stage;
+	}
+
+private:
+	StopWatch	wall_;
+	Timer		cpu_;
+};
+
+
+// Estimates the number of nodes of the octree SetTree() builds, without building it,
+// to choose the parameters that fit the memory budget. The points are read (twice) 
+// when the estimator is created, and sorted by their cell at the maximum depth (in 
+// Morton order, so that the cells at a coarser depth are given by shifting the keys).
+// As in SetTree(), a sample refines the tree down to the depth given by the number of
+// points in its cell at the splatting depth (depth - 2), and the nodes are created 
+// with their 3x3x3 neighbors. The estimate is an upper bound for most point clouds 
+// (by 10 to 20% with one sample per node, more with more samples per node).
+class NodeCountEstimator {
+public:
+	// the depth cannot exceed 21 (the keys are 63 bits)
+	NodeCountEstimator(PointStream<Real>* points, int max_depth, float scale_factor) : max_depth_(max_depth) {
+		Point3D<Real> p, n, pmin, pmax;
+		std::size_t count = 0;
+		while (points->nextPoint(p, n)) {
+			for (int i = 0; i < 3; ++i) {
+				if (!count || p[i] < pmin[i]) pmin[i] = p[i];
+				if (!count || p[i] > pmax[i]) pmax[i] = p[i];
+			}
+			++count;
+		}
+		points->reset();
+
+		// the normalization of SetTree() (with the Neumann boundary)
+		Real scale = std::max<Real>(pmax[0] - pmin[0], std::max<Real>(pmax[1] - pmin[1], pmax[2] - pmin[2])) * scale_factor;
+		if (scale <= 0)
+			scale = 1;
+		Point3D<Real> corner = (pmax + pmin) / 2;
+		for (int i = 0; i < 3; ++i)
+			corner[i] -= scale / 2;
+
+		double side = double(Numeric::uint64(1) << max_depth_);
+		Numeric::uint64 last = (Numeric::uint64(1) << max_depth_) - 1;
+		keys_.reserve(count);
+		while (points->nextPoint(p, n)) {
+			Numeric::uint64 c[3];
+			for (int i = 0; i < 3; ++i) {
+				double v = std::floor((p[i] - corner[i]) / scale * side);
+				c[i] = v <= 0 ? 0 : std::min<Numeric::uint64>(Numeric::uint64(v), last);
+			}
+			keys_.push_back(morton_key(c[0], c[1], c[2]));
+		}
+		points->reset();
+		std::sort(keys_.begin(), keys_.end());
+	}
+
+	double nb_nodes(int depth, int full_depth, float samples_per_node) const {
+		depth = std::min(depth, max_depth_);
+		full_depth = std::min(full_depth, depth);
+		int splat_depth = std::max(depth - 2, 0);
+		int shift = 3 * (max_depth_ - depth);
+
+		// the cells refined at each depth (i.e., with children)
+		std::vector< std::vector<Numeric::uint64> > refined(depth);
+		std::size_t begin = 0;
+		while (begin < keys_.size()) {
+			Numeric::uint64 cell = keys_[begin] >> (3 * (max_depth_ - splat_depth));
+			std::size_t end = begin + 1;
+			while (end < keys_.size() && (keys_[end] >> (3 * (max_depth_ - splat_depth))) == cell)
+				++end;
+
+			double d = splat_depth + std::log(double(end - begin) / samples_per_node) / std::log(4.0);
+			int top = static_cast<int>(std::ceil(std::max<double>(0.0, std::min<double>(depth, d))));
+			for (std::size_t i = begin; i < end; ++i) {
+				Numeric::uint64 key = keys_[i] >> shift;
+				for (int k = full_depth; k < top; ++k) {
+					Numeric::uint64 c = key >> (3 * (depth - k));
+					if (refined[k].empty() || refined[k].back() != c)
+						refined[k].push_back(c);
+				}
+			}
+			begin = end;
+		}
+
+		// the tree is complete down to the full depth
+		double count = 1;
+		for (int k = 0; k < depth; ++k) {
+			if (k < full_depth)
+				count += 8.0 * double(Numeric::uint64(1) << (3 * k));
+			else
+				count += 8.0 * dilated_size(refined[k], k);
+		}
+		return count;
+	}
+
+private:
+	// the bits of the 21 low bits of $x$, three bits apart
+	static Numeric::uint64 spread(Numeric::uint64 x) {
+		x &= 0x1fffffull;
+		x = (x | x << 32) & 0x1f00000000ffffull;
+		x = (x | x << 16) & 0x1f0000ff0000ffull;
+		x = (x | x << 8) & 0x100f00f00f00f00full;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+		x = (x | x << 2) & 0x1249249249249249ull;
+		return x;
+	}
+
+	static Numeric::uint64 compact(Numeric::uint64 x) {
+		x &= 0x1249249249249249ull;
+		x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ull;
+		x = (x ^ (x >> 4)) & 0x100f00f00f00f00full;
+		x = (x ^ (x >> 8)) & 0x1f0000ff0000ffull;
+		x = (x ^ (x >> 16)) & 0x1f00000000ffffull;
+		x = (x ^ (x >> 32)) & 0x1fffffull;
+		return x;
+	}
+
+	static Numeric::uint64 morton_key(Numeric::uint64 x, Numeric::uint64 y, Numeric::uint64 z) {
+		return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+	}
+
+	// the number of cells in the 3x3x3 neighborhoods of $cells$ (at depth $depth$),
+	// dilated one axis after the other
+	static double dilated_size(std::vector<Numeric::uint64>& cells, int depth) {
+		Numeric::uint64 side = Numeric::uint64(1) << depth;
+		std::sort(cells.begin(), cells.end());
+		cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+		for (int axis = 0; axis < 3; ++axis) {
+			Numeric::uint64 mask = 0x1249249249249249ull << axis;
+			std::size_t n = cells.size();
+			for (std::size_t i = 0; i < n; ++i) {
+				Numeric::uint64 v = compact(cells[i] >> axis);
+				Numeric::uint64 others = cells[i] & ~mask;
+				if (v > 0)
+					cells.push_back(others | (spread(v - 1) << axis));
+				if (v + 1 < side)
+					cells.push_back(others | (spread(v + 1) << axis));
+			}
+			std::sort(cells.begin(), cells.end());
+			cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+		}
+		return double(cells.size());
+	}
+
+private:
+	int							max_depth_;
+	std::vector<Numeric::uint64> keys_;
+};
+
+
+// The memory per node until the mesh is extracted: the node and its entry in the
+// sorted nodes, the point data, and the per-node arrays alive at the same time, the
+// largest set being the normals, the constraints (twice while they are set) and the
+// density and center weights.
+static const double bytes_per_node = double(
+	sizeof(OctNode<TreeNodeData>) + sizeof(OctNode<TreeNodeData>*) +
+	sizeof(int) + sizeof(Point3D<Real>) + 2 * sizeof(Real) +
+	sizeof(int) + sizeof(Point3D<Real>) + 4 * sizeof(Real)
+	);
+
+// The maximum depth of the node count estimate.
+static const int max_estimated_depth = 21;
+
+
+// Lowers the depth (or, if $keep_depth$, doubles the samples per node) to reduce 
+// the size of the octree. Returns false if the parameters cannot be reduced further.
+static bool reduce_parameters(int& depth, float& samples_per_node, bool keep_depth, int full_depth) {
+	if (keep_depth) {
+		if (samples_per_node >= 1024.0f)
+			return false;
+		samples_per_node *= 2.0f;
+	}
+	else {
+		if (depth <= full_depth + 1)
+			return false;
+		--depth;
+	}
+	return true;
+}
+
+
+IndexedMesh* PoissonReconstruction::reconstruct(PointStream<float>* points, const Object* obj, const std::string& density_attr_name) {
+	Logger::out(title()) << "Running Screened Poisson Reconstruction (Version 6.13)" << std::endl;
+
+	report_ = Report();
+	report_.nb_tree_builds = 0;
+	report_.solver_iterations = 0;
+	report_.solver_residual = -1;
 
-	int adaptiveExponent = 1;
-	int boundaryType = 1;
-    int pointCount = tree.SetTree< Point3D<Real> >(
-		pts, nms, cgDepth_, octree_depth_, full_depth_, kernelDepth, samples_per_node_, scale_, confidence_, normalWeight_,
-		pointWeight_, adaptiveExponent, *pointInfo, *normalInfo, *kernelDensityWeights, *centerWeights, boundaryType);
-	pts.clear();
-	nms.clear();
+	StopWatch w_total;
+	Timer t_total; t_total.start();
+	StageMeter meter;
 
-	Logger::out(title()) << "Tree built. " << t.time() << " seconds, " << clip_precision(tree.maxMemoryUsage, 2) << " MB memory" << std::endl;
-	pset->immediate_update();
+	int depth = octree_depth_;
+	float samples_per_node = samples_per_node_;
 
 	//////////////////////////////////////////////////////////////////////////
 
-	double maxMemoryUsage = tree.maxMemoryUsage;
-	t.reset();
+	Octree<Real>* tree = nil;
+	Octree<Real>::PointInfo* pointInfo = nil;
+	Octree<Real>::NormalInfo* normalInfo = nil;
+	std::vector<Real>* kernelDensityWeights = nil;
+	std::vector<Real>* centerWeights = nil;
+	int pointCount = 0;
+
+	double base_memory = Octree<Real>::MemoryUsage();
+	NodeCountEstimator* estimator = nil;
+	if (memory_budget_ > 0) {
+		if (depth <= max_estimated_depth)
+			estimator = new NodeCountEstimator(points, depth, scale_);
+		else
+			Logger::warn(title()) << "the memory needed cannot be estimated before the tree is built (depth > " << max_estimated_depth << ")" << std::endl;
+	}
+
+	bool reducible = true;
+	Stage stage;
+	while (true) {
+		// the parameters are reduced before the tree is built
+		if (estimator) {
+			double estimated = base_memory + estimator->nb_nodes(depth, full_depth_, samples_per_node) * bytes_per_node / (1 << 20);
+			while (estimated > memory_budget_) {
+				if (!reduce_parameters(depth, samples_per_node, keep_depth_, full_depth_)) {
+					Logger::warn(title()) << "about " << clip_precision(estimated, 1) << " MB needed (budget: " 
+						<< memory_budget_ << " MB), the parameters cannot be reduced further" << std::endl;
+					reducible = false;
+					break;
+				}
+				Logger::warn(title()) << "about " << clip_precision(estimated, 1) << " MB needed (budget: " << memory_budget_ 
+					<< " MB), reducing the parameters (depth " << depth << ", samples per node " << samples_per_node << ")" << std::endl;
+				estimated = base_memory + estimator->nb_nodes(depth, full_depth_, samples_per_node) * bytes_per_node / (1 << 20);
+			}
+		}
+
+		// the allocator releases the nodes of the previous tree
+		TreeNodeData::NodeCount = 0;
+		OctNode<TreeNodeData>::SetAllocator(MEMORY_ALLOCATOR_BLOCK_SIZE);
+		tree = new Octree<Real>;
+		tree->threads = threads_;
+
+		pointInfo = new Octree<Real>::PointInfo();
+		normalInfo = new Octree<Real>::NormalInfo();
+		kernelDensityWeights = new std::vector<Real>();
+		centerWeights = new std::vector<Real>();
+
+		int kernelDepth = depth - 2;
+		int adaptiveExponent = 1;
+		int boundaryType = 1;
+		// the points are read from the stream (three passes), there is no copy
+		pointCount = tree->SetTree<Real>(
+			points, cgDepth_, depth, full_depth_, kernelDepth, samples_per_node, scale_, confidence_, normalWeight_,
+			pointWeight_, adaptiveExponent, *pointInfo, *normalInfo, *kernelDensityWeights, *centerWeights, boundaryType, 
+			XForm4x4<Real>::Identity());
+		++report_.nb_tree_builds;
+
+		stage = meter.next("tree");
+		Logger::out(title()) << "Tree built. " << stage.cpu_time << " seconds, " << clip_precision(stage.peak_memory, 2) << " MB memory" << std::endl;
+		obj->immediate_update();
+
+		if (memory_budget_ <= 0 || !reducible)
+			break;
+
+		// the estimate may be too low for some point clouds, the tree is then rebuilt
+		double needed = base_memory + TreeNodeData::NodeCount * bytes_per_node / (1 << 20);
+		if (needed <= memory_budget_)
+			break;
+		if (!reduce_parameters(depth, samples_per_node, keep_depth_, full_depth_)) {
+			Logger::warn(title()) << "about " << clip_precision(needed, 1) << " MB needed (budget: " 
+				<< memory_budget_ << " MB), the parameters cannot be reduced further" << std::endl;
+			break;
+		}
+		Logger::warn(title()) << "about " << clip_precision(needed, 1) << " MB needed (budget: " << memory_budget_ 
+			<< " MB), rebuilding the tree (depth " << depth << ", samples per node " << samples_per_node << ")" << std::endl;
+
+		delete pointInfo;
+		delete normalInfo;
+		delete kernelDensityWeights;
+		delete centerWeights;
+		delete tree;
+		points->reset();
+		meter.start();
+	}
+	delete estimator;
+	report_.stages.push_back(stage);
+
+	report_.nb_points = pointCount;
+	report_.nb_nodes = TreeNodeData::NodeCount;
+	report_.octree_depth = depth;
+	report_.samples_per_node = samples_per_node;
+	Logger::out(title()) << pointCount << " points, " << TreeNodeData::NodeCount << " nodes" << std::endl;
+
+	//////////////////////////////////////////////////////////////////////////
 
-	tree.maxMemoryUsage = 0;
-	Pointer(Real)constraints = tree.SetLaplacianConstraints(*normalInfo);
+	Pointer(Real)constraints = tree->SetLaplacianConstraints(*normalInfo);
 	delete normalInfo;
 
-	Logger::out(title()) << "Constraints set. " << t.time() << " seconds, " << clip_precision(tree.maxMemoryUsage, 1) << " MB memory" << std::endl;
-	maxMemoryUsage = std::max<double>(maxMemoryUsage, tree.maxMemoryUsage);
-	pset->immediate_update();
+	stage = meter.next("constraints");
+	report_.stages.push_back(stage);
+	Logger::out(title()) << "Constraints set. " << stage.cpu_time << " seconds, " << clip_precision(stage.peak_memory, 1) << " MB memory" << std::endl;
+	obj->immediate_update();
 
 	//////////////////////////////////////////////////////////////////////////
 
 	bool showResidual = false;
 	Real solverAccuracy = 1e-3f;
-	Pointer(Real) solution = tree.SolveSystem(*pointInfo, constraints, showResidual, gsIter_, maxSolveDepth, cgDepth_, solverAccuracy);
+	int maxSolveDepth = depth;
+	Pointer(Real) solution = tree->SolveSystem(*pointInfo, constraints, showResidual, gsIter_, maxSolveDepth, cgDepth_, solverAccuracy, 
+		&report_.solver_iterations, &report_.solver_residual);
 	delete pointInfo;
 	FreePointer(constraints);
-	Logger::out(title()) << "Linear system solved. " << t.time() << "  seconds, " << clip_precision(tree.maxMemoryUsage, 1) << " MB memory" << std::endl;
-	maxMemoryUsage = std::max< double >(maxMemoryUsage, tree.maxMemoryUsage);
-	pset->immediate_update();
+
+	stage = meter.next("solve");
+	report_.stages.push_back(stage);
+	Logger::out(title()) << "Linear system solved. " << stage.cpu_time << "  seconds, " << clip_precision(stage.peak_memory, 1) << " MB memory. " 
+		<< report_.solver_iterations << " iterations, residual " << report_.solver_residual << std::endl;
+	obj->immediate_update();
 
 	//////////////////////////////////////////////////////////////////////////
 
-	if (verbose_) 
-		tree.maxMemoryUsage = 0;
-	t.reset();
-	Real isoValue = tree.GetIsoValue(solution, *centerWeights);
+	Real isoValue = tree->GetIsoValue(solution, *centerWeights);
 	delete centerWeights;
-	Logger::out(title()) << "Iso-Value: " << isoValue << ". " << t.time() << " seconds" << std::endl;
+
+	stage = meter.next("iso-value");
+	report_.stages.push_back(stage);
+	Logger::out(title()) << "Iso-Value: " << isoValue << ". " << stage.cpu_time << " seconds" << std::endl;
 
 	//////////////////////////////////////////////////////////////////////////
 
-	t.reset();
-	tree.maxMemoryUsage = 0;
 	bool nonManifold = false;
 
  #ifdef DISABLE_DEPTH_VALUE  // NOTE: disabling depth value will at the same time disable the trimmer.
-    CoredFileMeshData< PlyVertex<Real> > mesh;		// without the estimated depth values of the iso-surface vertices
+	typedef PlyVertex<Real>			MeshVertex;		// without the estimated depth values of the iso-surface vertices
  #else
-    CoredFileMeshData< PlyValueVertex<Real> > mesh;	// with the estimated depth values of the iso-surface vertices
+	typedef PlyValueVertex<Real>	MeshVertex;		// with the estimated depth values of the iso-surface vertices
  #endif
 
- 	tree.GetMCIsoSurface(
+	// CoredMeshData has no virtual destructor: the meshes are deleted through their own type
+	CoredFileMeshData<MeshVertex>* file_mesh = nil;
+	MemoryMeshData<MeshVertex>* memory_mesh = nil;
+	CoredMeshData<MeshVertex>* mesh = nil;
+	if (out_of_core_)
+		mesh = file_mesh = new CoredFileMeshData<MeshVertex>;
+	else
+		mesh = memory_mesh = new MemoryMeshData<MeshVertex>(threads_);
+
+ 	tree->GetMCIsoSurface(
 		kernelDensityWeights ? GetPointer(*kernelDensityWeights) : NullPointer<Real>(), 
 		solution, 
 		isoValue, 
-		mesh, 
+		*mesh, 
 		true, 
 		!nonManifold, 
 		!triangulate_mesh_
 		);
 	delete kernelDensityWeights;
 	kernelDensityWeights = nil;
-	Logger::out(title()) << "Mesh extracted. " << t.time() << " seconds, " << clip_precision(tree.maxMemoryUsage, 1) << " MB memory" << std::endl;
-	pset->immediate_update();
+	FreePointer(solution);
 
-	maxMemoryUsage = std::max<double>(maxMemoryUsage, tree.maxMemoryUsage);
+	stage = meter.next("extraction");
+	report_.stages.push_back(stage);
+	Logger::out(title()) << "Mesh extracted. " << stage.cpu_time << " seconds, " << clip_precision(stage.peak_memory, 1) << " MB memory" << std::endl;
+	obj->immediate_update();
 
 	//////////////////////////////////////////////////////////////////////////
 
-	Map* result = convert_to_map(mesh, density_attr_name);
-	Logger::out(title()) << "Total reconstruction: " << t_total.time() << " seconds, " << clip_precision(maxMemoryUsage, 1) << " MB memory" << std::endl;
+	IndexedMesh* result = nil;
+	if (out_of_core_)
+		result = convert_to_indexed_mesh(*file_mesh, density_attr_name);
+	else
+		result = convert_to_indexed_mesh(*memory_mesh, density_attr_name);
+	delete file_mesh;
+	delete memory_mesh;
+	delete tree;
+
+	report_.stages.push_back(meter.next("conversion"));
+
+	if (result)
+		log_density_range(result, density_attr_name);
+
+	report_.wall_time = w_total.elapsed();
+	report_.cpu_time = t_total.time();
+	report_.peak_memory = peak_process_memory();
+	Logger::out(title()) << "Total reconstruction: " << report_.cpu_time << " seconds (" << clip_precision(report_.wall_time, 2) 
+		<< " seconds wall time), " << clip_precision(report_.peak_memory, 1) << " MB memory" << std::endl;
 	
 	return result; 
 }
@@ -247,31 +800,47 @@ Map* PoissonReconstruction::trim(
 		return nil;
 	}
 
-	MapVertexAttribute<float> density(mesh, density_attr_name);
-	Attribute<Map::Vertex, int> vertex_id(mesh->vertex_attribute_manager());
-    std::vector< PlyValueVertex<Real> >	vertices;
-    std::vector< std::vector<int> >		polygons;
-	int id = 0;
-	FOR_EACH_VERTEX_CONST(Map, mesh, it) {
-		const vec3& p = it->point();
-		PlyValueVertex<Real> v;
-		v.point = Point3D<Real>(p.x, p.y, p.z);
-		v.value = density[it];
-		vertices.push_back(v);
-
-		vertex_id[it] = id;
-		++id;
-	}
-
-	FOR_EACH_FACET_CONST(Map, mesh, it) {
-		std::vector<int> plg;
-		Map::Halfedge* jt = it->halfedge() ;
-		do {
-			int id = vertex_id[jt->vertex()];
-			plg.push_back(id);
-			jt = jt->next() ;
-		} while(jt != it->halfedge()) ;
-		polygons.push_back(plg);
+	IndexedMesh indexed;
+	indexed.assign(mesh);
+	IndexedMesh* trimmed = trim(&indexed, density_attr_name, trim_value, area_ratio, triangulate, smooth);
+	if (!trimmed)
+		return nil;
+
+	Map* trimmed_mesh = new Map;
+	trimmed->copy_to(trimmed_mesh);
+	delete trimmed;
+
+	return trimmed_mesh;
+}
+
+
+IndexedMesh* PoissonReconstruction::trim(
+	const IndexedMesh* mesh,
+	const std::string& density_attr_name,
+	float trim_value,
+	float area_ratio,
+	bool triangulate,
+	int smooth)
+{
+	if (!mesh)
+		return nil;
+
+	const float* density = mesh->scalar_attribute(density_attr_name);
+	if (!density) {
+		Logger::err(title()) << "density is not available" << std::endl;
+		return nil;
+	}
+
+    std::vector< PlyValueVertex<Real> >	vertices(mesh->nb_vertices());
+    std::vector< std::vector<int> >		polygons(mesh->nb_facets());
+	for (unsigned int i=0; i<mesh->nb_vertices(); ++i) {
+		vec3 p = mesh->point(i);
+		vertices[i].point = Point3D<Real>(p.x, p.y, p.z);
+		vertices[i].value = density[i];
+	}
+	for (unsigned int i=0; i<mesh->nb_facets(); ++i) {
+		const unsigned int* v = mesh->facet_vertices(i);
+		polygons[i].assign(v, v + mesh->facet_size(i));
 	}
 	
 	Timer t; t.start();
@@ -280,31 +849,24 @@ Map* PoissonReconstruction::trim(
 
 	//////////////////////////////////////////////////////////////////////////
 
-	Map* trimmed_mesh = new Map;
-	density.bind(trimmed_mesh, density_attr_name);
-
-	MapBuilder builder(trimmed_mesh);
-	builder.begin_surface();
-
+	IndexedMesh* trimmed_mesh = new IndexedMesh;
+	trimmed_mesh->resize_vertices(static_cast<unsigned int>(vertices.size()));
+	float* trimmed_density = trimmed_mesh->add_scalar_attribute(density_attr_name);
 	for (size_t i=0; i<vertices.size(); ++i) {
 		const Point3D<Real>& pt = vertices[i].point;
-		builder.add_vertex(vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
-		Map::Vertex* v = builder.current_vertex();
-		density[v] = vertices[i].value;
+		trimmed_mesh->set_point(static_cast<unsigned int>(i), vec3(pt.coords[0], pt.coords[1], pt.coords[2]));
+		trimmed_density[i] = vertices[i].value;
 	}
 
+	std::vector<unsigned int> ids;
 	for (size_t i=0; i<polygons.size(); ++i) {
 		const std::vector<int>& plg = polygons[i];
-		builder.begin_facet();
-		for (unsigned int j=0; j<plg.size(); ++j) {
-			builder.add_vertex_to_facet(plg[j]);
-		}
-		builder.end_facet();
+		if (plg.empty())
+			continue;
+		ids.assign(plg.begin(), plg.end());
+		trimmed_mesh->add_facet(&ids[0], static_cast<unsigned int>(ids.size()));
 	}
 
-	builder.end_surface();
-
-	int removed_num = mesh->size_of_facets() - trimmed_mesh->size_of_facets();
 	Logger::out(title()) << "Done. Time: " << t.time() << " seconds" << std::endl;
 
 	return trimmed_mesh;
@@ -4,9 +4,14 @@
 
 #include "algo_common.h"
 #include <string>
+#include <vector>
 
 class Map;
+class IndexedMesh;
 class PointSet;
+class DensePointSet;
+class Object;
+template <class Real> class PointStream;
 
 class ALGO_API PoissonReconstruction
 {
@@ -20,10 +25,52 @@ public:
 	// reconstruction
 	void set_octree_depth(int d) { octree_depth_ = d; }
 	void set_sampers_per_node(float s) { samples_per_node_ = s; }
+	// If true, the extracted surface is written to temporary files during the
+	// extraction (for the meshes too large to be held twice in memory). 
+	// Otherwise (the default) it is kept in memory.
+	void set_out_of_core(bool b) { out_of_core_ = b; }
+	// The (approximate) maximum memory the reconstruction may use, in MB (0, the 
+	// default, for no limit). Before the octree is built, its number of nodes is
+	// estimated from the points, and the depth is lowered (or, if $keep_depth$ is
+	// true, the samples per node are doubled) until the memory needed fits. If the 
+	// tree built is still too large, it is rebuilt with reduced parameters. The
+	// parameters actually used are given by the report.
+	void set_memory_budget(double mb, bool keep_depth = false) { memory_budget_ = mb; keep_depth_ = keep_depth; }
 	Map* apply(const PointSet* pset, const std::string& density_attr_name = "density");
+	// same as apply(), but the halfedge structure is not built (faster if the
+	// mesh is only saved or rendered). The density is a scalar attribute.
+	IndexedMesh* apply_indexed(const PointSet* pset, const std::string& density_attr_name = "density");
+	// the points and normals are read from the arrays of $points$
+	IndexedMesh* apply_indexed(const DensePointSet* points, const std::string& density_attr_name = "density");
+
+	//////////////////////////////////////////////////////////////////////////
+	// statistics of the last reconstruction
+
+	struct Stage {
+		std::string	name;
+		double		wall_time;		// in seconds
+		double		cpu_time;		// user process time (all the threads), in seconds
+		double		peak_memory;	// peak memory (resident set) of the process at the end of the stage, in MB
+	};
+
+	struct Report {
+		std::vector<Stage>	stages;	// tree, constraints, solve, iso-value, extraction, conversion
+		double	wall_time;			// the whole reconstruction (the rebuilt trees included)
+		double	cpu_time;
+		double	peak_memory;		// peak memory of the process since it started (not only the reconstruction)
+		int		nb_points;
+		int		nb_nodes;			// number of nodes of the octree
+		int		nb_tree_builds;		// > 1 if the octree was rebuilt to fit the memory budget
+		int		octree_depth;		// the depth and samples per node actually used
+		float	samples_per_node;
+		int		solver_iterations;	// summed over all the depths
+		double	solver_residual;	// relative residual at the finest depth (-1 if unknown)
+	};
+	const Report& report() const { return report_; }
 
 	// trimming
 	static Map* trim(Map* mesh, const std::string& density_attr_name, float trim_value, float area_ratio, bool triangulate, int smooth);
+	static IndexedMesh* trim(const IndexedMesh* mesh, const std::string& density_attr_name, float trim_value, float area_ratio, bool triangulate, int smooth);
 
 public:
 	// these parameters that usually do not need to change
@@ -37,6 +84,10 @@ public:
 	void set_normal_weight(bool	v) { normalWeight_ = v; }
 	void set_verbose(bool v) { verbose_ = v; }
 
+private:
+	// $obj$ is the point cloud (updated between the steps)
+	IndexedMesh* reconstruct(PointStream<float>* points, const Object* obj, const std::string& density_attr_name);
+
 private:
 	/*
 	This integer is the maximum depth of the tree that will be used for surface 
@@ -67,6 +118,13 @@ private:
 
 	bool	triangulate_mesh_;
 
+	bool	out_of_core_;
+
+	double	memory_budget_;
+	bool	keep_depth_;
+
+	Report	report_;
+
 private:
 	int		voxelDepth_;
 	int		cgDepth_;
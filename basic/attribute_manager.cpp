@@ -39,6 +39,20 @@ AttributeManager::~AttributeManager() {
 	}
 }
 
+void AttributeManager::reserve(unsigned int n) {
+	if(n <= capacity()) {
+		return ;
+	}
+	unsigned int nb_new_chunks = (n - capacity() + RAT::CHUNK_SIZE - 1) / RAT::CHUNK_SIZE ;
+	rat_.grow(nb_new_chunks) ;
+	for(std::set<AttributeStore*>::iterator 
+		it=attributes_.begin(); it!=attributes_.end(); it++
+		) {
+			(*it)->grow(nb_new_chunks) ;
+			ogf_attribute_assert((*it)->capacity() == capacity()) ;
+	}
+}
+
 void AttributeManager::new_record(Record* record) {
 	if(rat_.is_full()) {
 		rat_.grow() ;
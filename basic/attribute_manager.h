@@ -26,6 +26,13 @@ public:
 
 	void clear() ;
 
+	/**
+	* makes room for (at least) n records in the allocation 
+	* table and in all the attributes. The missing chunks are
+	* allocated at once (one block per attribute).
+	*/
+	void reserve(unsigned int n) ;
+
 	/**
 	* creates new record attributes, and puts the resulting id
 	* in the specified Record
@@ -16,8 +16,8 @@ void AttributeStore::bind(AttributeManager* manager) {
 	ogf_assert(manager_ == nil) ;
 	manager_ = manager ;
 	if(manager_ != nil) {
-		while(nb_chunks() < manager_->rat().nb_chunks()) {
-			grow() ;
+		if(nb_chunks() < manager_->rat().nb_chunks()) {
+			grow(manager_->rat().nb_chunks() - nb_chunks()) ;
 		}
 		manager_-> register_attribute_store(this) ;
 	}
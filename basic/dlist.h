@@ -132,6 +132,7 @@ protected:
 		inactive_end_->next_ = inactive_end_ ;
 		inactive_end_->prev_ = inactive_end_ ;
 		size_ = 0 ;
+		capacity_ = 0 ;
 		free_list_ = nil ;
 	}
 
@@ -264,12 +265,13 @@ public:
 			// sanity check: freed memory is set to zero
 			// (enables uninitialized pointers to be detected
 			// by VM).
-			Memory::clear(chunks_[i], sizeof(Node) * chunk_size) ;
+			Memory::clear(chunks_[i], sizeof(Node) * chunk_sizes_[i]) ;
 			delete[] (chunks_[i]) ;
 		}}
 
 		// Step 3: clear the chunks vector.
 		chunks_.clear() ;
+		chunk_sizes_.clear() ;
 
 		init() ;
 	}
@@ -289,7 +291,19 @@ public:
 
 	int size() const     { return size_ ; }
 	int capacity() const { 
-		return chunks_.size() * chunk_size ;
+		return capacity_ ;
+	}
+
+	/**
+	* Makes room for (at least) n elements. The missing
+	* nodes are allocated in a single chunk, and the 
+	* elements subsequently created by create() are 
+	* contiguous in memory.
+	*/
+	void reserve(int n) {
+		if(n > capacity_) {
+			grow(n - capacity_) ;
+		}
 	}
 
 	iterator begin() { return iterator(end_->next_) ; }
@@ -394,15 +408,15 @@ public:
 	}
 
 protected:
-	void grow() {
-		Node* new_chunk = new Node[chunk_size] ;
+	void grow(int nb_nodes = chunk_size) {
+		Node* new_chunk = new Node[nb_nodes] ;
 
 		// sanity check: allocated memory is set to zero
 		// (enables uninitialized pointers to be detected
 		// by VM).
-		Memory::clear(new_chunk, sizeof(Node) * chunk_size) ;
+		Memory::clear(new_chunk, sizeof(Node) * nb_nodes) ;
 
-		Node* last_of_chunk = &(new_chunk[chunk_size - 1]) ;
+		Node* last_of_chunk = &(new_chunk[nb_nodes - 1]) ;
 		for(Node* it = new_chunk; it != last_of_chunk; it++) {
 			it->next_ = it + 1 ;
 			it->prev_ = nil ;
@@ -411,6 +425,8 @@ protected:
 		last_of_chunk->prev_ = nil ;
 		free_list_ = new_chunk ;
 		chunks_.push_back(new_chunk) ;
+		chunk_sizes_.push_back(nb_nodes) ;
+		capacity_ += nb_nodes ;
 	}
 
 
@@ -420,8 +436,10 @@ private:
 	Node inactive_end_node_ ;
 	Node* inactive_end_ ;
 	int size_ ;
+	int capacity_ ;
 	Node* free_list_ ;
 	std::vector<Node*> chunks_ ;
+	std::vector<int> chunk_sizes_ ;
 
 private:
 	// No copy constructor nor operator= (if you really need
@@ -0,0 +1,112 @@
+#include "mapped_file.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef WIN32
+
+MappedFile::MappedFile() 
+: data_(0), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(0) 
+{
+}
+
+bool MappedFile::open(const std::string& file_name) {
+	close() ;
+
+	HANDLE file = CreateFileA(
+		file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, 
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL
+		) ;
+	if (file == INVALID_HANDLE_VALUE)
+		return false ;
+
+	LARGE_INTEGER size ;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file) ;
+		return false ;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) ;
+	if (mapping == NULL) {
+		CloseHandle(file) ;
+		return false ;
+	}
+
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) ;
+	if (data == NULL) {
+		CloseHandle(mapping) ;
+		CloseHandle(file) ;
+		return false ;
+	}
+
+	file_ = file ;
+	mapping_ = mapping ;
+	data_ = static_cast<const char*>(data) ;
+	size_ = static_cast<std::size_t>(size.QuadPart) ;
+	return true ;
+}
+
+void MappedFile::close() {
+	if (data_)
+		UnmapViewOfFile(data_) ;
+	if (mapping_)
+		CloseHandle(mapping_) ;
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_) ;
+	data_ = 0 ;
+	size_ = 0 ;
+	mapping_ = 0 ;
+	file_ = INVALID_HANDLE_VALUE ;
+}
+
+#else
+
+MappedFile::MappedFile() 
+: data_(0), size_(0)
+{
+}
+
+bool MappedFile::open(const std::string& file_name) {
+	close() ;
+
+	int fd = ::open(file_name.c_str(), O_RDONLY) ;
+	if (fd < 0)
+		return false ;
+
+	struct stat st ;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd) ;
+		return false ;
+	}
+
+	void* data = mmap(0, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0) ;
+	::close(fd) ;	// the mapping keeps the file open
+	if (data == MAP_FAILED)
+		return false ;
+
+	data_ = static_cast<const char*>(data) ;
+	size_ = static_cast<std::size_t>(st.st_size) ;
+	return true ;
+}
+
+void MappedFile::close() {
+	if (data_)
+		munmap(const_cast<char*>(data_), size_) ;
+	data_ = 0 ;
+	size_ = 0 ;
+}
+
+#endif
+
+
+MappedFile::~MappedFile() {
+	close() ;
+}
@@ -0,0 +1,47 @@
+#ifndef _BASIC_MAPPED_FILE_H_
+#define _BASIC_MAPPED_FILE_H_
+
+#include "basic_common.h"
+#include <string>
+#include <cstddef>
+
+
+/**
+* A read-only memory mapping of a whole file. The content is
+* not read in advance: the pages are loaded by the OS when 
+* they are first accessed, so only the parts of the file that 
+* are actually used cost I/O.
+*/
+
+class BASIC_API MappedFile
+{
+public:
+	MappedFile() ;
+	~MappedFile() ;
+
+	// returns false if the file could not be opened or mapped
+	// (an empty file cannot be mapped).
+	bool open(const std::string& file_name) ;
+	void close() ;
+
+	bool is_open() const { return data_ != 0 ; }
+
+	const char* data() const { return data_ ; }
+	std::size_t size() const { return size_ ; }
+
+private:
+	const char*	data_ ;
+	std::size_t	size_ ;
+
+#ifdef WIN32
+	void*	file_ ;
+	void*	mapping_ ;
+#endif
+
+private:
+	MappedFile(const MappedFile&) ;
+	MappedFile& operator=(const MappedFile&) ;
+} ;
+
+
+#endif
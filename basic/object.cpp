@@ -1,9 +1,10 @@
 #include "object.h"
 #include "canvas.h"
 #include "logger.h"
+#include "basic_types.h"
 
 
-Object::Object() {}
+Object::Object() : canvas_(nil) {}
 
 
 Object::~Object() {}
@@ -24,13 +24,26 @@ void RAT::delete_record_id(RecordId record) {
 }
 
 
-void RAT::grow() {
-	RawAttributeStore::grow() ;
-	unsigned int chunk = nb_chunks() - 1 ;
-	for(unsigned int i=0; i<CHUNK_SIZE-1; i++) {
-		cell(chunk,i)=RecordId(chunk,i+1,true) ;
+void RAT::grow(unsigned int nb_new_chunks) {
+	if(nb_new_chunks == 0) {
+		return ;
 	}
-	cell(chunk,CHUNK_SIZE-1) = free_list_ ;
-	free_list_ = RecordId(chunk,0) ;
+	unsigned int first = nb_chunks() ;
+	RawAttributeStore::grow(nb_new_chunks) ;
+	unsigned int last = nb_chunks() - 1 ;
+	for(unsigned int chunk=first; chunk<=last; chunk++) {
+		for(unsigned int i=0; i<CHUNK_SIZE-1; i++) {
+			cell(chunk,i)=RecordId(chunk,i+1,true) ;
+		}
+		if(chunk < last) {
+			cell(chunk,CHUNK_SIZE-1) = RecordId(chunk+1,0,true) ;
+		}
+	}
+	// the new chunks are inserted at the beginning of the free list
+	// (which may not be empty if grow() is called by reserve())
+	RecordId next = free_list_ ;
+	next.free() ;
+	cell(last,CHUNK_SIZE-1) = next ;
+	free_list_ = RecordId(first,0) ;
 }
 
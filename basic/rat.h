@@ -33,10 +33,10 @@ public:
 	void delete_record_id(RecordId record) ;
 
 	/**
-	* adds all the items of the new chunk to 
-	* the free list.
+	* adds all the items of the new chunks to 
+	* the free list (in the order of the chunks).
 	*/
-	virtual void grow() ;
+	virtual void grow(unsigned int nb_new_chunks = 1) ;
 
 protected:
 	RecordId& cell(unsigned int chunk, unsigned int offset) {
@@ -5,32 +5,44 @@
 
 
 void RawAttributeStore::clear() {
+	// Paranoid stuff: reset freed memory to zero
+#ifdef OGF_ATTRIBUTE_CHECK
 	for(
 		std::vector<Memory::pointer>::iterator 
 		it=data_.begin(); it!=data_.end(); it++
 		) {
-			// Paranoid stuff: reset freed memory to zero
-#ifdef OGF_ATTRIBUTE_CHECK
 			Memory::clear(*it, CHUNK_SIZE * item_size_) ;
+	}
 #endif
+	for(
+		std::vector<Memory::pointer>::iterator 
+		it=blocks_.begin(); it!=blocks_.end(); it++
+		) {
 			delete[] *it ;
 	}
 	data_.clear() ;
+	blocks_.clear() ;
 }
 
 RawAttributeStore::~RawAttributeStore() {
 	clear() ;
 }
 
-void RawAttributeStore::grow() {
-	Memory::pointer chunk = new Memory::byte[
-		CHUNK_SIZE * item_size_
+void RawAttributeStore::grow(unsigned int nb_new_chunks) {
+	if(nb_new_chunks == 0) {
+		return ;
+	}
+	Memory::pointer block = new Memory::byte[
+		nb_new_chunks * CHUNK_SIZE * item_size_
 	] ;
 	// Paranoid stuff: initialize allocated memory to zero
 #ifdef OGF_ATTRIBUTE_CHECK
-	Memory::clear(chunk, CHUNK_SIZE * item_size_) ;
+	Memory::clear(block, nb_new_chunks * CHUNK_SIZE * item_size_) ;
 #endif
-	data_.push_back(chunk) ;
+	blocks_.push_back(block) ;
+	for(unsigned int i=0; i<nb_new_chunks; i++) {
+		data_.push_back(block + i * CHUNK_SIZE * item_size_) ;
+	}
 	//        std::cerr << "RawAttributeStore (" << typeid(*this).name() 
 	//                  << ") grow" << std::endl ;
 }
\ No newline at end of file
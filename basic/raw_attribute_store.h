@@ -40,11 +40,16 @@ public:
 		return data(r.record_id().chunk(), r.record_id().offset()) ;
 	}
 
-	virtual void grow() ;
+	/**
+	* allocates nb_new_chunks new chunks. They are allocated
+	* in a single block of memory.
+	*/
+	virtual void grow(unsigned int nb_new_chunks = 1) ;
 
 private:
 	unsigned int item_size_ ;
 	std::vector<Memory::pointer> data_ ;
+	std::vector<Memory::pointer> blocks_ ;
 } ;
 
 
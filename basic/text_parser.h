@@ -0,0 +1,201 @@
+#ifndef _BASIC_TEXT_PARSER_H_
+#define _BASIC_TEXT_PARSER_H_
+
+#include "basic_types.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+
+/**
+* Low level functions to parse numbers from a character buffer
+* (e.g., a file mapped in memory, see MappedFile). Contrary to
+* iostreams and strtod(), they do not need a '\0'-terminated
+* string, do not depend on the locale ('.' is the decimal
+* separator) and do not allocate memory, so they can be called
+* from several threads at the same time.
+*
+* The functions take the current position $p$ (updated) and the
+* end of the buffer. The values can be separated by spaces, tabs
+* or commas. The ends of line are never skipped.
+*/
+
+namespace TextParser {
+
+	inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == ',' ; }
+	inline bool is_digit(char c) { return c >= '0' && c <= '9' ; }
+
+	inline void skip_blanks(const char*& p, const char* end) {
+		while (p < end && is_blank(*p))
+			++p ;
+	}
+
+	// moves $p$ to the beginning of the next line (or to $end$)
+	inline void next_line(const char*& p, const char* end) {
+		const void* eol = std::memchr(p, '\n', end - p) ;
+		p = eol ? static_cast<const char*>(eol) + 1 : end ;
+	}
+
+	// Parses a floating point number (after the blanks). Returns false
+	// (and leaves $p$ unchanged) if there is no number at $p$.
+	inline bool parse_double(const char*& p, const char* end, double& value) {
+		static const double powers_of_ten[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		} ;
+
+		const char* s = p ;
+		skip_blanks(s, end) ;
+		const char* start = s ;
+
+		bool negative = false ;
+		if (s < end && (*s == '-' || *s == '+')) {
+			negative = (*s == '-') ;
+			++s ;
+		}
+
+		Numeric::uint64 mantissa = 0 ;
+		int nb_digits = 0 ;		// significant digits in the mantissa
+		int exponent = 0 ;
+		bool has_digits = false ;
+		for (; s < end && is_digit(*s); ++s) {
+			has_digits = true ;
+			if (nb_digits < 19) {
+				mantissa = mantissa * 10 + (*s - '0') ;
+				if (mantissa != 0)
+					++nb_digits ;
+			}
+			else
+				++exponent ;
+		}
+		if (s < end && *s == '.') {
+			++s ;
+			for (; s < end && is_digit(*s); ++s) {
+				has_digits = true ;
+				if (nb_digits < 19) {
+					mantissa = mantissa * 10 + (*s - '0') ;
+					if (mantissa != 0)
+						++nb_digits ;
+					--exponent ;
+				}
+			}
+		}
+
+		if (!has_digits) {
+			// "inf", "nan", ... are rare: let strtod() handle them
+			char buffer[32] ;
+			std::size_t n = 0 ;
+			for (const char* q = start; q < end && n < sizeof(buffer) - 1 && !is_blank(*q) && *q != '\n'; ++q)
+				buffer[n++] = *q ;
+			buffer[n] = '\0' ;
+			char* stop = nil ;
+			value = std::strtod(buffer, &stop) ;
+			if (stop == buffer)
+				return false ;
+			p = start + (stop - buffer) ;
+			return true ;
+		}
+
+		if (s < end && (*s == 'e' || *s == 'E')) {
+			const char* e = s + 1 ;
+			bool negative_exponent = false ;
+			if (e < end && (*e == '-' || *e == '+')) {
+				negative_exponent = (*e == '-') ;
+				++e ;
+			}
+			if (e < end && is_digit(*e)) {
+				int x = 0 ;
+				for (; e < end && is_digit(*e); ++e) {
+					if (x < 10000)
+						x = x * 10 + (*e - '0') ;
+				}
+				exponent += negative_exponent ? -x : x ;
+				s = e ;
+			}
+		}
+
+		double result = static_cast<double>(mantissa) ;
+		if (mantissa == 0)
+			result = 0.0 ;
+		// exact if the mantissa fits in 53 bits and |exponent| <= 22
+		else if (exponent < 0 && exponent >= -22)
+			result /= powers_of_ten[-exponent] ;
+		else if (exponent > 0 && exponent <= 22)
+			result *= powers_of_ten[exponent] ;
+		else if (exponent != 0)
+			result *= std::pow(10.0, exponent) ;
+
+		value = negative ? -result : result ;
+		p = s ;
+		return true ;
+	}
+
+	inline bool parse_float(const char*& p, const char* end, float& value) {
+		double v ;
+		if (!parse_double(p, end, v))
+			return false ;
+		value = static_cast<float>(v) ;
+		return true ;
+	}
+
+	// Parses an integer (after the blanks). Returns false (and leaves $p$
+	// unchanged) if there is no integer at $p$.
+	inline bool parse_int(const char*& p, const char* end, int& value) {
+		const char* s = p ;
+		skip_blanks(s, end) ;
+		bool negative = false ;
+		if (s < end && (*s == '-' || *s == '+')) {
+			negative = (*s == '-') ;
+			++s ;
+		}
+		if (s == end || !is_digit(*s))
+			return false ;
+		int result = 0 ;
+		for (; s < end && is_digit(*s); ++s)
+			result = result * 10 + (*s - '0') ;
+		value = negative ? -result : result ;
+		p = s ;
+		return true ;
+	}
+
+	// Parses up to $max_count$ floats from the current line. Returns the
+	// number of values read. $p$ is left after the last value read.
+	inline int parse_floats(const char*& p, const char* end, float* values, int max_count) {
+		int count = 0 ;
+		while (count < max_count && parse_float(p, end, values[count]))
+			++count ;
+		return count ;
+	}
+
+	// Splits [data, end) into $nb_chunks$ ranges of about the same size, each
+	// starting at the beginning of a line (so they can be parsed in parallel).
+	// The i-th range is [bounds[i], bounds[i+1]); some ranges may be empty.
+	inline void split_lines(const char* data, const char* end, std::size_t nb_chunks, std::vector<const char*>& bounds) {
+		std::size_t size = end - data ;
+		bounds.assign(nb_chunks + 1, end) ;
+		bounds[0] = data ;
+		for (std::size_t c = 1; c < nb_chunks; ++c) {
+			const char* p = data + size / nb_chunks * c ;
+			if (p < bounds[c - 1])
+				p = bounds[c - 1] ;
+			if (p > data && p[-1] != '\n')
+				next_line(p, end) ;
+			bounds[c] = p ;
+		}
+	}
+
+	// Returns the number of numbers on the line starting at $p$.
+	inline int count_numbers(const char* p, const char* end) {
+		int count = 0 ;
+		double v ;
+		while (parse_double(p, end, v))
+			++count ;
+		return count ;
+	}
+
+}
+
+
+#endif
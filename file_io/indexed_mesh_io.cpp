@@ -0,0 +1,284 @@
+#include "indexed_mesh_io.h"
+#include "map_io.h"
+#include "ply_binary_reader.h"
+#include "../basic/logger.h"
+#include "../basic/file_utils.h"
+#include "../basic/stop_watch.h"
+#include "../geom/indexed_mesh.h"
+#include "../geom/map.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+
+namespace {
+
+	inline bool is_little_endian() {
+		Numeric::uint32 x = 1;
+		return *reinterpret_cast<const char*>(&x) == 1;
+	}
+
+
+	class IndexedMeshLoad : public PlyBinaryReader::VertexConsumer, public PlyBinaryReader::FaceConsumer {
+	public:
+		IndexedMeshLoad(IndexedMesh* mesh) : mesh_(mesh), current_vertex_(0), nb_invalid_faces_(0) { }
+
+		unsigned int nb_invalid_faces() const { return nb_invalid_faces_; }
+
+		virtual bool consume_vertices(const float* xyz, const float* normals, const float* colors, unsigned int n) {
+			if (current_vertex_ + n > mesh_->nb_vertices())
+				return false;
+			std::size_t offset = 3 * std::size_t(current_vertex_);
+			std::memcpy(mesh_->positions() + offset, xyz, 3 * n * sizeof(float));
+			if (normals && mesh_->has_normals())
+				std::memcpy(mesh_->normals() + offset, normals, 3 * n * sizeof(float));
+			if (colors && mesh_->has_colors())
+				std::memcpy(mesh_->colors() + offset, colors, 3 * n * sizeof(float));
+			mesh_->touch();
+			current_vertex_ += n;
+			return true;
+		}
+
+		virtual bool consume_faces(const unsigned int* sizes, const int* indices, unsigned int n) {
+			unsigned int nv = mesh_->nb_vertices();
+			for (unsigned int i = 0; i < n; ++i) {
+				unsigned int size = sizes[i];
+				bool valid = (size >= 3);
+				for (unsigned int j = 0; valid && j < size; ++j)
+					valid = (indices[j] >= 0 && static_cast<unsigned int>(indices[j]) < nv);
+				if (valid)
+					mesh_->add_facet(reinterpret_cast<const unsigned int*>(indices), size);
+				else
+					++nb_invalid_faces_;
+				indices += size;
+			}
+			return true;
+		}
+
+	private:
+		IndexedMesh*	mesh_;
+		unsigned int	current_vertex_;
+		unsigned int	nb_invalid_faces_;
+	};
+
+
+	bool save_ply(const std::string& file_name, const IndexedMesh* mesh) {
+		if (!is_little_endian()) {
+			Logger::err(IndexedMeshIO::title()) << "big-endian machines are not supported" << std::endl;
+			return false;
+		}
+
+		std::ofstream output(file_name.c_str(), std::ios::binary);
+		if (output.fail()) {
+			Logger::err(IndexedMeshIO::title()) << "could not open file\'" << file_name << "\'" << std::endl;
+			return false;
+		}
+
+		unsigned int nv = mesh->nb_vertices();
+		unsigned int nf = mesh->nb_facets();
+		output << "ply" << "\n"
+			<< "format binary_little_endian 1.0" << "\n"
+			<< "element vertex " << nv << "\n"
+			<< "property float x" << "\n"
+			<< "property float y" << "\n"
+			<< "property float z" << "\n";
+		if (mesh->has_normals()) {
+			output << "property float nx" << "\n"
+				<< "property float ny" << "\n"
+				<< "property float nz" << "\n";
+		}
+		if (mesh->has_colors()) {
+			output << "property uchar red" << "\n"
+				<< "property uchar green" << "\n"
+				<< "property uchar blue" << "\n";
+		}
+		output << "element face " << nf << "\n"
+			<< "property list uchar int vertex_indices" << "\n"
+			<< "end_header" << "\n";
+
+		// the vertex records, by blocks
+		const unsigned int block = 65536;
+		unsigned int record_size = 12 + (mesh->has_normals() ? 12 : 0) + (mesh->has_colors() ? 3 : 0);
+		std::vector<char> buffer(std::size_t(block) * record_size);
+		const float* positions = mesh->positions();
+		const float* normals = mesh->normals();
+		const float* colors = mesh->colors();
+		for (unsigned int start = 0; start < nv; start += block) {
+			unsigned int n = ogf_min(block, nv - start);
+			char* q = &buffer[0];
+			for (unsigned int i = start; i < start + n; ++i) {
+				std::memcpy(q, positions + 3 * std::size_t(i), 12);
+				q += 12;
+				if (normals) {
+					std::memcpy(q, normals + 3 * std::size_t(i), 12);
+					q += 12;
+				}
+				if (colors) {
+					for (unsigned int j = 0; j < 3; ++j) {
+						float c = colors[3 * std::size_t(i) + j] * 255.0f;
+						ogf_clamp(c, 0.0f, 255.0f);
+						*q++ = static_cast<char>(static_cast<unsigned char>(c + 0.5f));
+					}
+				}
+			}
+			output.write(&buffer[0], q - &buffer[0]);
+		}
+
+		// the faces: the records have different sizes
+		buffer.clear();
+		for (unsigned int f = 0; f < nf; ++f) {
+			unsigned int size = mesh->facet_size(f);
+			if (size > 255) {
+				Logger::err(IndexedMeshIO::title()) << "facet with more than 255 vertices" << std::endl;
+				return false;
+			}
+			buffer.push_back(static_cast<char>(static_cast<unsigned char>(size)));
+			const char* v = reinterpret_cast<const char*>(mesh->facet_vertices(f));
+			buffer.insert(buffer.end(), v, v + 4 * size);
+			if (buffer.size() > (1 << 20)) {
+				output.write(&buffer[0], buffer.size());
+				buffer.clear();
+			}
+		}
+		if (!buffer.empty())
+			output.write(&buffer[0], buffer.size());
+
+		return !output.fail();
+	}
+
+
+	bool save_obj(const std::string& file_name, const IndexedMesh* mesh) {
+		std::ofstream output(file_name.c_str());
+		if (output.fail()) {
+			Logger::err(IndexedMeshIO::title()) << "could not open file\'" << file_name << "\'" << std::endl;
+			return false;
+		}
+		output.precision(16);
+
+		for (unsigned int v = 0; v < mesh->nb_vertices(); ++v)
+			output << "v " << mesh->point(v) << "\n";
+
+		// Vertex index starts by 1 in obj format.
+		for (unsigned int f = 0; f < mesh->nb_facets(); ++f) {
+			output << "f";
+			const unsigned int* v = mesh->facet_vertices(f);
+			for (unsigned int i = 0; i < mesh->facet_size(f); ++i)
+				output << " " << v[i] + 1;
+			output << "\n";
+		}
+
+		return !output.fail();
+	}
+
+
+	bool save_off(const std::string& file_name, const IndexedMesh* mesh) {
+		std::ofstream output(file_name.c_str());
+		if (output.fail()) {
+			Logger::err(IndexedMeshIO::title()) << "could not open file\'" << file_name << "\'" << std::endl;
+			return false;
+		}
+		output.precision(16);
+
+		// the number of edges is not known without the connectivity (it is ignored by the readers)
+		output << "OFF" << "\n" << mesh->nb_vertices() << " " << mesh->nb_facets() << " " << 0 << "\n";
+		for (unsigned int v = 0; v < mesh->nb_vertices(); ++v)
+			output << mesh->point(v) << "\n";
+
+		// Vertex index starts by 0 in off format.
+		for (unsigned int f = 0; f < mesh->nb_facets(); ++f) {
+			output << mesh->facet_size(f);
+			const unsigned int* v = mesh->facet_vertices(f);
+			for (unsigned int i = 0; i < mesh->facet_size(f); ++i)
+				output << " " << v[i];
+			output << "\n";
+		}
+
+		return !output.fail();
+	}
+
+}
+
+
+IndexedMesh* IndexedMeshIO::read(const std::string& file_name)
+{
+	std::string extension = FileUtils::extension(file_name) ;
+	String::to_lowercase(extension);
+
+	StopWatch w;
+	if (extension == "ply") {
+		PlyBinaryReader reader;
+		if (reader.open(file_name)) {
+			if (reader.nb_faces() == 0) {
+				Logger::err(title()) << "0 facet, maybe a point cloud file" << std::endl ;
+				return nil;
+			}
+
+			Logger::out(title()) << "reading file ..." << std::endl;
+			IndexedMesh* mesh = new IndexedMesh;
+			mesh->set_has_normals(reader.has_normals());
+			mesh->set_has_colors(reader.has_colors());
+			mesh->resize_vertices(reader.nb_vertices());
+			// most meshes are triangle meshes
+			mesh->reserve_facets(reader.nb_faces(), 3 * reader.nb_faces());
+
+			IndexedMeshLoad load(mesh);
+			if (!reader.read(&load, &load)) {
+				Logger::err(title()) << file_name << ": problem occurred while parsing PLY file" << std::endl ;
+				delete mesh;
+				return nil;
+			}
+			if (load.nb_invalid_faces() > 0)
+				Logger::warn(title()) << load.nb_invalid_faces() << " invalid facets ignored" << std::endl;
+
+			Logger::out(title()) << "done. Time=" << w.elapsed() << std::endl;
+			return mesh;
+		}
+	}
+
+	// the other formats: through the halfedge structure
+	Map* map = MapIO::read(file_name);
+	if (!map)
+		return nil;
+
+	IndexedMesh* mesh = new IndexedMesh;
+	mesh->assign(map);
+	delete map;
+	return mesh;
+}
+
+
+bool IndexedMeshIO::save(const std::string& file_name, const IndexedMesh* mesh)
+{
+	if (!mesh) {
+		Logger::err(title()) << "mesh is null" << std::endl;
+		return false;
+	}
+
+	std::string extension = FileUtils::extension(file_name) ;
+	String::to_lowercase(extension);
+
+	bool direct = (extension == "ply" || extension == "obj" || extension == "off");
+	if (!direct) {
+		Map map;
+		mesh->copy_to(&map);
+		return MapIO::save(file_name, &map);
+	}
+
+	StopWatch w;
+	Logger::out(title()) << "saving file ..." << std::endl;
+
+	bool ok = false;
+	if (extension == "ply")
+		ok = save_ply(file_name, mesh);
+	else if (extension == "obj")
+		ok = save_obj(file_name, mesh);
+	else
+		ok = save_off(file_name, mesh);
+
+	if (ok)
+		Logger::out(title()) << "done. Time=" << w.elapsed() << std::endl;
+	else
+		Logger::err(title()) << "saving file failed" << std::endl;
+	return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef _INDEXED_MESH_IO_H_
+#define _INDEXED_MESH_IO_H_
+
+#include "file_io_common.h"
+#include "../basic/basic_types.h"
+
+#include <string>
+
+
+class IndexedMesh;
+
+// Reads/saves an IndexedMesh without building the halfedge structure for
+// the formats that allow it: the binary PLY files supported by PlyBinaryReader
+// (read), PLY (saved binary little endian), OBJ and OFF (saved). The other
+// formats go through a Map (see MapIO).
+
+class FILE_IO_API IndexedMeshIO
+{
+public:
+	static std::string title() { return "IndexedMeshIO"; }
+
+	static IndexedMesh*	read(const std::string& file_name);
+	static bool	save(const std::string& file_name, const IndexedMesh* mesh) ;
+};
+
+
+#endif
@@ -4,9 +4,14 @@
 #include "../basic/logger.h"
 #include "../basic/file_utils.h"
 #include "../basic/line_stream.h"
+#include "../basic/mapped_file.h"
+#include "../basic/text_parser.h"
 #include "../geom/map_builder.h"
 #include "../geom/map_enumerator.h"
 
+#include <sstream>
+#include <omp.h>
+
 
 MapSerializer_obj::MapSerializer_obj() {
 	read_supported_ = true ;
@@ -18,7 +23,15 @@ bool MapSerializer_obj::serialize_read(
 									   ) 
 {
 	current_directory_ = FileUtils::dir_name(file_name) ;
-	bool flag = MapSerializer::serialize_read(file_name, mesh) ;
+	bool flag = false ;
+	MappedFile file ;
+	if(mesh != nil && file.open(file_name)) {
+		MapBuilder builder(mesh) ;
+		flag = read_mapped(file, builder) ;
+	} else {
+		// reports the errors (and handles the empty files, which cannot be mapped)
+		flag = MapSerializer::serialize_read(file_name, mesh) ;
+	}
 	current_directory_ = "" ;
 	return flag;
 }
@@ -94,23 +107,11 @@ bool MapSerializer_obj::do_read(std::istream& input, AbstractMapBuilder& builder
 		} else if(keyword == "mtllib") {
 			std::string mtl_lib_filename ;
 			in >> mtl_lib_filename ;
-			mtl_lib_filename = current_directory_ + "/" + mtl_lib_filename ;
-			std::ifstream mtl_lib_in(mtl_lib_filename.c_str()) ;
-			if(mtl_lib_in) {
-				Logger::out("MapSerializer_obj") << "using material lib: " << mtl_lib_filename << std::endl ;
-				read_mtl_lib(mtl_lib_in) ;
-			} else {
-				Logger::err("MapSerializer_obj") << mtl_lib_filename << ": no such file" << std::endl ;
-			}
+			load_mtl_lib(mtl_lib_filename) ;
 		} else if(keyword == "usemtl") {
 			std::string material ;
 			in >> material ;
-			MaterialLib::iterator it = material_lib_.find(material) ;
-			if(it == material_lib_.end()) {
-				current_material_ = Color(0.7f, 0.7f, 0.7f, 1.0f) ;
-			} else {
-				current_material_ = it->second ;
-			}
+			use_material(material) ;
 			if(!color_.is_bound() && concrete_builder != nil) {
 				color_.bind(concrete_builder->target(), "color") ;
 			}
@@ -123,6 +124,271 @@ bool MapSerializer_obj::do_read(std::istream& input, AbstractMapBuilder& builder
 	return true ;
 }
 
+void MapSerializer_obj::load_mtl_lib(const std::string& file_name) {
+	std::string mtl_lib_filename = current_directory_ + "/" + file_name ;
+	std::ifstream mtl_lib_in(mtl_lib_filename.c_str()) ;
+	if(mtl_lib_in) {
+		Logger::out("MapSerializer_obj") << "using material lib: " << mtl_lib_filename << std::endl ;
+		read_mtl_lib(mtl_lib_in) ;
+	} else {
+		Logger::err("MapSerializer_obj") << mtl_lib_filename << ": no such file" << std::endl ;
+	}
+}
+
+void MapSerializer_obj::use_material(const std::string& name) {
+	MaterialLib::iterator it = material_lib_.find(name) ;
+	if(it == material_lib_.end()) {
+		current_material_ = Color(0.7f, 0.7f, 0.7f, 1.0f) ;
+	} else {
+		current_material_ = it->second ;
+	}
+}
+
+//_________________________________________________________
+
+namespace {
+
+	enum ObjRecord { OBJ_OTHER, OBJ_VERTEX, OBJ_TEX_VERTEX, OBJ_FACET, OBJ_COMMAND } ;
+
+	// Reads the keyword at the beginning of the line, and leaves $p$ after it.
+	ObjRecord read_keyword(const char*& p, const char* end) {
+		TextParser::skip_blanks(p, end) ;
+		const char* keyword = p ;
+		while(p < end && *p != '\n' && *p != ' ' && *p != '\t' && *p != '\r') {
+			++p ;
+		}
+		std::size_t length = p - keyword ;
+		if(length == 1 && keyword[0] == 'v') {
+			return OBJ_VERTEX ;
+		} else if(length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+			return OBJ_TEX_VERTEX ;
+		} else if(length == 1 && keyword[0] == 'f') {
+			return OBJ_FACET ;
+		} else if(
+			(length == 1 && keyword[0] == '#') ||
+			(length == 6 && (std::strncmp(keyword, "mtllib", 6) == 0 || std::strncmp(keyword, "usemtl", 6) == 0))
+		) {
+			return OBJ_COMMAND ;
+		}
+		return OBJ_OTHER ;
+	}
+
+	inline bool starts_index(const char* p, const char* end) {
+		return p < end && (TextParser::is_digit(*p) || *p == '-') ;
+	}
+
+	// Parses a corner of a facet: "v", "v/vt", "v//vn" or "v/vt/vn" (the normal is
+	// ignored). The indices start at 1, negative ones are relative to the number of
+	// (texture) vertices defined so far. $vt$ is -1 if there is no texture vertex.
+	bool parse_corner(const char*& p, const char* end, int nb_v, int nb_vt, int& v, int& vt) {
+		int index ;
+		if(!TextParser::parse_int(p, end, index)) {
+			return false ;
+		}
+		v = (index < 0) ? nb_v + index : index - 1 ;
+		vt = -1 ;
+		if(p < end && *p == '/') {
+			++p ;
+			if(starts_index(p, end) && TextParser::parse_int(p, end, index)) {
+				vt = (index < 0) ? nb_vt + index : index - 1 ;
+			}
+			if(p < end && *p == '/') {
+				++p ;
+				if(starts_index(p, end)) {
+					TextParser::parse_int(p, end, index) ;
+				}
+			}
+		}
+		// skip what cannot be parsed (e.g., "1/2/3/4")
+		while(p < end && *p != '\n' && !TextParser::is_blank(*p)) {
+			++p ;
+		}
+		return true ;
+	}
+
+	// The number of records of each type in a range of lines.
+	struct ObjCounts {
+		ObjCounts() : nb_vertices(0), nb_tex_vertices(0), nb_facets(0), nb_corners(0) { }
+		unsigned int nb_vertices ;
+		unsigned int nb_tex_vertices ;
+		unsigned int nb_facets ;
+		unsigned int nb_corners ;	// an upper bound: the number of words on the facet lines
+	} ;
+
+	void count_records(const char* p, const char* end, ObjCounts& counts) {
+		while(p < end) {
+			switch(read_keyword(p, end)) {
+			case OBJ_VERTEX:
+				++counts.nb_vertices ;
+				break ;
+			case OBJ_TEX_VERTEX:
+				++counts.nb_tex_vertices ;
+				break ;
+			case OBJ_FACET: {
+				++counts.nb_facets ;
+				bool in_word = false ;
+				for(; p < end && *p != '\n'; ++p) {
+					bool blank = TextParser::is_blank(*p) ;
+					if(!blank && !in_word) {
+						++counts.nb_corners ;
+					}
+					in_word = !blank ;
+				}
+				break ;
+			}
+			default:
+				break ;
+			}
+			TextParser::next_line(p, end) ;
+		}
+	}
+
+}
+
+
+bool MapSerializer_obj::read_mapped(const MappedFile& file, MapBuilder& builder) {
+	const char* data = file.data() ;
+	const char* end = data + file.size() ;
+
+	const std::size_t min_chunk_size = 1 << 20 ;
+	std::size_t nb_chunks = ogf_min<std::size_t>(file.size() / min_chunk_size + 1, omp_get_max_threads() * 8) ;
+	std::vector<const char*> bounds ;
+	TextParser::split_lines(data, end, nb_chunks, bounds) ;
+	int num_chunks = static_cast<int>(nb_chunks) ;
+
+	// pass 1: the number of records of each chunk, to know where to store them
+	std::vector<ObjCounts> offsets(nb_chunks + 1) ;
+#pragma omp parallel for
+	for(int c = 0; c < num_chunks; ++c) {
+		count_records(bounds[c], bounds[c + 1], offsets[c + 1]) ;
+	}
+	for(std::size_t c = 0; c < nb_chunks; ++c) {
+		offsets[c + 1].nb_vertices += offsets[c].nb_vertices ;
+		offsets[c + 1].nb_tex_vertices += offsets[c].nb_tex_vertices ;
+		offsets[c + 1].nb_facets += offsets[c].nb_facets ;
+		offsets[c + 1].nb_corners += offsets[c].nb_corners ;
+	}
+	const ObjCounts& total = offsets[nb_chunks] ;
+
+	// pass 2: each chunk is parsed into its own range of the arrays
+	std::vector<double> points(3 * std::size_t(total.nb_vertices), 0.0) ;
+	std::vector<double> tex_coords(2 * std::size_t(total.nb_tex_vertices), 0.0) ;
+	std::vector<unsigned int> facet_begin(total.nb_facets) ;
+	std::vector<unsigned int> facet_size(total.nb_facets) ;
+	std::vector<int> corner_vertex(total.nb_corners) ;
+	std::vector<int> corner_tex_vertex(total.nb_corners) ;
+	// the "mtllib", "usemtl" and "# anchor" lines, with the index of the next facet
+	typedef std::vector< std::pair<unsigned int, const char*> > Commands ;
+	std::vector<Commands> commands(nb_chunks) ;
+#pragma omp parallel for schedule(dynamic)
+	for(int c = 0; c < num_chunks; ++c) {
+		const char* p = bounds[c] ;
+		const char* e = bounds[c + 1] ;
+		unsigned int v = offsets[c].nb_vertices ;
+		unsigned int vt = offsets[c].nb_tex_vertices ;
+		unsigned int f = offsets[c].nb_facets ;
+		unsigned int corner = offsets[c].nb_corners ;
+		while(p < e) {
+			const char* line = p ;
+			switch(read_keyword(p, e)) {
+			case OBJ_VERTEX:
+				for(int k = 0; k < 3 && TextParser::parse_double(p, e, points[3 * v + k]); ++k) { }
+				++v ;
+				break ;
+			case OBJ_TEX_VERTEX:
+				for(int k = 0; k < 2 && TextParser::parse_double(p, e, tex_coords[2 * vt + k]); ++k) { }
+				++vt ;
+				break ;
+			case OBJ_FACET: {
+				facet_begin[f] = corner ;
+				int i, ti ;
+				while(parse_corner(p, e, int(v), int(vt), i, ti)) {
+					corner_vertex[corner] = i ;
+					corner_tex_vertex[corner] = ti ;
+					++corner ;
+				}
+				facet_size[f] = corner - facet_begin[f] ;
+				++f ;
+				break ;
+			}
+			case OBJ_COMMAND:
+				commands[c].push_back(std::make_pair(f, line)) ;
+				break ;
+			default:
+				break ;
+			}
+			TextParser::next_line(p, e) ;
+		}
+	}
+
+	// the builder is fed sequentially
+	MapFacetAttribute<Color> color ;
+	builder.begin_surface() ;
+	builder.reserve_vertices(total.nb_vertices) ;
+	builder.reserve_facets(total.nb_facets) ;
+	for(unsigned int i = 0; i < total.nb_vertices; ++i) {
+		builder.add_vertex(vec3(points[3 * i], points[3 * i + 1], points[3 * i + 2])) ;
+	}
+	for(unsigned int i = 0; i < total.nb_tex_vertices; ++i) {
+		builder.add_tex_vertex(vec2(tex_coords[2 * i], tex_coords[2 * i + 1])) ;
+	}
+	std::vector<double>().swap(points) ;
+	std::vector<double>().swap(tex_coords) ;
+
+	Commands all_commands ;
+	for(std::size_t c = 0; c < nb_chunks; ++c) {
+		all_commands.insert(all_commands.end(), commands[c].begin(), commands[c].end()) ;
+	}
+
+	std::size_t command = 0 ;
+	for(unsigned int f = 0; f <= total.nb_facets; ++f) {
+		// the commands before the facet
+		for(; command < all_commands.size() && all_commands[command].first <= f; ++command) {
+			const char* line = all_commands[command].second ;
+			const char* eol = line ;
+			TextParser::next_line(eol, end) ;
+			std::istringstream in(std::string(line, eol)) ;
+			std::string keyword, word ;
+			in >> keyword >> word ;
+			if(keyword == "mtllib") {
+				load_mtl_lib(word) ;
+			} else if(keyword == "usemtl") {
+				use_material(word) ;
+				if(!color.is_bound()) {
+					color.bind(builder.target(), "color") ;
+				}
+			} else if(word == "anchor") {
+				int index ;
+				if(in >> index) {
+					builder.lock_vertex(index - 1) ;
+				}
+			}
+		}
+		if(f == total.nb_facets) {
+			break ;
+		}
+
+		builder.begin_facet() ;
+		for(unsigned int k = facet_begin[f]; k < facet_begin[f] + facet_size[f]; ++k) {
+			builder.add_vertex_to_facet(corner_vertex[k]) ;
+			if(corner_tex_vertex[k] >= 0) {
+				builder.set_corner_tex_vertex(corner_tex_vertex[k]) ;
+			}
+		}
+		builder.end_facet() ;
+		if(color.is_bound()) {
+			color[builder.current_facet()] = current_material_ ;
+		}
+	}
+
+	builder.end_surface() ;
+	if(color.is_bound()) {
+		color.unbind() ;
+	}
+	material_lib_.clear() ;
+	return true ;
+}
+
 bool MapSerializer_obj::do_write(std::ostream& out, const Map* mesh) const {
 	// Obj files numbering starts with 1
 	Attribute<Vertex, int>	vertex_id(mesh->vertex_attribute_manager());
@@ -181,6 +447,10 @@ bool MapSerializer_obj::do_write(std::ostream& out, const Map* mesh) const {
 MapSerializer_eobj::MapSerializer_eobj() : MapSerializer_obj() {
 }
 
+bool MapSerializer_eobj::serialize_read(const std::string& file_name, Map* mesh) {
+	return MapSerializer::serialize_read(file_name, mesh) ;
+}
+
 static Map::Halfedge* find_halfedge_between(Map::Vertex* v1, Map::Vertex* v2) {
 	Map::Halfedge* h = v2->halfedge() ;
 	do {
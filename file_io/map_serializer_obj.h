@@ -7,6 +7,9 @@
 #include "../image/color.h"
 
 
+class MappedFile ;
+class MapBuilder ;
+
 class FILE_IO_API MapSerializer_obj : public MapSerializer 
 {
 public:
@@ -21,6 +24,15 @@ protected:
 	virtual bool do_write(std::ostream& output, const Map* mesh) const; 
 	void read_mtl_lib(std::istream& input) ;
 
+	// The fast path of serialize_read(): the file is mapped in memory, its
+	// records are counted and parsed in parallel, then given to the builder
+	// (all the vertices first, then the facets in the order of the file).
+	bool read_mapped(const MappedFile& file, MapBuilder& builder) ;
+
+	// "mtllib" and "usemtl"
+	void load_mtl_lib(const std::string& file_name) ;
+	void use_material(const std::string& name) ;
+
 protected:
 	std::string	current_directory_ ;
 
@@ -41,6 +53,9 @@ class FILE_IO_API MapSerializer_eobj : public MapSerializer_obj {
 public:
 	MapSerializer_eobj() ;
 
+	// reads the file as a stream (see do_read())
+	virtual bool serialize_read(const std::string& file_name, Map* mesh) ;
+
 	virtual bool do_read(std::istream& input, AbstractMapBuilder& builder) ;        
 	virtual bool do_write(std::ostream& output, const Map* mesh) const; 
 
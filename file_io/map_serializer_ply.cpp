@@ -1,6 +1,7 @@
 
 #include "map_serializer_ply.h"
 #include "rply.h"
+#include "ply_binary_reader.h"
 #include "../geom/map_builder.h"
 #include "../basic/logger.h"
 #include "../geom/map_enumerator.h"
@@ -8,10 +9,31 @@
 
 //_________________________________________________________
 
-class PlyMeshLoad {
+// The common binary files are read by PlyBinaryReader, rply is used for the others.
+class PlyMeshLoad : public PlyBinaryReader::VertexConsumer, public PlyBinaryReader::FaceConsumer {
 public:
 	PlyMeshLoad(AbstractMapBuilder& builder) : builder_(builder) { } 
 	bool load(const std::string& filename) {
+		PlyBinaryReader reader ;
+		if (reader.open(filename)) {
+			if (reader.nb_faces() == 0) {
+				Logger::err("PlyMeshLoad") 
+					<< "0 facet, maybe a point cloud file" << std::endl ;
+				return false ;
+			}
+
+			current_vertex_ = 0 ;
+			builder_.begin_surface() ;
+			builder_.create_vertices(reader.nb_vertices(), reader.has_colors()) ;
+			bool ok = reader.read(this, this) ;
+			if (!ok) {
+				Logger::err("PlyMeshLoad") 
+					<< filename << ": problem occurred while parsing PLY file" << std::endl ;
+			}
+			builder_.end_surface() ;
+			return ok ;
+		}
+
 		p_ply ply = ply_open(filename.c_str(), nil, 0, nil) ;
 
 		if(ply == nil) {
@@ -64,6 +86,25 @@ public:
 	}
 
 protected:
+	virtual bool consume_vertices(const float* xyz, const float* normals, const float* colors, unsigned int n) {
+		for (unsigned int i = 0; i < n; ++i, ++current_vertex_) {
+			builder_.set_vertex(current_vertex_, vec3(xyz + 3 * i)) ;
+			if (colors)
+				builder_.set_vertex_color(current_vertex_, Color(colors + 3 * i)) ;
+		}
+		return true ;
+	}
+
+	virtual bool consume_faces(const unsigned int* sizes, const int* indices, unsigned int n) {
+		for (unsigned int i = 0; i < n; ++i) {
+			builder_.begin_facet() ;
+			for (unsigned int j = 0; j < sizes[i]; ++j)
+				builder_.add_vertex_to_facet(*indices++) ;
+			builder_.end_facet() ;
+		}
+		return true ;
+	}
+
 	void check_for_colors(p_ply ply) {
 		p_ply_element element = nil ;
 
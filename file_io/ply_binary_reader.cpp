@@ -0,0 +1,549 @@
+#include "ply_binary_reader.h"
+#include "../basic/logger.h"
+#include "../basic/basic_types.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+	enum PlyType { T_INT8, T_UINT8, T_INT16, T_UINT16, T_INT32, T_UINT32, T_FLOAT32, T_FLOAT64 };
+
+	const unsigned int type_sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+	int type_from_name(const std::string& name) {
+		if (name == "char"   || name == "int8")		return T_INT8;
+		if (name == "uchar"  || name == "uint8")	return T_UINT8;
+		if (name == "short"  || name == "int16")	return T_INT16;
+		if (name == "ushort" || name == "uint16")	return T_UINT16;
+		if (name == "int"    || name == "int32")	return T_INT32;
+		if (name == "uint"   || name == "uint32")	return T_UINT32;
+		if (name == "float"  || name == "float32")	return T_FLOAT32;
+		if (name == "double" || name == "float64")	return T_FLOAT64;
+		return -1;
+	}
+
+	inline bool is_integer(int type) { return type >= T_INT8 && type <= T_UINT32; }
+
+	inline bool is_little_endian() {
+		Numeric::uint32 x = 1;
+		return *reinterpret_cast<const char*>(&x) == 1;
+	}
+
+	template <class T> inline T load(const char* p, bool swap) {
+		T v;
+		if (swap) {
+			char bytes[sizeof(T)];
+			for (std::size_t k = 0; k < sizeof(T); ++k)
+				bytes[k] = p[sizeof(T) - 1 - k];
+			std::memcpy(&v, bytes, sizeof(T));
+		}
+		else
+			std::memcpy(&v, p, sizeof(T));
+		return v;
+	}
+
+	inline double value(const char* p, int type, bool swap) {
+		switch (type) {
+		case T_INT8:	return *reinterpret_cast<const signed char*>(p);
+		case T_UINT8:	return *reinterpret_cast<const Numeric::uint8*>(p);
+		case T_INT16:	return load<Numeric::int16>(p, swap);
+		case T_UINT16:	return load<Numeric::uint16>(p, swap);
+		case T_INT32:	return load<Numeric::int32>(p, swap);
+		case T_UINT32:	return load<Numeric::uint32>(p, swap);
+		case T_FLOAT32:	return load<Numeric::float32>(p, swap);
+		case T_FLOAT64:	return load<Numeric::float64>(p, swap);
+		}
+		return 0.0;
+	}
+
+}
+
+
+// Reads a stream by large blocks and gives access to the next bytes.
+class PlyBlockReader
+{
+public:
+	PlyBlockReader(std::istream& in) : in_(in), buffer_(1 << 20), begin_(0), end_(0), unread_(0) {
+		std::streamoff pos = in_.tellg();
+		in_.seekg(0, std::ios::end);
+		std::streamoff end = in_.tellg();
+		in_.seekg(pos);
+		if (pos >= 0 && end > pos)
+			unread_ = static_cast<std::size_t>(end - pos);
+	}
+
+	// The number of bytes left in the stream
+	std::size_t remaining() const { return end_ - begin_ + unread_; }
+
+	// Returns the next $n$ bytes (valid until the next call), or nil if
+	// the end of the stream is reached before.
+	const char* get(std::size_t n) {
+		if (end_ - begin_ < n && !fill(n))
+			return nil;
+		const char* result = &buffer_[0] + begin_;
+		begin_ += n;
+		return result;
+	}
+
+private:
+	bool fill(std::size_t n) {
+		std::size_t remaining = end_ - begin_;
+		if (remaining > 0 && begin_ > 0)
+			std::memmove(&buffer_[0], &buffer_[begin_], remaining);
+		begin_ = 0;
+		end_ = remaining;
+		if (buffer_.size() < n)
+			buffer_.resize(n);
+		while (end_ < n) {
+			in_.read(&buffer_[end_], static_cast<std::streamsize>(buffer_.size() - end_));
+			std::size_t count = static_cast<std::size_t>(in_.gcount());
+			if (count == 0)
+				break;
+			end_ += count;
+			unread_ -= std::min(unread_, count);
+		}
+		return end_ >= n;
+	}
+
+private:
+	std::istream&		in_;
+	std::vector<char>	buffer_;
+	std::size_t			begin_;
+	std::size_t			end_;
+	std::size_t			unread_;	// in the stream, after the buffer
+};
+
+
+PlyBinaryReader::PlyBinaryReader()
+: data_offset_(0)
+, swap_bytes_(false)
+, nb_vertices_(0)
+, nb_faces_(0)
+, vertex_size_(0)
+, has_normals_(false)
+, has_colors_(false)
+, color_mult_(1.0f)
+, face_indices_(-1)
+, stream_(nil)
+, block_reader_(nil)
+, vertices_left_(0)
+{
+}
+
+
+PlyBinaryReader::~PlyBinaryReader() {
+	delete block_reader_;
+	delete stream_;
+}
+
+
+bool PlyBinaryReader::open(const std::string& file_name) {
+	delete block_reader_;
+	delete stream_;
+	block_reader_ = nil;
+	stream_ = nil;
+	vertices_left_ = 0;
+
+	file_name_ = file_name;
+	elements_.clear();
+	nb_vertices_ = nb_faces_ = 0;
+	vertex_size_ = 0;
+	has_normals_ = has_colors_ = false;
+	color_mult_ = 1.0f;
+	face_indices_ = -1;
+	for (int k = 0; k < 9; ++k) {
+		fields_[k].offset = 0;
+		fields_[k].type = T_FLOAT32;
+	}
+
+	std::ifstream in(file_name.c_str(), std::fstream::binary);
+	if (in.fail())
+		return false;
+
+	std::string line;
+	if (!std::getline(in, line) || line.compare(0, 3, "ply") != 0)
+		return false;
+
+	bool binary = false;
+	bool end_header = false;
+	while (!end_header && std::getline(in, line)) {
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+		if (keyword == "format") {
+			std::string format;
+			tokens >> format;
+			if (format == "binary_little_endian")
+				swap_bytes_ = !is_little_endian();
+			else if (format == "binary_big_endian")
+				swap_bytes_ = is_little_endian();
+			else
+				return false;	// ASCII
+			binary = true;
+		}
+		else if (keyword == "element") {
+			Element e;
+			tokens >> e.name >> e.count;
+			if (tokens.fail())
+				return false;
+			e.record_size = 0;
+			elements_.push_back(e);
+		}
+		else if (keyword == "property") {
+			if (elements_.empty())
+				return false;
+			Property p;
+			std::string type;
+			tokens >> type;
+			if (type == "list") {
+				std::string count_type, value_type;
+				tokens >> count_type >> value_type >> p.name;
+				p.count_type = type_from_name(count_type);
+				p.type = type_from_name(value_type);
+				if (!is_integer(p.count_type) || p.type < 0)
+					return false;
+			}
+			else {
+				tokens >> p.name;
+				p.type = type_from_name(type);
+				p.count_type = -1;
+				if (p.type < 0)
+					return false;
+			}
+			if (tokens.fail())
+				return false;
+			elements_.back().properties.push_back(p);
+		}
+		else if (keyword == "end_header")
+			end_header = true;
+		// "comment" and "obj_info" are ignored
+	}
+	if (!binary || !end_header)
+		return false;
+	data_offset_ = static_cast<std::size_t>(in.tellg());
+
+	for (std::size_t i = 0; i < elements_.size(); ++i) {
+		Element& e = elements_[i];
+		for (std::size_t j = 0; j < e.properties.size(); ++j) {
+			const Property& p = e.properties[j];
+			if (p.count_type >= 0) {
+				e.record_size = 0;
+				break;
+			}
+			e.record_size += type_sizes[p.type];
+		}
+
+		if (e.name == "tristrips")
+			return false;
+		else if (e.name == "vertex") {
+			if (e.record_size == 0)
+				return false;
+
+			// the properties of each of the 9 values, by order of preference
+			static const char* names[9][3] = {
+				{ "x", nil, nil }, { "y", nil, nil }, { "z", nil, nil },
+				{ "nx", "vsfm_cnx", nil }, { "ny", "vsfm_cny", nil }, { "nz", "vsfm_cnz", nil },
+				{ "r", "red", "diffuse_red" }, { "g", "green", "diffuse_green" }, { "b", "blue", "diffuse_blue" }
+			};
+			int found[9][3];
+			VertexField fields[9][3];
+			for (int k = 0; k < 9; ++k) {
+				for (int n = 0; n < 3; ++n)
+					found[k][n] = 0;
+			}
+			unsigned int offset = 0;
+			for (std::size_t j = 0; j < e.properties.size(); ++j) {
+				const Property& p = e.properties[j];
+				for (int k = 0; k < 9; ++k) {
+					for (int n = 0; n < 3; ++n) {
+						if (names[k][n] && p.name == names[k][n]) {
+							found[k][n] = 1;
+							fields[k][n].offset = offset;
+							fields[k][n].type = p.type;
+						}
+					}
+				}
+				offset += type_sizes[p.type];
+			}
+
+			if (!found[0][0] || !found[1][0] || !found[2][0])
+				return false;
+			for (int k = 0; k < 3; ++k)
+				fields_[k] = fields[k][0];
+
+			for (int n = 0; n < 2 && !has_normals_; ++n) {
+				if (found[3][n] && found[4][n] && found[5][n]) {
+					has_normals_ = true;
+					for (int k = 3; k < 6; ++k)
+						fields_[k] = fields[k][n];
+				}
+			}
+			for (int n = 0; n < 3 && !has_colors_; ++n) {
+				if (found[6][n] && found[7][n] && found[8][n]) {
+					has_colors_ = true;
+					color_mult_ = (n == 0) ? 1.0f : 1.0f / 255.0f;
+					for (int k = 6; k < 9; ++k)
+						fields_[k] = fields[k][n];
+				}
+			}
+			nb_vertices_ = e.count;
+			vertex_size_ = e.record_size;
+		}
+		else if (e.name == "face") {
+			for (std::size_t j = 0; j < e.properties.size(); ++j) {
+				const Property& p = e.properties[j];
+				if (p.count_type >= 0 && (p.name == "vertex_indices" || p.name == "vertex_index")) {
+					face_indices_ = static_cast<int>(j);
+					break;
+				}
+			}
+			if (face_indices_ < 0 || !is_integer(e.properties[face_indices_].type))
+				return false;
+			nb_faces_ = e.count;
+		}
+	}
+
+	return nb_vertices_ > 0;
+}
+
+
+bool PlyBinaryReader::read(VertexConsumer* vertices, FaceConsumer* faces, unsigned int chunk_size) {
+	std::ifstream input(file_name_.c_str(), std::fstream::binary);
+	if (input.fail()) {
+		Logger::err(title()) << "could not open file\'" << file_name_ << "\'" << std::endl;
+		return false;
+	}
+	input.seekg(static_cast<std::streamoff>(data_offset_));
+	if (chunk_size == 0)
+		chunk_size = DEFAULT_CHUNK_SIZE;
+
+	// no need to go further than the last element to be read
+	std::size_t last = 0;
+	for (std::size_t i = 0; i < elements_.size(); ++i) {
+		if ((vertices && elements_[i].name == "vertex") || (faces && elements_[i].name == "face"))
+			last = i + 1;
+	}
+
+	PlyBlockReader in(input);
+	for (std::size_t i = 0; i < last; ++i) {
+		const Element& e = elements_[i];
+		bool ok = false;
+		if (vertices && e.name == "vertex")
+			ok = read_vertices(in, e, vertices, chunk_size);
+		else if (faces && e.name == "face")
+			ok = read_faces(in, e, faces, chunk_size);
+		else
+			ok = skip_element(in, e);
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+
+void PlyBinaryReader::decode_vertices(const char* records, unsigned int n, float* xyz, float* normals, float* colors) const {
+	float* arrays[3] = { xyz, has_normals_ ? normals : nil, has_colors_ ? colors : nil };
+	std::size_t record_size = vertex_size_;
+	for (int g = 0; g < 3; ++g) {
+		float* a = arrays[g];
+		if (a == nil)
+			continue;
+		const VertexField* f = fields_ + 3 * g;
+		const char* r = records;
+		// the 3 values can be copied as is if they are consecutive native floats
+		bool copy = !swap_bytes_ &&
+			f[0].type == T_FLOAT32 && f[1].type == T_FLOAT32 && f[2].type == T_FLOAT32 &&
+			f[1].offset == f[0].offset + 4 && f[2].offset == f[0].offset + 8;
+		if (copy) {
+			for (unsigned int i = 0; i < n; ++i, r += record_size, a += 3)
+				std::memcpy(a, r + f[0].offset, 3 * sizeof(float));
+		}
+		else {
+			for (unsigned int i = 0; i < n; ++i, r += record_size, a += 3) {
+				for (int k = 0; k < 3; ++k)
+					a[k] = static_cast<float>(value(r + f[k].offset, f[k].type, swap_bytes_));
+			}
+		}
+	}
+
+	if (arrays[2] && color_mult_ != 1.0f) {
+		for (unsigned int i = 0; i < 3 * n; ++i)
+			colors[i] *= color_mult_;
+	}
+}
+
+
+bool PlyBinaryReader::read_vertices(PlyBlockReader& in, const Element& e, VertexConsumer* consumer, unsigned int chunk_size) {
+	std::vector<float> xyz(3 * chunk_size);
+	std::vector<float> normals(has_normals_ ? 3 * chunk_size : 0);
+	std::vector<float> colors(has_colors_ ? 3 * chunk_size : 0);
+	float* n_ptr = has_normals_ ? &normals[0] : nil;
+	float* c_ptr = has_colors_ ? &colors[0] : nil;
+
+	for (unsigned int start = 0; start < e.count; start += chunk_size) {
+		unsigned int n = std::min(chunk_size, e.count - start);
+		const char* records = in.get(static_cast<std::size_t>(n) * e.record_size);
+		if (records == nil) {
+			Logger::err(title()) << "unexpected end of file" << std::endl;
+			return false;
+		}
+		decode_vertices(records, n, &xyz[0], n_ptr, c_ptr);
+		if (!consumer->consume_vertices(&xyz[0], n_ptr, c_ptr, n))
+			return false;
+	}
+	return true;
+}
+
+
+bool PlyBinaryReader::begin_vertices() {
+	delete block_reader_;
+	delete stream_;
+	block_reader_ = nil;
+	vertices_left_ = 0;
+
+	stream_ = new std::ifstream(file_name_.c_str(), std::fstream::binary);
+	if (stream_->fail()) {
+		Logger::err(title()) << "could not open file\'" << file_name_ << "\'" << std::endl;
+		return false;
+	}
+	stream_->seekg(static_cast<std::streamoff>(data_offset_));
+	block_reader_ = new PlyBlockReader(*stream_);
+
+	for (std::size_t i = 0; i < elements_.size(); ++i) {
+		if (elements_[i].name == "vertex") {
+			vertices_left_ = elements_[i].count;
+			return true;
+		}
+		if (!skip_element(*block_reader_, elements_[i]))
+			return false;
+	}
+	return false;
+}
+
+
+unsigned int PlyBinaryReader::next_vertices(float* xyz, float* normals, float* colors, unsigned int n) {
+	if (block_reader_ == nil || vertices_left_ == 0)
+		return 0;
+
+	std::size_t record_size = vertex_size_;
+	n = std::min(n, vertices_left_);
+	const char* records = block_reader_->get(n * record_size);
+	if (records == nil) {
+		Logger::err(title()) << "unexpected end of file" << std::endl;
+		vertices_left_ = 0;
+		return 0;
+	}
+	decode_vertices(records, n, xyz, normals, colors);
+	vertices_left_ -= n;
+	return n;
+}
+
+
+bool PlyBinaryReader::read_list_size(PlyBlockReader& in, const Element& e, const Property& p, unsigned int i, std::size_t& count) {
+	const char* data = in.get(type_sizes[p.count_type]);
+	if (data == nil) {
+		Logger::err(title()) << "unexpected end of file" << std::endl;
+		return false;
+	}
+	// a corrupted size must not be used to read (or allocate) anything
+	double n = value(data, p.count_type, swap_bytes_);
+	if (n < 0 || n * type_sizes[p.type] > static_cast<double>(in.remaining())) {
+		Logger::err(title()) << "invalid list size " << n << " in " << e.name << " " << i << std::endl;
+		return false;
+	}
+	count = static_cast<std::size_t>(n);
+	return true;
+}
+
+
+bool PlyBinaryReader::read_faces(PlyBlockReader& in, const Element& e, FaceConsumer* consumer, unsigned int chunk_size) {
+	std::vector<unsigned int> sizes;
+	std::vector<int> indices;
+	sizes.reserve(chunk_size);
+	indices.reserve(3 * chunk_size);
+
+	const Property& list = e.properties[face_indices_];
+	bool copy = !swap_bytes_ && (list.type == T_INT32 || list.type == T_UINT32);
+	unsigned int value_size = type_sizes[list.type];
+
+	for (unsigned int i = 0; i < e.count; ++i) {
+		for (std::size_t k = 0; k < e.properties.size(); ++k) {
+			const Property& p = e.properties[k];
+			const char* data = nil;
+			if (p.count_type < 0) {
+				data = in.get(type_sizes[p.type]);
+			}
+			else {
+				std::size_t count = 0;
+				if (!read_list_size(in, e, p, i, count))
+					return false;
+				data = in.get(count * type_sizes[p.type]);
+				// the faces with less than 3 vertices are skipped
+				if (data != nil && static_cast<int>(k) == face_indices_ && count >= 3) {
+					sizes.push_back(static_cast<unsigned int>(count));
+					std::size_t pos = indices.size();
+					indices.resize(pos + count);
+					if (copy && count > 0)
+						std::memcpy(&indices[pos], data, count * sizeof(int));
+					else {
+						for (std::size_t j = 0; j < count; ++j)
+							indices[pos + j] = static_cast<int>(value(data + j * value_size, list.type, swap_bytes_));
+					}
+				}
+			}
+			if (data == nil) {
+				Logger::err(title()) << "unexpected end of file" << std::endl;
+				return false;
+			}
+		}
+
+		if (sizes.size() == chunk_size || (i + 1 == e.count && !sizes.empty())) {
+			if (!consumer->consume_faces(&sizes[0], indices.empty() ? nil : &indices[0], static_cast<unsigned int>(sizes.size())))
+				return false;
+			sizes.clear();
+			indices.clear();
+		}
+	}
+	return true;
+}
+
+
+bool PlyBinaryReader::skip_element(PlyBlockReader& in, const Element& e) {
+	if (e.record_size > 0) {
+		const std::size_t block = 1 << 20;
+		std::size_t size = static_cast<std::size_t>(e.count) * e.record_size;
+		for (std::size_t done = 0; done < size; done += block) {
+			if (in.get(std::min(block, size - done)) == nil) {
+				Logger::err(title()) << "unexpected end of file" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	for (unsigned int i = 0; i < e.count; ++i) {
+		for (std::size_t k = 0; k < e.properties.size(); ++k) {
+			const Property& p = e.properties[k];
+			const char* data = nil;
+			if (p.count_type < 0)
+				data = in.get(type_sizes[p.type]);
+			else {
+				std::size_t count = 0;
+				if (!read_list_size(in, e, p, i, count))
+					return false;
+				data = in.get(count * type_sizes[p.type]);
+			}
+			if (data == nil) {
+				Logger::err(title()) << "unexpected end of file" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
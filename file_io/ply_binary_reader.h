@@ -0,0 +1,133 @@
+#ifndef _PLY_BINARY_READER_H_
+#define _PLY_BINARY_READER_H_
+
+#include "file_io_common.h"
+#include "../basic/basic_types.h"
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+
+/***********************************************************************
+ A reader for the common binary PLY files (point clouds and polygonal
+ meshes). rply calls a function per scalar value; this reader instead
+ reads the data by large blocks and decodes whole vertex records at once
+ (plain copies when the values are little-endian floats), then passes
+ them to the consumers chunk by chunk. The memory needed does not depend
+ on the size of the file.
+
+ open() accepts the binary (little or big endian) files with:
+   - a "vertex" element made of scalar properties only, with x, y, z and
+     optionally nx, ny, nz (or vsfm_cnx, vsfm_cny, vsfm_cnz) and
+     r, g, b (or red, green, blue, or diffuse_red, ...);
+   - optionally a "face" element with a "vertex_indices" (or "vertex_index")
+     list of integers. Its other properties are skipped, and so are the
+     other elements (except "tristrips").
+ The other files (ASCII, tristrips, ...) are rejected and must be read
+ with rply.
+************************************************************************/
+
+
+class PlyBlockReader;
+
+class FILE_IO_API PlyBinaryReader
+{
+public:
+	static std::string title() { return "[PlyBinaryReader]: "; }
+
+	enum { DEFAULT_CHUNK_SIZE = 65536 };
+
+	class VertexConsumer {
+	public:
+		virtual ~VertexConsumer() {}
+		// $n$ vertices, 3 floats per vertex in each array. $normals$ and $colors$
+		// are nil if the file has none. The colors are in [0, 1].
+		// Returns false to stop reading.
+		virtual bool consume_vertices(const float* xyz, const float* normals, const float* colors, unsigned int n) = 0;
+	};
+
+	class FaceConsumer {
+	public:
+		virtual ~FaceConsumer() {}
+		// $n$ faces: the i-th face has $sizes[i]$ vertices, the vertex indices of
+		// all the faces follow each other in $indices$.
+		// Returns false to stop reading.
+		virtual bool consume_faces(const unsigned int* sizes, const int* indices, unsigned int n) = 0;
+	};
+
+public:
+	PlyBinaryReader() ;
+	~PlyBinaryReader() ;
+
+	// Reads the header. Returns false if the file cannot be read or if it
+	// is not a binary PLY file this reader supports (see above).
+	bool open(const std::string& file_name) ;
+
+	unsigned int nb_vertices() const { return nb_vertices_ ; }
+	unsigned int nb_faces() const	 { return nb_faces_ ; }
+	bool has_normals() const { return has_normals_ ; }
+	bool has_colors() const	 { return has_colors_ ; }
+
+	// Reads the data, sending the vertices (resp. faces) to $vertices$ (resp.
+	// $faces$) by chunks of at most $chunk_size$ elements. Any consumer can be
+	// nil, in which case the corresponding data are skipped.
+	bool read(VertexConsumer* vertices, FaceConsumer* faces = nil, unsigned int chunk_size = DEFAULT_CHUNK_SIZE) ;
+
+	// Reads the vertices on demand instead of sending them to a consumer: 
+	// begin_vertices() moves to the first vertex, then each call to 
+	// next_vertices() decodes up to $n$ vertices into the arrays (3 floats 
+	// per vertex, $normals$ and $colors$ can be nil) and returns the number
+	// of vertices read, 0 at the end (or on error).
+	bool begin_vertices() ;
+	unsigned int next_vertices(float* xyz, float* normals, float* colors, unsigned int n) ;
+
+private:
+	struct Property {
+		std::string name ;
+		int		type ;			// the type of the values
+		int		count_type ;	// the type of the number of values for a list, -1 for a scalar
+	} ;
+
+	struct Element {
+		std::string name ;
+		unsigned int count ;
+		std::vector<Property> properties ;
+		unsigned int record_size ;	// 0 if the element has lists
+	} ;
+
+	// where (in a vertex record) and how the 9 values are stored (x, y, z, nx, ...)
+	struct VertexField {
+		unsigned int offset ;
+		int type ;
+	} ;
+
+	void decode_vertices(const char* records, unsigned int n, float* xyz, float* normals, float* colors) const ;
+	bool read_vertices(PlyBlockReader& in, const Element& e, VertexConsumer* consumer, unsigned int chunk_size) ;
+	// Reads the size of the list $p$ of the $i$-th element $e$ (false if invalid)
+	bool read_list_size(PlyBlockReader& in, const Element& e, const Property& p, unsigned int i, std::size_t& count) ;
+	bool read_faces(PlyBlockReader& in, const Element& e, FaceConsumer* consumer, unsigned int chunk_size) ;
+	bool skip_element(PlyBlockReader& in, const Element& e) ;
+
+private:
+	std::string		file_name_ ;
+	std::size_t		data_offset_ ;
+	bool			swap_bytes_ ;
+	std::vector<Element> elements_ ;
+
+	unsigned int	nb_vertices_ ;
+	unsigned int	nb_faces_ ;
+	unsigned int	vertex_size_ ;	// the size of a vertex record
+	bool			has_normals_ ;
+	bool			has_colors_ ;
+	float			color_mult_ ;
+	VertexField		fields_[9] ;
+	int				face_indices_ ;		// the index of "vertex_indices" in the face properties
+
+	// for begin_vertices()/next_vertices()
+	std::ifstream*	stream_ ;
+	PlyBlockReader*	block_reader_ ;
+	unsigned int	vertices_left_ ;
+} ;
+
+
+#endif
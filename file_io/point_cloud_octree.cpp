@@ -0,0 +1,640 @@
+#include "point_cloud_octree.h"
+#include "point_stream_io.h"
+#include "point_set_serializer_bpc.h"
+#include "../geom/point_set.h"
+#include "../geom/dense_point_set.h"
+#include "../basic/file_utils.h"
+#include "../basic/logger.h"
+#include "../basic/stop_watch.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <map>
+#include <cmath>
+#include <cstdio>
+
+
+namespace {
+
+	const unsigned int MORTON_BITS = 21;	// per axis, so the codes fit in 64 bits
+	const unsigned int PLAN_DEPTH = 7;		// the depth at which the points are counted to plan the tree
+	const unsigned int RUN_BUFFER_SIZE = 16384;
+
+	struct SortedPoint {
+		Numeric::uint64	code;
+		float			p[3];
+		float			n[3];
+		float			c[3];
+	};
+
+	inline bool code_less(const SortedPoint& a, const SortedPoint& b) {
+		return a.code < b.code;
+	}
+
+	// inserts two 0 bits between each of the 21 lower bits of x
+	inline Numeric::uint64 spread_bits(Numeric::uint64 x) {
+		x &= 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffffull;
+		x = (x | x << 16) & 0x1f0000ff0000ffull;
+		x = (x | x << 8)  & 0x100f00f00f00f00full;
+		x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+		x = (x | x << 2)  & 0x1249249249249249ull;
+		return x;
+	}
+
+	// the octant (0 to 7) containing the point at $depth$ (>= 1)
+	inline unsigned int octant(Numeric::uint64 code, unsigned int depth) {
+		return static_cast<unsigned int>((code >> (3 * (MORTON_BITS - depth))) & 7);
+	}
+
+	std::string node_name(unsigned int depth, Numeric::uint64 prefix) {
+		std::string name(depth + 1, 'r');
+		for (unsigned int d = depth; d > 0; --d, prefix >>= 3)
+			name[d] = static_cast<char>('0' + (prefix & 7));
+		return name;
+	}
+
+	// false for the points with a NaN or infinite coordinate
+	inline bool is_finite(const float* p) {
+		return !Numeric::is_nan(p[0]) && !Numeric::is_nan(p[1]) && !Numeric::is_nan(p[2]);
+	}
+
+	inline bool intersect(const Box3d& a, const Box3d& b) {
+		return a.initialized() && b.initialized() &&
+			a.x_min() <= b.x_max() && b.x_min() <= a.x_max() &&
+			a.y_min() <= b.y_max() && b.y_min() <= a.y_max() &&
+			a.z_min() <= b.z_max() && b.z_min() <= a.z_max();
+	}
+
+
+	class MortonEncoder {
+	public:
+		MortonEncoder(const vec3& origin, double size) : origin_(origin), scale_(double(1 << MORTON_BITS) / size) {}
+
+		Numeric::uint64 encode(const float* p) const {
+			const double max_coord = double((1 << MORTON_BITS) - 1);
+			Numeric::uint64 q[3];
+			for (unsigned int k = 0; k < 3; ++k) {
+				double v = (p[k] - origin_[k]) * scale_;
+				ogf_clamp(v, 0.0, max_coord);
+				q[k] = static_cast<Numeric::uint64>(v);
+			}
+			return (spread_bits(q[0]) << 2) | (spread_bits(q[1]) << 1) | spread_bits(q[2]);
+		}
+
+	private:
+		vec3	origin_;
+		double	scale_;
+	};
+
+
+	// Reads a sorted run back by blocks.
+	class RunReader {
+	public:
+		RunReader(const std::string& file_name) : input_(file_name.c_str(), std::fstream::binary), pos_(0) {
+			fill();
+		}
+
+		bool done() const { return pos_ >= buffer_.size(); }
+		const SortedPoint& current() const { return buffer_[pos_]; }
+		void next() {
+			if (++pos_ >= buffer_.size())
+				fill();
+		}
+
+	private:
+		void fill() {
+			buffer_.resize(RUN_BUFFER_SIZE);
+			input_.read(reinterpret_cast<char*>(&buffer_[0]), RUN_BUFFER_SIZE * sizeof(SortedPoint));
+			buffer_.resize(static_cast<std::size_t>(input_.gcount() / sizeof(SortedPoint)));
+			pos_ = 0;
+		}
+
+	private:
+		std::ifstream				input_;
+		std::vector<SortedPoint>	buffer_;
+		std::size_t					pos_;
+	};
+
+
+	// Receives the points sorted by Morton code and writes the tiles. The leaves
+	// are planned in advance (from the number of points in each cell at
+	// PLAN_DEPTH), so the points of a leaf are buffered until the next leaf
+	// starts. The internal nodes whose points are being received are on a
+	// stack; they are completed (their sample written) when the points leave
+	// their cube.
+	class TileWriter {
+	public:
+		struct PlannedLeaf {
+			unsigned int	depth;
+			Numeric::uint64	prefix;
+			Numeric::uint64	end_cell;	// the cells at PLAN_DEPTH before this one are in the leaf
+		};
+
+		struct Entry {
+			std::string		name;
+			unsigned int	depth;
+			bool			is_leaf;
+			Numeric::uint64	nb_points;
+			Box3d			box;
+			bool operator<(const Entry& rhs) const { return name < rhs.name; }
+		};
+
+		TileWriter(const std::string& directory, const PointCloudOctree::BuildOptions& options,
+			bool has_normals, bool has_colors, const std::vector<PlannedLeaf>& leaves)
+			: directory_(directory), options_(options), has_normals_(has_normals), has_colors_(has_colors)
+			, leaves_(leaves), current_(0), failed_(false)
+		{
+			stack_.reserve(MORTON_BITS + 1);
+		}
+
+		void add(const SortedPoint& r) {
+			Numeric::uint64 cell = r.code >> (3 * (MORTON_BITS - PLAN_DEPTH));
+			while (cell >= leaves_[current_].end_cell) {
+				flush_leaf();
+				++current_;
+			}
+			buffer_.push_back(r);
+		}
+
+		// Returns the nodes, in depth-first order.
+		bool finish(std::vector<Entry>& entries) {
+			flush_leaf();
+			while (!stack_.empty())
+				pop_node();
+			std::sort(entries_.begin(), entries_.end());
+			entries.swap(entries_);
+			return !failed_;
+		}
+
+	private:
+		struct OpenNode {
+			unsigned int				depth;
+			Numeric::uint64				prefix;
+			Numeric::uint64				nb_points;
+			Box3d						box;
+			std::vector<SortedPoint>	samples;
+		};
+
+		void flush_leaf() {
+			if (buffer_.empty())
+				return;
+
+			unsigned int depth = leaves_[current_].depth;
+			Numeric::uint64 prefix = leaves_[current_].prefix;
+			while (!stack_.empty() && !is_ancestor(stack_.back(), depth, prefix))
+				pop_node();
+			for (unsigned int d = stack_.empty() ? 0 : stack_.back().depth + 1; d < depth; ++d) {
+				stack_.push_back(OpenNode());
+				OpenNode& node = stack_.back();
+				node.depth = d;
+				node.prefix = prefix >> (3 * (depth - d));
+				node.nb_points = 0;
+			}
+
+			const SortedPoint* begin = &buffer_[0];
+			build_node(begin, begin + buffer_.size(), depth, prefix, stack_.empty() ? nil : &stack_.back());
+			buffer_.clear();
+		}
+
+		static bool is_ancestor(const OpenNode& node, unsigned int depth, Numeric::uint64 prefix) {
+			return node.depth < depth && (prefix >> (3 * (depth - node.depth))) == node.prefix;
+		}
+
+		void pop_node() {
+			OpenNode node;
+			std::swap(node, stack_.back());
+			stack_.pop_back();
+			close_node(node, stack_.empty() ? nil : &stack_.back());
+		}
+
+		// Writes the subtree of the node containing the points [begin, end) and
+		// adds them to its parent.
+		void build_node(const SortedPoint* begin, const SortedPoint* end, unsigned int depth, Numeric::uint64 prefix, OpenNode* parent) {
+			Numeric::uint64 num = end - begin;
+			if (num <= options_.max_points_per_tile || depth == MORTON_BITS) {
+				Box3d box;
+				write_tile(node_name(depth, prefix), begin, end, box);
+				add_entry(depth, prefix, true, num, box);
+				if (parent) {
+					parent->nb_points += num;
+					parent->box.add_box(box);
+					reduce(begin, end, parent->depth, parent->samples);
+				}
+				return;
+			}
+
+			// the points of each child are contiguous
+			OpenNode node;
+			node.depth = depth;
+			node.prefix = prefix;
+			node.nb_points = 0;
+			while (begin != end) {
+				unsigned int o = octant(begin->code, depth + 1);
+				const SortedPoint* child_end = begin;
+				while (child_end != end && octant(child_end->code, depth + 1) == o)
+					++child_end;
+				build_node(begin, child_end, depth + 1, prefix * 8 + o, &node);
+				begin = child_end;
+			}
+			close_node(node, parent);
+		}
+
+		void close_node(OpenNode& node, OpenNode* parent) {
+			Box3d sample_box;
+			const SortedPoint* samples = node.samples.empty() ? nil : &node.samples[0];
+			write_tile(node_name(node.depth, node.prefix), samples, samples + node.samples.size(), sample_box);
+			add_entry(node.depth, node.prefix, false, node.nb_points, node.box);
+			if (parent) {
+				parent->nb_points += node.nb_points;
+				parent->box.add_box(node.box);
+				reduce(samples, samples + node.samples.size(), parent->depth, parent->samples);
+			}
+		}
+
+		// Appends to $samples$ one of the points [begin, end) per cell of the
+		// sampling grid of the nodes at $depth$. The cells are prefixes of the
+		// Morton codes, so the points of a cell are contiguous.
+		void reduce(const SortedPoint* begin, const SortedPoint* end, unsigned int depth, std::vector<SortedPoint>& samples) const {
+			unsigned int level = ogf_min(depth + options_.sample_bits, MORTON_BITS);
+			unsigned int shift = 3 * (MORTON_BITS - level);
+			for (const SortedPoint* r = begin; r != end; ++r) {
+				if (samples.empty() || (samples.back().code >> shift) != (r->code >> shift))
+					samples.push_back(*r);
+			}
+		}
+
+		void write_tile(const std::string& name, const SortedPoint* begin, const SortedPoint* end, Box3d& box) {
+			unsigned int num = static_cast<unsigned int>(end - begin);
+			DensePointSet tile;
+			tile.set_has_normals(has_normals_);
+			tile.set_has_colors(has_colors_);
+			tile.resize(num);
+			float* p = tile.positions();
+			float* n = tile.normals();
+			float* c = tile.colors();
+			for (unsigned int i = 0; i < num; ++i) {
+				const SortedPoint& r = begin[i];
+				std::copy(r.p, r.p + 3, p + 3 * i);
+				if (n)	std::copy(r.n, r.n + 3, n + 3 * i);
+				if (c)	std::copy(r.c, r.c + 3, c + 3 * i);
+				box.add_point(vec3(r.p[0], r.p[1], r.p[2]));
+			}
+			if (!PointSetSerializer_bpc::save(directory_ + "/" + name + ".bpc", &tile))
+				failed_ = true;
+		}
+
+		void add_entry(unsigned int depth, Numeric::uint64 prefix, bool is_leaf, Numeric::uint64 nb_points, const Box3d& box) {
+			Entry e;
+			e.name = node_name(depth, prefix);
+			e.depth = depth;
+			e.is_leaf = is_leaf;
+			e.nb_points = nb_points;
+			e.box = box;
+			entries_.push_back(e);
+		}
+
+	private:
+		std::string						directory_;
+		PointCloudOctree::BuildOptions	options_;
+		bool							has_normals_;
+		bool							has_colors_;
+		const std::vector<PlannedLeaf>&	leaves_;
+		std::size_t						current_;
+		std::vector<SortedPoint>		buffer_;	// the points of the current leaf
+		std::vector<OpenNode>			stack_;
+		std::vector<Entry>				entries_;
+		bool							failed_;
+	};
+
+
+	// The leaves of the subtree of the node (depth, prefix), in Morton order. $counts$
+	// are the cumulated numbers of points of the cells at PLAN_DEPTH.
+	void plan_leaves(const std::vector<Numeric::uint64>& counts, unsigned int depth, Numeric::uint64 prefix,
+		unsigned int max_points, std::vector<TileWriter::PlannedLeaf>& leaves)
+	{
+		unsigned int shift = 3 * (PLAN_DEPTH - depth);
+		Numeric::uint64 begin_cell = prefix << shift;
+		Numeric::uint64 end_cell = (prefix + 1) << shift;
+		Numeric::uint64 num = counts[end_cell] - counts[begin_cell];
+		if (num == 0)
+			return;
+
+		if (num <= max_points || depth == PLAN_DEPTH) {
+			TileWriter::PlannedLeaf leaf;
+			leaf.depth = depth;
+			leaf.prefix = prefix;
+			leaf.end_cell = end_cell;
+			leaves.push_back(leaf);
+			return;
+		}
+		for (unsigned int o = 0; o < 8; ++o)
+			plan_leaves(counts, depth + 1, prefix * 8 + o, max_points, leaves);
+	}
+
+
+	bool write_run(const std::string& file_name, std::vector<SortedPoint>& run) {
+		std::sort(run.begin(), run.end(), code_less);
+		std::ofstream output(file_name.c_str(), std::fstream::binary);
+		output.write(reinterpret_cast<const char*>(&run[0]), run.size() * sizeof(SortedPoint));
+		run.clear();
+		return !output.fail();
+	}
+
+}
+
+
+bool PointCloudOctree::build(const std::string& input_file, const std::string& directory, const BuildOptions& options) {
+	StopWatch w;
+
+	// pass 1: the bounding box (the points with a non-finite coordinate are skipped
+	// in both passes, they would have no place in the tree)
+
+	PointSource* source = PointStreamIO::open(input_file);
+	if (source == nil)
+		return false;
+	bool has_normals = source->has_normals();
+	bool has_colors = source->has_colors();
+
+	Box3d box;
+	Numeric::uint64 num = 0;
+	Numeric::uint64 num_skipped = 0;
+	DensePointSet chunk;
+	while (source->next(chunk)) {
+		const float* p = chunk.positions();
+		for (unsigned int i = 0; i < chunk.size(); ++i, p += 3) {
+			if (is_finite(p)) {
+				box.add_point(vec3(p[0], p[1], p[2]));
+				++num;
+			}
+			else
+				++num_skipped;
+		}
+	}
+	delete source;
+
+	if (num == 0) {
+		Logger::err(title()) << "no points in file \'" << input_file << "\'" << std::endl;
+		return false;
+	}
+	if (!FileUtils::is_directory(directory) && !FileUtils::create_directory(directory)) {
+		Logger::err(title()) << "could not create directory \'" << directory << "\'" << std::endl;
+		return false;
+	}
+
+	double size = ogf_max(box.width(), ogf_max(box.height(), box.depth()));
+	if (size <= 0)
+		size = 1.0;
+	vec3 origin = box.center() - vec3(0.5 * size, 0.5 * size, 0.5 * size);
+	MortonEncoder encoder(origin, size);
+
+	// pass 2: the points sorted by Morton code in runs of run_size points
+
+	unsigned int run_size = ogf_max(options.run_size, 1u);
+	std::vector<SortedPoint> run;
+	run.reserve(static_cast<std::size_t>(ogf_min(Numeric::uint64(run_size), num)));
+	std::vector<std::string> run_files;
+	std::vector<Numeric::uint64> counts((Numeric::uint64(1) << (3 * PLAN_DEPTH)) + 1, 0);
+	bool ok = true;
+
+	source = PointStreamIO::open(input_file);
+	if (source == nil)
+		return false;
+	while (ok && source->next(chunk)) {
+		const float* p = chunk.positions();
+		const float* n = chunk.normals();
+		const float* c = chunk.colors();
+		for (unsigned int i = 0; i < chunk.size(); ++i) {
+			if (!is_finite(p + 3 * i))
+				continue;
+			SortedPoint r;
+			std::copy(p + 3 * i, p + 3 * i + 3, r.p);
+			if (n)	std::copy(n + 3 * i, n + 3 * i + 3, r.n);
+			else	std::fill(r.n, r.n + 3, 0.0f);
+			if (c)	std::copy(c + 3 * i, c + 3 * i + 3, r.c);
+			else	std::fill(r.c, r.c + 3, 0.0f);
+			r.code = encoder.encode(r.p);
+			++counts[(r.code >> (3 * (MORTON_BITS - PLAN_DEPTH))) + 1];
+			run.push_back(r);
+
+			if (run.size() == run_size) {
+				std::ostringstream name;
+				name << directory << "/run" << run_files.size() << ".tmp";
+				run_files.push_back(name.str());
+				ok = write_run(run_files.back(), run);
+			}
+		}
+	}
+	delete source;
+
+	if (ok && !run_files.empty() && !run.empty()) {
+		std::ostringstream name;
+		name << directory << "/run" << run_files.size() << ".tmp";
+		run_files.push_back(name.str());
+		ok = write_run(run_files.back(), run);
+	}
+	if (!ok)
+		Logger::err(title()) << "failed writing the temporary files" << std::endl;
+
+	// pass 3: the tiles, from the merge of the runs
+
+	std::vector<TileWriter::Entry> entries;
+	if (ok) {
+		for (std::size_t i = 1; i < counts.size(); ++i)
+			counts[i] += counts[i - 1];
+		std::vector<TileWriter::PlannedLeaf> leaves;
+		plan_leaves(counts, 0, 0, options.max_points_per_tile, leaves);
+
+		TileWriter writer(directory, options, has_normals, has_colors, leaves);
+		if (run_files.empty()) {	// everything fits in a single run
+			std::sort(run.begin(), run.end(), code_less);
+			for (std::size_t i = 0; i < run.size(); ++i)
+				writer.add(run[i]);
+			std::vector<SortedPoint>().swap(run);
+		}
+		else {
+			typedef std::pair<Numeric::uint64, std::size_t> Head;
+			std::priority_queue< Head, std::vector<Head>, std::greater<Head> > heads;
+			std::vector<RunReader*> readers;
+			for (std::size_t i = 0; i < run_files.size(); ++i) {
+				readers.push_back(new RunReader(run_files[i]));
+				if (!readers[i]->done())
+					heads.push(Head(readers[i]->current().code, i));
+			}
+			while (!heads.empty()) {
+				std::size_t i = heads.top().second;
+				heads.pop();
+				writer.add(readers[i]->current());
+				readers[i]->next();
+				if (!readers[i]->done())
+					heads.push(Head(readers[i]->current().code, i));
+			}
+			for (std::size_t i = 0; i < readers.size(); ++i)
+				delete readers[i];
+		}
+		ok = writer.finish(entries);
+	}
+
+	for (std::size_t i = 0; i < run_files.size(); ++i)
+		FileUtils::delete_file(run_files[i]);
+	if (!ok)
+		return false;
+
+	// the index
+
+	std::string index_file = directory + "/octree.txt";
+	std::ofstream output(index_file.c_str());
+	output.precision(17);
+	output << "octree 1" << std::endl;
+	output << "normals " << (has_normals ? 1 : 0) << std::endl;
+	output << "colors " << (has_colors ? 1 : 0) << std::endl;
+	output << "cube " << origin << " " << size << std::endl;
+	output << "sample_bits " << options.sample_bits << std::endl;
+	output << "nodes " << entries.size() << std::endl;
+	for (std::size_t i = 0; i < entries.size(); ++i) {
+		const TileWriter::Entry& e = entries[i];
+		output << e.name << " " << e.depth << " " << (e.is_leaf ? 1 : 0) << " " << e.nb_points << " "
+			<< e.box.x_min() << " " << e.box.y_min() << " " << e.box.z_min() << " "
+			<< e.box.x_max() << " " << e.box.y_max() << " " << e.box.z_max() << std::endl;
+	}
+	if (output.fail()) {
+		Logger::err(title()) << "failed writing file \'" << index_file << "\'" << std::endl;
+		return false;
+	}
+
+	Logger::out(title()) << num << " points, " << entries.size() << " tiles ("
+		<< run_files.size() << " runs). Time: " << w.elapsed() << " seconds" << std::endl;
+	if (num_skipped > 0)
+		Logger::warn(title()) << num_skipped << " points with non-finite coordinates skipped" << std::endl;
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+
+
+PointCloudOctree::PointCloudOctree()
+: size_(0)
+, sample_bits_(0)
+, has_normals_(false)
+, has_colors_(false)
+{
+}
+
+
+void PointCloudOctree::close() {
+	directory_.clear();
+	nodes_.clear();
+	size_ = 0;
+	has_normals_ = has_colors_ = false;
+}
+
+
+bool PointCloudOctree::open(const std::string& directory) {
+	close();
+
+	std::string index_file = directory + "/octree.txt";
+	std::ifstream input(index_file.c_str());
+	if (input.fail()) {
+		Logger::err(title()) << "could not open file\'" << index_file << "\'" << std::endl;
+		return false;
+	}
+
+	std::string keyword;
+	int version = 0, normals = 0, colors = 0;
+	std::size_t nb_nodes = 0;
+	input >> keyword >> version;
+	if (keyword != "octree" || version != 1) {
+		Logger::err(title()) << "not an octree index" << std::endl;
+		return false;
+	}
+	input >> keyword >> normals >> keyword >> colors
+		>> keyword >> origin_ >> size_
+		>> keyword >> sample_bits_
+		>> keyword >> nb_nodes;
+
+	std::map<std::string, int> indices;
+	for (std::size_t i = 0; i < nb_nodes && input; ++i) {
+		Node node;
+		int is_leaf = 0;
+		vec3 box_min, box_max;
+		input >> node.name >> node.depth >> is_leaf >> node.nb_points >> box_min >> box_max;
+		node.is_leaf = (is_leaf != 0);
+		node.box.add_point(box_min);
+		node.box.add_point(box_max);
+		std::fill(node.children, node.children + 8, -1);
+
+		// depth-first order: the parent is already known
+		int index = static_cast<int>(nodes_.size());
+		if (index > 0) {
+			std::map<std::string, int>::const_iterator parent = indices.find(node.name.substr(0, node.name.size() - 1));
+			char digit = node.name[node.name.size() - 1];
+			if (parent == indices.end() || digit < '0' || digit > '7')
+				break;
+			nodes_[parent->second].children[digit - '0'] = index;
+		}
+		else if (node.name != "r")
+			break;
+		indices[node.name] = index;
+		nodes_.push_back(node);
+	}
+
+	if (input.fail() || nodes_.size() != nb_nodes || nb_nodes == 0) {
+		Logger::err(title()) << "invalid index file \'" << index_file << "\'" << std::endl;
+		close();
+		return false;
+	}
+
+	directory_ = directory;
+	has_normals_ = (normals != 0);
+	has_colors_ = (colors != 0);
+	return true;
+}
+
+
+double PointCloudOctree::spacing(unsigned int i) const {
+	const Node& node = nodes_[i];
+	if (node.is_leaf)
+		return 0.0;
+	return std::ldexp(size_, -static_cast<int>(node.depth + sample_bits_));
+}
+
+
+unsigned int PointCloudOctree::load_region(const Box3d& box, PointSet* pset) const {
+	return is_open() ? load(0, box, 0.0, pset) : 0;
+}
+
+
+unsigned int PointCloudOctree::load_lod(const Box3d& box, double spacing, PointSet* pset) const {
+	return is_open() ? load(0, box, spacing, pset) : 0;
+}
+
+
+unsigned int PointCloudOctree::load_lod(double spacing, PointSet* pset) const {
+	return is_open() ? load(0, bounding_box(), spacing, pset) : 0;
+}
+
+
+unsigned int PointCloudOctree::load(unsigned int i, const Box3d& box, double spacing, PointSet* pset) const {
+	const Node& node = nodes_[i];
+	if (!intersect(node.box, box))
+		return 0;
+
+	if (node.is_leaf || this->spacing(i) <= spacing) {
+		MappedPointSet tile;
+		if (!tile.open(tile_file(i)))
+			return 0;
+		tile.copy_to(pset, box);
+		return 1;
+	}
+
+	unsigned int nb_tiles = 0;
+	for (int k = 0; k < 8; ++k) {
+		if (node.children[k] >= 0)
+			nb_tiles += load(node.children[k], box, spacing, pset);
+	}
+	return nb_tiles;
+}
@@ -0,0 +1,111 @@
+#ifndef _POINT_CLOUD_OCTREE_H_
+#define _POINT_CLOUD_OCTREE_H_
+
+#include "file_io_common.h"
+#include "../math/math_types.h"
+#include "../basic/basic_types.h"
+#include <string>
+#include <vector>
+
+
+/***********************************************************************
+ An out-of-core octree over a point cloud too large to be held in memory.
+ Only the tiles (nodes) touched by a query are loaded.
+
+ On disk, the octree is a directory containing:
+   - "octree.txt": the index (the bounding cube and the list of nodes);
+   - one "bpc" file per node, named after the path of octants from the
+     root: "r.bpc" (the root), "r0.bpc", ..., "r7.bpc", "r70.bpc", ...
+
+ Each point is in exactly one leaf. An internal node holds a sample of the
+ points below it: at most one point per cell of a regular grid of
+ 2^sample_bits cells per axis over the cube of the node, so the spacing
+ of the samples is halved at each level (the levels of detail).
+
+ The octree is built by build() in three streaming passes over the input
+ file: the bounding box, then the points sorted by Morton code in runs
+ (external sort), then the merge of the runs, during which the tiles are
+ written as the points of their nodes arrive.
+************************************************************************/
+
+class PointSet;
+
+class FILE_IO_API PointCloudOctree
+{
+public:
+	static std::string title() { return "[PointCloudOctree]: "; }
+
+	struct BuildOptions {
+		BuildOptions() : max_points_per_tile(1000000), run_size(4000000), sample_bits(6) {}
+
+		// A node with more points is subdivided.
+		unsigned int max_points_per_tile;
+		// The number of points sorted in memory at once (48 bytes per point).
+		unsigned int run_size;
+		// The resolution of the samples of the internal nodes.
+		unsigned int sample_bits;
+	};
+
+	// Builds the octree of the points of $input_file$ (any file supported by
+	// PointStreamIO) in $directory$, which is created if needed. The memory
+	// used does not depend on the number of points but on $run_size$ and on
+	// the largest tile (the octree is planned at a fixed depth, so tiles of
+	// very dense regions may be read in memory entirely before being split).
+	static bool build(const std::string& input_file, const std::string& directory,
+		const BuildOptions& options = BuildOptions());
+
+public:
+	struct Node {
+		std::string		name;		// e.g., "r", "r3", "r37"
+		unsigned int	depth;
+		bool			is_leaf;
+		Numeric::uint64	nb_points;	// the number of points below the node
+		Box3d			box;		// the bounding box of these points
+		int				children[8];	// indices of the children, -1 if none
+	};
+
+	PointCloudOctree();
+
+	// Reads the index of the octree built in $directory$.
+	bool open(const std::string& directory);
+	void close();
+	bool is_open() const { return !nodes_.empty(); }
+
+	Numeric::uint64 size() const { return nodes_.empty() ? 0 : nodes_[0].nb_points; }
+	bool has_normals() const { return has_normals_; }
+	bool has_colors() const  { return has_colors_; }
+	Box3d bounding_box() const { return nodes_.empty() ? Box3d() : nodes_[0].box; }
+
+	// The root is the node 0.
+	unsigned int nb_nodes() const { return static_cast<unsigned int>(nodes_.size()); }
+	const Node& node(unsigned int i) const { return nodes_[i]; }
+	std::string tile_file(unsigned int i) const { return directory_ + "/" + nodes_[i].name + ".bpc"; }
+	// The distance between the samples of a node (0 for the leaves, which
+	// have all their points).
+	double spacing(unsigned int i) const;
+
+	// Appends to $pset$ the points in $box$, loading only the leaves whose
+	// bounding box intersects $box$. Returns the number of tiles loaded.
+	unsigned int load_region(const Box3d& box, PointSet* pset) const;
+
+	// Same as load_region(), but with the points at a spacing of about $spacing$:
+	// the octree is descended from the root until the nodes whose samples are
+	// dense enough (or the leaves).
+	unsigned int load_lod(const Box3d& box, double spacing, PointSet* pset) const;
+	unsigned int load_lod(double spacing, PointSet* pset) const;
+
+private:
+	unsigned int load(unsigned int i, const Box3d& box, double spacing, PointSet* pset) const;
+
+private:
+	std::string			directory_;
+	std::vector<Node>	nodes_;
+	vec3				origin_;	// the bounding cube of the octree
+	double				size_;
+	unsigned int		sample_bits_;
+	bool				has_normals_;
+	bool				has_colors_;
+};
+
+
+#endif
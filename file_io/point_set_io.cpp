@@ -1,12 +1,19 @@
 #include "point_set_io.h"
 #include "point_set_serializer_ply.h"
+#include "point_set_serializer_bpc.h"
 #include "../geom/point_set.h"
 #include "../geom/iterators.h"
 #include "../basic/stop_watch.h"
 #include "../basic/file_utils.h"
 #include "../basic/progress.h"
 #include "../basic/logger.h"
+#include "../basic/mapped_file.h"
+#include "../basic/text_parser.h"
+
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
 
 
 
@@ -31,6 +38,10 @@ PointSet* PointSetIO::read(const std::string& file_name)
 		object = PointSetSerializer_ply::load(file_name);
 	}
 
+	else if (ext == "bpc") {
+		object = PointSetSerializer_bpc::load(file_name);
+	}
+
 	else {
 		PointSet* point_set = new PointSet;
 		if (ext == "xyz")
@@ -96,6 +107,9 @@ bool PointSetIO::save(const std::string& file_name, const PointSet* point_set) {
 	else if (ext == "ply")
 		PointSetSerializer_ply::save(file_name, point_set);
 
+	else if (ext == "bpc")
+		PointSetSerializer_bpc::save(file_name, point_set);
+
 	else if (ext == "pnc")
 		save_pnc(point_set, file_name);
 	else if (ext == "bpnc")
@@ -117,90 +131,112 @@ bool PointSetIO::save(const std::string& file_name, const PointSet* point_set) {
 	return true;
 }
 
-//HaoLi:load_xyz by its scheme 
-void PointSetIO::load_xyz(PointSet* pointSet, const std::string& file_name) {
-
-	int cols = get_file_cols(file_name);
-
-	std::ifstream input(file_name.c_str());
-	if (input.fail()) {
-		Logger::err(title()) << "could not open file\'" << file_name << "\'" << std::endl;
-		return;
-	}
-
-	printf("cols:%d\n", cols);
-
-	switch (cols){
-	case 3:
-		while (!input.eof()) {
-			float x, y, z;
-			input >> x >> y >> z;
-
-			if (input.good()) {
-				pointSet->new_vertex(vec3(x, y, z));
+void PointSetIO::load_ascii(PointSet* pointSet, const MappedFile& file, bool normals, bool colors) {
+	const char* data = file.data();
+	const char* end = data + file.size();
+	int nb_values = colors ? 9 : (normals ? 6 : 3);
+
+	// split the file into chunks starting at the beginning of a line
+	const std::size_t min_chunk_size = 1 << 20;
+	std::size_t nb_chunks = std::min<std::size_t>(file.size() / min_chunk_size + 1, omp_get_max_threads() * 8);
+	std::vector<const char*> bounds;
+	TextParser::split_lines(data, end, nb_chunks, bounds);
+
+	// an upper bound of the number of points of each chunk: its number of lines
+	int num_chunks = static_cast<int>(nb_chunks);
+	std::vector<std::size_t> offsets(nb_chunks + 1, 0);
+#pragma omp parallel for
+	for (int c = 0; c < num_chunks; ++c) {
+		const char* b = bounds[c];
+		const char* e = bounds[c + 1];
+		std::size_t nb_lines = std::count(b, e, '\n');
+		if (e > b && e[-1] != '\n')
+			++nb_lines;
+		offsets[c + 1] = nb_lines;
+	}
+	for (std::size_t c = 0; c < nb_chunks; ++c)
+		offsets[c + 1] += offsets[c];
+
+	std::size_t max_num = offsets[nb_chunks];
+	std::vector<float> points(3 * max_num);
+	std::vector<float> nmls(normals ? 3 * max_num : 0);
+	std::vector<float> cols(colors ? 3 * max_num : 0);
+
+	// each chunk is parsed into its own range of the arrays
+	std::vector<std::size_t> counts(nb_chunks, 0);
+	std::vector<std::size_t> nb_ignored(nb_chunks, 0);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < num_chunks; ++c) {
+		const char* p = bounds[c];
+		const char* e = bounds[c + 1];
+		std::size_t idx = offsets[c];
+		float v[9];
+		while (p < e) {
+			const char* line = p;
+			if (TextParser::parse_floats(p, e, v, nb_values) == nb_values) {
+				std::memcpy(&points[3 * idx], v, 3 * sizeof(float));
+				if (normals)
+					std::memcpy(&nmls[3 * idx], v + 3, 3 * sizeof(float));
+				if (colors)
+					std::memcpy(&cols[3 * idx], v + 6, 3 * sizeof(float));
+				++idx;
+			}
+			else {
+				TextParser::skip_blanks(line, e);
+				if (line < e && *line != '\n')	// not an empty line
+					++nb_ignored[c];
 			}
+			TextParser::next_line(p, e);
 		}
-		break;
-	case 6:{
-			   PointSetNormal normals6(pointSet);
-
-			   while (!input.eof()) {
-				   float x, y, z, nx, ny, nz;
-				   input >> x >> y >> z >> nx >> ny >> nz;
+		counts[c] = idx - offsets[c];
+	}
+
+	// remove the gaps left by the ignored lines
+	std::size_t num = counts[0];
+	std::size_t ignored = nb_ignored[0];
+	for (std::size_t c = 1; c < nb_chunks; ++c) {
+		if (counts[c] > 0 && num != offsets[c]) {
+			std::memmove(&points[3 * num], &points[3 * offsets[c]], 3 * counts[c] * sizeof(float));
+			if (normals)
+				std::memmove(&nmls[3 * num], &nmls[3 * offsets[c]], 3 * counts[c] * sizeof(float));
+			if (colors)
+				std::memmove(&cols[3 * num], &cols[3 * offsets[c]], 3 * counts[c] * sizeof(float));
+		}
+		num += counts[c];
+		ignored += nb_ignored[c];
+	}
+	if (ignored > 0)
+		Logger::warn(title()) << ignored << " lines ignored (less than " << nb_values << " values)" << std::endl;
 
-				   if (input.good()) {
-					   PointSet::Vertex* v = pointSet->new_vertex(vec3(x, y, z));
-					   normals6[v] = vec3(nx, ny, nz);
-				   }
-			   }
-			   break;
+	if (num > 0) {
+		pointSet->append(&points[0], static_cast<unsigned int>(num),
+			normals ? &nmls[0] : nil, colors ? &cols[0] : nil);
 	}
-	case 9:{
-			   PointSetNormal normals9(pointSet);
-			   //PointSetColor colors9(pointSet);
+}
 
-			   while (!input.eof()) {
-				   float x, y, z, nx, ny, nz, r, g, b;
-				   input >> x >> y >> z >> nx >> ny >> nz >> r >> g >> b;
 
-				   if (input.good()) {
-					   PointSet::Vertex* v = pointSet->new_vertex(vec3(x, y, z));
-					   normals9[v] = vec3(nx, ny, nz);
-					   //colors9[v] = Color(r, g, b);
-				   }
-			   }
-			   break;
+// The first line tells the content: x y z [nx ny nz [r g b]]. The colors are ignored.
+void PointSetIO::load_xyz(PointSet* pointSet, const std::string& file_name) {
+	MappedFile file;
+	if (!file.open(file_name)) {
+		Logger::err(title()) << "could not open file\'" << file_name << "\'" << std::endl;
+		return;
 	}
 
+	const char* p = file.data();
+	const char* end = p + file.size();
+	int cols = 0;
+	while (p < end && cols == 0) {	// the first line with numbers
+		cols = TextParser::count_numbers(p, end);
+		TextParser::next_line(p, end);
 	}
-}
+	Logger::out(title()) << "cols: " << cols << std::endl;
 
-//HaoLi:get file columns
-int PointSetIO::get_file_cols(const std::string& file_name){
-	std::ifstream infile(file_name.c_str());
-	infile >> std::noskipws;
-
-	int col = 0;
-	bool flag = 1;
-
-	char chr;
-	while (infile >> chr && flag)
-	{
-		switch (chr)
-		{
-		case '\n':
-			flag = 0;
-			break;
-		case ' ':
-			++col;
-			break;
-		default:;
-		}
+	if (cols < 3) {
+		Logger::err(title()) << "at least 3 values per line expected" << std::endl;
+		return;
 	}
-	infile.close();
-
-	col++;
-	return col;
+	load_ascii(pointSet, file, cols >= 6, false);
 }
 
 
@@ -239,11 +275,7 @@ void PointSetIO::load_bxyz(PointSet* pointSet, const std::string& file_name) {
 	float* data = new float[num * 3];
 	input.read((char*)data, num * 12);	// read the entire blocks
 
-	ProgressLogger progress(num);
-	for (int i = 0; i < num; ++i) {
-		progress.notify(i);
-		pointSet->new_vertex(vec3(data + i * 3));
-	}
+	pointSet->append(data, num);
 	delete[] data;
 }
 
@@ -269,22 +301,12 @@ void PointSetIO::save_bxyz(const PointSet* pointSet, const std::string& file_nam
 
 
 void PointSetIO::load_pn(PointSet* pointSet, const std::string& file_name) {
-	std::ifstream input(file_name.c_str());
-	if (input.fail()) {
+	MappedFile file;
+	if (!file.open(file_name)) {
 		Logger::err(title()) << "could not open file\'" << file_name << "\'" << std::endl;
 		return;
 	}
-
-	PointSetNormal normals(pointSet);
-	while (!input.eof()) {
-		float x, y, z, nx, ny, nz;
-		input >> x >> y >> z >> nx >> ny >> nz;
-
-		if (input.good()) {
-			PointSet::Vertex* v = pointSet->new_vertex(vec3(x, y, z));
-			normals[v] = vec3(nx, ny, nz);
-		}
-	}
+	load_ascii(pointSet, file, true, false);
 }
 
 
@@ -323,6 +345,8 @@ void PointSetIO::load_bpn(PointSet* pointSet, const std::string& file_name) {
 
 	float* data = new float[num * 6];
 	input.read((char*)data, num * 24);	// read the entire blocks
+
+	pointSet->reserve(pointSet->size_of_vertices() + num);
 	ProgressLogger progress(num);
 	for (int i = 0; i < num; ++i) {
 		progress.notify(i);
@@ -366,25 +390,12 @@ void PointSetIO::save_bpn(const PointSet* pointSet, const std::string& file_name
 
 
 void PointSetIO::load_pnc(PointSet* pointSet, const std::string& file_name) {
-	std::ifstream input(file_name.c_str());
-	if (input.fail()) {
+	MappedFile file;
+	if (!file.open(file_name)) {
 		Logger::err(title()) << "could not open file\'" << file_name << "\'" << std::endl;
 		return;
 	}
-
-	PointSetNormal	normals(pointSet);
-	PointSetColor	colors(pointSet);
-
-	float x, y, z, nx, ny, nz, r, g, b;
-	while (!input.eof()) {
-		input >> x >> y >> z >> nx >> ny >> nz >> r >> g >> b;
-
-		if (input.good()) {
-			PointSet::Vertex* v = pointSet->new_vertex(vec3(x, y, z));
-			normals[v] = vec3(nx, ny, nz);
-			colors[v] = Color(r, g, b);
-		}
-	}
+	load_ascii(pointSet, file, true, true);
 }
 
 
@@ -437,6 +448,7 @@ void PointSetIO::load_bpnc(PointSet* pointSet, const std::string& file_name) {
 	float* data = new float[num * 9];
 	input.read((char*)data, num * line_size);	// read the entire blocks
 
+	pointSet->reserve(pointSet->size_of_vertices() + num);
 	ProgressLogger progress(num);
 	for (int i = 0; i < num; ++i) {
 		progress.notify(i);
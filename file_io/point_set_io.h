@@ -8,6 +8,7 @@
 
 
 class PointSet;
+class MappedFile;
 
 class FILE_IO_API PointSetIO
 {
@@ -37,8 +38,10 @@ protected:
 	static void load_bpnc(PointSet* pointSet, const std::string& file_name);
 	static void save_bpnc(const PointSet* pointSet, const std::string& file_name);
 
-	//get columns of the file 
-	static int get_file_cols(const std::string& file_name);
+	// Parses a text file with one point per line: x y z [nx ny nz [r g b]]. The
+	// lines are parsed in parallel, directly from the mapped file. Lines with 
+	// fewer values than expected are ignored, extra values are ignored.
+	static void load_ascii(PointSet* pointSet, const MappedFile& file, bool normals, bool colors);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,545 @@
+#include "point_set_serializer_bpc.h"
+#include "../geom/point_set.h"
+#include "../geom/dense_point_set.h"
+#include "../basic/basic_types.h"
+#include "../basic/logger.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+
+namespace {
+
+	const char			BPC_MAGIC[4] = { 'B', 'P', 'C', '\0' };
+	const Numeric::uint32	BPC_VERSION = 1;
+	const Numeric::uint32	BPC_FLOAT32 = 1;
+	const Numeric::uint64	BPC_ALIGNMENT = 64;
+
+	struct BpcHeader {
+		char				magic[4];
+		Numeric::uint32		version;
+		Numeric::uint32		header_size;
+		Numeric::uint32		nb_attributes;
+		Numeric::uint64		nb_points;
+		Numeric::uint32		chunk_size;
+		Numeric::uint32		nb_chunks;
+		Numeric::uint64		attribute_table_offset;
+		Numeric::uint64		chunk_table_offset;
+		char				reserved[16];
+	};
+
+	struct BpcAttribute {
+		char				name[16];
+		Numeric::uint32		type;
+		Numeric::uint32		dimension;
+		Numeric::uint64		offset;
+	};
+
+	inline Numeric::uint64 align(Numeric::uint64 offset) {
+		return (offset + BPC_ALIGNMENT - 1) / BPC_ALIGNMENT * BPC_ALIGNMENT;
+	}
+
+	// true if $count$ elements of $elem_size$ bytes at $offset$ lie in a file
+	// of $size$ bytes (without overflow, the offsets come from the file)
+	inline bool fits_in_file(Numeric::uint64 offset, Numeric::uint64 count, Numeric::uint64 elem_size, Numeric::uint64 size) {
+		return offset <= size && count <= (size - offset) / elem_size;
+	}
+
+	inline bool is_little_endian() {
+		Numeric::uint32 x = 1;
+		return *reinterpret_cast<const char*>(&x) == 1;
+	}
+
+
+	bool write_bpc(
+		const std::string& file_name, unsigned int num,
+		const float* positions, const float* normals, const float* colors,
+		unsigned int chunk_size, bool chunk_boxes)
+	{
+		if (!is_little_endian()) {
+			Logger::err(PointSetSerializer_bpc::title()) << "big-endian machines are not supported" << std::endl;
+			return false;
+		}
+		if (chunk_size == 0)
+			chunk_size = PointSetSerializer_bpc::DEFAULT_CHUNK_SIZE;
+
+		std::ofstream output(file_name.c_str(), std::fstream::binary);
+		if (output.fail()) {
+			Logger::err(PointSetSerializer_bpc::title()) << "could not open file\'" << file_name << "\'" << std::endl;
+			return false;
+		}
+
+		const char*	 names[3] = { "position", "normal", "color" };
+		const float* arrays[3] = { positions, normals, colors };
+
+		BpcHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, BPC_MAGIC, 4);
+		header.version = BPC_VERSION;
+		header.header_size = sizeof(BpcHeader);
+		header.nb_points = num;
+		header.chunk_size = chunk_size;
+		header.nb_chunks = (num + chunk_size - 1) / chunk_size;
+		for (int a = 0; a < 3; ++a) {
+			if (arrays[a])
+				++header.nb_attributes;
+		}
+
+		// layout
+		header.attribute_table_offset = sizeof(BpcHeader);
+		Numeric::uint64 offset = header.attribute_table_offset + header.nb_attributes * sizeof(BpcAttribute);
+		if (chunk_boxes && num > 0) {
+			header.chunk_table_offset = offset;
+			offset += header.nb_chunks * 6 * sizeof(float);
+		}
+
+		Numeric::uint64 array_size = Numeric::uint64(num) * 3 * sizeof(float);
+		std::vector<BpcAttribute> attributes;
+		for (int a = 0; a < 3; ++a) {
+			if (!arrays[a])
+				continue;
+			BpcAttribute attr;
+			std::memset(&attr, 0, sizeof(attr));
+			std::strcpy(attr.name, names[a]);
+			attr.type = BPC_FLOAT32;
+			attr.dimension = 3;
+			attr.offset = align(offset);
+			offset = attr.offset + array_size;
+			attributes.push_back(attr);
+		}
+
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!attributes.empty())
+			output.write(reinterpret_cast<const char*>(&attributes[0]), attributes.size() * sizeof(BpcAttribute));
+
+		if (header.chunk_table_offset != 0) {
+			std::vector<float> boxes(header.nb_chunks * 6);
+			for (unsigned int c = 0; c < header.nb_chunks; ++c) {
+				unsigned int begin = c * chunk_size;
+				unsigned int end = ogf_min(begin + chunk_size, num);
+				float* box = &boxes[c * 6];
+				for (int k = 0; k < 3; ++k)
+					box[k] = box[k + 3] = positions[3 * begin + k];
+				for (unsigned int i = begin + 1; i < end; ++i) {
+					const float* p = positions + 3 * i;
+					for (int k = 0; k < 3; ++k) {
+						if (p[k] < box[k])		box[k] = p[k];
+						if (p[k] > box[k + 3])	box[k + 3] = p[k];
+					}
+				}
+			}
+			output.write(reinterpret_cast<const char*>(&boxes[0]), boxes.size() * sizeof(float));
+		}
+
+		static const char padding[BPC_ALIGNMENT] = { 0 };
+		Numeric::uint64 pos = header.chunk_table_offset != 0 ?
+			header.chunk_table_offset + header.nb_chunks * 6 * sizeof(float) :
+			header.attribute_table_offset + header.nb_attributes * sizeof(BpcAttribute);
+		for (std::size_t a = 0, k = 0; a < 3; ++a) {
+			if (!arrays[a])
+				continue;
+			output.write(padding, static_cast<std::streamsize>(attributes[k].offset - pos));
+			output.write(reinterpret_cast<const char*>(arrays[a]), static_cast<std::streamsize>(array_size));
+			pos = attributes[k].offset + array_size;
+			++k;
+		}
+
+		if (output.fail()) {
+			Logger::err(PointSetSerializer_bpc::title()) << "failed writing file \'" << file_name << "\'" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+}
+
+
+PointSet* PointSetSerializer_bpc::load(const std::string& file_name) {
+	MappedPointSet mapped;
+	if (!mapped.open(file_name))
+		return nil;
+
+	PointSet* pset = new PointSet;
+	mapped.copy_to(pset);
+	return pset;
+}
+
+
+bool PointSetSerializer_bpc::save(const std::string& file_name, const PointSet* pset, unsigned int chunk_size, bool chunk_boxes) {
+	DensePointSet dense;
+	dense.assign(pset);
+	return save(file_name, &dense, chunk_size, chunk_boxes);
+}
+
+
+bool PointSetSerializer_bpc::save(const std::string& file_name, const DensePointSet* pset, unsigned int chunk_size, bool chunk_boxes) {
+	return write_bpc(file_name, pset->size(), pset->positions(), pset->normals(), pset->colors(), chunk_size, chunk_boxes);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+
+
+// The file is laid out as: header, attribute table, positions, normals, colors,
+// chunk table (the positions start at a known offset, the rest is appended by
+// close() when the number of points is known).
+
+BpcWriter::BpcWriter()
+: output_(nil)
+, normals_(nil)
+, colors_(nil)
+, num_(0)
+, chunk_size_(PointSetSerializer_bpc::DEFAULT_CHUNK_SIZE)
+, chunk_boxes_(true)
+, failed_(false)
+{
+}
+
+
+BpcWriter::~BpcWriter() {
+	if (output_)
+		close();
+}
+
+
+bool BpcWriter::open(const std::string& file_name, bool normals, bool colors, unsigned int chunk_size, bool chunk_boxes) {
+	if (output_)
+		close();
+
+	const std::string& title = PointSetSerializer_bpc::title();
+	if (!is_little_endian()) {
+		Logger::err(title) << "big-endian machines are not supported" << std::endl;
+		return false;
+	}
+
+	file_name_ = file_name;
+	num_ = 0;
+	chunk_size_ = (chunk_size > 0) ? chunk_size : static_cast<unsigned int>(PointSetSerializer_bpc::DEFAULT_CHUNK_SIZE);
+	chunk_boxes_ = chunk_boxes;
+	boxes_.clear();
+	failed_ = false;
+
+	output_ = new std::ofstream(file_name.c_str(), std::fstream::binary);
+	if (normals)
+		normals_ = new std::ofstream((file_name + ".normals.tmp").c_str(), std::fstream::binary);
+	if (colors)
+		colors_ = new std::ofstream((file_name + ".colors.tmp").c_str(), std::fstream::binary);
+	if (output_->fail() || (normals_ && normals_->fail()) || (colors_ && colors_->fail())) {
+		Logger::err(title) << "could not open file\'" << file_name << "\'" << std::endl;
+		discard();
+		return false;
+	}
+
+	// room for the header and the attribute table, written by close()
+	unsigned int nb_attributes = 1 + (normals ? 1 : 0) + (colors ? 1 : 0);
+	Numeric::uint64 positions_offset = align(sizeof(BpcHeader) + nb_attributes * sizeof(BpcAttribute));
+	std::vector<char> zeros(static_cast<std::size_t>(positions_offset), 0);
+	output_->write(&zeros[0], zeros.size());
+	if (output_->fail()) {
+		Logger::err(title) << "failed writing file \'" << file_name << "\'" << std::endl;
+		discard();
+		return false;
+	}
+	return true;
+}
+
+
+bool BpcWriter::write(const float* xyz, const float* normals, const float* colors, unsigned int n) {
+	if (output_ == nil || n == 0)
+		return output_ != nil;
+
+	if ((normals_ && normals == nil) || (colors_ && colors == nil)) {
+		Logger::err(PointSetSerializer_bpc::title()) << "missing normals or colors (the writer was opened with them)" << std::endl;
+		return false;
+	}
+
+	output_->write(reinterpret_cast<const char*>(xyz), n * 3 * sizeof(float));
+	if (normals_)
+		normals_->write(reinterpret_cast<const char*>(normals), n * 3 * sizeof(float));
+	if (colors_)
+		colors_->write(reinterpret_cast<const char*>(colors), n * 3 * sizeof(float));
+
+	if (chunk_boxes_) {
+		for (unsigned int i = 0; i < n; ++i) {
+			const float* p = xyz + 3 * i;
+			if ((num_ + i) % chunk_size_ == 0) {
+				boxes_.insert(boxes_.end(), p, p + 3);
+				boxes_.insert(boxes_.end(), p, p + 3);
+				continue;
+			}
+			float* box = &boxes_[boxes_.size() - 6];
+			for (int k = 0; k < 3; ++k) {
+				if (p[k] < box[k])		box[k] = p[k];
+				if (p[k] > box[k + 3])	box[k + 3] = p[k];
+			}
+		}
+	}
+	num_ += n;
+
+	if (output_->fail() || (normals_ && normals_->fail()) || (colors_ && colors_->fail()))
+		failed_ = true;
+	return !failed_;
+}
+
+
+void BpcWriter::discard() {
+	// only the files created by open() (a file that could not be opened is not ours)
+	bool remove_output = output_ && output_->is_open();
+	bool remove_normals = normals_ && normals_->is_open();
+	bool remove_colors = colors_ && colors_->is_open();
+	delete output_;
+	delete normals_;
+	delete colors_;
+	output_ = normals_ = colors_ = nil;
+	if (remove_output)
+		std::remove(file_name_.c_str());
+	if (remove_normals)
+		std::remove((file_name_ + ".normals.tmp").c_str());
+	if (remove_colors)
+		std::remove((file_name_ + ".colors.tmp").c_str());
+	num_ = 0;
+	boxes_.clear();
+	failed_ = false;
+}
+
+
+bool BpcWriter::close() {
+	if (output_ == nil)
+		return false;
+
+	// the header is not written over a partially written file
+	if (failed_) {
+		Logger::err(PointSetSerializer_bpc::title()) << "failed writing file \'" << file_name_ << "\'" << std::endl;
+		discard();
+		return false;
+	}
+
+	const char* names[3] = { "position", "normal", "color" };
+	std::ofstream* temporaries[3] = { nil, normals_, colors_ };
+	std::string temporary_names[3] = { "", file_name_ + ".normals.tmp", file_name_ + ".colors.tmp" };
+
+	BpcHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, BPC_MAGIC, 4);
+	header.version = BPC_VERSION;
+	header.header_size = sizeof(BpcHeader);
+	header.nb_points = num_;
+	header.chunk_size = chunk_size_;
+	header.nb_chunks = (num_ + chunk_size_ - 1) / chunk_size_;
+	header.attribute_table_offset = sizeof(BpcHeader);
+	header.nb_attributes = 1 + (normals_ ? 1 : 0) + (colors_ ? 1 : 0);
+
+	Numeric::uint64 array_size = Numeric::uint64(num_) * 3 * sizeof(float);
+	Numeric::uint64 offset = align(sizeof(BpcHeader) + header.nb_attributes * sizeof(BpcAttribute));
+	std::vector<BpcAttribute> attributes;
+	static const char padding[BPC_ALIGNMENT] = { 0 };
+	std::vector<char> buffer(1 << 20);
+	for (int a = 0; a < 3; ++a) {
+		if (a > 0 && temporaries[a] == nil)
+			continue;
+		BpcAttribute attr;
+		std::memset(&attr, 0, sizeof(attr));
+		std::strcpy(attr.name, names[a]);
+		attr.type = BPC_FLOAT32;
+		attr.dimension = 3;
+		attr.offset = align(offset);
+		attributes.push_back(attr);
+
+		if (a > 0) {	// append the temporary file
+			output_->write(padding, static_cast<std::streamsize>(attr.offset - offset));
+			temporaries[a]->close();
+			std::ifstream input(temporary_names[a].c_str(), std::fstream::binary);
+			while (input) {
+				input.read(&buffer[0], buffer.size());
+				output_->write(&buffer[0], input.gcount());
+			}
+			input.close();
+			std::remove(temporary_names[a].c_str());
+		}
+		offset = attr.offset + array_size;
+	}
+
+	if (chunk_boxes_ && num_ > 0) {
+		header.chunk_table_offset = offset;
+		output_->write(reinterpret_cast<const char*>(&boxes_[0]), boxes_.size() * sizeof(float));
+	}
+
+	output_->seekp(0);
+	output_->write(reinterpret_cast<const char*>(&header), sizeof(header));
+	output_->write(reinterpret_cast<const char*>(&attributes[0]), attributes.size() * sizeof(BpcAttribute));
+	if (output_->fail()) {
+		Logger::err(PointSetSerializer_bpc::title()) << "failed writing file \'" << file_name_ << "\'" << std::endl;
+		discard();
+		return false;
+	}
+
+	delete output_;
+	delete normals_;
+	delete colors_;
+	output_ = normals_ = colors_ = nil;
+	boxes_.clear();
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+
+
+MappedPointSet::MappedPointSet()
+: num_(0)
+, chunk_size_(0)
+, nb_chunks_(0)
+, positions_(nil)
+, normals_(nil)
+, colors_(nil)
+, chunk_boxes_(nil)
+{
+}
+
+
+MappedPointSet::~MappedPointSet() {
+	close();
+}
+
+
+void MappedPointSet::close() {
+	file_.close();
+	num_ = chunk_size_ = nb_chunks_ = 0;
+	positions_ = normals_ = colors_ = chunk_boxes_ = nil;
+}
+
+
+bool MappedPointSet::open(const std::string& file_name) {
+	close();
+
+	const std::string& title = PointSetSerializer_bpc::title();
+	if (!is_little_endian()) {
+		Logger::err(title) << "big-endian machines are not supported" << std::endl;
+		return false;
+	}
+	if (!file_.open(file_name)) {
+		Logger::err(title) << "could not open file\'" << file_name << "\'" << std::endl;
+		return false;
+	}
+
+	const char* data = file_.data();
+	Numeric::uint64 size = file_.size();
+
+	BpcHeader header;
+	if (size < sizeof(header)) {
+		Logger::err(title) << "invalid file (too small)" << std::endl;
+		close();
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, BPC_MAGIC, 4) != 0 || header.header_size < sizeof(header)) {
+		Logger::err(title) << "not a bpc file" << std::endl;
+		close();
+		return false;
+	}
+	if (header.version > BPC_VERSION) {
+		Logger::err(title) << "unsupported version " << header.version << std::endl;
+		close();
+		return false;
+	}
+	if (header.nb_points > 0xFFFFFFFFull || header.chunk_size == 0 ||
+		Numeric::uint64(header.nb_chunks) * header.chunk_size < header.nb_points)
+	{
+		Logger::err(title) << "invalid header" << std::endl;
+		close();
+		return false;
+	}
+	if (!fits_in_file(header.attribute_table_offset, header.nb_attributes, sizeof(BpcAttribute), size) ||
+		(header.chunk_table_offset != 0 && !fits_in_file(header.chunk_table_offset, header.nb_chunks, 6 * sizeof(float), size)))
+	{
+		Logger::err(title) << "invalid file (truncated)" << std::endl;
+		close();
+		return false;
+	}
+
+	num_ = static_cast<unsigned int>(header.nb_points);
+	chunk_size_ = header.chunk_size;
+	nb_chunks_ = header.nb_chunks;
+	if (header.chunk_table_offset != 0 && header.chunk_table_offset % sizeof(float) == 0)
+		chunk_boxes_ = reinterpret_cast<const float*>(data + header.chunk_table_offset);
+
+	for (unsigned int i = 0; i < header.nb_attributes; ++i) {
+		BpcAttribute attr;
+		std::memcpy(&attr, data + header.attribute_table_offset + i * sizeof(BpcAttribute), sizeof(attr));
+		attr.name[15] = '\0';
+
+		const float** array = nil;
+		if (!std::strcmp(attr.name, "position"))	array = &positions_;
+		else if (!std::strcmp(attr.name, "normal"))	array = &normals_;
+		else if (!std::strcmp(attr.name, "color"))	array = &colors_;
+		else
+			continue;	// unknown attribute: skip it
+
+		if (attr.type != BPC_FLOAT32 || attr.dimension != 3 || attr.offset % sizeof(float) != 0 ||
+			!fits_in_file(attr.offset, num_, 3 * sizeof(float), size))
+		{
+			Logger::warn(title) << "attribute \'" << attr.name << "\' ignored (invalid)" << std::endl;
+			continue;
+		}
+		*array = reinterpret_cast<const float*>(data + attr.offset);
+	}
+
+	if (positions_ == nil && num_ > 0) {
+		Logger::err(title) << "no point positions in file" << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+Box3d MappedPointSet::chunk_box(unsigned int i) const {
+	Box3d box;
+	if (chunk_boxes_) {
+		const float* b = chunk_boxes_ + 6 * i;
+		box.add_point(vec3(b[0], b[1], b[2]));
+		box.add_point(vec3(b[3], b[4], b[5]));
+	}
+	return box;
+}
+
+
+void MappedPointSet::copy_to(PointSet* pset) const {
+	pset->append(positions_, num_, normals_, colors_);
+}
+
+
+void MappedPointSet::copy_to(PointSet* pset, const Box3d& box) const {
+	std::vector<float> positions, normals, colors;
+	for (unsigned int c = 0; c < nb_chunks_; ++c) {
+		if (chunk_boxes_) {
+			const float* b = chunk_boxes_ + 6 * c;
+			if (b[0] > box.x_max() || b[3] < box.x_min() ||
+				b[1] > box.y_max() || b[4] < box.y_min() ||
+				b[2] > box.z_max() || b[5] < box.z_min())
+				continue;
+		}
+
+		positions.clear();
+		normals.clear();
+		colors.clear();
+		for (unsigned int i = chunk_begin(c); i < chunk_end(c); ++i) {
+			const float* p = positions_ + 3 * i;
+			if (p[0] < box.x_min() || p[0] > box.x_max() ||
+				p[1] < box.y_min() || p[1] > box.y_max() ||
+				p[2] < box.z_min() || p[2] > box.z_max())
+				continue;
+			positions.insert(positions.end(), p, p + 3);
+			if (normals_)
+				normals.insert(normals.end(), normals_ + 3 * i, normals_ + 3 * i + 3);
+			if (colors_)
+				colors.insert(colors.end(), colors_ + 3 * i, colors_ + 3 * i + 3);
+		}
+		if (!positions.empty()) {
+			pset->append(&positions[0], static_cast<unsigned int>(positions.size() / 3),
+				normals_ ? &normals[0] : nil, colors_ ? &colors[0] : nil);
+		}
+	}
+}
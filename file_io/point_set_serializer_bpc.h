@@ -0,0 +1,166 @@
+#ifndef _POINT_SET_SERIALIZER_BPC_H_
+#define _POINT_SET_SERIALIZER_BPC_H_
+
+#include "file_io_common.h"
+#include "../basic/mapped_file.h"
+#include "../math/math_types.h"
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+
+/***********************************************************************
+ The "bpc" (binary point cloud) format. It is designed to be memory-mapped:
+ each attribute is stored as one contiguous, 64-byte aligned array that can
+ be used in place (see MappedPointSet).
+
+ All values are little-endian.
+   - header (64 bytes):
+       char[4]  magic ("BPC" followed by '\0')
+       uint32   version (1)
+       uint32   header size (64)
+       uint32   number of attributes
+       uint64   number of points
+       uint32   chunk size (number of points per chunk)
+       uint32   number of chunks
+       uint64   offset of the attribute table
+       uint64   offset of the chunk table (0 if there is none)
+       char[16] reserved (0)
+   - attribute table, one entry (32 bytes) per attribute:
+       char[16] name ("position", "normal", "color"), '\0'-terminated
+       uint32   type of the values (1: float32)
+       uint32   number of values per point (3)
+       uint64   offset of the array
+   - chunk table (optional), one entry (24 bytes) per chunk: the bounding box
+       of the points of the chunk (float32 x_min, y_min, z_min, x_max, y_max, z_max).
+       The i-th chunk contains the points [i * chunk_size, (i+1) * chunk_size).
+   - the arrays of the attributes.
+
+ Readers skip the attributes they do not know, so new attributes can be
+ added without changing the version.
+************************************************************************/
+
+
+class PointSet;
+class DensePointSet;
+
+class FILE_IO_API PointSetSerializer_bpc
+{
+public:
+	static std::string title() { return "[PointSetSerializer_bpc]: "; }
+
+	enum { DEFAULT_CHUNK_SIZE = 65536 };
+
+	// Reads the whole file into a new PointSet (see MappedPointSet to access it without copy).
+	static PointSet* load(const std::string& file_name) ;
+
+	// If $chunk_boxes$ is true, the bounding box of each chunk is saved.
+	static bool		 save(const std::string& file_name, const PointSet* pset,
+		unsigned int chunk_size = DEFAULT_CHUNK_SIZE, bool chunk_boxes = true) ;
+	static bool		 save(const std::string& file_name, const DensePointSet* pset,
+		unsigned int chunk_size = DEFAULT_CHUNK_SIZE, bool chunk_boxes = true) ;
+} ;
+
+
+// Writes a "bpc" file by pieces, when the number of points is not known in
+// advance (e.g., the output of a PointPipeline). The positions are written 
+// directly to the file, the normals and colors to temporary files (next to
+// the file) which are appended to it by close().
+class FILE_IO_API BpcWriter
+{
+public:
+	BpcWriter() ;
+	~BpcWriter() ;
+
+	bool open(const std::string& file_name, bool normals, bool colors,
+		unsigned int chunk_size = PointSetSerializer_bpc::DEFAULT_CHUNK_SIZE, bool chunk_boxes = true) ;
+
+	// $n$ points, 3 floats per point in each array. $normals$ (resp. $colors$)
+	// is ignored if the file was opened without normals (resp. colors), and
+	// must not be nil otherwise (the points are then not written).
+	bool write(const float* xyz, const float* normals, const float* colors, unsigned int n) ;
+
+	// Completes the file. Returns false if anything failed since open(), and
+	// then deletes the file (there is no incomplete file with a valid header).
+	bool close() ;
+
+	unsigned int size() const { return num_ ; }
+
+private:
+	std::string		file_name_ ;
+	std::ofstream*	output_ ;
+	std::ofstream*	normals_ ;
+	std::ofstream*	colors_ ;
+	unsigned int	num_ ;
+	unsigned int	chunk_size_ ;
+	bool			chunk_boxes_ ;
+	std::vector<float>	boxes_ ;	// the boxes of the chunks (6 floats per chunk)
+	bool			failed_ ;
+
+private:
+	// closes and deletes the file and the temporary files
+	void discard() ;
+
+	BpcWriter(const BpcWriter&) ;
+	BpcWriter& operator=(const BpcWriter&) ;
+} ;
+
+
+// A "bpc" file mapped in memory. The arrays point directly into the mapping
+// (3 floats per point, the same layout as DensePointSet), so opening a file
+// costs nothing but reading its header, and only the pages actually accessed
+// are loaded from the disk. The arrays are valid until close().
+class FILE_IO_API MappedPointSet
+{
+public:
+	MappedPointSet() ;
+	~MappedPointSet() ;
+
+	// returns false if the file cannot be mapped or is not a valid "bpc" file.
+	bool open(const std::string& file_name) ;
+	void close() ;
+
+	bool is_open() const { return file_.is_open() ; }
+
+	unsigned int size() const { return num_ ; }
+
+	// nil if the attribute is not in the file
+	const float* positions() const { return positions_ ; }
+	const float* normals() const   { return normals_ ; }
+	const float* colors() const    { return colors_ ; }
+
+	vec3 point(unsigned int i) const {
+		const float* p = positions_ + 3 * i ;
+		return vec3(p[0], p[1], p[2]) ;
+	}
+
+	unsigned int chunk_size() const { return chunk_size_ ; }
+	unsigned int nb_chunks() const  { return nb_chunks_ ; }
+	// the points of the i-th chunk are [chunk_begin(i), chunk_end(i))
+	unsigned int chunk_begin(unsigned int i) const { return i * chunk_size_ ; }
+	unsigned int chunk_end(unsigned int i) const {
+		unsigned int end = (i + 1) * chunk_size_ ;
+		return (end < num_) ? end : num_ ;
+	}
+	bool has_chunk_boxes() const { return chunk_boxes_ != nil ; }
+	Box3d chunk_box(unsigned int i) const ;
+
+	// Appends the points (and the normals/colors if any) to $pset$.
+	void copy_to(PointSet* pset) const ;
+	// Appends the points of the chunks intersecting $box$ to $pset$. All the
+	// chunks are copied if the file has no chunk boxes.
+	void copy_to(PointSet* pset, const Box3d& box) const ;
+
+private:
+	MappedFile		file_ ;
+	unsigned int	num_ ;
+	unsigned int	chunk_size_ ;
+	unsigned int	nb_chunks_ ;
+	const float*	positions_ ;
+	const float*	normals_ ;
+	const float*	colors_ ;
+	const float*	chunk_boxes_ ;
+} ;
+
+
+#endif
@@ -1,6 +1,7 @@
 
 #include "point_set_serializer_ply.h"
 #include "rply.h"
+#include "ply_binary_reader.h"
 #include "../basic/logger.h"
 #include "../basic/basic_types.h"
 #include "../geom/point_set.h"
@@ -11,10 +12,25 @@
 
 
 
-class PlyPointSetLoad 
+// The vertices of the common binary files are read by PlyBinaryReader, rply
+// is used for the others.
+class PlyPointSetLoad : public PlyBinaryReader::VertexConsumer
 {
 public:
 	PointSet* load(const std::string& filename) {
+		PlyBinaryReader reader;
+		if (reader.open(filename)) {
+			point_set_ = new PointSet;
+			point_set_->reserve(reader.nb_vertices());
+			if (!reader.read(this)) {
+				Logger::err("PlyPointSetLoad") 
+					<< filename << ": problem occurred while parsing PLY file" << std::endl;
+				delete point_set_;
+				point_set_ = nil;
+			}
+			return end_point_set();
+		}
+
 		p_ply ply = ply_open(filename.c_str(), nil, 0, nil) ;
 		if(ply == nil) {
 			Logger::err("PlyPointSetLoad") << filename << ": could not open" << std::endl;
@@ -53,6 +69,11 @@ public:
 	}
 
 protected:
+	virtual bool consume_vertices(const float* xyz, const float* normals, const float* colors, unsigned int n) {
+		point_set_->append(xyz, n, normals, colors);
+		return true;
+	}
+
 	void check_for_colors_and_normals(p_ply ply) {
 		p_ply_element element = nil ;
 
@@ -212,6 +233,7 @@ protected:
 	
 	void create_vertices(unsigned int nb_vertices) {
 		vertices_.resize(nb_vertices);
+		point_set_->reserve(nb_vertices);	// the attributes are already bound
 	}
 
 	void set_vertex_color(unsigned int idx, const Color& c) {
@@ -0,0 +1,559 @@
+#include "point_stream_io.h"
+#include "ply_binary_reader.h"
+#include "point_set_serializer_ply.h"
+#include "point_set_serializer_bpc.h"
+#include "../geom/point_set.h"
+#include "../basic/file_utils.h"
+#include "../basic/logger.h"
+#include "../basic/text_parser.h"
+
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+
+namespace {
+
+	// ___________________________ sources ___________________________
+
+
+	// xyz, pn and pnc files: one point per line.
+	class TextPointSource : public PointSource {
+	public:
+		TextPointSource(unsigned int chunk_size)
+			: chunk_size_(chunk_size), buffer_(1 << 22), begin_(0), end_(0)
+			, nb_values_(3), normals_(false), colors_(false)
+		{}
+
+		bool open(const std::string& file_name, const std::string& ext) {
+			input_.open(file_name.c_str(), std::fstream::binary);
+			if (input_.fail())
+				return false;
+
+			if (ext == "pn")
+				normals_ = true;
+			else if (ext == "pnc")
+				normals_ = colors_ = true;
+			else {
+				// xyz: the first line with numbers tells the content (see PointSetIO::load_xyz())
+				fill();
+				const char* p = data() + begin_;
+				const char* end = data() + end_;
+				int cols = 0;
+				while (p < end && cols == 0) {
+					cols = TextParser::count_numbers(p, end);
+					TextParser::next_line(p, end);
+				}
+				if (cols < 3)
+					return false;
+				normals_ = (cols >= 6);
+			}
+			nb_values_ = colors_ ? 9 : (normals_ ? 6 : 3);
+			return true;
+		}
+
+		virtual bool has_normals() const { return normals_; }
+		virtual bool has_colors() const { return colors_; }
+
+		virtual bool next(DensePointSet& chunk) {
+			chunk.set_has_normals(normals_);
+			chunk.set_has_colors(colors_);
+			chunk.resize(chunk_size_);
+			float* p = chunk.positions();
+			float* n = chunk.normals();
+			float* c = chunk.colors();
+
+			unsigned int num = 0;
+			float v[9];
+			while (num < chunk_size_) {
+				const char* line = data() + begin_;
+				const char* end = data() + end_;
+				const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+				if (eol == nil) {
+					if (fill())
+						continue;
+					// fill() may have moved the content to the front of the buffer
+					line = data() + begin_;
+					end = data() + end_;
+					if (line == end)
+						break;
+					eol = end;	// the last line, without '\n'
+				}
+
+				if (TextParser::parse_floats(line, eol, v, nb_values_) == nb_values_) {
+					std::memcpy(p + 3 * num, v, 3 * sizeof(float));
+					if (n)
+						std::memcpy(n + 3 * num, v + 3, 3 * sizeof(float));
+					if (c)
+						std::memcpy(c + 3 * num, v + 6, 3 * sizeof(float));
+					++num;
+				}
+				begin_ = (eol - data()) + (eol < end ? 1 : 0);
+			}
+
+			chunk.resize(num);
+			return num > 0;
+		}
+
+	private:
+		const char* data() const { return &buffer_[0]; }
+
+		// reads more data after the current content, returns false at the end of the file
+		bool fill() {
+			std::size_t remaining = end_ - begin_;
+			if (remaining > 0 && begin_ > 0)
+				std::memmove(&buffer_[0], &buffer_[begin_], remaining);
+			begin_ = 0;
+			end_ = remaining;
+			if (end_ == buffer_.size())		// a very long line
+				buffer_.resize(2 * buffer_.size());
+			if (!input_)
+				return false;
+			input_.read(&buffer_[end_], static_cast<std::streamsize>(buffer_.size() - end_));
+			std::size_t count = static_cast<std::size_t>(input_.gcount());
+			end_ += count;
+			return count > 0;
+		}
+
+	private:
+		std::ifstream		input_;
+		unsigned int		chunk_size_;
+		std::vector<char>	buffer_;
+		std::size_t			begin_;
+		std::size_t			end_;
+		int					nb_values_;
+		bool				normals_;
+		bool				colors_;
+	};
+
+
+	// bxyz, bpn and bpnc files: 3, 6 or 9 floats per point.
+	class BinaryPointSource : public PointSource {
+	public:
+		BinaryPointSource(unsigned int chunk_size)
+			: chunk_size_(chunk_size), nb_values_(3), normals_(false), colors_(false), num_left_(0)
+		{}
+
+		bool open(const std::string& file_name, const std::string& ext) {
+			input_.open(file_name.c_str(), std::fstream::binary);
+			if (input_.fail())
+				return false;
+
+			normals_ = (ext == "bpn" || ext == "bpnc");
+			colors_ = (ext == "bpnc");
+			nb_values_ = colors_ ? 9 : (normals_ ? 6 : 3);
+
+			input_.seekg(0, std::ios::end);
+			std::streamoff size = input_.tellg();
+			input_.seekg(0, std::ios::beg);
+			if (ext == "bpn") {		// the number of points comes first
+				int num = 0;
+				input_.read(reinterpret_cast<char*>(&num), sizeof(int));
+				num_left_ = static_cast<std::size_t>(std::max(num, 0));
+			}
+			else
+				num_left_ = static_cast<std::size_t>(size / (nb_values_ * sizeof(float)));
+			return !input_.fail();
+		}
+
+		virtual bool has_normals() const { return normals_; }
+		virtual bool has_colors() const { return colors_; }
+
+		virtual bool next(DensePointSet& chunk) {
+			unsigned int num = static_cast<unsigned int>(std::min<std::size_t>(chunk_size_, num_left_));
+			chunk.set_has_normals(normals_);
+			chunk.set_has_colors(colors_);
+			chunk.resize(num);
+			if (num == 0)
+				return false;
+
+			if (nb_values_ == 3)
+				input_.read(reinterpret_cast<char*>(chunk.positions()), num * 3 * sizeof(float));
+			else {
+				buffer_.resize(num * nb_values_);
+				input_.read(reinterpret_cast<char*>(&buffer_[0]), buffer_.size() * sizeof(float));
+				float* arrays[3] = { chunk.positions(), chunk.normals(), chunk.colors() };
+				for (unsigned int i = 0; i < num; ++i) {
+					const float* v = &buffer_[i * nb_values_];
+					for (int a = 0; a < nb_values_ / 3; ++a)
+						std::memcpy(arrays[a] + 3 * i, v + 3 * a, 3 * sizeof(float));
+				}
+			}
+
+			num_left_ -= num;
+			if (input_.fail()) {
+				Logger::err(PointStreamIO::title()) << "unexpected end of file" << std::endl;
+				num_left_ = 0;
+				chunk.resize(0);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		std::ifstream		input_;
+		unsigned int		chunk_size_;
+		int					nb_values_;
+		bool				normals_;
+		bool				colors_;
+		std::size_t			num_left_;
+		std::vector<float>	buffer_;
+	};
+
+
+	class PlyPointSource : public PointSource {
+	public:
+		PlyPointSource(unsigned int chunk_size) : chunk_size_(chunk_size) {}
+
+		bool open(const std::string& file_name) {
+			return reader_.open(file_name) && reader_.begin_vertices();
+		}
+
+		virtual bool has_normals() const { return reader_.has_normals(); }
+		virtual bool has_colors() const { return reader_.has_colors(); }
+
+		virtual bool next(DensePointSet& chunk) {
+			chunk.set_has_normals(reader_.has_normals());
+			chunk.set_has_colors(reader_.has_colors());
+			chunk.resize(chunk_size_);
+			unsigned int num = reader_.next_vertices(chunk.positions(), chunk.normals(), chunk.colors(), chunk_size_);
+			chunk.resize(num);
+			return num > 0;
+		}
+
+	private:
+		PlyBinaryReader		reader_;
+		unsigned int		chunk_size_;
+	};
+
+
+	// Used for the files PlyBinaryReader cannot read (e.g., ASCII): the points
+	// are all loaded first.
+	class LoadedPointSource : public PointSource {
+	public:
+		LoadedPointSource(PointSet* pset, unsigned int chunk_size)
+			: pset_(pset), source_(new PointSetSource(pset, chunk_size))
+		{}
+		~LoadedPointSource() {
+			delete source_;
+			delete pset_;
+		}
+
+		virtual bool next(DensePointSet& chunk) { return source_->next(chunk); }
+		virtual bool has_normals() const { return source_->has_normals(); }
+		virtual bool has_colors() const { return source_->has_colors(); }
+
+	private:
+		PointSet*		pset_;
+		PointSetSource*	source_;
+	};
+
+
+	class BpcPointSource : public PointSource {
+	public:
+		BpcPointSource(unsigned int chunk_size) : chunk_size_(chunk_size), current_(0) {}
+
+		bool open(const std::string& file_name) {
+			return mapped_.open(file_name);
+		}
+
+		virtual bool has_normals() const { return mapped_.normals() != nil; }
+		virtual bool has_colors() const { return mapped_.colors() != nil; }
+
+		virtual bool next(DensePointSet& chunk) {
+			unsigned int num = std::min(chunk_size_, mapped_.size() - current_);
+			chunk.set_has_normals(has_normals());
+			chunk.set_has_colors(has_colors());
+			chunk.resize(num);
+			if (num == 0)
+				return false;
+
+			std::memcpy(chunk.positions(), mapped_.positions() + 3 * current_, num * 3 * sizeof(float));
+			if (has_normals())
+				std::memcpy(chunk.normals(), mapped_.normals() + 3 * current_, num * 3 * sizeof(float));
+			if (has_colors())
+				std::memcpy(chunk.colors(), mapped_.colors() + 3 * current_, num * 3 * sizeof(float));
+			current_ += num;
+			return true;
+		}
+
+	private:
+		MappedPointSet	mapped_;
+		unsigned int	chunk_size_;
+		unsigned int	current_;
+	};
+
+
+	// ___________________________ sinks ___________________________
+
+
+	// the arrays of a chunk, with zeros for the missing normals/colors
+	void chunk_arrays(const DensePointSet& chunk, std::vector<float>& zeros, const float* arrays[3]) {
+		arrays[0] = chunk.positions();
+		arrays[1] = chunk.normals();
+		arrays[2] = chunk.colors();
+		if (arrays[1] == nil || arrays[2] == nil) {
+			zeros.assign(3 * chunk.size(), 0.0f);
+			if (arrays[1] == nil)	arrays[1] = &zeros[0];
+			if (arrays[2] == nil)	arrays[2] = &zeros[0];
+		}
+	}
+
+
+	// xyz, pn and pnc files
+	class TextPointSink : public PointSink {
+	public:
+		TextPointSink(const std::string& file_name, int nb_values) : file_name_(file_name), nb_values_(nb_values) {}
+
+		virtual bool begin(bool, bool) {
+			output_.open(file_name_.c_str(), std::fstream::binary);
+			return !output_.fail();
+		}
+
+		virtual bool write(const DensePointSet& chunk) {
+			const float* arrays[3];
+			chunk_arrays(chunk, zeros_, arrays);
+
+			text_.clear();
+			char line[256];
+			for (unsigned int i = 0; i < chunk.size(); ++i) {
+				int length = 0;
+				for (int k = 0; k < nb_values_; ++k) {
+					const char* format = (k + 1 < nb_values_) ? "%.9g " : "%.9g\n";
+					length += std::sprintf(line + length, format, arrays[k / 3][3 * i + k % 3]);
+				}
+				text_.insert(text_.end(), line, line + length);
+			}
+			if (!text_.empty())
+				output_.write(&text_[0], text_.size());
+			return !output_.fail();
+		}
+
+		virtual bool end() {
+			output_.close();
+			return !output_.fail();
+		}
+
+	private:
+		std::string			file_name_;
+		int					nb_values_;
+		std::ofstream		output_;
+		std::vector<char>	text_;
+		std::vector<float>	zeros_;
+	};
+
+
+	// bxyz, bpn and bpnc files
+	class BinaryPointSink : public PointSink {
+	public:
+		BinaryPointSink(const std::string& file_name, int nb_values, bool with_count)
+			: file_name_(file_name), nb_values_(nb_values), with_count_(with_count), num_(0)
+		{}
+
+		virtual bool begin(bool, bool) {
+			output_.open(file_name_.c_str(), std::fstream::binary);
+			num_ = 0;
+			if (with_count_)	// completed by end()
+				output_.write(reinterpret_cast<const char*>(&num_), sizeof(int));
+			return !output_.fail();
+		}
+
+		virtual bool write(const DensePointSet& chunk) {
+			const float* arrays[3];
+			chunk_arrays(chunk, zeros_, arrays);
+
+			buffer_.resize(chunk.size() * nb_values_);
+			for (unsigned int i = 0; i < chunk.size(); ++i) {
+				float* v = &buffer_[i * nb_values_];
+				for (int a = 0; a < nb_values_ / 3; ++a)
+					std::memcpy(v + 3 * a, arrays[a] + 3 * i, 3 * sizeof(float));
+			}
+			if (!buffer_.empty())
+				output_.write(reinterpret_cast<const char*>(&buffer_[0]), buffer_.size() * sizeof(float));
+			num_ += chunk.size();
+			return !output_.fail();
+		}
+
+		virtual bool end() {
+			if (with_count_) {
+				output_.seekp(0);
+				output_.write(reinterpret_cast<const char*>(&num_), sizeof(int));
+			}
+			output_.close();
+			return !output_.fail();
+		}
+
+	private:
+		std::string			file_name_;
+		int					nb_values_;
+		bool				with_count_;
+		int					num_;
+		std::ofstream		output_;
+		std::vector<float>	buffer_;
+		std::vector<float>	zeros_;
+	};
+
+
+	// Binary little-endian PLY files, with the same properties as the ones
+	// saved by PointSetSerializer_ply. The number of vertices is written with
+	// a fixed width and updated by end().
+	class PlyPointSink : public PointSink {
+	public:
+		PlyPointSink(const std::string& file_name) : file_name_(file_name), num_(0), count_pos_(0) {}
+
+		virtual bool begin(bool has_normals, bool has_colors) {
+			normals_ = has_normals;
+			colors_ = has_colors;
+			num_ = 0;
+
+			output_.open(file_name_.c_str(), std::fstream::binary);
+			output_ << "ply\n" << "format binary_little_endian 1.0\n" << "element vertex ";
+			count_pos_ = output_.tellp();
+			write_count();
+			output_ << "\nproperty float x\nproperty float y\nproperty float z\n";
+			if (normals_)
+				output_ << "property float nx\nproperty float ny\nproperty float nz\n";
+			if (colors_)
+				output_ << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+			output_ << "end_header\n";
+			return !output_.fail();
+		}
+
+		virtual bool write(const DensePointSet& chunk) {
+			std::size_t record_size = 12 + (normals_ ? 12 : 0) + (colors_ ? 3 : 0);
+			buffer_.resize(chunk.size() * record_size);
+			const float* p = chunk.positions();
+			const float* n = chunk.normals();
+			const float* c = chunk.colors();
+			char* r = &buffer_[0];
+			for (unsigned int i = 0; i < chunk.size(); ++i) {
+				std::memcpy(r, p + 3 * i, 12);
+				r += 12;
+				if (normals_) {
+					std::memcpy(r, n + 3 * i, 12);
+					r += 12;
+				}
+				if (colors_) {
+					for (int k = 0; k < 3; ++k) {
+						float v = c[3 * i + k] * 255.0f;
+						ogf_clamp(v, 0.0f, 255.0f);
+						*r++ = static_cast<char>(static_cast<unsigned char>(v));
+					}
+				}
+			}
+			if (!buffer_.empty())
+				output_.write(&buffer_[0], buffer_.size());
+			num_ += chunk.size();
+			return !output_.fail();
+		}
+
+		virtual bool end() {
+			output_.seekp(count_pos_);
+			write_count();
+			output_.close();
+			return !output_.fail();
+		}
+
+	private:
+		void write_count() {
+			char count[16];
+			std::sprintf(count, "%010u", num_);
+			output_ << count;
+		}
+
+	private:
+		std::string			file_name_;
+		bool				normals_;
+		bool				colors_;
+		unsigned int		num_;
+		std::streampos		count_pos_;
+		std::ofstream		output_;
+		std::vector<char>	buffer_;
+	};
+
+
+	class BpcPointSink : public PointSink {
+	public:
+		BpcPointSink(const std::string& file_name) : file_name_(file_name) {}
+
+		virtual bool begin(bool has_normals, bool has_colors) {
+			return writer_.open(file_name_, has_normals, has_colors);
+		}
+		virtual bool write(const DensePointSet& chunk) {
+			return writer_.write(chunk.positions(), chunk.normals(), chunk.colors(), chunk.size());
+		}
+		virtual bool end() {
+			return writer_.close();
+		}
+
+	private:
+		std::string	file_name_;
+		BpcWriter	writer_;
+	};
+
+}
+
+
+PointSource* PointStreamIO::open(const std::string& file_name, unsigned int chunk_size /* = 65536 */) {
+	std::string ext = FileUtils::extension(file_name);
+	String::to_lowercase(ext);
+	if (chunk_size == 0)
+		chunk_size = 65536;
+
+	if (ext == "xyz" || ext == "pn" || ext == "pnc") {
+		TextPointSource* source = new TextPointSource(chunk_size);
+		if (source->open(file_name, ext))
+			return source;
+		delete source;
+	}
+	else if (ext == "bxyz" || ext == "bpn" || ext == "bpnc") {
+		BinaryPointSource* source = new BinaryPointSource(chunk_size);
+		if (source->open(file_name, ext))
+			return source;
+		delete source;
+	}
+	else if (ext == "ply") {
+		PlyPointSource* source = new PlyPointSource(chunk_size);
+		if (source->open(file_name))
+			return source;
+		delete source;
+
+		Logger::warn(title()) << "the file cannot be streamed (e.g., ASCII PLY), loading it entirely" << std::endl;
+		PointSet* pset = PointSetSerializer_ply::load(file_name);
+		if (pset)
+			return new LoadedPointSource(pset, chunk_size);
+	}
+	else if (ext == "bpc") {
+		BpcPointSource* source = new BpcPointSource(chunk_size);
+		if (source->open(file_name))
+			return source;
+		delete source;
+	}
+	else {
+		Logger::err(title()) << "unknown file format: " << ext << std::endl;
+		return nil;
+	}
+
+	Logger::err(title()) << "could not open file \'" << file_name << "\'" << std::endl;
+	return nil;
+}
+
+
+PointSink* PointStreamIO::create(const std::string& file_name) {
+	std::string ext = FileUtils::extension(file_name);
+	String::to_lowercase(ext);
+
+	if (ext == "xyz")	return new TextPointSink(file_name, 3);
+	if (ext == "pn")	return new TextPointSink(file_name, 6);
+	if (ext == "pnc")	return new TextPointSink(file_name, 9);
+	if (ext == "bxyz")	return new BinaryPointSink(file_name, 3, false);
+	if (ext == "bpn")	return new BinaryPointSink(file_name, 6, true);
+	if (ext == "bpnc")	return new BinaryPointSink(file_name, 9, false);
+	if (ext == "ply")	return new PlyPointSink(file_name);
+	if (ext == "bpc")	return new BpcPointSink(file_name);
+
+	Logger::err(title()) << "unknown file format: " << ext << std::endl;
+	return nil;
+}
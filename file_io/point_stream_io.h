@@ -0,0 +1,31 @@
+#ifndef _POINT_STREAM_IO_H_
+#define _POINT_STREAM_IO_H_
+
+#include "file_io_common.h"
+#include "../geom/point_stream.h"
+
+#include <string>
+
+
+// Sources and sinks of the streaming pipeline (see PointPipeline) for the
+// point cloud files. The formats are those of PointSetIO (chosen by the
+// extension): xyz, pn, pnc, bxyz, bpn, bpnc, ply and bpc. The files are
+// read and written by chunks, so the memory used does not depend on their
+// size, except for the ASCII PLY files which are loaded entirely.
+
+class FILE_IO_API PointStreamIO
+{
+public:
+	static std::string title() { return "PointStreamIO"; }
+
+	// Returns nil if the file cannot be opened or its format is not supported.
+	// The chunks have at most $chunk_size$ points.
+	static PointSource* open(const std::string& file_name, unsigned int chunk_size = 65536) ;
+
+	// Returns nil if the format is not supported. The file is created by the
+	// begin() of the sink.
+	static PointSink* create(const std::string& file_name) ;
+} ;
+
+
+#endif
@@ -0,0 +1,138 @@
+#include "dense_point_set.h"
+#include "point_set.h"
+#include "iterators.h"
+
+
+DensePointSet::DensePointSet()
+: has_normals_(false)
+, has_colors_(false)
+{
+}
+
+DensePointSet::~DensePointSet() {
+}
+
+
+Box3d DensePointSet::bounding_box() const {
+	Box3d result ;
+	unsigned int num = size() ;
+	if (num == 0)
+		return result ;
+
+	const float* p = positions() ;
+	float min_x = p[0], min_y = p[1], min_z = p[2] ;
+	float max_x = p[0], max_y = p[1], max_z = p[2] ;
+	for (unsigned int i = 1; i < num; ++i) {
+		p += 3 ;
+		if (p[0] < min_x) min_x = p[0] ; else if (p[0] > max_x) max_x = p[0] ;
+		if (p[1] < min_y) min_y = p[1] ; else if (p[1] > max_y) max_y = p[1] ;
+		if (p[2] < min_z) min_z = p[2] ; else if (p[2] > max_z) max_z = p[2] ;
+	}
+	result.add_point(vec3(min_x, min_y, min_z)) ;
+	result.add_point(vec3(max_x, max_y, max_z)) ;
+	return result ;
+}
+
+
+void DensePointSet::clear() {
+	positions_.clear() ;
+	normals_.clear() ;
+	colors_.clear() ;
+}
+
+
+void DensePointSet::set_has_normals(bool b) {
+	has_normals_ = b ;
+	if (b)
+		normals_.resize(positions_.size(), 0.0f) ;
+	else
+		std::vector<float>().swap(normals_) ;
+}
+
+
+void DensePointSet::set_has_colors(bool b) {
+	has_colors_ = b ;
+	if (b)
+		colors_.resize(positions_.size(), 0.0f) ;
+	else
+		std::vector<float>().swap(colors_) ;
+}
+
+
+void DensePointSet::reserve(unsigned int n) {
+	positions_.reserve(3 * n) ;
+	if (has_normals_)
+		normals_.reserve(3 * n) ;
+	if (has_colors_)
+		colors_.reserve(3 * n) ;
+}
+
+
+void DensePointSet::resize(unsigned int n) {
+	positions_.resize(3 * n, 0.0f) ;
+	if (has_normals_)
+		normals_.resize(3 * n, 0.0f) ;
+	if (has_colors_)
+		colors_.resize(3 * n, 0.0f) ;
+}
+
+
+unsigned int DensePointSet::add_point(const vec3& p) {
+	unsigned int idx = size() ;
+	resize(idx + 1) ;
+	set_point(idx, p) ;
+	return idx ;
+}
+
+
+void DensePointSet::keep(const std::vector<unsigned int>& indices) {
+	float* arrays[3] = { positions(), normals(), colors() } ;
+	for (int a = 0; a < 3; ++a) {
+		float* v = arrays[a] ;
+		if (v == nil)
+			continue ;
+		// in place: indices[i] >= i
+		for (std::size_t i = 0; i < indices.size(); ++i) {
+			const float* src = v + 3 * indices[i] ;
+			float* dst = v + 3 * i ;
+			dst[0] = src[0] ;	dst[1] = src[1] ;	dst[2] = src[2] ;
+		}
+	}
+	resize(static_cast<unsigned int>(indices.size())) ;
+}
+
+
+void DensePointSet::assign(const PointSet* pset) {
+	clear() ;
+
+	PointSet* s = const_cast<PointSet*>(pset) ;
+	PointSetNormal normals ;
+	PointSetColor  colors ;
+	set_has_normals(normals.bind_if_defined(s, "normal")) ;
+	set_has_colors(colors.bind_if_defined(s, "color")) ;
+	resize(pset->size_of_vertices()) ;
+
+	float* p = positions() ;
+	float* n = this->normals() ;
+	float* c = this->colors() ;
+	FOR_EACH_VERTEX_CONST(PointSet, pset, it) {
+		const vec3& q = it->point() ;
+		p[0] = float(q.x) ;	p[1] = float(q.y) ;	p[2] = float(q.z) ;
+		p += 3 ;
+		if (n) {
+			const vec3& m = normals[it] ;
+			n[0] = float(m.x) ;	n[1] = float(m.y) ;	n[2] = float(m.z) ;
+			n += 3 ;
+		}
+		if (c) {
+			const Color& col = colors[it] ;
+			c[0] = col.r() ;	c[1] = col.g() ;	c[2] = col.b() ;
+			c += 3 ;
+		}
+	}
+}
+
+
+void DensePointSet::copy_to(PointSet* pset) const {
+	pset->append(positions(), size(), normals(), colors()) ;
+}
@@ -0,0 +1,121 @@
+#ifndef _GEOM_DENSE_POINT_SET_H_
+#define _GEOM_DENSE_POINT_SET_H_
+
+#include "geom_common.h"
+#include "../math/math_types.h"
+#include "../basic/object.h"
+#include "../image/color.h"
+
+#include <vector>
+
+
+class PointSet;
+
+/***********************************************************************
+ A point cloud stored in flat arrays, one per attribute: the positions, the
+ normals (optional) and the colors (optional) of the i-th point are at
+ [3 * i], [3 * i + 1], and [3 * i + 2] of the respective arrays. All values
+ are floats.
+
+ Compared to PointSet (a DList of vertices plus attributes looked up through
+ the attribute manager), the points can be processed with plain indices and
+ the arrays can be given as is to SIMD code, to the kd-tree (see KdTreeIndex),
+ to OpenGL vertex arrays (glVertexPointer(3, GL_FLOAT, 0, positions()), ...)
+ and to binary writers.
+
+ There are no per-point attributes other than the normals and the colors, and
+ no stable handles: the points are identified by their index.
+ Use assign() and copy_to() to convert from/to a PointSet.
+************************************************************************/
+
+class GEOM_API DensePointSet : public Object
+{
+public:
+	DensePointSet() ;
+	virtual ~DensePointSet() ;
+
+	// __________________ access ___________________
+
+	unsigned int size() const { return static_cast<unsigned int>(positions_.size() / 3) ; }
+	bool empty() const { return positions_.empty() ; }
+
+	bool has_normals() const { return has_normals_ ; }
+	bool has_colors() const  { return has_colors_ ; }
+
+	// The arrays (3 floats per point). nil if empty or if the attribute is not present.
+	float* positions()             { return positions_.empty() ? nil : &positions_[0] ; }
+	const float* positions() const { return positions_.empty() ? nil : &positions_[0] ; }
+	float* normals()               { return normals_.empty() ? nil : &normals_[0] ; }
+	const float* normals() const   { return normals_.empty() ? nil : &normals_[0] ; }
+	float* colors()                { return colors_.empty() ? nil : &colors_[0] ; }
+	const float* colors() const    { return colors_.empty() ? nil : &colors_[0] ; }
+
+	vec3 point(unsigned int i) const {
+		const float* p = &positions_[3 * i] ;
+		return vec3(p[0], p[1], p[2]) ;
+	}
+	void set_point(unsigned int i, const vec3& p) {
+		float* q = &positions_[3 * i] ;
+		q[0] = float(p.x) ;	q[1] = float(p.y) ;	q[2] = float(p.z) ;
+	}
+
+	vec3 normal(unsigned int i) const {
+		const float* n = &normals_[3 * i] ;
+		return vec3(n[0], n[1], n[2]) ;
+	}
+	void set_normal(unsigned int i, const vec3& n) {
+		float* q = &normals_[3 * i] ;
+		q[0] = float(n.x) ;	q[1] = float(n.y) ;	q[2] = float(n.z) ;
+	}
+
+	Color color(unsigned int i) const {
+		const float* c = &colors_[3 * i] ;
+		return Color(c[0], c[1], c[2]) ;
+	}
+	void set_color(unsigned int i, const Color& c) {
+		float* q = &colors_[3 * i] ;
+		q[0] = c.r() ;	q[1] = c.g() ;	q[2] = c.b() ;
+	}
+
+	Box3d bounding_box() const ;
+
+	// __________________ modification ______________________
+
+	void clear() ;
+
+	// Allocates (or releases) the normal/color arrays. New normals are (0, 0, 0)
+	// and new colors are black.
+	void set_has_normals(bool b) ;
+	void set_has_colors(bool b) ;
+
+	void reserve(unsigned int n) ;
+	// The new points are at the origin.
+	void resize(unsigned int n) ;
+
+	// Appends a point and returns its index. The normal/color are not set.
+	unsigned int add_point(const vec3& p) ;
+
+	// Keeps only the points whose indices are in $indices$ (sorted in increasing
+	// order) and removes the others. The remaining points keep their order.
+	void keep(const std::vector<unsigned int>& indices) ;
+
+	// __________________ conversion ______________________
+
+	// Replaces the content by the vertices of $pset$ (in the order of the point
+	// set), with the "normal" and "color" attributes if they are defined.
+	void assign(const PointSet* pset) ;
+
+	// Appends the points to $pset$. The "normal" and "color" attributes of $pset$
+	// are created if needed.
+	void copy_to(PointSet* pset) const ;
+
+private:
+	std::vector<float>	positions_ ;
+	std::vector<float>	normals_ ;
+	std::vector<float>	colors_ ;
+	bool	has_normals_ ;
+	bool	has_colors_ ;
+} ;
+
+
+#endif
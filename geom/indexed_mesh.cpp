@@ -0,0 +1,304 @@
+#include "indexed_mesh.h"
+#include "map.h"
+#include "map_builder.h"
+#include "map_attributes.h"
+#include "iterators.h"
+
+#include <typeinfo>
+#include <algorithm>
+
+
+IndexedMesh::IndexedMesh()
+: has_normals_(false)
+, has_colors_(false)
+, facet_begin_(1, 0)
+, nb_non_triangles_(0)
+, revision_(0)
+{
+}
+
+IndexedMesh::~IndexedMesh() {
+}
+
+
+Box3d IndexedMesh::bounding_box() const {
+	Box3d result ;
+	unsigned int num = nb_vertices() ;
+	if (num == 0)
+		return result ;
+
+	const float* p = positions() ;
+	float min_x = p[0], min_y = p[1], min_z = p[2] ;
+	float max_x = p[0], max_y = p[1], max_z = p[2] ;
+	for (unsigned int i = 1; i < num; ++i) {
+		p += 3 ;
+		if (p[0] < min_x) min_x = p[0] ; else if (p[0] > max_x) max_x = p[0] ;
+		if (p[1] < min_y) min_y = p[1] ; else if (p[1] > max_y) max_y = p[1] ;
+		if (p[2] < min_z) min_z = p[2] ; else if (p[2] > max_z) max_z = p[2] ;
+	}
+	result.add_point(vec3(min_x, min_y, min_z)) ;
+	result.add_point(vec3(max_x, max_y, max_z)) ;
+	return result ;
+}
+
+
+float* IndexedMesh::scalar_attribute(const std::string& name) {
+	ScalarAttributes::iterator it = scalars_.find(name) ;
+	if (it == scalars_.end() || it->second.empty())
+		return nil ;
+	return &it->second[0] ;
+}
+
+
+const float* IndexedMesh::scalar_attribute(const std::string& name) const {
+	ScalarAttributes::const_iterator it = scalars_.find(name) ;
+	if (it == scalars_.end() || it->second.empty())
+		return nil ;
+	return &it->second[0] ;
+}
+
+
+float* IndexedMesh::add_scalar_attribute(const std::string& name) {
+	std::vector<float>& values = scalars_[name] ;
+	values.resize(nb_vertices(), 0.0f) ;
+	return values.empty() ? nil : &values[0] ;
+}
+
+
+void IndexedMesh::remove_scalar_attribute(const std::string& name) {
+	scalars_.erase(name) ;
+}
+
+
+void IndexedMesh::get_scalar_attribute_names(std::vector<std::string>& names) const {
+	names.clear() ;
+	for (ScalarAttributes::const_iterator it = scalars_.begin(); it != scalars_.end(); ++it)
+		names.push_back(it->first) ;
+}
+
+
+void IndexedMesh::clear() {
+	++revision_ ;
+	positions_.clear() ;
+	normals_.clear() ;
+	colors_.clear() ;
+	facet_begin_.assign(1, 0) ;
+	indices_.clear() ;
+	nb_non_triangles_ = 0 ;
+	for (ScalarAttributes::iterator it = scalars_.begin(); it != scalars_.end(); ++it)
+		it->second.clear() ;
+}
+
+
+void IndexedMesh::set_has_normals(bool b) {
+	++revision_ ;
+	has_normals_ = b ;
+	if (b)
+		normals_.resize(positions_.size(), 0.0f) ;
+	else
+		std::vector<float>().swap(normals_) ;
+}
+
+
+void IndexedMesh::set_has_colors(bool b) {
+	++revision_ ;
+	has_colors_ = b ;
+	if (b)
+		colors_.resize(positions_.size(), 0.0f) ;
+	else
+		std::vector<float>().swap(colors_) ;
+}
+
+
+void IndexedMesh::reserve_vertices(unsigned int n) {
+	positions_.reserve(3 * n) ;
+	if (has_normals_)
+		normals_.reserve(3 * n) ;
+	if (has_colors_)
+		colors_.reserve(3 * n) ;
+	for (ScalarAttributes::iterator it = scalars_.begin(); it != scalars_.end(); ++it)
+		it->second.reserve(n) ;
+}
+
+
+void IndexedMesh::reserve_facets(unsigned int nb_facets, unsigned int nb_indices) {
+	facet_begin_.reserve(nb_facets + 1) ;
+	indices_.reserve(nb_indices) ;
+}
+
+
+void IndexedMesh::resize_vertices(unsigned int n) {
+	++revision_ ;
+	positions_.resize(3 * n, 0.0f) ;
+	if (has_normals_)
+		normals_.resize(3 * n, 0.0f) ;
+	if (has_colors_)
+		colors_.resize(3 * n, 0.0f) ;
+	for (ScalarAttributes::iterator it = scalars_.begin(); it != scalars_.end(); ++it)
+		it->second.resize(n, 0.0f) ;
+}
+
+
+unsigned int IndexedMesh::add_vertex(const vec3& p) {
+	unsigned int idx = nb_vertices() ;
+	resize_vertices(idx + 1) ;
+	set_point(idx, p) ;
+	return idx ;
+}
+
+
+unsigned int IndexedMesh::add_facet(const unsigned int* vertices, unsigned int n) {
+	++revision_ ;
+	indices_.insert(indices_.end(), vertices, vertices + n) ;
+	facet_begin_.push_back(static_cast<unsigned int>(indices_.size())) ;
+	if (n != 3)
+		++nb_non_triangles_ ;
+	return nb_facets() - 1 ;
+}
+
+
+unsigned int IndexedMesh::add_triangle(unsigned int v0, unsigned int v1, unsigned int v2) {
+	++revision_ ;
+	indices_.push_back(v0) ;
+	indices_.push_back(v1) ;
+	indices_.push_back(v2) ;
+	facet_begin_.push_back(static_cast<unsigned int>(indices_.size())) ;
+	return nb_facets() - 1 ;
+}
+
+
+void IndexedMesh::compute_vertex_normals() {
+	unsigned int nv = nb_vertices() ;
+	std::vector<vec3> sums(nv, vec3(0, 0, 0)) ;
+	for (unsigned int f = 0; f < nb_facets(); ++f) {
+		// the length of the normal of Newell is twice the area of the facet
+		const unsigned int* v = facet_vertices(f) ;
+		unsigned int n = facet_size(f) ;
+		vec3 normal(0, 0, 0) ;
+		for (unsigned int i = 0; i < n; ++i) {
+			vec3 p = point(v[i]) ;
+			vec3 q = point(v[(i + 1) % n]) ;
+			normal.x += (p.y - q.y) * (p.z + q.z) ;
+			normal.y += (p.z - q.z) * (p.x + q.x) ;
+			normal.z += (p.x - q.x) * (p.y + q.y) ;
+		}
+		for (unsigned int i = 0; i < n; ++i)
+			sums[v[i]] += normal ;
+	}
+
+	set_has_normals(true) ;
+	float* normals = this->normals() ;
+	for (unsigned int i = 0; i < nv; ++i) {
+		vec3 n = sums[i] ;
+		double len = n.length() ;
+		if (len > 0)
+			n = n / len ;
+		normals[3 * i] = float(n.x) ;	normals[3 * i + 1] = float(n.y) ;	normals[3 * i + 2] = float(n.z) ;
+	}
+	++revision_ ;
+}
+
+
+void IndexedMesh::assign(const Map* map) {
+	clear() ;
+	scalars_.clear() ;
+
+	Map* m = const_cast<Map*>(map) ;
+	MapVertexNormal normals ;
+	MapVertexAttribute<Color> colors ;
+	set_has_normals(normals.bind_if_defined(m, "normal")) ;
+	set_has_colors(colors.bind_if_defined(m, "color")) ;
+
+	// the float attributes
+	std::vector<std::string> names ;
+	std::vector< MapVertexAttribute<float> > attributes ;	// they share their stores when copied
+	m->vertex_attribute_manager()->list_named_attributes(names) ;
+	for (std::size_t i = 0; i < names.size(); ++i) {
+		if (m->vertex_attribute_manager()->resolve_named_attribute_type_id(names[i]) == typeid(float)) {
+			attributes.push_back(MapVertexAttribute<float>(m, names[i])) ;
+			add_scalar_attribute(names[i]) ;
+		}
+		else
+			names[i].clear() ;
+	}
+	names.erase(std::remove(names.begin(), names.end(), std::string()), names.end()) ;
+
+	resize_vertices(map->size_of_vertices()) ;
+	std::vector<float*> values(names.size()) ;
+	for (std::size_t i = 0; i < names.size(); ++i)
+		values[i] = scalar_attribute(names[i]) ;
+
+	MapVertexAttribute<unsigned int> vertex_id(m) ;
+	unsigned int idx = 0 ;
+	FOR_EACH_VERTEX_CONST(Map, map, it) {
+		vertex_id[it] = idx ;
+		set_point(idx, it->point()) ;
+		if (has_normals_) {
+			const vec3& n = normals[it] ;
+			float* q = &normals_[3 * idx] ;
+			q[0] = float(n.x) ;	q[1] = float(n.y) ;	q[2] = float(n.z) ;
+		}
+		if (has_colors_) {
+			const Color& c = colors[it] ;
+			float* q = &colors_[3 * idx] ;
+			q[0] = c.r() ;	q[1] = c.g() ;	q[2] = c.b() ;
+		}
+		for (std::size_t i = 0; i < attributes.size(); ++i)
+			values[i][idx] = attributes[i][it] ;
+		++idx ;
+	}
+
+	reserve_facets(map->size_of_facets(), map->size_of_halfedges()) ;
+	FOR_EACH_FACET_CONST(Map, map, it) {
+		Map::Halfedge* h = it->halfedge() ;
+		do {
+			indices_.push_back(vertex_id[h->vertex()]) ;
+			h = h->next() ;
+		} while (h != it->halfedge()) ;
+		facet_begin_.push_back(static_cast<unsigned int>(indices_.size())) ;
+		if (facet_size(nb_facets() - 1) != 3)
+			++nb_non_triangles_ ;
+	}
+	++revision_ ;
+}
+
+
+void IndexedMesh::copy_to(Map* map) const {
+	MapVertexNormal normals ;
+	MapVertexAttribute<Color> colors ;
+	if (has_normals_)
+		normals.bind(map) ;
+	if (has_colors_)
+		colors.bind(map, "color") ;
+
+	std::vector< MapVertexAttribute<float> > attributes ;
+	std::vector<const float*> values ;
+	for (ScalarAttributes::const_iterator it = scalars_.begin(); it != scalars_.end(); ++it) {
+		if (it->second.empty())
+			continue ;
+		attributes.push_back(MapVertexAttribute<float>(map, it->first)) ;
+		values.push_back(&it->second[0]) ;
+	}
+
+	MapBuilder builder(map) ;
+	builder.begin_surface() ;
+	builder.reserve_vertices(nb_vertices()) ;
+	builder.reserve_facets(nb_facets()) ;
+
+	// the attributes are set before the facets: the builder may duplicate
+	// (non-manifold) or remove (isolated) vertices.
+	for (unsigned int v = 0; v < nb_vertices(); ++v) {
+		builder.add_vertex(point(v)) ;
+		Map::Vertex* mv = builder.current_vertex() ;
+		if (has_normals_)
+			normals[mv] = vec3(&normals_[3 * v]) ;
+		if (has_colors_)
+			colors[mv] = Color(&colors_[3 * v]) ;
+		for (std::size_t i = 0; i < attributes.size(); ++i)
+			attributes[i][mv] = values[i][v] ;
+	}
+
+	if (nb_facets() > 0)
+		builder.add_facets(&facet_begin_[0], &indices_[0], nb_facets()) ;
+	builder.end_surface() ;
+}
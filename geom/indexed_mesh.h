@@ -0,0 +1,160 @@
+#ifndef _GEOM_INDEXED_MESH_H_
+#define _GEOM_INDEXED_MESH_H_
+
+#include "geom_common.h"
+#include "../math/math_types.h"
+#include "../basic/object.h"
+#include "../image/color.h"
+
+#include <vector>
+#include <map>
+#include <string>
+
+
+class Map;
+
+/***********************************************************************
+ A polygonal mesh stored in flat arrays (an "indexed face set"): the
+ vertices are stored as in DensePointSet (positions, optional normals and
+ colors, 3 floats per vertex), and the vertex indices of the facets one
+ after the other: the vertices of the f-th facet are
+ indices()[facet_begin(f)], ..., indices()[facet_end(f) - 1].
+
+ There is no connectivity (no halfedges), so creating, saving and drawing
+ a mesh is cheap: the arrays can be written as is to a file and given to
+ OpenGL (glDrawElements(GL_TRIANGLES, nb_indices(), GL_UNSIGNED_INT,
+ indices()) for a triangle mesh). The halfedge structure (Map) is only
+ built when it is needed (e.g., for editing), with copy_to(); assign()
+ gets the arrays of a Map.
+
+ Each modification increments revision(), so that the objects derived from
+ the arrays (e.g., the arrays of the flat shading) know when to update.
+ The arrays can also be written directly (through positions(), etc.): call
+ touch() afterwards.
+
+ The per-vertex scalar values (e.g., the density of the Poisson
+ reconstruction) are stored as named attributes, which copy_to() and
+ assign() convert to/from the MapVertexAttribute<float> of the same name.
+************************************************************************/
+
+class GEOM_API IndexedMesh : public Object
+{
+public:
+	IndexedMesh() ;
+	virtual ~IndexedMesh() ;
+
+	// __________________ vertices ___________________
+
+	unsigned int nb_vertices() const { return static_cast<unsigned int>(positions_.size() / 3) ; }
+
+	bool has_normals() const { return has_normals_ ; }
+	bool has_colors() const  { return has_colors_ ; }
+
+	// The arrays (3 floats per vertex). nil if empty or if the attribute is not present.
+	float* positions()             { return positions_.empty() ? nil : &positions_[0] ; }
+	const float* positions() const { return positions_.empty() ? nil : &positions_[0] ; }
+	float* normals()               { return normals_.empty() ? nil : &normals_[0] ; }
+	const float* normals() const   { return normals_.empty() ? nil : &normals_[0] ; }
+	float* colors()                { return colors_.empty() ? nil : &colors_[0] ; }
+	const float* colors() const    { return colors_.empty() ? nil : &colors_[0] ; }
+
+	vec3 point(unsigned int v) const {
+		const float* p = &positions_[3 * v] ;
+		return vec3(p[0], p[1], p[2]) ;
+	}
+	void set_point(unsigned int v, const vec3& p) {
+		float* q = &positions_[3 * v] ;
+		q[0] = float(p.x) ;	q[1] = float(p.y) ;	q[2] = float(p.z) ;
+		++revision_ ;
+	}
+
+	Box3d bounding_box() const ;
+
+	// __________________ facets ___________________
+
+	unsigned int nb_facets() const  { return static_cast<unsigned int>(facet_begin_.size() - 1) ; }
+	unsigned int nb_indices() const { return static_cast<unsigned int>(indices_.size()) ; }
+
+	unsigned int facet_begin(unsigned int f) const { return facet_begin_[f] ; }
+	unsigned int facet_end(unsigned int f) const   { return facet_begin_[f + 1] ; }
+	unsigned int facet_size(unsigned int f) const  { return facet_begin_[f + 1] - facet_begin_[f] ; }
+
+	// nil if there is no facet
+	const unsigned int* indices() const { return indices_.empty() ? nil : &indices_[0] ; }
+	const unsigned int* facet_vertices(unsigned int f) const { return &indices_[0] + facet_begin_[f] ; }
+
+	// true if all the facets are triangles (then facet_begin(f) = 3 * f)
+	bool is_triangulated() const { return nb_non_triangles_ == 0 ; }
+
+	// __________________ scalar attributes ___________________
+
+	// nil if the attribute does not exist
+	float* scalar_attribute(const std::string& name) ;
+	const float* scalar_attribute(const std::string& name) const ;
+	// creates the attribute (0 for all the vertices) if it does not exist
+	float* add_scalar_attribute(const std::string& name) ;
+	void remove_scalar_attribute(const std::string& name) ;
+	void get_scalar_attribute_names(std::vector<std::string>& names) const ;
+
+	// __________________ modification ______________________
+
+	// incremented by each modification
+	unsigned int revision() const { return revision_ ; }
+	// to be called after writing the arrays directly
+	void touch() { ++revision_ ; }
+
+	void clear() ;
+
+	// Allocates (or releases) the normal/color arrays. New normals are (0, 0, 0)
+	// and new colors are black.
+	void set_has_normals(bool b) ;
+	void set_has_colors(bool b) ;
+
+	void reserve_vertices(unsigned int n) ;
+	void reserve_facets(unsigned int nb_facets, unsigned int nb_indices) ;
+
+	// The new vertices are at the origin (and their scalar attributes are 0).
+	void resize_vertices(unsigned int n) ;
+	// Appends a vertex and returns its index. The normal/color are not set.
+	unsigned int add_vertex(const vec3& p) ;
+
+	// Appends a facet and returns its index.
+	unsigned int add_facet(const unsigned int* vertices, unsigned int n) ;
+	unsigned int add_triangle(unsigned int v0, unsigned int v1, unsigned int v2) ;
+
+	// Sets the normals of the vertices to the normalized sum of the normals of
+	// the facets around them, weighted by the area of the facets.
+	void compute_vertex_normals() ;
+
+	// __________________ conversion ______________________
+
+	// Replaces the content by the vertices and the facets of $map$ (in the order
+	// of the map), with the "normal" and "color" vertex attributes if they are
+	// defined, and all the float vertex attributes.
+	void assign(const Map* map) ;
+
+	// Appends the vertices and the facets to $map$, with the scalar attributes
+	// (the halfedges are built in parallel, see MapBuilder::add_facets()).
+	// The normals (resp. colors) are stored in the "normal" (resp. "color") vertex
+	// attribute of $map$.
+	void copy_to(Map* map) const ;
+
+private:
+	std::vector<float>	positions_ ;
+	std::vector<float>	normals_ ;
+	std::vector<float>	colors_ ;
+	bool	has_normals_ ;
+	bool	has_colors_ ;
+
+	std::vector<unsigned int>	facet_begin_ ;	// nb_facets() + 1 entries
+	std::vector<unsigned int>	indices_ ;
+	unsigned int	nb_non_triangles_ ;	// the facets with fewer or more than 3 vertices
+
+	typedef std::map< std::string, std::vector<float> > ScalarAttributes ;
+	ScalarAttributes	scalars_ ;
+
+	unsigned int	revision_ ;
+} ;
+
+
+#endif
@@ -188,6 +188,21 @@ void Map::clear_inactive_items() {
 	facets_.clear_inactive_items() ;
 }
 
+void Map::reserve_vertices(unsigned int n) {
+	vertices_.reserve(n) ;
+	vertex_attribute_manager_.reserve(n) ;
+}
+
+void Map::reserve_halfedges(unsigned int n) {
+	halfedges_.reserve(n) ;
+	halfedge_attribute_manager_.reserve(n) ;
+}
+
+void Map::reserve_facets(unsigned int n) {
+	facets_.reserve(n) ;
+	facet_attribute_manager_.reserve(n) ;
+}
+
 // _____________________ Low level ______________________
 
 Map::Halfedge* Map::new_edge() {
@@ -150,6 +150,13 @@ public:
 	void clear() ;
 	void clear_inactive_items() ;
 
+	// Allocates the memory for $n$ vertices (resp. halfedges, facets) in total,
+	// with their attributes, so that creating them afterwards does not allocate
+	// memory piece by piece.
+	void reserve_vertices(unsigned int n) ;
+	void reserve_halfedges(unsigned int n) ;
+	void reserve_facets(unsigned int n) ;
+
 	// __________________ stored normals ____________________
 
 	void compute_vertex_normals();
@@ -97,6 +97,16 @@ void MapBuilder::reset() {
 	transition(final, initial) ;
 }
 
+void MapBuilder::reserve_vertices(unsigned int nb_vertices) {
+	vertex_.reserve(vertex_.size() + nb_vertices) ;
+	target()->reserve_vertices(target()->size_of_vertices() + nb_vertices) ;
+}
+
+void MapBuilder::reserve_facets(unsigned int nb_facets) {
+	target()->reserve_facets(target()->size_of_facets() + nb_facets) ;
+	target()->reserve_halfedges(target()->size_of_halfedges() + 3 * nb_facets) ;
+}
+
 void MapBuilder::add_vertex(unsigned int id, const vec3& p) {
 	transition(surface, surface) ;
 	add_vertex_internal(id, p) ;
@@ -202,6 +212,184 @@ void MapBuilder::end_facet() {
 }
 
 
+bool MapBuilder::is_valid_facet(const unsigned int* v, unsigned int n) const {
+	if (n < 3)
+		return false ;
+	for(unsigned int i=0; i<n; i++) {
+		if (v[i] >= vertex_.size() || vertex_[v[i]] == nil)
+			return false ;
+		for(unsigned int j=i+1; j<n; j++) {
+			if (v[i] == v[j])
+				return false ;
+		}
+	}
+	return true ;
+}
+
+void MapBuilder::add_facets(
+	const unsigned int* facet_begin, const unsigned int* indices, unsigned int nb_facets
+	) {
+		transition(surface, surface) ;
+		if (nb_facets == 0)
+			return ;
+
+		const unsigned int first = facet_begin[0] ;
+		const unsigned int nb_h = facet_begin[nb_facets] - first ;
+		const unsigned int nb_v = static_cast<unsigned int>(vertex_.size()) ;
+		int nf = static_cast<int>(nb_facets) ;
+
+		// the halfedge h (numbered in the order of the corners) goes from
+		// corner h to the next corner of its facet.
+		std::vector<char> valid(nb_facets) ;
+		std::vector<unsigned int> to(nb_h) ;
+#pragma omp parallel for
+		for(int f=0; f<nf; f++) {
+			const unsigned int* v = indices + facet_begin[f] ;
+			unsigned int n = facet_begin[f + 1] - facet_begin[f] ;
+			valid[f] = is_valid_facet(v, n) ;
+			unsigned int h = facet_begin[f] - first ;
+			for(unsigned int i=0; i<n; i++)
+				to[h + i] = v[(i + 1) % n] ;
+		}
+
+		// The halfedges of the valid facets, bucketed by their origin: 
+		// star[star_begin[v]] ... star[star_begin[v+1] - 1], in increasing order.
+		std::vector<unsigned int> star_begin(nb_v + 1, 0) ;
+		int nb_invalid = 0 ;
+		for(unsigned int f=0; f<nb_facets; f++) {
+			if (!valid[f]) {
+				nb_invalid++ ;
+				continue ;
+			}
+			for(unsigned int i=facet_begin[f]; i<facet_begin[f + 1]; i++)
+				star_begin[indices[i] + 1]++ ;
+		}
+		for(unsigned int v=0; v<nb_v; v++)
+			star_begin[v + 1] += star_begin[v] ;
+		std::vector<unsigned int> star(star_begin[nb_v]) ;
+		{
+			std::vector<unsigned int> pos(star_begin.begin(), star_begin.end() - 1) ;
+			for(unsigned int f=0; f<nb_facets; f++) {
+				if (!valid[f])
+					continue ;
+				for(unsigned int i=facet_begin[f]; i<facet_begin[f + 1]; i++)
+					star[pos[indices[i]]++] = i - first ;
+			}
+		}
+
+		// A facet having an edge of a previous facet (or of a facet already in
+		// the map) is deferred: end_facet() duplicates the vertices.
+		std::vector<char> deferred(nb_facets, 0) ;
+#pragma omp parallel for
+		for(int f=0; f<nf; f++) {
+			if (!valid[f])
+				continue ;
+			for(unsigned int i=facet_begin[f]; i<facet_begin[f + 1] && !deferred[f]; i++) {
+				unsigned int h = i - first ;
+				unsigned int from = indices[i] ;
+				for(unsigned int j=star_begin[from]; j<star_begin[from + 1] && star[j] < h; j++) {
+					if (to[star[j]] == to[h]) {
+						deferred[f] = 1 ;
+						break ;
+					}
+				}
+				const Star& s = star_[vertex_[from]] ;
+				for(unsigned int j=0; j<s.size(); j++) {
+					if (s[j]->vertex() == vertex_[to[h]]) {
+						deferred[f] = 1 ;
+						break ;
+					}
+				}
+			}
+		}
+
+		// The creation of the facets and the halfedges (not thread-safe). The
+		// halfedges of the deferred facets remain nil.
+		std::vector<Map::Halfedge*> halfedge(nb_h, nil) ;
+		for(unsigned int f=0; f<nb_facets; f++) {
+			if (!valid[f] || deferred[f])
+				continue ;
+			Map::Facet* facet = new_facet() ;
+			for(unsigned int i=facet_begin[f]; i<facet_begin[f + 1]; i++) {
+				Map::Halfedge* h = new_halfedge() ;
+				set_halfedge_facet(h, facet) ;
+				halfedge[i - first] = h ;
+			}
+			make_facet_key(halfedge[facet_begin[f] - first]) ;
+		}
+
+		// Connects the halfedges of each facet, and to their opposite.
+#pragma omp parallel for
+		for(int f=0; f<nf; f++) {
+			if (!valid[f] || deferred[f])
+				continue ;
+			unsigned int b = facet_begin[f] - first ;
+			unsigned int n = facet_begin[f + 1] - facet_begin[f] ;
+			for(unsigned int i=0; i<n; i++) {
+				unsigned int h = b + i ;
+				unsigned int from = indices[first + h] ;
+				Map::Halfedge* cur = halfedge[h] ;
+				set_halfedge_vertex(cur, vertex_[to[h]]) ;
+				make_sequence(cur, halfedge[b + (i + 1) % n]) ;
+
+				// the opposite is among the bulk halfedges or the existing ones
+				unsigned int other = to[h] ;
+				for(unsigned int j=star_begin[other]; j<star_begin[other + 1]; j++) {
+					unsigned int g = star[j] ;
+					if (to[g] == from && halfedge[g] != nil) {
+						set_halfedge_opposite(cur, halfedge[g]) ;
+						break ;
+					}
+				}
+				if (cur->opposite() == nil) {
+					const Star& s = star_[vertex_[other]] ;
+					for(unsigned int j=0; j<s.size(); j++) {
+						if (s[j]->vertex() == vertex_[from]) {
+							make_opposite(cur, s[j]) ;
+							break ;
+						}
+					}
+				}
+			}
+		}
+
+		// The stars, and the halfedge of each vertex (one of its incoming halfedges).
+		int nv = static_cast<int>(nb_v) ;
+#pragma omp parallel for
+		for(int v=0; v<nv; v++) {
+			if (star_begin[v] == star_begin[v + 1])
+				continue ;
+			Star& s = star_[vertex_[v]] ;
+			s.reserve(s.size() + star_begin[v + 1] - star_begin[v]) ;
+			for(unsigned int j=star_begin[v]; j<star_begin[v + 1]; j++) {
+				Map::Halfedge* h = halfedge[star[j]] ;
+				if (h != nil) {
+					s.push_back(h) ;
+					set_vertex_halfedge(vertex_[v], h->prev()) ;
+				}
+			}
+		}
+
+		if(!quiet_ && nb_invalid > 0) {
+			Logger::err("MapBuilder")
+				<< nb_invalid << " facets with less than 3 vertices, duplicated vertices or invalid indices, ignored"
+				<< std::endl ;
+		}
+
+		// Finally, the deferred facets, one by one.
+		for(unsigned int f=0; f<nb_facets; f++) {
+			if (!deferred[f])
+				continue ;
+			begin_facet() ;
+			for(unsigned int i=facet_begin[f]; i<facet_begin[f + 1]; i++) {
+				facet_vertex_.push_back(vertex_[indices[i]]) ;
+				facet_tex_vertex_.push_back(nil) ;
+			}
+			end_facet() ;
+		}
+}
+
+
 Map::Vertex* MapBuilder::copy_vertex(Vertex* from) {
 	// Note: tex coords are not copied, since 
 	//  an halfedge does not exist in the copy to
@@ -484,6 +672,7 @@ void MapBuilder::terminate_surface() {
 
 	// Step 1 : create the border halfedges, and setup the 'opposite'
 	//   and 'vertex' pointers.
+	std::vector<Map::Halfedge*> border ;
 	FOR_EACH_HALFEDGE(Map, target(), it) {
 		if(it->opposite() == nil) {
 			Map::Halfedge* h = new_halfedge() ;
@@ -497,32 +686,44 @@ void MapBuilder::terminate_surface() {
 
 			// Used later to fix non-manifold vertices.
 			star_[ it->vertex() ].push_back(h) ;
+			border.push_back(h) ;
 		}
 	}
 
 	// Step 2 : setup the 'next' and 'prev' pointers of the border.
-	//
-	FOR_EACH_HALFEDGE(Map, target(), it) {
-		if(it->facet() == nil) {
-
-			Map::Halfedge* next = it->opposite() ;
-			while(next->facet() != nil) {
-				next = next->prev()->opposite() ;
-			}
-			set_halfedge_next(it, next) ;
+	//   Only the interior halfedges are traversed, so the border 
+	//   halfedges can be processed in parallel.
+	int nb_border = static_cast<int>(border.size()) ;
+#pragma omp parallel for
+	for(int i=0; i<nb_border; i++) {
+		Map::Halfedge* it = border[i] ;
+
+		Map::Halfedge* next = it->opposite() ;
+		while(next->facet() != nil) {
+			next = next->prev()->opposite() ;
+		}
+		set_halfedge_next(it, next) ;
 
-			Map::Halfedge* prev = it->opposite() ;
-			while(prev->facet() != nil) {
-				prev = prev->next()->opposite() ;
-			}
-			set_halfedge_prev(it, prev) ;
+		Map::Halfedge* prev = it->opposite() ;
+		while(prev->facet() != nil) {
+			prev = prev->next()->opposite() ;
 		}
+		set_halfedge_prev(it, prev) ;
 	}
 
-	// Step 3 : fix non-manifold vertices
+	// Step 3 : fix non-manifold vertices. The test is done in parallel, 
+	//   splitting a vertex does not change the stars of the others.
 
+	int nb_v = static_cast<int>(vertex_.size()) ;
+	std::vector<char> non_manifold(vertex_.size(), 0) ;
+#pragma omp parallel for
+	for(int i=0; i<nb_v; i++) {
+		if(vertex_[i] != nil && !vertex_is_manifold(vertex_[i])) {
+			non_manifold[i] = 1 ;
+		}
+	}
 	for(unsigned int i=0; i<vertex_.size(); i++) {
-		if(vertex_[i] == nil) {
+		if(!non_manifold[i]) {
 			continue ;
 		}
 		if(split_non_manifold_vertex(vertex_[i])) {
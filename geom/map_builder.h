@@ -75,6 +75,21 @@ public:
 
 	virtual void create_vertices(unsigned int nb_vertices, bool with_colors = false) ;
 
+	// $nb_vertices$ (resp. $nb_facets$) more vertices (resp. facets) will be 
+	// added. For the facets, 3 halfedges per facet are reserved (triangles).
+	virtual void reserve_vertices(unsigned int nb_vertices) ;
+	virtual void reserve_facets(unsigned int nb_facets) ;
+
+	// Adds $nb_facets$ facets at once: the vertices of the f-th facet are
+	// indices[facet_begin[f]], ..., indices[facet_begin[f + 1] - 1] (indices
+	// of the vertices added to the builder, as for add_vertex_to_facet()).
+	// The result is the same as with begin_facet()/add_vertex_to_facet()/
+	// end_facet() for each facet, but the opposite halfedges are found in
+	// parallel (the halfedges are bucketed by their origin vertex) instead
+	// of facet by facet. The facets with an edge already present (which
+	// need their vertices duplicated) are added last, one by one.
+	void add_facets(const unsigned int* facet_begin, const unsigned int* indices, unsigned int nb_facets) ;
+
 	Map::Vertex* current_vertex() ;
 	Map::Vertex* vertex(int i) ;
 	Map::Facet* current_facet() ;
@@ -135,6 +150,9 @@ private:
 		std::set<Map::Halfedge*>& star
 		) ;
 
+	// used by add_facets(): the facet made of the vertices $v$ (indices of vertex_)
+	bool is_valid_facet(const unsigned int* v, unsigned int n) const ;
+
 	void terminate_surface() ;
 	friend class MapSerializer_eobj ;
 
@@ -36,5 +36,31 @@ void PointSet::delete_vertex(Vertex* v) {
 }
 
 
+void PointSet::reserve(unsigned int n) {
+	vertices_.reserve(n) ;
+	vertex_attribute_manager_.reserve(n) ;
+}
+
 
+void PointSet::append(const float* xyz, unsigned int n, const float* normals, const float* colors, const int* pixels) {
+	PointSetNormal normal_attr ;
+	PointSetColor  color_attr ;
+	PointSetPixel  pixel_attr ;
+	if (normals)
+		normal_attr.bind(this) ;
+	if (colors)
+		color_attr.bind(this) ;
+	if (pixels)
+		pixel_attr.bind(this) ;
 
+	reserve(size_of_vertices() + n) ;	// after binding: the new attributes are also reserved
+	for (unsigned int i = 0; i < n; ++i) {
+		Vertex* v = new_vertex(vec3(xyz + 3 * i)) ;
+		if (normals)
+			normal_attr[v] = vec3(normals + 3 * i) ;
+		if (colors)
+			color_attr[v] = Color(colors + 3 * i) ;
+		if (pixels)
+			pixel_attr[v] = pixels[i] ;
+	}
+}
@@ -80,6 +80,15 @@ public:
 	Vertex* new_vertex(const vec3& p) ;
 	void	delete_vertex(Vertex* v) ;
 
+	// Makes room for n vertices (in total) in the vertex list and in all 
+	// the attributes bound so far, so that new_vertex() does not allocate.
+	void	reserve(unsigned int n) ;
+
+	// Appends $n$ vertices at once. Each array stores 3 floats per point (one 
+	// int for $pixels$); $normals$, $colors$ and $pixels$ are optional (the 
+	// "normal", "color" and "pixel" attributes are created if given).
+	void	append(const float* xyz, unsigned int n, const float* normals = nil, const float* colors = nil, const int* pixels = nil) ;
+
 private:
 	DList<Vertex> vertices_ ;
 	VertexAttributeManager vertex_attribute_manager_ ;        
@@ -162,6 +171,22 @@ public:
 	}
 } ;
 
+//______________________________________________________________
+
+// For the points of a depth image: the index of the pixel the point comes
+// from (row * image width + column).
+class PointSetPixel : public PointSetAttribute<int> {
+public:
+	typedef PointSetAttribute<int> superclass ;
+	PointSetPixel() { }
+	PointSetPixel(PointSet* pset) : superclass(pset, "pixel") { }
+	void bind(PointSet* pset) { superclass::bind(pset, "pixel");  }
+	bool bind_if_defined(PointSet* pset) { return superclass::bind_if_defined(pset, "pixel");  }
+	static bool is_defined(PointSet* pset) {
+		return superclass::is_defined(pset, "pixel") ;
+	}
+} ;
+
 //_________________________________________________________
 
 
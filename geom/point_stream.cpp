@@ -0,0 +1,100 @@
+#include "point_stream.h"
+
+
+PointPipeline::PointPipeline()
+: source_(nil)
+, sink_(nil)
+, nb_points_read_(0)
+, nb_points_written_(0)
+{
+}
+
+
+bool PointPipeline::run() {
+	ogf_assert(source_ != nil && sink_ != nil) ;
+	nb_points_read_ = nb_points_written_ = 0 ;
+
+	if (!sink_->begin(source_->has_normals(), source_->has_colors()))
+		return false ;
+
+	DensePointSet chunk ;
+	while (source_->next(chunk)) {
+		nb_points_read_ += chunk.size() ;
+		for (std::size_t i = 0; i < filters_.size() && !chunk.empty(); ++i)
+			filters_[i]->process(chunk) ;
+
+		if (chunk.empty())
+			continue ;
+		if (!sink_->write(chunk))
+			return false ;
+		nb_points_written_ += chunk.size() ;
+	}
+
+	return sink_->end() ;
+}
+
+
+//______________________________________________________________________
+
+
+PointSetSource::PointSetSource(const PointSet* pset, unsigned int chunk_size /* = 65536 */)
+: pset_(pset)
+, chunk_size_(chunk_size > 0 ? chunk_size : 65536)
+, current_(pset->vertices_begin())
+{
+	PointSet* s = const_cast<PointSet*>(pset) ;
+	has_normals_ = normals_.bind_if_defined(s, "normal") ;
+	has_colors_ = colors_.bind_if_defined(s, "color") ;
+}
+
+
+PointSetSource::~PointSetSource() {
+	if (normals_.is_bound())
+		normals_.unbind() ;
+	if (colors_.is_bound())
+		colors_.unbind() ;
+}
+
+
+bool PointSetSource::next(DensePointSet& chunk) {
+	chunk.set_has_normals(has_normals_) ;
+	chunk.set_has_colors(has_colors_) ;
+	chunk.resize(chunk_size_) ;
+
+	float* p = chunk.positions() ;
+	float* n = chunk.normals() ;
+	float* c = chunk.colors() ;
+	unsigned int num = 0 ;
+	for (; num < chunk_size_ && current_ != pset_->vertices_end(); ++num, ++current_) {
+		const vec3& q = current_->point() ;
+		p[0] = float(q.x) ;	p[1] = float(q.y) ;	p[2] = float(q.z) ;
+		p += 3 ;
+		if (n) {
+			const vec3& m = normals_[current_] ;
+			n[0] = float(m.x) ;	n[1] = float(m.y) ;	n[2] = float(m.z) ;
+			n += 3 ;
+		}
+		if (c) {
+			const Color& col = colors_[current_] ;
+			c[0] = col.r() ;	c[1] = col.g() ;	c[2] = col.b() ;
+			c += 3 ;
+		}
+	}
+
+	chunk.resize(num) ;
+	return num > 0 ;
+}
+
+
+//______________________________________________________________________
+
+
+bool PointSetSink::begin(bool, bool) {
+	return pset_ != nil ;
+}
+
+
+bool PointSetSink::write(const DensePointSet& chunk) {
+	pset_->append(chunk.positions(), chunk.size(), chunk.normals(), chunk.colors()) ;
+	return true ;
+}
@@ -0,0 +1,137 @@
+#ifndef _GEOM_POINT_STREAM_H_
+#define _GEOM_POINT_STREAM_H_
+
+#include "geom_common.h"
+#include "dense_point_set.h"
+#include "point_set.h"
+
+#include <vector>
+#include <cstddef>
+
+
+/***********************************************************************
+ Streaming processing of point clouds too large to be held in memory.
+
+ The points flow through a pipeline by chunks (DensePointSet): the
+ pipeline pulls the chunks one after the other from a PointSource,
+ gives each of them to a sequence of PointFilter (crop, decimation,
+ transform, ...) and writes the result to a PointSink. Only one chunk is
+ in memory at a time, whatever the size of the data.
+
+ The filters are stateless: a chunk is processed independently of the
+ others, so the result does not depend on the chunk size (except for
+ the filters which combine nearby points, e.g. decimation, at the chunk
+ boundaries).
+
+ Sources and sinks for the point cloud files are created by PointStreamIO
+ (file_io), the filters are in algo/point_stream_filters.h.
+************************************************************************/
+
+
+class GEOM_API PointSource
+{
+public:
+	virtual ~PointSource() {}
+
+	// Replaces the content of $chunk$ by the next points. Returns false
+	// (and leaves $chunk$ empty) when there are no more points.
+	virtual bool next(DensePointSet& chunk) = 0 ;
+
+	// The attributes of the points. Known before the first chunk is read,
+	// and the same for all the chunks.
+	virtual bool has_normals() const = 0 ;
+	virtual bool has_colors() const = 0 ;
+} ;
+
+
+class GEOM_API PointFilter
+{
+public:
+	virtual ~PointFilter() {}
+
+	// Processes $chunk$ in place: the points can be modified or removed.
+	virtual void process(DensePointSet& chunk) = 0 ;
+} ;
+
+
+class GEOM_API PointSink
+{
+public:
+	virtual ~PointSink() {}
+
+	// Called before the first chunk.
+	virtual bool begin(bool has_normals, bool has_colors) = 0 ;
+	virtual bool write(const DensePointSet& chunk) = 0 ;
+	// Called after the last chunk (e.g., to complete the header of a file).
+	virtual bool end() = 0 ;
+} ;
+
+
+// The source, the filters and the sink are not owned by the pipeline.
+class GEOM_API PointPipeline
+{
+public:
+	PointPipeline() ;
+
+	void set_source(PointSource* source) { source_ = source ; }
+	void add_filter(PointFilter* filter) { filters_.push_back(filter) ; }
+	void set_sink(PointSink* sink) { sink_ = sink ; }
+
+	// Pulls all the chunks from the source through the filters to the
+	// sink. Returns false if the sink failed.
+	bool run() ;
+
+	std::size_t nb_points_read() const	  { return nb_points_read_ ; }
+	std::size_t nb_points_written() const { return nb_points_written_ ; }
+
+private:
+	PointSource*				source_ ;
+	std::vector<PointFilter*>	filters_ ;
+	PointSink*					sink_ ;
+
+	std::size_t	nb_points_read_ ;
+	std::size_t	nb_points_written_ ;
+} ;
+
+
+//______________________________________________________________________
+
+// The points of a PointSet (e.g., a frame of the scanner), by chunks of
+// $chunk_size$ points. The point set must not be modified while it is read.
+class GEOM_API PointSetSource : public PointSource
+{
+public:
+	PointSetSource(const PointSet* pset, unsigned int chunk_size = 65536) ;
+	~PointSetSource() ;
+
+	virtual bool next(DensePointSet& chunk) ;
+	virtual bool has_normals() const { return has_normals_ ; }
+	virtual bool has_colors() const { return has_colors_ ; }
+
+private:
+	const PointSet*		pset_ ;
+	unsigned int		chunk_size_ ;
+	PointSetNormal		normals_ ;
+	PointSetColor		colors_ ;
+	bool				has_normals_ ;
+	bool				has_colors_ ;
+	PointSet::Vertex_const_iterator	current_ ;	// the next vertex to be read
+} ;
+
+
+// Appends the points to a PointSet.
+class GEOM_API PointSetSink : public PointSink
+{
+public:
+	PointSetSink(PointSet* pset) : pset_(pset) {}
+
+	virtual bool begin(bool has_normals, bool has_colors) ;
+	virtual bool write(const DensePointSet& chunk) ;
+	virtual bool end() { return true ; }
+
+private:
+	PointSet*	pset_ ;
+} ;
+
+
+#endif
@@ -29,6 +29,7 @@
 #include "kdTree.h"
 #include <float.h>
 #include <stdlib.h>
+#include <omp.h>
 
 
 namespace kdtree  {
@@ -40,221 +41,202 @@ namespace kdtree  {
 	points[b] = tmp;
 
 
-	// ******************
-	// global definitions
-	// ******************
-	bool     g_queryAll;
-
-	//=====================================================
-	// global parameters for range search
-	//-----------------------------------------------------
-	float    g_queryOffsets[3];
-	Vector3D g_queryPosition;
-	//=====================================================
-
-	//=====================================================
-	// global parameters for line intersection search
-	//-----------------------------------------------------
-	bool     g_queryToLine;
-	Vector3D g_queryLine[2];
-	Vector3D g_queryLineDir;
-	//-----------------------------------------------------
-	// parameters for cylinder intersection
-	//-----------------------------------------------------
-	float g_queryMaxDist, g_queryMaxSqrDist, g_queryMaxSqrRange;
-	//-----------------------------------------------------
-	// parameters for cone intersection
-	//-----------------------------------------------------
-	Vector3D g_queryEye;
-	float g_queryMaxCosAngle, g_queryMaxTanAngle, g_queryMinSqrRange;
-	//=====================================================
-
-	KdTree::KdTree(const Vector3D *positions, unsigned int nOfPositions, unsigned int maxBucketSize) {
+	QueryContext::QueryContext() {
+		m_nOfFoundNeighbours	= 0;
+		m_nOfNeighbours			= 0;
+		m_queryAll				= false;
+		m_queryToLine			= true;
+		setNOfNeighbours(1);
+	}
+
+	void QueryContext::setNOfNeighbours (const unsigned int newNOfNeighbours) {
+		if (newNOfNeighbours != m_nOfNeighbours) {
+			m_nOfNeighbours = newNOfNeighbours;
+			m_queue.setSize(m_nOfNeighbours);
+			m_neighbours.resize(m_nOfNeighbours);
+			m_nOfFoundNeighbours = 0;
+		}
+	}
+
+	void QueryContext::collectNeighbours() {
+		if (m_queue.getMax().index == -1) {
+			m_queue.removeMax();
+		}
+
+		m_nOfFoundNeighbours = m_queue.getNofElements();
+		if( m_nOfFoundNeighbours > m_nOfNeighbours )
+		{
+			m_nOfNeighbours = m_nOfFoundNeighbours;
+			m_neighbours.resize(m_nOfNeighbours);
+		}
+
+		for(int i=m_nOfFoundNeighbours-1; i>=0; i--) {
+			m_neighbours[i] = m_queue.getMax();
+			m_queue.removeMax();
+		}
+	}
+
+
+	KdTree::KdTree(const Vector3D *positions, unsigned int nOfPositions, unsigned int maxBucketSize, bool parallelBuild) {
 		m_bucketSize			= maxBucketSize;
 		m_nOfPositions			= nOfPositions;
 		m_points				= new KdTreePoint[nOfPositions];
-		m_nOfFoundNeighbours	= 0;
-		m_nOfNeighbours			= 0;
-		m_queryPriorityQueue	= new PQueue();
-		for (unsigned int i=0; i<nOfPositions; i++) {
+		m_context				= new QueryContext();
+		int n = static_cast<int>(nOfPositions);
+#pragma omp parallel for if (parallelBuild)
+		for (int i=0; i<n; i++) {
 			m_points[i].pos = positions[i];
 			m_points[i].index = i;
 		}
 		m_root = new KdNode();
 		Vector3D maximum, minimum;
 		getSpread(m_points, nOfPositions, maximum, minimum);
-		createTree(*m_root, 0, nOfPositions, maximum, minimum);
-		m_root->createBoundingBox(m_boundingBoxLowCorner, m_boundingBoxHighCorner);
-		setNOfNeighbours(1);
+		if (parallelBuild) {
+			createTreeParallel(maximum, minimum);
+		}
+		else {
+			createTree(*m_root, 0, nOfPositions, maximum, minimum);
+			m_root->createBoundingBox(m_boundingBoxLowCorner, m_boundingBoxHighCorner);
+		}
 	}
 
 
 	KdTree::~KdTree() {
 		delete m_root;
 		delete[] m_points;
-		delete m_queryPriorityQueue;
+		delete m_context;
 	}
 
 	void KdTree::queryPosition(const Vector3D &position) {
-		if (m_neighbours.size() == 0) {
-			return;
-		}
-		g_queryAll          =   false;
-		g_queryOffsets[0]   =   0.0;
-		g_queryOffsets[1]   =   0.0;
-		g_queryOffsets[2]   =   0.0;
-		m_queryPriorityQueue->init();
-		m_queryPriorityQueue->insert(-1, FLT_MAX);
-		g_queryPosition     =   position;
-		float dist = BaseKdNode::computeBoxDistance(position, m_boundingBoxLowCorner, m_boundingBoxHighCorner);
-		m_root->queryNode(dist, m_queryPriorityQueue);
+		queryPosition(position, *m_context);
+	}
 
-		if (m_queryPriorityQueue->getMax().index == -1) {
-			m_queryPriorityQueue->removeMax();
-		}
+	void KdTree::queryRange(const Vector3D &position, float maxSqrDistance, bool queryAll ) {
+		queryRange(position, maxSqrDistance, *m_context, queryAll);
+	}
 
-		m_nOfFoundNeighbours = m_queryPriorityQueue->getNofElements();
-		if( m_nOfFoundNeighbours > m_nOfNeighbours )
-		{
-			m_nOfNeighbours = m_nOfFoundNeighbours;
-			m_neighbours.resize(m_nOfNeighbours);
-		}
+	void KdTree::queryLineIntersection( const Vector3D& v1, const Vector3D& v2, float maxDist, bool toLine, bool queryAll )
+	{
+		queryLineIntersection(v1, v2, maxDist, *m_context, toLine, queryAll);
+	}
 
-		for(int i=m_nOfFoundNeighbours-1; i>=0; i--) {
-			m_neighbours[i] = m_queryPriorityQueue->getMax();
-			m_queryPriorityQueue->removeMax();
+	void KdTree::queryConeIntersection( const Vector3D& eye, const Vector3D& v1, const Vector3D& v2, float maxAngle, bool toLine, bool queryAll )
+	{
+		queryConeIntersection(eye, v1, v2, maxAngle, *m_context, toLine, queryAll);
+	}
+
+	void KdTree::setNOfNeighbours (const unsigned int newNOfNeighbours) {
+		m_context->setNOfNeighbours(newNOfNeighbours);
+	}
+
+	void KdTree::queryPosition(const Vector3D &position, QueryContext& context) const {
+		if (context.m_neighbours.size() == 0) {
+			return;
 		}
+		context.m_queryAll          =   false;
+		context.m_queryOffsets[0]   =   0.0;
+		context.m_queryOffsets[1]   =   0.0;
+		context.m_queryOffsets[2]   =   0.0;
+		context.m_queue.init();
+		context.m_queue.insert(-1, FLT_MAX);
+		context.m_queryPosition     =   position;
+		float dist = BaseKdNode::computeBoxDistance(position, m_boundingBoxLowCorner, m_boundingBoxHighCorner);
+		m_root->queryNode(dist, &context);
+
+		context.collectNeighbours();
 	}
 
-	void KdTree::queryRange(const Vector3D &position, float maxSqrDistance, bool queryAll ) {
-		if (m_neighbours.size() == 0) {
+	void KdTree::queryRange(const Vector3D &position, float maxSqrDistance, QueryContext& context, bool queryAll ) const {
+		if (context.m_neighbours.size() == 0) {
 			if ( queryAll ) {
-				setNOfNeighbours ( 32 );
+				context.setNOfNeighbours ( 32 );
 			} else {
 				return;
 			}
 		}
-		g_queryAll          =   queryAll;
-		g_queryOffsets[0]   =   0.0;
-		g_queryOffsets[1]   =   0.0;
-		g_queryOffsets[2]   =   0.0;
-		m_queryPriorityQueue->init();
-		m_queryPriorityQueue->insert(-1, maxSqrDistance);
-		g_queryPosition     =   position;
+		context.m_queryAll          =   queryAll;
+		context.m_queryOffsets[0]   =   0.0;
+		context.m_queryOffsets[1]   =   0.0;
+		context.m_queryOffsets[2]   =   0.0;
+		context.m_queue.init();
+		context.m_queue.insert(-1, maxSqrDistance);
+		context.m_queryPosition     =   position;
 
 		float dist = BaseKdNode::computeBoxDistance(position, m_boundingBoxLowCorner, m_boundingBoxHighCorner);	
-		m_root->queryNode(dist, m_queryPriorityQueue);
-
-		if (m_queryPriorityQueue->getMax().index == -1) {
-			m_queryPriorityQueue->removeMax();
-		}
-
-		m_nOfFoundNeighbours = m_queryPriorityQueue->getNofElements();
-		if( m_nOfFoundNeighbours > m_nOfNeighbours )
-		{
-			m_nOfNeighbours = m_nOfFoundNeighbours;
-			m_neighbours.resize(m_nOfNeighbours);
-		}
+		m_root->queryNode(dist, &context);
 
-		for(int i=m_nOfFoundNeighbours-1; i>=0; i--) {
-			m_neighbours[i] = m_queryPriorityQueue->getMax();
-			m_queryPriorityQueue->removeMax();
-		}
+		context.collectNeighbours();
 	}
 
-	void KdTree::queryLineIntersection( const Vector3D& v1, const Vector3D& v2, float maxDist, bool toLine, bool queryAll )
+	void KdTree::queryLineIntersection( const Vector3D& v1, const Vector3D& v2, float maxDist, QueryContext& context, bool toLine, bool queryAll ) const
 	{
-		if (m_neighbours.size() == 0) {
+		if (context.m_neighbours.size() == 0) {
 			if ( queryAll ) {
-				setNOfNeighbours ( 32 );
+				context.setNOfNeighbours ( 32 );
 			} else {
 				return;
 			}
 		}
-		g_queryAll          =   queryAll;
-		g_queryToLine       =   toLine;
-		g_queryMaxDist      =   maxDist;
-		g_queryMaxSqrDist   =   maxDist * maxDist;
-		g_queryLine[0]      =   v1;
-		g_queryLine[1]      =   v2;
-		g_queryLineDir      =   v2 - v1;
-		g_queryMaxSqrRange  =   g_queryLineDir.getSquaredLength();  // maximal square range
-		g_queryLineDir.normalize();
-		m_queryPriorityQueue->init();
-		m_queryPriorityQueue->insert(-1, FLT_MAX);
-
-		m_root->queryLineIntersection(m_queryPriorityQueue);
-
-		if (m_queryPriorityQueue->getMax().index == -1) {
-			m_queryPriorityQueue->removeMax();
-		}
-
-		m_nOfFoundNeighbours = m_queryPriorityQueue->getNofElements();
-		if( m_nOfFoundNeighbours > m_nOfNeighbours )
-		{
-			m_nOfNeighbours = m_nOfFoundNeighbours;
-			m_neighbours.resize(m_nOfNeighbours);
-		}
-
-		for(int i=m_nOfFoundNeighbours-1; i>=0; i--) {
-			m_neighbours[i] = m_queryPriorityQueue->getMax();
-			m_queryPriorityQueue->removeMax();
-		}
+		context.m_queryAll          =   queryAll;
+		context.m_queryToLine       =   toLine;
+		context.m_queryMaxDist      =   maxDist;
+		context.m_queryMaxSqrDist   =   maxDist * maxDist;
+		context.m_queryLine[0]      =   v1;
+		context.m_queryLine[1]      =   v2;
+		context.m_queryLineDir      =   v2 - v1;
+		context.m_queryMaxSqrRange  =   context.m_queryLineDir.getSquaredLength();  // maximal square range
+		context.m_queryLineDir.normalize();
+		context.m_queue.init();
+		context.m_queue.insert(-1, FLT_MAX);
+
+		m_root->queryLineIntersection(&context);
+
+		context.collectNeighbours();
 	}
 
-	void KdTree::queryConeIntersection( const Vector3D& eye, const Vector3D& v1, const Vector3D& v2, float maxAngle, bool toLine, bool queryAll )
+	void KdTree::queryConeIntersection( const Vector3D& eye, const Vector3D& v1, const Vector3D& v2, float maxAngle, QueryContext& context, bool toLine, bool queryAll ) const
 	{
-		if (m_neighbours.size() == 0) {
+		if (context.m_neighbours.size() == 0) {
 			if ( queryAll ) {
-				setNOfNeighbours ( 32 );
+				context.setNOfNeighbours ( 32 );
 			} else {
 				return;
 			}
 		}
-		g_queryAll          =   queryAll;
-		g_queryToLine       =   toLine;
-		g_queryMaxCosAngle  =   cosf(maxAngle);
-		g_queryMaxTanAngle  =   tanf(maxAngle);
-		g_queryEye          =   eye;
-		g_queryLine[0]      =   v1;
-		g_queryLine[1]      =   v2;
-		g_queryMinSqrRange  =   (v1 - eye).getSquaredLength();      // minimal square range
-		g_queryLineDir      =   v2 - eye;
-		g_queryMaxSqrRange  =   g_queryLineDir.getSquaredLength();  // maximal square range
-		g_queryLineDir.normalize();
-		m_queryPriorityQueue->init();
-		m_queryPriorityQueue->insert(-1, FLT_MAX);
-
-		m_root->queryConeIntersection(m_queryPriorityQueue);
-
-		if (m_queryPriorityQueue->getMax().index == -1) {
-			m_queryPriorityQueue->removeMax();
-		}
-
-		m_nOfFoundNeighbours = m_queryPriorityQueue->getNofElements();
-		if( m_nOfFoundNeighbours > m_nOfNeighbours )
-		{
-			m_nOfNeighbours = m_nOfFoundNeighbours;
-			m_neighbours.resize(m_nOfNeighbours);
-		}
-
-		for(int i=m_nOfFoundNeighbours-1; i>=0; i--) {
-			m_neighbours[i] = m_queryPriorityQueue->getMax();
-			m_queryPriorityQueue->removeMax();
-		}
+		context.m_queryAll          =   queryAll;
+		context.m_queryToLine       =   toLine;
+		context.m_queryMaxCosAngle  =   cosf(maxAngle);
+		context.m_queryMaxTanAngle  =   tanf(maxAngle);
+		context.m_queryEye          =   eye;
+		context.m_queryLine[0]      =   v1;
+		context.m_queryLine[1]      =   v2;
+		context.m_queryMinSqrRange  =   (v1 - eye).getSquaredLength();      // minimal square range
+		context.m_queryLineDir      =   v2 - eye;
+		context.m_queryMaxSqrRange  =   context.m_queryLineDir.getSquaredLength();  // maximal square range
+		context.m_queryLineDir.normalize();
+		context.m_queue.init();
+		context.m_queue.insert(-1, FLT_MAX);
+
+		m_root->queryConeIntersection(&context);
+
+		context.collectNeighbours();
 	}
 
-	void KdTree::setNOfNeighbours (const unsigned int newNOfNeighbours) {
-		if (newNOfNeighbours != m_nOfNeighbours) {
-			m_nOfNeighbours = newNOfNeighbours;
-			m_queryPriorityQueue->setSize(m_nOfNeighbours);
-			m_nOfNeighbours = newNOfNeighbours;
-			m_neighbours.resize(m_nOfNeighbours);
-			m_nOfFoundNeighbours = 0;
+	void KdTree::createTree(KdNode &node, int start, int end, Vector3D maximum, Vector3D minimum) {
+		BuildTask task = { &node, start, end, maximum, minimum };
+		BuildTask children[2];
+		int nOfChildren = splitNode(task, children);
+		for (int i=0; i<nOfChildren; i++) {
+			createTree(*children[i].node, children[i].start, children[i].end, children[i].maximum, children[i].minimum);
 		}
 	}
 
-	void KdTree::createTree(KdNode &node, int start, int end, Vector3D maximum, Vector3D minimum) {
+	int KdTree::splitNode(const BuildTask &task, BuildTask children[2]) {
+		KdNode& node = *task.node;
+		int start = task.start;
+		int end = task.end;
+		Vector3D maximum = task.maximum;
+		Vector3D minimum = task.minimum;
 		int	mid;
 
 		int n = end-start;
@@ -298,6 +280,7 @@ namespace kdtree  {
 		else if (br2 < n/2.0) mid = start+br2;
 		else mid = start + (n>>1);
 
+		int nOfChildren = 0;
 		BaseKdNode** childNodes = new BaseKdNode*[2];
 		node.m_children = childNodes;
 		if (mid-start <= m_bucketSize) {
@@ -311,10 +294,13 @@ namespace kdtree  {
 			// new node
 			KdNode* childNode = new KdNode();
 			node.m_children[0] = childNode;
-			float oldMax = maximum[dim];
-			maximum[dim] = node.m_cutVal;
-			createTree(*childNode, start, mid, maximum, minimum);
-			maximum[dim] = oldMax;
+			BuildTask& child = children[nOfChildren++];
+			child.node = childNode;
+			child.start = start;
+			child.end = mid;
+			child.maximum = maximum;
+			child.maximum[dim] = node.m_cutVal;
+			child.minimum = minimum;
 		}
 
 		if (end-mid <= m_bucketSize) {
@@ -326,11 +312,85 @@ namespace kdtree  {
 		}
 		else {
 			// new node
-			minimum[dim] = node.m_cutVal;
 			KdNode* childNode = new KdNode();
 			node.m_children[1] = childNode;
-			createTree(*childNode, mid, end, maximum, minimum);
+			BuildTask& child = children[nOfChildren++];
+			child.node = childNode;
+			child.start = mid;
+			child.end = end;
+			child.maximum = maximum;
+			child.minimum = minimum;
+			child.minimum[dim] = node.m_cutVal;
+		}
+		return nOfChildren;
+	}
+
+	void KdTree::createTreeParallel(Vector3D maximum, Vector3D minimum) {
+		// subtrees smaller than this are built by a single thread. Each thread gets
+		// several subtrees so that the (unbalanced) subtrees are evenly distributed.
+		int minTaskSize = static_cast<int>(m_nOfPositions) / (8 * omp_get_max_threads());
+		if (minTaskSize < 4096)
+			minTaskSize = 4096;
+
+		std::vector<BuildTask>	level;		// the nodes to split at the current level
+		std::vector<BuildTask>	subtrees;	// the subtrees to build as a whole
+		std::vector<KdNode*>	topNodes;	// the nodes split level by level (top-down)
+		BuildTask root = { m_root, 0, static_cast<int>(m_nOfPositions), maximum, minimum };
+		if (root.end - root.start > minTaskSize)
+			level.push_back(root);
+		else
+			subtrees.push_back(root);
+
+		while (!level.empty()) {
+			int nOfNodes = static_cast<int>(level.size());
+			std::vector<BuildTask> children(2 * nOfNodes);
+			std::vector<int> nOfChildren(nOfNodes);
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int i=0; i<nOfNodes; i++) {
+				KdNode* node = level[i].node;
+				nOfChildren[i] = splitNode(level[i], &children[2 * i]);
+				// the leaves at the top levels are bounded right away
+				Vector3D low, high;
+				for (int c=0; c<2; c++) {
+					bool isLeaf = true;
+					for (int j=0; j<nOfChildren[i]; j++) {
+						if (children[2 * i + j].node == node->m_children[c])
+							isLeaf = false;
+					}
+					if (isLeaf)
+						node->m_children[c]->createBoundingBox(low, high);
+				}
+			}
+
+			std::vector<BuildTask> nextLevel;
+			for (int i=0; i<nOfNodes; i++) {
+				topNodes.push_back(level[i].node);
+				for (int j=0; j<nOfChildren[i]; j++) {
+					const BuildTask& child = children[2 * i + j];
+					if (child.end - child.start > minTaskSize)
+						nextLevel.push_back(child);
+					else
+						subtrees.push_back(child);
+				}
+			}
+			level.swap(nextLevel);
+		}
+
+		int nOfSubtrees = static_cast<int>(subtrees.size());
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i=0; i<nOfSubtrees; i++) {
+			const BuildTask& task = subtrees[i];
+			createTree(*task.node, task.start, task.end, task.maximum, task.minimum);
+			Vector3D low, high;
+			task.node->createBoundingBox(low, high);
 		}
+
+		// children before parents
+		for (int i=static_cast<int>(topNodes.size())-1; i>=0; i--) {
+			topNodes[i]->updateBoundingBox();
+		}
+		m_boundingBoxLowCorner = m_root->m_boundingBoxLowCorner;
+		m_boundingBoxHighCorner = m_root->m_boundingBoxHighCorner;
 	}
 
 	void KdTree::getSpread(KdTreePoint* points, int nOfPoints, Vector3D &maximum, Vector3D &minimum) {
@@ -701,72 +761,79 @@ namespace kdtree  {
 		return true;
 	}
 
-	void KdNode::queryNode(float rd, PQueue* queryPriorityQueue) {
-		register float old_off = g_queryOffsets[m_dim];
-		register float new_off = g_queryPosition[m_dim] - m_cutVal;
+	void KdNode::queryNode(float rd, QueryContext* context) const {
+		register float old_off = context->m_queryOffsets[m_dim];
+		register float new_off = context->m_queryPosition[m_dim] - m_cutVal;
 		if (new_off < 0) {
-			m_children[0]->queryNode(rd, queryPriorityQueue);
+			m_children[0]->queryNode(rd, context);
 			rd = rd - SQR(old_off) + SQR(new_off);
-			if (rd < queryPriorityQueue->getMaxWeight()) {
-				g_queryOffsets[m_dim] = new_off;
-				m_children[1]->queryNode(rd, queryPriorityQueue);
-				g_queryOffsets[m_dim] = old_off;
+			if (rd < context->m_queue.getMaxWeight()) {
+				context->m_queryOffsets[m_dim] = new_off;
+				m_children[1]->queryNode(rd, context);
+				context->m_queryOffsets[m_dim] = old_off;
 			}
 		}
 		else {
-			m_children[1]->queryNode(rd, queryPriorityQueue);
+			m_children[1]->queryNode(rd, context);
 			rd = rd - SQR(old_off) + SQR(new_off);
-			if (rd < queryPriorityQueue->getMaxWeight()) {
-				g_queryOffsets[m_dim] = new_off;
-				m_children[0]->queryNode(rd, queryPriorityQueue);
-				g_queryOffsets[m_dim] = old_off;
+			if (rd < context->m_queue.getMaxWeight()) {
+				context->m_queryOffsets[m_dim] = new_off;
+				m_children[0]->queryNode(rd, context);
+				context->m_queryOffsets[m_dim] = old_off;
 			}
 		}
 	}
 
 	void KdNode::createBoundingBox( Vector3D& lowCorner, Vector3D& highCorner )
 	{
-		KdTreePoint points[4];
 		Vector3D vlow, vhigh;
 		for( register unsigned int i = 0; i < 2; i++ ) {
 			m_children[i]->createBoundingBox( vlow, vhigh );
-			points[2*i].pos = vlow;
-			points[2*i+1].pos = vhigh;
 		}
-		BaseKdNode::computeEnclosingBoundingBox( 4, points, lowCorner, highCorner );
-		m_boundingBoxLowCorner = lowCorner;
-		m_boundingBoxHighCorner = highCorner;
+		updateBoundingBox();
+		lowCorner = m_boundingBoxLowCorner;
+		highCorner = m_boundingBoxHighCorner;
+	}
+
+	void KdNode::updateBoundingBox()
+	{
+		KdTreePoint points[4];
+		for( register unsigned int i = 0; i < 2; i++ ) {
+			points[2*i].pos = m_children[i]->m_boundingBoxLowCorner;
+			points[2*i+1].pos = m_children[i]->m_boundingBoxHighCorner;
+		}
+		BaseKdNode::computeEnclosingBoundingBox( 4, points, m_boundingBoxLowCorner, m_boundingBoxHighCorner );
 	}
 
-	void KdNode::queryLineIntersection(PQueue *queryPriorityQueue)
+	void KdNode::queryLineIntersection(QueryContext* context) const
 	{
-		if( BaseKdNode::intersectBox( g_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, g_queryMaxDist ) )
+		if( BaseKdNode::intersectBox( context->m_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, context->m_queryMaxDist ) )
 		{
-			m_children[0]->queryLineIntersection( queryPriorityQueue );
-			m_children[1]->queryLineIntersection( queryPriorityQueue );
+			m_children[0]->queryLineIntersection( context );
+			m_children[1]->queryLineIntersection( context );
 		}
 	}
 
-	void KdNode::queryConeIntersection(PQueue* queryPriorityQueue)
+	void KdNode::queryConeIntersection(QueryContext* context) const
 	{
 		float fMaxDist;
-		fMaxDist = BaseKdNode::computeBoxMaxDistance( g_queryEye, m_boundingBoxLowCorner, m_boundingBoxHighCorner );
-		fMaxDist = fMaxDist * g_queryMaxTanAngle; // g_queryMaxValue2 = tan( cone_angle )
-		if( BaseKdNode::intersectBox( g_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, fMaxDist ) )
+		fMaxDist = BaseKdNode::computeBoxMaxDistance( context->m_queryEye, m_boundingBoxLowCorner, m_boundingBoxHighCorner );
+		fMaxDist = fMaxDist * context->m_queryMaxTanAngle; // m_queryMaxTanAngle = tan( cone_angle )
+		if( BaseKdNode::intersectBox( context->m_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, fMaxDist ) )
 		{
-			m_children[0]->queryConeIntersection( queryPriorityQueue );
-			m_children[1]->queryConeIntersection( queryPriorityQueue );
+			m_children[0]->queryConeIntersection( context );
+			m_children[1]->queryConeIntersection( context );
 		}
 	}
 
-	void KdLeaf::queryNode(float rd, PQueue* queryPriorityQueue) {
+	void KdLeaf::queryNode(float rd, QueryContext* context) const {
 		float sqrDist;
 		//use pointer arithmetic to speed up the linear traversing
 		KdTreePoint* point = m_points;
 		for (register unsigned int i=0; i<m_nOfElements; i++) {
-			sqrDist = (point->pos - g_queryPosition).getSquaredLength();
-			if (sqrDist < queryPriorityQueue->getMaxWeight()) {
-				queryPriorityQueue->insert(point->index, sqrDist, g_queryAll);
+			sqrDist = (point->pos - context->m_queryPosition).getSquaredLength();
+			if (sqrDist < context->m_queue.getMaxWeight()) {
+				context->m_queue.insert(point->index, sqrDist, context->m_queryAll);
 			}
 			point++;
 		}		
@@ -779,76 +846,74 @@ namespace kdtree  {
 		m_boundingBoxHighCorner = highCorner;
 	}
 
-	void KdLeaf::queryLineIntersection(PQueue *queryPriorityQueue)
+	void KdLeaf::queryLineIntersection(QueryContext* context) const
 	{
-		if( BaseKdNode::intersectBox( g_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, g_queryMaxDist ) )
+		if( BaseKdNode::intersectBox( context->m_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, context->m_queryMaxDist ) )
 		{
 			Vector3D vc;
 			float sqrDist, sqrDistLine, sqrDistVert;
 			KdTreePoint* point = m_points;
 			// check points individually
-			for( register unsigned int i = 0; i < m_nOfElements; i++ ) {
-				vc = point->pos - g_queryLine[0];
+			for( register unsigned int i = 0; i < m_nOfElements; i++, point++ ) {
+				vc = point->pos - context->m_queryLine[0];
 				sqrDist = vc.getSquaredLength();
-				sqrDistLine = Vector3D::dotProduct( vc, g_queryLineDir );
+				sqrDistLine = Vector3D::dotProduct( vc, context->m_queryLineDir );
 				sqrDistLine *= sqrDistLine;
-				if( sqrDistLine > g_queryMaxSqrRange ) continue;
+				if( sqrDistLine > context->m_queryMaxSqrRange ) continue;
 				sqrDistVert = sqrDist - sqrDistLine;
-				if( sqrDistVert < g_queryMaxSqrDist )
+				if( sqrDistVert < context->m_queryMaxSqrDist )
 				{
-					if( g_queryToLine && sqrDistVert < queryPriorityQueue->getMaxWeight() )
+					if( context->m_queryToLine && sqrDistVert < context->m_queue.getMaxWeight() )
 					{
 						// cloest to line first
-						queryPriorityQueue->insert(point->index, sqrDistVert, g_queryAll);
+						context->m_queue.insert(point->index, sqrDistVert, context->m_queryAll);
 					}
-					else if( sqrDistLine < queryPriorityQueue->getMaxWeight() )
+					else if( sqrDistLine < context->m_queue.getMaxWeight() )
 					{
 						// cloest to eye first
-						queryPriorityQueue->insert(point->index, sqrDistLine, g_queryAll);
+						context->m_queue.insert(point->index, sqrDistLine, context->m_queryAll);
 					}
 				}
-				point++;
 			}
 		}
 	}
 
-	void KdLeaf::queryConeIntersection(PQueue* queryPriorityQueue)
+	void KdLeaf::queryConeIntersection(QueryContext* context) const
 	{
 		float fMaxDist;
-		fMaxDist = BaseKdNode::computeBoxMaxDistance( g_queryEye, m_boundingBoxLowCorner, m_boundingBoxHighCorner );
-		fMaxDist = fMaxDist * g_queryMaxTanAngle;
-		if( BaseKdNode::intersectBox( g_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, fMaxDist ) )
+		fMaxDist = BaseKdNode::computeBoxMaxDistance( context->m_queryEye, m_boundingBoxLowCorner, m_boundingBoxHighCorner );
+		fMaxDist = fMaxDist * context->m_queryMaxTanAngle;
+		if( BaseKdNode::intersectBox( context->m_queryLine, m_boundingBoxLowCorner, m_boundingBoxHighCorner, fMaxDist ) )
 		{
 			Vector3D vc;
 			float sqrDist, distLine, sqrDistVert, cosAngle;
 			KdTreePoint* point = m_points;
 			// check points individually
-			for( register unsigned int i = 0; i < m_nOfElements; i++ ) {
-				vc = point->pos - g_queryEye;
+			for( register unsigned int i = 0; i < m_nOfElements; i++, point++ ) {
+				vc = point->pos - context->m_queryEye;
 				sqrDist = vc.getSquaredLength();
-				if( sqrDist < g_queryMinSqrRange ) continue;
-				if( sqrDist > g_queryMaxSqrRange ) continue;
+				if( sqrDist < context->m_queryMinSqrRange ) continue;
+				if( sqrDist > context->m_queryMaxSqrRange ) continue;
 
-				distLine = Vector3D::dotProduct( vc, g_queryLineDir );
+				distLine = Vector3D::dotProduct( vc, context->m_queryLineDir );
 				cosAngle =  distLine / sqrtf(sqrDist);
-				if( cosAngle > g_queryMaxCosAngle )
+				if( cosAngle > context->m_queryMaxCosAngle )
 				{
-					if( g_queryToLine )
+					if( context->m_queryToLine )
 					{
 						// cloest to line first
 						sqrDistVert = sqrDist - distLine * distLine;
-						if( sqrDistVert < queryPriorityQueue->getMaxWeight() )
+						if( sqrDistVert < context->m_queue.getMaxWeight() )
 						{
-							queryPriorityQueue->insert(point->index, sqrDistVert, g_queryAll);
+							context->m_queue.insert(point->index, sqrDistVert, context->m_queryAll);
 						}
 					}
-					else if( sqrDist < queryPriorityQueue->getMaxWeight() )
+					else if( sqrDist < context->m_queue.getMaxWeight() )
 					{
 						// cloest to eye first
-						queryPriorityQueue->insert(point->index, sqrDist, g_queryAll);
+						context->m_queue.insert(point->index, sqrDist, context->m_queryAll);
 					}
 				}
-				point++;
 			}
 		}
 	}
@@ -52,6 +52,80 @@ namespace kdtree  {
 	} KdTreePoint;
 
 
+	/**
+	* The state of a single query: the query parameters, the priority queue used 
+	* during the traversal and the neighbours found. The tree is never modified by 
+	* a query running on a QueryContext, so several threads can query the same 
+	* tree at the same time as long as each thread uses its own context.
+	*/
+	class QueryContext {
+	public:
+		QueryContext();
+
+		/**
+		* set the number of nearest neighbours which have to be looked at for a query
+		*
+		* @params newNOfNeighbours
+		*			the number of nearest neighbours
+		*/
+		void setNOfNeighbours (const unsigned int newNOfNeighbours);
+
+		/**
+		* get the index of the i-th nearest neighbour to the query point
+		* i must be smaller than the number of found neighbours
+		*/
+		inline unsigned int getNeighbourPositionIndex (const unsigned int i) const { return m_neighbours[i].index; }
+
+		/**
+		* get the squared distance of the query point and its i-th nearest neighbour
+		* i must be smaller than the number of found neighbours
+		*/
+		inline float getSquaredDistance (const unsigned int i) const { return m_neighbours[i].weight; }
+
+		/**
+		* get the number of found neighbours
+		*/
+		inline unsigned int getNOfFoundNeighbours() const { return m_nOfFoundNeighbours; }
+
+		/**
+		* get the number of query neighbours
+		*/
+		inline unsigned int getNOfQueryNeighbours() const { return m_nOfNeighbours; }
+
+	public:
+		// moves the content of the priority queue to m_neighbours (closest first)
+		void collectNeighbours();
+
+		PQueue					m_queue;
+		std::vector<Neighbour>	m_neighbours;
+		unsigned int			m_nOfFoundNeighbours,
+								m_nOfNeighbours;
+
+		bool     m_queryAll;
+		//=====================================================
+		// parameters for range search
+		//-----------------------------------------------------
+		float    m_queryOffsets[3];
+		Vector3D m_queryPosition;
+		//=====================================================
+		// parameters for line intersection search
+		//-----------------------------------------------------
+		bool     m_queryToLine;
+		Vector3D m_queryLine[2];
+		Vector3D m_queryLineDir;
+		//-----------------------------------------------------
+		// parameters for cylinder intersection
+		//-----------------------------------------------------
+		float m_queryMaxDist, m_queryMaxSqrDist, m_queryMaxSqrRange;
+		//-----------------------------------------------------
+		// parameters for cone intersection
+		//-----------------------------------------------------
+		Vector3D m_queryEye;
+		float m_queryMaxCosAngle, m_queryMaxTanAngle, m_queryMinSqrRange;
+		//=====================================================
+	};
+
+
 
 	class KdBoxFace {
 	public:
@@ -101,13 +175,13 @@ namespace kdtree  {
 		* look for the nearest neighbours
 		* @param rd 
 		*		  the distance of the query position to the node box
-		* @param queryPriorityQueue
-		*		  a priority queue
+		* @param context
+		*		  the query parameters and priority queue
 		*/
-		virtual void queryNode(float rd, PQueue* queryPriorityQueue) = 0;
+		virtual void queryNode(float rd, QueryContext* context) const = 0;
 		virtual void createBoundingBox( Vector3D& lowCorner, Vector3D& highCorner ) = 0;
-		virtual void queryLineIntersection(PQueue* queryPriorityQueue) = 0;
-		virtual void queryConeIntersection(PQueue* queryPriorityQueue) = 0;
+		virtual void queryLineIntersection(QueryContext* context) const = 0;
+		virtual void queryConeIntersection(QueryContext* context) const = 0;
 
 		/**
 		* compute distance from point to box
@@ -198,13 +272,15 @@ namespace kdtree  {
 		* look for the nearest neighbours
 		* @param rd 
 		*		  the distance of the query position to the node box
-		* @param queryPriorityQueue
-		*		  a priority queue
+		* @param context
+		*		  the query parameters and priority queue
 		*/
-		void queryNode(float rd, PQueue* queryPriorityQueue);
+		void queryNode(float rd, QueryContext* context) const;
 		void createBoundingBox( Vector3D& lowCorner, Vector3D& highCorner );
-		void queryLineIntersection(PQueue* queryPriorityQueue);
-		void queryConeIntersection(PQueue* queryPriorityQueue);
+		// bounding box of the (already bounded) children, the children are not visited
+		void updateBoundingBox();
+		void queryLineIntersection(QueryContext* context) const;
+		void queryConeIntersection(QueryContext* context) const;
 	};
 
 
@@ -230,13 +306,13 @@ namespace kdtree  {
 		* look for the nearest neighbours
 		* @param rd 
 		*		  the distance of the query position to the node box
-		* @param queryPriorityQueue
-		*		  a priority queue
+		* @param context
+		*		  the query parameters and priority queue
 		*/
-		void queryNode(float rd, PQueue* queryPriorityQueue);
+		void queryNode(float rd, QueryContext* context) const;
 		void createBoundingBox( Vector3D& lowCorner, Vector3D& highCorner );
-		void queryLineIntersection(PQueue* queryPriorityQueue);
-		void queryConeIntersection(PQueue* queryPriorityQueue);
+		void queryLineIntersection(QueryContext* context) const;
+		void queryConeIntersection(QueryContext* context) const;
 	};
 
 
@@ -263,8 +339,11 @@ namespace kdtree  {
 		*			number of points
 		* @param maxBucketSize
 		*			number of points per bucket
+		* @param parallelBuild
+		*			if true, the subtrees are built in parallel (OpenMP). The
+		*			resulting tree is the same as the one built sequentially.
 		*/
-		KdTree(const Vector3D *positions, unsigned int nOfPositions, unsigned int maxBucketSize);
+		KdTree(const Vector3D *positions, unsigned int nOfPositions, unsigned int maxBucketSize, bool parallelBuild = false);
 
 		/**
 		* Destructor
@@ -331,6 +410,19 @@ namespace kdtree  {
 		void queryConeIntersection( const Vector3D& eye, const Vector3D& v1, const Vector3D& v2, float maxAngle,
 			bool toLine = true, bool queryAll = false );
 
+		/**
+		* Reentrant versions of the queries above. The query parameters, the priority queue 
+		* and the result are held by <code>context</code> instead of the tree, so the same 
+		* tree can be queried by several threads at a time, each with its own context.
+		* The number of nearest neighbours is set by QueryContext::setNOfNeighbours().
+		*/
+		void queryPosition(const Vector3D &position, QueryContext& context) const;
+		void queryRange(const Vector3D &position, float maxSqrDistance, QueryContext& context, bool queryAll = false ) const;
+		void queryLineIntersection( const Vector3D& v1, const Vector3D& v2, float maxDist, QueryContext& context,
+			bool toLine = true, bool queryAll = false ) const;
+		void queryConeIntersection( const Vector3D& eye, const Vector3D& v1, const Vector3D& v2, float maxAngle, QueryContext& context,
+			bool toLine = true, bool queryAll = false ) const;
+
 		/**
 		* set the number of nearest neighbours which have to be looked at for a query
 		*
@@ -403,18 +495,45 @@ namespace kdtree  {
 		*/
 		void createTree(KdNode &node, int start, int end, Vector3D maximum, Vector3D minimum);
 
+		/**
+		* a node that still has to be split, together with its points and its cell
+		*/
+		struct BuildTask {
+			KdNode*		node;
+			int			start;
+			int			end;
+			Vector3D	maximum;
+			Vector3D	minimum;
+		};
+
+		/** 
+		* splits the node of the task once (using the sliding midpoint splitting rule)
+		* 
+		* @param task
+		*		  the node to split
+		* @param children
+		*		  the children that are inner nodes (and still need to be split)
+		* @return the number of inner children (0, 1 or 2)
+		*/
+		int splitNode(const BuildTask &task, BuildTask children[2]);
+
+		/** 
+		* creates the tree in parallel: the top levels are split one level at a time 
+		* (all the nodes of a level in parallel), then the remaining subtrees are built
+		* and bounded in parallel.
+		*/
+		void createTreeParallel(Vector3D maximum, Vector3D minimum);
+
 
 	private:
 
 		KdTreePoint*				m_points;
 		//const Vector3D*				m_positions;
-		std::vector<Neighbour>  	m_neighbours;
 		int							m_bucketSize;
 		KdNode*						m_root;
-		unsigned int				m_nOfFoundNeighbours,
-			m_nOfNeighbours,
-			m_nOfPositions;
-		PQueue*						m_queryPriorityQueue;
+		unsigned int				m_nOfPositions;
+		// used by the non-reentrant queries
+		QueryContext*				m_context;
 		Vector3D                    m_boundingBoxLowCorner;
 		Vector3D	                m_boundingBoxHighCorner;
 
@@ -430,15 +549,15 @@ namespace kdtree  {
 	};
 
 	inline unsigned int KdTree::getNOfFoundNeighbours() {
-		return m_nOfFoundNeighbours;
+		return m_context->getNOfFoundNeighbours();
 	}
 
 	inline unsigned int KdTree::getNOfQueryNeighbours() {
-		return m_nOfNeighbours;
+		return m_context->getNOfQueryNeighbours();
 	}
 
 	inline unsigned int KdTree::getNeighbourPositionIndex(const unsigned int neighbourIndex) {
-		return m_neighbours[neighbourIndex].index;
+		return m_context->getNeighbourPositionIndex(neighbourIndex);
 	}
 
 	/*inline Vector3D KdTree::getNeighbourPosition(const unsigned int neighbourIndex) {
@@ -446,7 +565,7 @@ namespace kdtree  {
 	}*/
 
 	inline float KdTree::getSquaredDistance (const unsigned int neighbourIndex) {
-		return m_neighbours[neighbourIndex].weight;
+		return m_context->getSquaredDistance(neighbourIndex);
 	}
 
 
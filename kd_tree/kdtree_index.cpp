@@ -0,0 +1,526 @@
+
+#include "kdtree_index.h"
+
+#include <algorithm>
+#include <float.h>
+#include <omp.h>
+
+
+
+// The K closest points found so far, sorted by increasing distance. The arrays
+// are provided by the caller, so a query does not allocate anything.
+struct KdTreeIndex::KnnResult {
+	KnnResult(unsigned int k, unsigned int* indices, float* squared_distances)
+		: k_(k), num_(0), indices_(indices), squared_distances_(squared_distances) {}
+
+	float max_distance() const {
+		return (num_ < k_) ? FLT_MAX : squared_distances_[k_ - 1];
+	}
+
+	void insert(unsigned int index, float squared_distance) {
+		unsigned int i = (num_ < k_) ? num_++ : k_ - 1;
+		while (i > 0 && squared_distances_[i - 1] > squared_distance) {
+			squared_distances_[i] = squared_distances_[i - 1];
+			indices_[i] = indices_[i - 1];
+			--i;
+		}
+		squared_distances_[i] = squared_distance;
+		indices_[i] = index;
+	}
+
+	unsigned int	k_;
+	unsigned int	num_;
+	unsigned int*	indices_;
+	float*			squared_distances_;
+};
+
+
+KdTreeIndex::KdTreeIndex()
+: bucket_size_(16)
+, parallel_build_(false)
+{
+	for (int i = 0; i < 3; ++i) {
+		bbox_min_[i] = 0.0f;
+		bbox_max_[i] = 0.0f;
+	}
+}
+
+
+KdTreeIndex::~KdTreeIndex() {
+}
+
+
+void KdTreeIndex::clear() {
+	std::vector<float>().swap(points_);
+	std::vector<unsigned int>().swap(indices_);
+	std::vector<Node>().swap(nodes_);
+}
+
+
+void KdTreeIndex::build(const float* points, unsigned int num, unsigned int stride) {
+	clear();
+
+	points_.resize(num * 3);
+	indices_.resize(num);
+	int n = static_cast<int>(num);
+#pragma omp parallel for if (parallel_build_)
+	for (int i = 0; i < n; ++i) {
+		const float* p = points + i * stride;
+		points_[i * 3] = p[0];
+		points_[i * 3 + 1] = p[1];
+		points_[i * 3 + 2] = p[2];
+		indices_[i] = i;
+	}
+
+	build_tree();
+}
+
+
+void KdTreeIndex::build(const float* x, const float* y, const float* z, unsigned int num) {
+	clear();
+
+	points_.resize(num * 3);
+	indices_.resize(num);
+	int n = static_cast<int>(num);
+#pragma omp parallel for if (parallel_build_)
+	for (int i = 0; i < n; ++i) {
+		points_[i * 3] = x[i];
+		points_[i * 3 + 1] = y[i];
+		points_[i * 3 + 2] = z[i];
+		indices_[i] = i;
+	}
+
+	build_tree();
+}
+
+
+void KdTreeIndex::build_tree() {
+	unsigned int num = size();
+	if (num == 0)
+		return;
+
+	for (int d = 0; d < 3; ++d)
+		bbox_min_[d] = bbox_max_[d] = points_[d];
+	for (unsigned int i = 1; i < num; ++i) {
+		const float* p = &points_[i * 3];
+		for (int d = 0; d < 3; ++d) {
+			if (p[d] < bbox_min_[d])		bbox_min_[d] = p[d];
+			else if (p[d] > bbox_max_[d])	bbox_max_[d] = p[d];
+		}
+	}
+
+	// a rough estimate of the number of nodes (it grows if needed)
+	nodes_.reserve(4 * (num / bucket_size_ + 1));
+	nodes_.push_back(make_node(0, num));
+
+	if (parallel_build_)
+		build_tree_parallel();
+	else {
+		float lo[3] = { bbox_min_[0], bbox_min_[1], bbox_min_[2] };
+		float hi[3] = { bbox_max_[0], bbox_max_[1], bbox_max_[2] };
+		build_node(nodes_, 0, lo, hi);
+	}
+}
+
+
+// A node still to be split and its cell.
+struct KdTreeIndex::BuildTask {
+	unsigned int	node;
+	float			lo[3];
+	float			hi[3];
+};
+
+
+void KdTreeIndex::build_tree_parallel() {
+	// subtrees smaller than this are built by a single thread. Each thread gets
+	// several subtrees so that the (unbalanced) subtrees are evenly distributed.
+	unsigned int min_task_size = size() / (8 * omp_get_max_threads());
+	if (min_task_size < 4096)
+		min_task_size = 4096;
+
+	std::vector<BuildTask> level;		// the nodes to split at the current level
+	std::vector<BuildTask> subtrees;	// the subtrees to build as a whole
+	BuildTask root;
+	root.node = 0;
+	for (int d = 0; d < 3; ++d) {
+		root.lo[d] = bbox_min_[d];
+		root.hi[d] = bbox_max_[d];
+	}
+	if (size() > min_task_size)
+		level.push_back(root);
+	else
+		subtrees.push_back(root);
+
+	// the top levels are split one level at a time, all the nodes of a level in
+	// parallel (the nodes are only appended to nodes_ by the master thread).
+	while (!level.empty()) {
+		int num = static_cast<int>(level.size());
+		std::vector<unsigned int> dims(num), mids(num);
+		std::vector<float> cuts(num);
+		std::vector<char> inner(num);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i < num; ++i) {
+			const Node& n = nodes_[level[i].node];
+			inner[i] = split_node(n.begin, n.end, level[i].lo, level[i].hi, dims[i], cuts[i], mids[i]);
+		}
+
+		std::vector<BuildTask> next_level;
+		for (int i = 0; i < num; ++i) {
+			if (!inner[i])
+				continue;
+			const BuildTask& task = level[i];
+			unsigned int child = static_cast<unsigned int>(nodes_.size());
+			nodes_.push_back(make_node(nodes_[task.node].begin, mids[i]));
+			nodes_.push_back(make_node(mids[i], nodes_[task.node].end));
+			nodes_[task.node].child = child;
+			nodes_[task.node].dim = dims[i];
+			nodes_[task.node].cut = cuts[i];
+
+			for (unsigned int c = 0; c < 2; ++c) {
+				BuildTask t = task;
+				t.node = child + c;
+				if (c == 0)	t.hi[dims[i]] = cuts[i];
+				else		t.lo[dims[i]] = cuts[i];
+
+				const Node& n = nodes_[t.node];
+				if (n.end - n.begin > min_task_size)
+					next_level.push_back(t);
+				else if (n.end - n.begin > bucket_size_)
+					subtrees.push_back(t);
+			}
+		}
+		level.swap(next_level);
+	}
+
+	// each subtree is built into its own node array...
+	int num = static_cast<int>(subtrees.size());
+	std::vector< std::vector<Node> > subtree_nodes(num);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < num; ++i) {
+		BuildTask& task = subtrees[i];
+		std::vector<Node>& nodes = subtree_nodes[i];
+		const Node& root = nodes_[task.node];
+		nodes.reserve(4 * ((root.end - root.begin) / bucket_size_ + 1));
+		nodes.push_back(root);
+		build_node(nodes, 0, task.lo, task.hi);
+	}
+
+	// ... and then appended to nodes_ (the local node i > 0 goes to base + i - 1)
+	for (int i = 0; i < num; ++i) {
+		const std::vector<Node>& nodes = subtree_nodes[i];
+		unsigned int base = static_cast<unsigned int>(nodes_.size());
+		for (std::size_t j = 0; j < nodes.size(); ++j) {
+			Node n = nodes[j];
+			if (n.child != 0)
+				n.child = base + n.child - 1;
+			if (j == 0)
+				nodes_[subtrees[i].node] = n;
+			else
+				nodes_.push_back(n);
+		}
+	}
+}
+
+
+bool KdTreeIndex::split_node(unsigned int begin, unsigned int end, const float lo[3], const float hi[3], unsigned int& dim, float& cut, unsigned int& mid) {
+	unsigned int n = end - begin;
+	if (n <= bucket_size_)
+		return false;		// a leaf
+
+	// split along the longest side of the cell
+	dim = 0;
+	if (hi[1] - lo[1] > hi[dim] - lo[dim])	dim = 1;
+	if (hi[2] - lo[2] > hi[dim] - lo[dim])	dim = 2;
+
+	float min = points_[begin * 3 + dim];
+	float max = min;
+	for (unsigned int i = begin + 1; i < end; ++i) {
+		float v = points_[i * 3 + dim];
+		if (v < min)		min = v;
+		else if (v > max)	max = v;
+	}
+
+	float best_cut = (lo[dim] + hi[dim]) * 0.5f;
+	cut = best_cut;
+	if (best_cut < min)			// slide to min or max as needed
+		cut = min;
+	else if (best_cut > max)
+		cut = max;
+
+	unsigned int br1, br2;
+	split(begin, end, dim, cut, br1, br2);
+
+	if (best_cut < min)				mid = begin + 1;
+	else if (best_cut > max)		mid = end - 1;
+	else if (2 * (br1 - begin) > n)	mid = br1;
+	else if (2 * (br2 - begin) < n)	mid = br2;
+	else							mid = begin + n / 2;
+	return true;
+}
+
+
+void KdTreeIndex::build_node(std::vector<Node>& nodes, unsigned int node, float lo[3], float hi[3]) {
+	unsigned int dim, mid;
+	float cut;
+	if (!split_node(nodes[node].begin, nodes[node].end, lo, hi, dim, cut, mid))
+		return;
+
+	unsigned int child = static_cast<unsigned int>(nodes.size());
+	nodes.push_back(make_node(nodes[node].begin, mid));
+	nodes.push_back(make_node(mid, nodes[node].end));
+
+	nodes[node].child = child;
+	nodes[node].dim = dim;
+	nodes[node].cut = cut;
+
+	float old_hi = hi[dim];
+	hi[dim] = cut;
+	build_node(nodes, child, lo, hi);
+	hi[dim] = old_hi;
+
+	float old_lo = lo[dim];
+	lo[dim] = cut;
+	build_node(nodes, child + 1, lo, hi);
+	lo[dim] = old_lo;
+}
+
+
+KdTreeIndex::Node KdTreeIndex::make_node(unsigned int begin, unsigned int end) {
+	Node n;
+	n.begin = begin;
+	n.end = end;
+	n.child = 0;
+	n.dim = 0;
+	n.cut = 0.0f;
+	return n;
+}
+
+
+void KdTreeIndex::swap_points(unsigned int a, unsigned int b) {
+	std::swap(points_[a * 3], points_[b * 3]);
+	std::swap(points_[a * 3 + 1], points_[b * 3 + 1]);
+	std::swap(points_[a * 3 + 2], points_[b * 3 + 2]);
+	std::swap(indices_[a], indices_[b]);
+}
+
+
+void KdTreeIndex::split(unsigned int begin, unsigned int end, unsigned int dim, float cut, unsigned int& br1, unsigned int& br2) {
+	// use signed indices as r can go below begin
+	int l = static_cast<int>(begin);
+	int r = static_cast<int>(end) - 1;
+	for(;;) {				// partition points[begin..end-1] about the cut value
+		while (l < static_cast<int>(end) && points_[l * 3 + dim] < cut)
+			l++;
+		while (r >= static_cast<int>(begin) && points_[r * 3 + dim] >= cut)
+			r--;
+		if (l > r)
+			break;
+		swap_points(l, r);
+		l++;
+		r--;
+	}
+	br1 = l;			// now: points[begin..br1-1] < cut <= points[br1..end-1]
+	r = static_cast<int>(end) - 1;
+	for(;;) {				// partition points[br1..end-1] about the cut value
+		while (l < static_cast<int>(end) && points_[l * 3 + dim] <= cut)
+			l++;
+		while (r >= static_cast<int>(br1) && points_[r * 3 + dim] > cut)
+			r--;
+		if (l > r)
+			break;
+		swap_points(l, r);
+		l++;
+		r--;
+	}
+	br2 = l;			// now: points[br1..br2-1] == cut < points[br2..end-1]
+}
+
+
+float KdTreeIndex::box_distance(const float p[3]) const {
+	float dist = 0.0f;
+	for (int d = 0; d < 3; ++d) {
+		float t = 0.0f;
+		if (p[d] < bbox_min_[d])		t = bbox_min_[d] - p[d];
+		else if (p[d] > bbox_max_[d])	t = p[d] - bbox_max_[d];
+		dist += t * t;
+	}
+	return dist;
+}
+
+
+// The search uses the incremental distance computation of Arya and Mount: $offsets$
+// holds the per-dimension offsets of the query point to the current cell and $rd$
+// the squared distance to the cell, so a far child is visited only if its cell is
+// closer than the current K-th neighbor.
+void KdTreeIndex::search_K(unsigned int node, const float p[3], float rd, float offsets[3], KnnResult& result) const {
+	const Node& n = nodes_[node];
+	if (n.child == 0) {
+		const float* q = &points_[n.begin * 3];
+		for (unsigned int i = n.begin; i < n.end; ++i, q += 3) {
+			float dx = q[0] - p[0];
+			float dy = q[1] - p[1];
+			float dz = q[2] - p[2];
+			float d = dx * dx + dy * dy + dz * dz;
+			if (d < result.max_distance())
+				result.insert(indices_[i], d);
+		}
+		return;
+	}
+
+	float old_off = offsets[n.dim];
+	float new_off = p[n.dim] - n.cut;
+	unsigned int near_child = (new_off < 0) ? n.child : n.child + 1;
+	unsigned int far_child = (new_off < 0) ? n.child + 1 : n.child;
+
+	search_K(near_child, p, rd, offsets, result);
+	rd = rd - old_off * old_off + new_off * new_off;
+	if (rd < result.max_distance()) {
+		offsets[n.dim] = new_off;
+		search_K(far_child, p, rd, offsets, result);
+		offsets[n.dim] = old_off;
+	}
+}
+
+
+void KdTreeIndex::search_radius(
+	unsigned int node, const float p[3], float squared_radius, float rd, float offsets[3],
+	std::vector<unsigned int>& indices, std::vector<float>& squared_distances
+	) const {
+	const Node& n = nodes_[node];
+	if (n.child == 0) {
+		const float* q = &points_[n.begin * 3];
+		for (unsigned int i = n.begin; i < n.end; ++i, q += 3) {
+			float dx = q[0] - p[0];
+			float dy = q[1] - p[1];
+			float dz = q[2] - p[2];
+			float d = dx * dx + dy * dy + dz * dz;
+			if (d < squared_radius) {
+				indices.push_back(indices_[i]);
+				squared_distances.push_back(d);
+			}
+		}
+		return;
+	}
+
+	float old_off = offsets[n.dim];
+	float new_off = p[n.dim] - n.cut;
+	unsigned int near_child = (new_off < 0) ? n.child : n.child + 1;
+	unsigned int far_child = (new_off < 0) ? n.child + 1 : n.child;
+
+	search_radius(near_child, p, squared_radius, rd, offsets, indices, squared_distances);
+	rd = rd - old_off * old_off + new_off * new_off;
+	if (rd < squared_radius) {
+		offsets[n.dim] = new_off;
+		search_radius(far_child, p, squared_radius, rd, offsets, indices, squared_distances);
+		offsets[n.dim] = old_off;
+	}
+}
+
+
+int KdTreeIndex::find_closest_point(const float p[3], float& squared_distance) const {
+	unsigned int index = 0;
+	if (find_closest_K_points(p, 1, &index, &squared_distance) == 1)
+		return static_cast<int>(index);
+	else
+		return -1;
+}
+
+
+unsigned int KdTreeIndex::find_closest_K_points(const float p[3], unsigned int k, unsigned int* indices, float* squared_distances) const {
+	if (nodes_.empty() || k == 0)
+		return 0;
+
+	float offsets[3];
+	for (int d = 0; d < 3; ++d) {
+		if (p[d] < bbox_min_[d])		offsets[d] = p[d] - bbox_min_[d];
+		else if (p[d] > bbox_max_[d])	offsets[d] = p[d] - bbox_max_[d];
+		else							offsets[d] = 0.0f;
+	}
+
+	KnnResult result(k, indices, squared_distances);
+	search_K(0, p, box_distance(p), offsets, result);
+	return result.num_;
+}
+
+
+unsigned int KdTreeIndex::find_points_in_radius(
+	const float p[3], float squared_radius,
+	std::vector<unsigned int>& indices, std::vector<float>& squared_distances
+	) const {
+	if (nodes_.empty())
+		return 0;
+
+	float rd = box_distance(p);
+	if (rd >= squared_radius)
+		return 0;
+
+	float offsets[3];
+	for (int d = 0; d < 3; ++d) {
+		if (p[d] < bbox_min_[d])		offsets[d] = p[d] - bbox_min_[d];
+		else if (p[d] > bbox_max_[d])	offsets[d] = p[d] - bbox_max_[d];
+		else							offsets[d] = 0.0f;
+	}
+
+	std::size_t num = indices.size();
+	search_radius(0, p, squared_radius, rd, offsets, indices, squared_distances);
+	return static_cast<unsigned int>(indices.size() - num);
+}
+
+
+void KdTreeIndex::batch_find_closest_K_points(const float* queries, unsigned int num, unsigned int k, KdTreeNeighbors& result) const {
+	unsigned int m = std::min(k, size());	// the number of neighbors of each query
+
+	result.resize(num, m);
+	if (m == 0)
+		return;
+
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (int i = 0; i < static_cast<int>(num); ++i) {
+		find_closest_K_points(queries + i * 3, m, &result.indices[i * m], &result.squared_distances[i * m]);
+	}
+}
+
+
+void KdTreeIndex::batch_find_points_in_radius(const float* queries, unsigned int num, float squared_radius, KdTreeNeighbors& result) const {
+	batch_gather_neighbors<KdTreeNoContext>(num,
+		[&](KdTreeNoContext&, int i, std::vector<unsigned int>& indices, std::vector<float>& squared_distances) -> unsigned int {
+			return find_points_in_radius(queries + i * 3, squared_radius, indices, squared_distances);
+		},
+		result);
+}
+
+
+void KdTreeIndex::find_all_closest_K_points(unsigned int k, KdTreeNeighbors& result, bool exclude_self) const {
+	unsigned int num = size();
+	// the number of points to query, and the number of neighbors of each point
+	unsigned int kq = std::min(exclude_self ? k + 1 : k, num);
+	unsigned int m = (exclude_self && kq > 0) ? kq - 1 : kq;
+
+	result.resize(num, m);
+	if (m == 0)
+		return;
+
+	// The points are queried in tree order (consecutive queries visit the same leaves)
+	// and the result is written to the row of their index in the input buffer.
+#pragma omp parallel
+	{
+		std::vector<unsigned int>	indices(kq);
+		std::vector<float>			squared_distances(kq);
+
+#pragma omp for schedule(dynamic, 1024)
+		for (int i = 0; i < static_cast<int>(num); ++i) {
+			unsigned int self = indices_[i];
+			unsigned int* row_indices = &result.indices[self * m];
+			float* row_distances = &result.squared_distances[self * m];
+
+			if (!exclude_self) {
+				find_closest_K_points(&points_[i * 3], kq, row_indices, row_distances);
+				continue;
+			}
+
+			find_closest_K_points(&points_[i * 3], kq, &indices[0], &squared_distances[0]);
+			copy_neighbors_except_self(self, &indices[0], &squared_distances[0], kq, row_indices, row_distances);
+		}
+	}
+}
+
@@ -0,0 +1,136 @@
+#ifndef __KDTREE_KDTREE_INDEX__
+#define __KDTREE_KDTREE_INDEX__
+
+#include "kdtree_common.h"
+#include "kdtree_neighbors.h"
+#include <vector>
+
+
+/***********************************************************************
+ A kd-tree built directly over a contiguous buffer of float coordinates.
+ Unlike KdTreeSearch, it knows nothing about PointSet: the points are
+ identified by their 32-bit index in the input buffer.
+
+ - The tree copies the coordinates once and reorders them (together with
+   their original indices) in tree order, so the points of a leaf are
+   contiguous in memory. Nothing else is allocated during the build (about
+   16 bytes per point plus the nodes, compared to ~36 bytes per point for
+   the temporary arrays of KdTreeSearch_ETH).
+ - The nodes are stored in a flat array (no virtual calls, no pointers).
+ - All queries are const and do not use any shared scratch space, so the
+   tree can be queried from several threads at the same time.
+
+ The splitting rule is the sliding midpoint rule also used by ETH and ANN.
+************************************************************************/
+
+class KDTREE_API KdTreeIndex
+{
+public:
+	KdTreeIndex();
+	~KdTreeIndex();
+
+	//______________ tree construction __________________________
+
+	// Builds the tree from $num$ points stored as an array of structures: the
+	// coordinates of the i-th point are points[i * stride], points[i * stride + 1],
+	// and points[i * stride + 2] (i.e., stride = 3 for packed xyz triples).
+	void build(const float* points, unsigned int num, unsigned int stride = 3);
+
+	// Builds the tree from $num$ points stored as a structure of arrays.
+	void build(const float* x, const float* y, const float* z, unsigned int num);
+
+	void clear();
+
+	// number of points per leaf (default: 16). Must be set before build().
+	void set_bucket_size(unsigned int n) { bucket_size_ = (n > 0 ? n : 1); }
+
+	// If true, the tree is built using all the cores (default: false). The 
+	// resulting tree is the same as the one built sequentially.
+	void set_parallel_build(bool b) { parallel_build_ = b; }
+
+	unsigned int size() const { return static_cast<unsigned int>(indices_.size()); }
+
+	// The coordinates of the i-th point in tree order and its index in the input buffer.
+	const float* point_in_tree_order(unsigned int i) const { return &points_[i * 3]; }
+	unsigned int index_in_tree_order(unsigned int i) const { return indices_[i]; }
+
+	//________________ closest point ____________________________
+
+	// Returns the index of the closest point, or -1 if the tree is empty.
+	// NOTE: *squared* distance is returned
+	int find_closest_point(const float p[3], float& squared_distance) const;
+
+	//_________________ K-nearest neighbors ____________________
+
+	// The $indices$ and $squared_distances$ arrays must have room for $k$ elements.
+	// Returns the number of neighbors found (i.e., min(k, size())), sorted by
+	// increasing distance.
+	// NOTE: *squared* distances are returned
+	unsigned int find_closest_K_points(const float p[3], unsigned int k, unsigned int* indices, float* squared_distances) const;
+
+	//___________________ radius search __________________________
+
+	// All points within the ball. The neighbors are appended to $indices$ and
+	// $squared_distances$ in tree order (i.e., they are *not* sorted by distance).
+	// Returns the number of neighbors found.
+	// NOTE: *squared* radius of query ball
+	unsigned int find_points_in_radius(const float p[3], float squared_radius,
+		std::vector<unsigned int>& indices, std::vector<float>& squared_distances
+		) const;
+
+	//___________________ batched queries ________________________
+
+	// The $num$ query points are packed xyz triples. The queries are distributed
+	// over all the cores and the result is stored in compressed form.
+	void batch_find_closest_K_points(const float* queries, unsigned int num, unsigned int k, KdTreeNeighbors& result) const;
+	void batch_find_points_in_radius(const float* queries, unsigned int num, float squared_radius, KdTreeNeighbors& result) const;
+
+	// The K nearest neighbors of every point in the tree (i.e., the i-th entry of the
+	// result is the neighborhood of the i-th point of the input buffer). If
+	// $exclude_self$ is true, the point itself is not reported as its own neighbor.
+	void find_all_closest_K_points(unsigned int k, KdTreeNeighbors& result, bool exclude_self = false) const;
+
+private:
+	struct Node {
+		unsigned int	begin, end;	// the points of the subtree (in tree order)
+		unsigned int	child;		// the children are nodes_[child] and nodes_[child + 1]. 0 for a leaf.
+		unsigned int	dim;		// splitting dimension
+		float			cut;		// splitting value
+	};
+
+	struct KnnResult;
+	struct BuildTask;
+
+	void build_tree();
+	void build_tree_parallel();
+	// recursively splits nodes[node] (whose cell is [lo, hi]), appending the children to $nodes$
+	void build_node(std::vector<Node>& nodes, unsigned int node, float lo[3], float hi[3]);
+	// computes the split of the points [begin, end). Returns false if they make a leaf.
+	bool split_node(unsigned int begin, unsigned int end, const float lo[3], const float hi[3], unsigned int& dim, float& cut, unsigned int& mid);
+	static Node make_node(unsigned int begin, unsigned int end);
+	// partitions points [begin, end) about the cut value. On return:
+	//		points[begin..br1-1] < cut
+	//		points[br1..br2-1] == cut
+	//		points[br2..end-1] > cut
+	void split(unsigned int begin, unsigned int end, unsigned int dim, float cut, unsigned int& br1, unsigned int& br2);
+	void swap_points(unsigned int a, unsigned int b);
+
+	void search_K(unsigned int node, const float p[3], float rd, float offsets[3], KnnResult& result) const;
+	void search_radius(unsigned int node, const float p[3], float squared_radius, float rd, float offsets[3],
+		std::vector<unsigned int>& indices, std::vector<float>& squared_distances) const;
+	// the squared distance from p to the bounding box of all points
+	float box_distance(const float p[3]) const;
+
+private:
+	std::vector<float>			points_;	// xyz coordinates in tree order
+	std::vector<unsigned int>	indices_;	// index in the input buffer of each point (in tree order)
+	std::vector<Node>			nodes_;		// nodes_[0] is the root
+	float						bbox_min_[3];
+	float						bbox_max_[3];
+	unsigned int				bucket_size_;
+	bool						parallel_build_;
+};
+
+
+#endif
+
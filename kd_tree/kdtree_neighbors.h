@@ -0,0 +1,128 @@
+#ifndef __KDTREE_NEIGHBORS__
+#define __KDTREE_NEIGHBORS__
+
+#include "kdtree_common.h"
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+
+// The result of a batched query in compressed (CSR) form: the neighbors of the i-th 
+// query are indices[offsets[i]], ..., indices[offsets[i+1] - 1], and their *squared* 
+// distances are stored at the same positions in squared_distances. The indices refer 
+// to the order in which the points were given to the tree (see KdTreeSearch::vertex()
+// and KdTreeIndex::build()).
+class KdTreeNeighbors
+{
+public:
+	// number of queries
+	unsigned int size() const { return offsets.empty() ? 0 : static_cast<unsigned int>(offsets.size() - 1); }
+	// number of neighbors found for the i-th query
+	unsigned int size_of_neighbors(unsigned int i) const { return offsets[i + 1] - offsets[i]; }
+
+	// $num$ queries with $k$ neighbors each (to be filled by the caller)
+	void resize(unsigned int num, unsigned int k) {
+		offsets.resize(num + 1);
+		for (unsigned int i = 0; i <= num; ++i)
+			offsets[i] = i * k;
+		indices.resize(num * k);
+		squared_distances.resize(num * k);
+	}
+
+	void clear() {
+		offsets.clear();
+		indices.clear();
+		squared_distances.clear();
+	}
+
+	std::vector<unsigned int>	offsets;
+	std::vector<unsigned int>	indices;
+	std::vector<float>			squared_distances;
+};
+
+
+// Runs query(ctx, i, indices, squared_distances) for the $num$ queries in parallel. Each call
+// appends the neighbors of the i-th query to the buffers of its thread and returns their number;
+// $ctx$ is a Context owned by the thread (e.g., the query context of the tree). The buffers are
+// gathered into $result$ once the number of neighbors of each query is known.
+template <class Context, class Query>
+void batch_gather_neighbors(unsigned int num, const Query& query, KdTreeNeighbors& result)
+{
+	result.offsets.assign(num + 1, 0);
+
+	int num_threads = omp_get_max_threads();
+	std::vector< std::vector<unsigned int> >	thread_indices(num_threads);
+	std::vector< std::vector<float> >			thread_distances(num_threads);
+	std::vector<int>			owner(num);
+	std::vector<unsigned int>	start(num);
+
+#pragma omp parallel
+	{
+		int t = omp_get_thread_num();
+		std::vector<unsigned int>& indices = thread_indices[t];
+		std::vector<float>& squared_distances = thread_distances[t];
+		Context ctx;
+
+#pragma omp for schedule(dynamic, 1024)
+		for (int i = 0; i < static_cast<int>(num); ++i) {
+			owner[i] = t;
+			start[i] = static_cast<unsigned int>(indices.size());
+			result.offsets[i + 1] = query(ctx, i, indices, squared_distances);
+		}
+	}
+
+	for (unsigned int i = 0; i < num; ++i)
+		result.offsets[i + 1] += result.offsets[i];
+	result.indices.resize(result.offsets[num]);
+	result.squared_distances.resize(result.offsets[num]);
+
+#pragma omp parallel for
+	for (int i = 0; i < static_cast<int>(num); ++i) {
+		unsigned int found = result.size_of_neighbors(i);
+		if (found == 0)
+			continue;
+		const unsigned int* indices = &thread_indices[owner[i]][start[i]];
+		const float* squared_distances = &thread_distances[owner[i]][start[i]];
+		std::copy(indices, indices + found, result.indices.begin() + result.offsets[i]);
+		std::copy(squared_distances, squared_distances + found, result.squared_distances.begin() + result.offsets[i]);
+	}
+}
+
+
+// The Context of the queries that need none
+struct KdTreeNoContext {};
+
+
+// Copies the $num$ neighbors of the point $self$ (the point itself among them) to $out_indices$
+// and $out_squared_distances$, without the point itself. The point is not necessarily the first
+// one if there are duplicated points. If it is not in the list at all, the farthest neighbor is
+// dropped. Returns the number of neighbors copied.
+inline unsigned int copy_neighbors_except_self(
+	unsigned int self, const unsigned int* indices, const float* squared_distances, unsigned int num,
+	unsigned int* out_indices, float* out_squared_distances)
+{
+	if (num == 0)
+		return 0;
+
+	unsigned int skip = num - 1;
+	for (unsigned int j = 0; j < num; ++j) {
+		if (indices[j] == self) {
+			skip = j;
+			break;
+		}
+	}
+
+	unsigned int pos = 0;
+	for (unsigned int j = 0; j < num; ++j) {
+		if (j == skip)
+			continue;
+		out_indices[pos] = indices[j];
+		out_squared_distances[pos] = squared_distances[j];
+		++pos;
+	}
+	return pos;
+}
+
+
+#endif
+
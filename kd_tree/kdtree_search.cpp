@@ -4,10 +4,44 @@
 
 
 KdTreeSearch::KdTreeSearch()
+: parallel_build_(false)
 {
 }
 
 
 KdTreeSearch::~KdTreeSearch()
 {
-}
\ No newline at end of file
+}
+
+
+void KdTreeSearch::find_all_closest_K_points(unsigned int k, KdTreeNeighbors& result, bool exclude_self) const {
+	int num = static_cast<int>(vertices_.size());
+	std::vector<vec3> queries(num);
+	for (int i = 0; i < num; ++i)
+		queries[i] = vertices_[i]->point();
+
+	if (!exclude_self) {
+		batch_find_closest_K_points(queries, k, result);
+		return;
+	}
+
+	// query one more neighbor and then drop the point itself
+	KdTreeNeighbors all;
+	batch_find_closest_K_points(queries, k + 1, all);
+	std::vector<vec3>().swap(queries);
+
+	result.offsets.resize(num + 1);
+	result.offsets[0] = 0;
+	for (int i = 0; i < num; ++i) {
+		unsigned int found = all.size_of_neighbors(i);
+		result.offsets[i + 1] = result.offsets[i] + (found > 0 ? found - 1 : 0);
+	}
+	result.indices.resize(result.offsets[num]);
+	result.squared_distances.resize(result.offsets[num]);
+
+#pragma omp parallel for
+	for (int i = 0; i < num; ++i) {
+		copy_neighbors_except_self(i, all.indices.data() + all.offsets[i], all.squared_distances.data() + all.offsets[i], all.size_of_neighbors(i),
+			result.indices.data() + result.offsets[i], result.squared_distances.data() + result.offsets[i]);
+	}
+}
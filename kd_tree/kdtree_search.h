@@ -3,6 +3,7 @@
 #define __KDTREE_SPATIAL_SEARCH__
 
 #include "kdtree_common.h"
+#include "kdtree_neighbors.h"
 #include "../math/math_types.h"
 #include "../basic/basic_types.h"
 #include "../geom/point_set.h"
@@ -53,6 +54,11 @@ public:
 	virtual void add_vertex_set(PointSet* vs) = 0;
 	virtual void end() = 0;
 
+	// If true, end() builds the tree using all the cores (if the implementation 
+	// allows). Default is false.
+	void set_parallel_build(bool b) { parallel_build_ = b; }
+	bool parallel_build() const { return parallel_build_; }
+
 	//________________ closest point ____________________________
 
 	// NOTE: *squared* distance is returned
@@ -71,6 +77,31 @@ public:
 	// NOTE: *squared* radius of query ball
 	virtual void find_points_in_radius(const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors) const = 0;
 	virtual void find_points_in_radius(const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances) const = 0;
+
+	//___________________ batched queries ________________________
+
+	// Query a whole array of points at once (in parallel if the implementation allows).
+	// The result is stored in compressed form (see KdTreeNeighbors), which avoids one 
+	// virtual call and the allocation of two std::vectors per query.
+	// NOTE: *squared* distances are returned
+	virtual void batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const = 0;
+	virtual void batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const = 0;
+
+	// The K nearest neighbors of every point in the tree (i.e., the i-th entry of the 
+	// result is the neighborhood of vertex(i)). If $exclude_self$ is true, the point 
+	// itself is not reported as one of its own neighbors.
+	void find_all_closest_K_points(unsigned int k, KdTreeNeighbors& result, bool exclude_self = false) const;
+
+	//______________________ indexed points ______________________
+
+	unsigned int size_of_points() const { return static_cast<unsigned int>(vertices_.size()); }
+
+	// the i-th point added to the tree
+	PointSet::Vertex* vertex(unsigned int i) const { return vertices_[i]; }
+
+protected:
+	std::vector<PointSet::Vertex*> vertices_;
+	bool	parallel_build_;
 };
 
 
@@ -39,7 +39,10 @@ void KdTreeSearch_ANN::end()  {
 	points_num_ = vertices_.size();
 	points_ = annAllocPts(points_num_, 3);
 
-	for(unsigned int i=0; i<points_num_; ++i) {
+	// NOTE: ANN builds the tree sequentially, only the copy is done in parallel
+	int num = static_cast<int>(points_num_);
+#pragma omp parallel for if (parallel_build_)
+	for(int i=0; i<num; ++i) {
 		const vec3& p = vertices_[i]->point();
 		points_[i][0] = p[0];
 		points_[i][1] = p[1];
@@ -184,3 +187,62 @@ void KdTreeSearch_ANN::find_points_in_radius(
 		delete [] closest_pts_idx;
 		delete [] closest_pts_dists;
 }
+
+
+void KdTreeSearch_ANN::batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const {
+	unsigned int num = static_cast<unsigned int>(queries.size());
+	unsigned int m = std::min(k, points_num_);	// the number of neighbors of each query
+
+	result.resize(num, m);
+	if (m == 0)
+		return;
+
+	ANNidxArray  closest_pts_idx = new ANNidx[m];		// near neighbor indices
+	ANNdistArray closest_pts_dists = new ANNdist[m];	// near neighbor distances
+	ANNcoord ann_p[3];
+	for (unsigned int i = 0; i < num; ++i) {
+		const vec3& p = queries[i];
+		ann_p[0] = p[0];
+		ann_p[1] = p[1];
+		ann_p[2] = p[2];
+		get_tree(tree_)->annkSearch(ann_p, m, closest_pts_idx, closest_pts_dists);
+
+		for (unsigned int j = 0; j < m; ++j) {
+			result.indices[i * m + j] = closest_pts_idx[j];
+			result.squared_distances[i * m + j] = static_cast<float>(closest_pts_dists[j]); // ANN uses squared distance internally
+		}
+	}
+
+	delete [] closest_pts_idx;
+	delete [] closest_pts_dists;
+}
+
+
+void KdTreeSearch_ANN::batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const {
+	unsigned int num = static_cast<unsigned int>(queries.size());
+	result.offsets.resize(num + 1);
+	result.offsets[0] = 0;
+	result.indices.clear();
+	result.squared_distances.clear();
+
+	ANNidxArray  closest_pts_idx = new ANNidx[k_for_radius_search_];		// near neighbor indices
+	ANNdistArray closest_pts_dists = new ANNdist[k_for_radius_search_];		// near neighbor distances
+	ANNcoord ann_p[3];
+	for (unsigned int i = 0; i < num; ++i) {
+		const vec3& p = queries[i];
+		ann_p[0] = p[0];
+		ann_p[1] = p[1];
+		ann_p[2] = p[2];
+		int n = get_tree(tree_)->annkFRSearch(ann_p, squared_radius, k_for_radius_search_, closest_pts_idx, closest_pts_dists);
+
+		int found = std::min(n, k_for_radius_search_);
+		for (int j = 0; j < found; ++j) {
+			result.indices.push_back(closest_pts_idx[j]);
+			result.squared_distances.push_back(static_cast<float>(closest_pts_dists[j])); // ANN uses squared distance internally
+		}
+		result.offsets[i + 1] = static_cast<unsigned int>(result.indices.size());
+	}
+
+	delete [] closest_pts_idx;
+	delete [] closest_pts_dists;
+}
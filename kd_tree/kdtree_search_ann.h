@@ -57,8 +57,13 @@ public:
 		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
 		) const ;
 
+	//___________________ batched queries ________________________
+
+	// NOTE: ANN keeps its search state in global variables, so the queries are run sequentially.
+	virtual void batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const ;
+	virtual void batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const ;
+
 protected:
-	std::vector<PointSet::Vertex*> vertices_;
 	unsigned int	points_num_;
 	double**		points_;
 
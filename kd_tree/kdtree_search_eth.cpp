@@ -2,20 +2,36 @@
 #include "kdtree_search_eth.h"
 #include "ETH_Kd_Tree/kdTree.h"
 
+#include <algorithm>
+#include <omp.h>
+
 
 
 
 #define get_tree(x) ((kdtree::KdTree*)(x))
+#define get_context(x) (*(kdtree::QueryContext*)((x).context_))
+
+
+KdTreeSearch_ETH::QueryContext::QueryContext() {
+	context_ = new kdtree::QueryContext;
+}
+
+
+KdTreeSearch_ETH::QueryContext::~QueryContext() {
+	delete (kdtree::QueryContext*)context_;
+}
 
 
 KdTreeSearch_ETH::KdTreeSearch_ETH()  {
 	points_num_ = 0;
 	tree_ = nil;
+	context_ = new QueryContext;
 }
 
 
 KdTreeSearch_ETH::~KdTreeSearch_ETH() {
     delete get_tree(tree_);
+	delete context_;
 }
 
 
@@ -31,7 +47,9 @@ void KdTreeSearch_ETH::end()  {
 	points_num_ = vertices_.size();
 
 	kdtree::Vector3D* points = new kdtree::Vector3D[points_num_];
-	for(unsigned int i=0; i<points_num_; ++i) {
+	int num = static_cast<int>(points_num_);
+#pragma omp parallel for if (parallel_build_)
+	for(int i=0; i<num; ++i) {
 		const vec3& p = vertices_[i]->point();
 		points[i].x = p.x;
 		points[i].y = p.y;
@@ -39,7 +57,7 @@ void KdTreeSearch_ETH::end()  {
 	}
 
 	unsigned int maxBucketSize = 16 ;	// number of points per bucket
-	tree_ = new kdtree::KdTree(points, points_num_, maxBucketSize );
+	tree_ = new kdtree::KdTree(points, points_num_, maxBucketSize, parallel_build_);
 	delete [] points;
 }
 
@@ -56,26 +74,63 @@ void KdTreeSearch_ETH::add_vertex_set(PointSet* vs)  {
 
 
 PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p) const {
+	return find_closest_point(p, *context_);
+}
+
+PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p, double& squared_distance) const {
+	return find_closest_point(p, squared_distance, *context_);
+}
+
+void KdTreeSearch_ETH::find_closest_K_points(
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors
+	)  const {
+		find_closest_K_points(p, k, neighbors, *context_);
+}
+
+void KdTreeSearch_ETH::find_closest_K_points(
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	)  const {
+		find_closest_K_points(p, k, neighbors, squared_distances, *context_);
+}
+
+
+void KdTreeSearch_ETH::find_points_in_radius(
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors
+	)  const {
+		find_points_in_radius(p, squared_radius, neighbors, *context_);
+}
+
+
+void KdTreeSearch_ETH::find_points_in_radius(
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	)  const {
+		find_points_in_radius(p, squared_radius, neighbors, squared_distances, *context_);
+}
+
+
+PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p, QueryContext& context) const {
+	kdtree::QueryContext& ctx = get_context(context);
 	kdtree::Vector3D v3d( p.x, p.y, p.z );
-	get_tree(tree_)->setNOfNeighbours( 1 );
-	get_tree(tree_)->queryPosition( v3d );
+	ctx.setNOfNeighbours( 1 );
+	get_tree(tree_)->queryPosition( v3d, ctx );
 
-	unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+	unsigned int num = ctx.getNOfFoundNeighbours();
 	if (num == 1) {
-		return vertices_[ get_tree(tree_)->getNeighbourPositionIndex(0) ];
+		return vertices_[ ctx.getNeighbourPositionIndex(0) ];
 	} else
 		return nil;
 }
 
-PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p, double& squared_distance) const {
+PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p, double& squared_distance, QueryContext& context) const {
+	kdtree::QueryContext& ctx = get_context(context);
 	kdtree::Vector3D v3d( p.x, p.y, p.z );
-	get_tree(tree_)->setNOfNeighbours( 1 );
-	get_tree(tree_)->queryPosition( v3d );
+	ctx.setNOfNeighbours( 1 );
+	get_tree(tree_)->queryPosition( v3d, ctx );
 
-	unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+	unsigned int num = ctx.getNOfFoundNeighbours();
 	if (num == 1) {
-		squared_distance = get_tree(tree_)->getSquaredDistance(0);
-		return vertices_[ get_tree(tree_)->getNeighbourPositionIndex(0) ];
+		squared_distance = ctx.getSquaredDistance(0);
+		return vertices_[ ctx.getNeighbourPositionIndex(0) ];
 	} else {
 		std::cerr << "no point found" << std::endl;
 		return nil;
@@ -83,73 +138,124 @@ PointSet::Vertex* KdTreeSearch_ETH::find_closest_point(const vec3& p, double& sq
 }
 
 void KdTreeSearch_ETH::find_closest_K_points(
-	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors, QueryContext& context
 	)  const {
+		kdtree::QueryContext& ctx = get_context(context);
 		kdtree::Vector3D v3d( p.x, p.y, p.z );
-		get_tree(tree_)->setNOfNeighbours( k );
-		get_tree(tree_)->queryPosition( v3d );
+		ctx.setNOfNeighbours( k );
+		get_tree(tree_)->queryPosition( v3d, ctx );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		if (num == k) {
 			neighbors.resize(k);
 			for (unsigned int i=0; i<k; ++i) {
-				neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
+				neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
 			}		
 		} else
 			std::cerr << "less than " << k << " points found" << std::endl;
 }
 
 void KdTreeSearch_ETH::find_closest_K_points(
-	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances, QueryContext& context
 	)  const {
+		kdtree::QueryContext& ctx = get_context(context);
 		kdtree::Vector3D v3d( p.x, p.y, p.z );
-		get_tree(tree_)->setNOfNeighbours( k );
-		get_tree(tree_)->queryPosition( v3d );
+		ctx.setNOfNeighbours( k );
+		get_tree(tree_)->queryPosition( v3d, ctx );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		if (num == k) {
 			neighbors.resize(k);
 			squared_distances.resize(k);
 			for (unsigned int i=0; i<k; ++i) {
-				neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
-				squared_distances[i] = get_tree(tree_)->getSquaredDistance(i);
+				neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
+				squared_distances[i] = ctx.getSquaredDistance(i);
 			}		
 		} else
 			std::cerr << "less than " << k << " points found" << std::endl;
 }
 
 
-
 void KdTreeSearch_ETH::find_points_in_radius(
-	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, QueryContext& context
 	)  const {
+		kdtree::QueryContext& ctx = get_context(context);
 		kdtree::Vector3D v3d( p.x, p.y, p.z );
-		get_tree(tree_)->queryRange( v3d, squared_radius, true );
+		get_tree(tree_)->queryRange( v3d, squared_radius, ctx, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		neighbors.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
 		}	
 }
 
 
 void KdTreeSearch_ETH::find_points_in_radius(
-	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances, QueryContext& context
 	)  const {
+		kdtree::QueryContext& ctx = get_context(context);
 		kdtree::Vector3D v3d( p.x, p.y, p.z );
-		get_tree(tree_)->queryRange( v3d, squared_radius, true );
+		get_tree(tree_)->queryRange( v3d, squared_radius, ctx, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		neighbors.resize(num);
 		squared_distances.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
-			squared_distances[i] = get_tree(tree_)->getSquaredDistance(i);
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
+			squared_distances[i] = ctx.getSquaredDistance(i);
 		}	
 }
 
 
+void KdTreeSearch_ETH::batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const {
+	int num = static_cast<int>(queries.size());
+	unsigned int m = std::min(k, points_num_);	// the number of neighbors of each query
+
+	result.resize(num, m);
+	if (m == 0)
+		return;
+
+#pragma omp parallel
+	{
+		kdtree::QueryContext ctx;
+		ctx.setNOfNeighbours(m);
+
+#pragma omp for schedule(dynamic, 1024)
+		for (int i = 0; i < num; ++i) {
+			const vec3& p = queries[i];
+			get_tree(tree_)->queryPosition(kdtree::Vector3D(p.x, p.y, p.z), ctx);
+
+			unsigned int* indices = &result.indices[i * m];
+			float* squared_distances = &result.squared_distances[i * m];
+			for (unsigned int j = 0; j < m; ++j) {
+				indices[j] = ctx.getNeighbourPositionIndex(j);
+				squared_distances[j] = ctx.getSquaredDistance(j);
+			}
+		}
+	}
+}
+
+
+void KdTreeSearch_ETH::batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const {
+	kdtree::KdTree* tree = get_tree(tree_);
+	float r2 = static_cast<float>(squared_radius);
+	batch_gather_neighbors<kdtree::QueryContext>(static_cast<unsigned int>(queries.size()),
+		[&](kdtree::QueryContext& ctx, int i, std::vector<unsigned int>& indices, std::vector<float>& squared_distances) -> unsigned int {
+			const vec3& p = queries[i];
+			tree->queryRange(kdtree::Vector3D(p.x, p.y, p.z), r2, ctx, true);
+
+			unsigned int found = ctx.getNOfFoundNeighbours();
+			for (unsigned int j = 0; j < found; ++j) {
+				indices.push_back(ctx.getNeighbourPositionIndex(j));
+				squared_distances.push_back(ctx.getSquaredDistance(j));
+			}
+			return found;
+		},
+		result);
+}
+
+
 unsigned int KdTreeSearch_ETH::find_points_in_cylinder(
 	const vec3& p1, const vec3& p2, double radius, 
 	std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances, 
@@ -157,15 +263,16 @@ unsigned int KdTreeSearch_ETH::find_points_in_cylinder(
 	) const {
 		kdtree::Vector3D s( p1.x, p1.y, p1.z );
 		kdtree::Vector3D t( p2.x, p2.y, p2.z );
-		get_tree(tree_)->queryLineIntersection( s, t, radius, bToLine, true );
+		kdtree::QueryContext& ctx = get_context(*context_);
+		get_tree(tree_)->queryLineIntersection( s, t, radius, ctx, bToLine, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 
 		neighbors.resize(num);
 		squared_distances.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
-			squared_distances[i] = get_tree(tree_)->getSquaredDistance(i);
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
+			squared_distances[i] = ctx.getSquaredDistance(i);
 		}	
 
 		return num;
@@ -178,12 +285,13 @@ unsigned int KdTreeSearch_ETH::find_points_in_cylinder(
 	) const {
 		kdtree::Vector3D s( p1.x, p1.y, p1.z );
 		kdtree::Vector3D t( p2.x, p2.y, p2.z );
-		get_tree(tree_)->queryLineIntersection( s, t, radius, bToLine, true );
+		kdtree::QueryContext& ctx = get_context(*context_);
+		get_tree(tree_)->queryLineIntersection( s, t, radius, ctx, bToLine, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		neighbors.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
 		}
 
 		return num;
@@ -198,14 +306,15 @@ unsigned int KdTreeSearch_ETH::find_points_in_cone(
 		kdtree::Vector3D eye3d( eye.x, eye.y, eye.z );
 		kdtree::Vector3D s( p1.x, p1.y, p1.z );
 		kdtree::Vector3D t( p2.x, p2.y, p2.z ); 
-		get_tree(tree_)->queryConeIntersection( eye3d, s, t, angle_range, bToLine, true );
+		kdtree::QueryContext& ctx = get_context(*context_);
+		get_tree(tree_)->queryConeIntersection( eye3d, s, t, angle_range, ctx, bToLine, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		neighbors.resize(num);
 		squared_distances.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
-			squared_distances[i] = get_tree(tree_)->getSquaredDistance(i);
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
+			squared_distances[i] = ctx.getSquaredDistance(i);
 		}
 
 		return num;
@@ -219,12 +328,13 @@ unsigned int KdTreeSearch_ETH::find_points_in_cone(
 		kdtree::Vector3D eye3d( eye.x, eye.y, eye.z );
 		kdtree::Vector3D s( p1.x, p1.y, p1.z );
 		kdtree::Vector3D t( p2.x, p2.y, p2.z );
-		get_tree(tree_)->queryConeIntersection( eye3d, s, t, angle_range, bToLine, true);
+		kdtree::QueryContext& ctx = get_context(*context_);
+		get_tree(tree_)->queryConeIntersection( eye3d, s, t, angle_range, ctx, bToLine, true );
 
-		unsigned int num = get_tree(tree_)->getNOfFoundNeighbours();
+		unsigned int num = ctx.getNOfFoundNeighbours();
 		neighbors.resize(num);
 		for (unsigned int i=0; i<num; ++i) {
-			neighbors[i] = vertices_[ get_tree(tree_)->getNeighbourPositionIndex(i) ];
+			neighbors[i] = vertices_[ ctx.getNeighbourPositionIndex(i) ];
 		}
 
 		return num;
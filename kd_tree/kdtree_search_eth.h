@@ -7,6 +7,25 @@
 
 
 class KDTREE_API KdTreeSearch_ETH : public KdTreeSearch  {
+public:
+	// The scratch space of a query (the priority queue and the neighbors found). 
+	// The queries that do not take a QueryContext share the one owned by the tree,
+	// so they must not be called concurrently. The overloads taking a QueryContext
+	// leave the tree untouched: give each thread its own context and a single tree
+	// can serve all of them. A context can be reused for any number of queries
+	// (and trees), which also avoids reallocating the scratch space for each query.
+	class KDTREE_API QueryContext {
+	public:
+		QueryContext();
+		~QueryContext();
+	private:
+		QueryContext(const QueryContext&);
+		QueryContext& operator=(const QueryContext&);
+
+		void*	context_;
+		friend class KdTreeSearch_ETH;
+	};
+
 public:
 	KdTreeSearch_ETH();
 	virtual ~KdTreeSearch_ETH();
@@ -49,6 +68,40 @@ public:
 		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
 		) const ;
 
+	//___________________ batched queries ________________________
+
+	// The queries are distributed over all the cores (each thread with its own QueryContext)
+	virtual void batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const ;
+	virtual void batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const ;
+
+	//______________ queries with a caller-owned context __________
+
+	// Same as the above queries but thread safe (see QueryContext).
+	PointSet::Vertex* find_closest_point(const vec3& p, double& squared_distance, QueryContext& context) const ;
+	PointSet::Vertex* find_closest_point(const vec3& p, QueryContext& context) const ;
+
+	void find_closest_K_points(
+		const vec3& p, unsigned int k, 
+		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances,
+		QueryContext& context
+		) const ;
+
+	void find_closest_K_points(
+		const vec3& p, unsigned int k, 
+		std::vector<PointSet::Vertex*>& neighbors,
+		QueryContext& context
+		) const ;
+
+	void find_points_in_radius(const vec3& p, double squared_radius, 
+		std::vector<PointSet::Vertex*>& neighbors,
+		QueryContext& context
+		) const ;
+
+	void find_points_in_radius(const vec3& p, double squared_radius, 
+		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances,
+		QueryContext& context
+		) const ;
+
 	//____________________ cylinder range search _________________
 
 	// Search for the nearest points whose distances to line segment $v1$-$v2$ are smaller 
@@ -87,10 +140,12 @@ public:
 		) const ;
 
 protected:
-	std::vector<PointSet::Vertex*> vertices_;
 	unsigned int	points_num_;
 
 	void*	tree_;
+
+	// used by the queries without a caller-owned context
+	QueryContext*	context_;
 } ;
 
 #endif
@@ -2,6 +2,8 @@
 #include "kdtree_search_flann.h"
 #include "FLANN/flann.hpp"
 
+#include <omp.h>
+
 
 
 #define get_tree(x) ((const flann::Index< flann::L2<double> > *)(x))
@@ -41,7 +43,10 @@ void KdTreeSearch_FLANN::end()  {
 	points_num_ = vertices_.size();
 	points_ = new double[points_num_ * 3];
 
-	for(unsigned int i=0; i<points_num_; ++i) {
+	// NOTE: FLANN builds the tree sequentially, only the copy is done in parallel
+	int num = static_cast<int>(points_num_);
+#pragma omp parallel for if (parallel_build_)
+	for(int i=0; i<num; ++i) {
 		const vec3& p = vertices_[i]->point();
 		points_[i*3  ] = p.x;
 		points_[i*3+1] = p.y;
@@ -141,3 +146,63 @@ void KdTreeSearch_FLANN::find_points_in_radius(
 			squared_distances[i] = dists[0][i];
 		}
 }
+
+
+void KdTreeSearch_FLANN::batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const {
+	unsigned int num = static_cast<unsigned int>(queries.size());
+	unsigned int m = std::min(k, points_num_);	// the number of neighbors of each query
+
+	result.offsets.resize(num + 1);
+	for (unsigned int i = 0; i <= num; ++i)
+		result.offsets[i] = i * m;
+	result.indices.resize(num * m);
+	result.squared_distances.resize(num * m);
+	if (num == 0 || m == 0)
+		return;
+
+	flann::Matrix<double> query(const_cast<double*>(queries[0].data()), num, 3);
+	flann::Matrix<size_t> indices(new size_t[num * m], num, m);
+	flann::Matrix<double> dists(new double[num * m], num, m);
+
+	flann::SearchParams params(checks_);
+	params.cores = omp_get_max_threads();
+	get_tree(tree_)->knnSearch(query, indices, dists, m, params);
+
+	for (unsigned int i = 0; i < num * m; ++i) {
+		result.indices[i] = static_cast<unsigned int>(indices.ptr()[i]);
+		result.squared_distances[i] = static_cast<float>(dists.ptr()[i]);
+	}
+
+	delete [] indices.ptr();
+	delete [] dists.ptr();
+}
+
+
+void KdTreeSearch_FLANN::batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const {
+	unsigned int num = static_cast<unsigned int>(queries.size());
+	result.offsets.assign(num + 1, 0);
+	result.indices.clear();
+	result.squared_distances.clear();
+	if (num == 0)
+		return;
+
+	flann::Matrix<double> query(const_cast<double*>(queries[0].data()), num, 3);
+	std::vector< std::vector<int> >		indices;
+	std::vector< std::vector<double> >	dists;
+
+	flann::SearchParams params(checks_);
+	params.cores = omp_get_max_threads();
+	get_tree(tree_)->radiusSearch(query, indices, dists, static_cast<float>(squared_radius), params);
+
+	for (unsigned int i = 0; i < num; ++i)
+		result.offsets[i + 1] = result.offsets[i] + static_cast<unsigned int>(indices[i].size());
+	result.indices.resize(result.offsets[num]);
+	result.squared_distances.resize(result.offsets[num]);
+	for (unsigned int i = 0; i < num; ++i) {
+		unsigned int pos = result.offsets[i];
+		for (size_t j = 0; j < indices[i].size(); ++j, ++pos) {
+			result.indices[pos] = indices[i][j];
+			result.squared_distances[pos] = static_cast<float>(dists[i][j]);
+		}
+	}
+}
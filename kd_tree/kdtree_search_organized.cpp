@@ -0,0 +1,425 @@
+
+#include "kdtree_search_organized.h"
+#include "../basic/logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+#include <omp.h>
+
+
+
+KdTreeSearch_Organized::KdTreeSearch_Organized()
+: width_(512)
+, height_(424)
+, has_projection_(false)
+, fx_(0), cx_(0), fy_(0), cy_(0)
+, margin_(0)
+{
+}
+
+
+KdTreeSearch_Organized::~KdTreeSearch_Organized() {
+}
+
+
+void KdTreeSearch_Organized::set_image_size(int width, int height) {
+	width_ = std::max(width, 1);
+	height_ = std::max(height, 1);
+}
+
+
+void KdTreeSearch_Organized::begin()  {
+	vertices_.clear();
+	pixels_.clear();
+	points_.clear();
+	grid_.clear();
+	others_.clear();
+	has_projection_ = false;
+}
+
+
+void KdTreeSearch_Organized::add_point(PointSet::Vertex* v)  {
+	add_point(v, -1);
+}
+
+
+void KdTreeSearch_Organized::add_point(PointSet::Vertex* v, int pixel)  {
+	vertices_.push_back(v);
+	pixels_.push_back(pixel);
+}
+
+
+void KdTreeSearch_Organized::add_vertex_set(PointSet* vs)  {
+	PointSetPixel pixel;
+	bool has_pixels = pixel.bind_if_defined(vs);
+	if (!has_pixels)
+		Logger::warn("KdTreeSearch") << "the points have no pixel (the neighbors are searched exhaustively)" << std::endl;
+
+	vertices_.reserve(vertices_.size() + vs->size_of_vertices());
+	pixels_.reserve(pixels_.size() + vs->size_of_vertices());
+	for(PointSet::Vertex_iterator it = vs->vertices_begin() ; it != vs->vertices_end() ; ++it) {
+		vertices_.push_back(it);
+		pixels_.push_back(has_pixels ? pixel[it] : -1);
+	}
+}
+
+
+void KdTreeSearch_Organized::end()  {
+	int num = static_cast<int>(vertices_.size());
+	points_.resize(3 * num);
+#pragma omp parallel for if (parallel_build_)
+	for (int i = 0; i < num; ++i) {
+		const vec3& p = vertices_[i]->point();
+		points_[3 * i] = static_cast<float>(p.x);
+		points_[3 * i + 1] = static_cast<float>(p.y);
+		points_[3 * i + 2] = static_cast<float>(p.z);
+	}
+
+	// the first point of each pixel goes to the grid
+	grid_.assign(width_ * height_, -1);
+	others_.clear();
+	for (int i = 0; i < num; ++i) {
+		int pixel = pixels_[i];
+		if (pixel >= 0 && pixel < width_ * height_ && grid_[pixel] == -1 && points_[3 * i + 2] > 0)
+			grid_[pixel] = i;
+		else
+			others_.push_back(i);
+	}
+	if (others_.size() > 0)
+		Logger::warn("KdTreeSearch") << others_.size() << " points not in the grid (tested for each query)" << std::endl;
+
+	fit_projection();
+}
+
+
+void KdTreeSearch_Organized::fit_projection() {
+	// Least squares fit of x = fx * X / Z + cx and y = fy * Y / Z + cy
+	has_projection_ = false;
+	double n = 0, sa = 0, sx = 0, saa = 0, sax = 0;
+	double sb = 0, sy = 0, sbb = 0, sby = 0;
+	for (std::size_t pixel = 0; pixel < grid_.size(); ++pixel) {
+		int i = grid_[pixel];
+		if (i < 0)
+			continue;
+		const float* p = &points_[3 * i];
+		double a = p[0] / p[2], b = p[1] / p[2];
+		double x = static_cast<double>(pixel % width_), y = static_cast<double>(pixel / width_);
+		n += 1;
+		sa += a;	sx += x;	saa += a * a;	sax += a * x;
+		sb += b;	sy += y;	sbb += b * b;	sby += b * y;
+	}
+
+	double da = n * saa - sa * sa;
+	double db = n * sbb - sb * sb;
+	if (n < 2 || da <= 0 || db <= 0) {
+		if (n > 0)
+			Logger::warn("KdTreeSearch") << "could not fit the projection (the neighbors are searched exhaustively)" << std::endl;
+		return;
+	}
+	fx_ = (n * sax - sa * sx) / da;		cx_ = (sx - fx_ * sa) / n;
+	fy_ = (n * sby - sb * sy) / db;		cy_ = (sy - fy_ * sb) / n;
+	if (fx_ == 0 || fy_ == 0)
+		return;
+
+	// The pixels are not exactly the projections of the points (e.g., lens distortion,
+	// the pixels are the corners of the projections): the error is added to the windows.
+	margin_ = 0;
+	for (std::size_t pixel = 0; pixel < grid_.size(); ++pixel) {
+		int i = grid_[pixel];
+		if (i < 0)
+			continue;
+		const float* p = &points_[3 * i];
+		double ex = std::fabs(fx_ * p[0] / p[2] + cx_ - static_cast<double>(pixel % width_));
+		double ey = std::fabs(fy_ * p[1] / p[2] + cy_ - static_cast<double>(pixel / width_));
+		margin_ = std::max(margin_, std::max(ex, ey));
+	}
+	margin_ += 1.0;
+	has_projection_ = true;
+
+	if (margin_ > 0.05 * std::max(width_, height_)) {
+		Logger::warn("KdTreeSearch") << "the points do not fit a pinhole camera (error: " << margin_
+			<< " pixels), the queries will be slow" << std::endl;
+	}
+}
+
+
+bool KdTreeSearch_Organized::project(const vec3& p, double& x, double& y) const {
+	if (!has_projection_ || p.z <= 0)
+		return false;
+	x = fx_ * p.x / p.z + cx_;
+	y = fy_ * p.y / p.z + cy_;
+	return true;
+}
+
+
+bool KdTreeSearch_Organized::half_window(const float* p, double distance, double& hx, double& hy) const {
+	if (!has_projection_ || p[2] <= distance)
+		return false;
+
+	// For a point q with |q - p| < d: |qx/qz - px/pz| < d * (1 + |px/pz|) / (pz - d)
+	double s = distance / (p[2] - distance);
+	hx = std::fabs(fx_) * s * (1.0 + std::fabs(p[0] / p[2])) + margin_;
+	hy = std::fabs(fy_) * s * (1.0 + std::fabs(p[1] / p[2])) + margin_;
+	return true;
+}
+
+
+void KdTreeSearch_Organized::window(const float* p, double distance, int& x_min, int& x_max, int& y_min, int& y_max) const {
+	x_min = 0;	x_max = width_ - 1;
+	y_min = 0;	y_max = height_ - 1;
+	double hx, hy;
+	if (!half_window(p, distance, hx, hy))
+		return;
+
+	double x = fx_ * p[0] / p[2] + cx_;
+	double y = fy_ * p[1] / p[2] + cy_;
+	x_min = static_cast<int>(std::max(std::floor(x - hx), 0.0));
+	x_max = static_cast<int>(std::min(std::ceil(x + hx), static_cast<double>(width_ - 1)));
+	y_min = static_cast<int>(std::max(std::floor(y - hy), 0.0));
+	y_max = static_cast<int>(std::min(std::ceil(y + hy), static_cast<double>(height_ - 1)));
+}
+
+
+inline float squared_distance(const float* p, const float* q) {
+	float dx = p[0] - q[0], dy = p[1] - q[1], dz = p[2] - q[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+
+void KdTreeSearch_Organized::query_all(const float* p, float squared_radius, unsigned int k, Candidates& neighbors) const {
+	neighbors.clear();
+	unsigned int num = static_cast<unsigned int>(vertices_.size());
+	for (unsigned int i = 0; i < num; ++i) {
+		float d = squared_distance(p, &points_[3 * i]);
+		if (d <= squared_radius)
+			neighbors.push_back(std::make_pair(d, i));
+	}
+	if (k < neighbors.size()) {
+		std::partial_sort(neighbors.begin(), neighbors.begin() + k, neighbors.end());
+		neighbors.resize(k);
+	}
+	else
+		std::sort(neighbors.begin(), neighbors.end());
+}
+
+
+// Adds the point $i$ to the max-heap $neighbors$ of the K closest points found so far
+inline void add_candidate(float d, unsigned int i, unsigned int k, std::vector< std::pair<float, unsigned int> >& neighbors) {
+	if (neighbors.size() < k) {
+		neighbors.push_back(std::make_pair(d, i));
+		std::push_heap(neighbors.begin(), neighbors.end());
+	}
+	else if (d < neighbors.front().first) {
+		std::pop_heap(neighbors.begin(), neighbors.end());
+		neighbors.back() = std::make_pair(d, i);
+		std::push_heap(neighbors.begin(), neighbors.end());
+	}
+}
+
+
+void KdTreeSearch_Organized::query_K(const float* p, unsigned int k, Candidates& neighbors) const {
+	neighbors.clear();
+	if (k == 0 || vertices_.empty())
+		return;
+	if (!has_projection_ || p[2] <= 0) {
+		query_all(p, FLT_MAX, k, neighbors);
+		return;
+	}
+
+	// The rings must be centered on the projection of the query point: if it is off
+	// the image (e.g., a point very close to the sensor plane), all the points are tested.
+	double u = fx_ * p[0] / p[2] + cx_;
+	double v = fy_ * p[1] / p[2] + cy_;
+	if (!(u >= -0.5 && u < width_ - 0.5 && v >= -0.5 && v < height_ - 0.5)) {
+		query_all(p, FLT_MAX, k, neighbors);
+		return;
+	}
+
+	for (std::size_t j = 0; j < others_.size(); ++j) {
+		unsigned int i = others_[j];
+		add_candidate(squared_distance(p, &points_[3 * i]), i, k, neighbors);
+	}
+
+	// The pixels are scanned ring by ring around the projection of the query point
+	// (the rings are the borders of squares of increasing sizes). Once K points are
+	// found, the search stops when the rings cover the window of the K-th distance.
+	int x0 = static_cast<int>(std::floor(u + 0.5));
+	int y0 = static_cast<int>(std::floor(v + 0.5));
+	int max_ring = std::max(std::max(x0, width_ - 1 - x0), std::max(y0, height_ - 1 - y0));
+	for (int r = 0; r <= max_ring; ++r) {
+		int x_min = x0 - r, x_max = x0 + r;
+		int y_min = y0 - r, y_max = y0 + r;
+		for (int y = std::max(y_min, 0); y <= std::min(y_max, height_ - 1); ++y) {
+			const int* row = &grid_[y * width_];
+			// the whole row for the top and bottom sides, only the two ends for the others
+			int step = (y == y_min || y == y_max) ? 1 : std::max(x_max - x_min, 1);
+			for (int x = x_min; x <= x_max; x += step) {
+				if (x < 0 || x >= width_)
+					continue;
+				int i = row[x];
+				if (i < 0)
+					continue;
+				const float* q = &points_[3 * i];
+				if (neighbors.size() == k) {
+					float dz = q[2] - p[2];
+					if (dz * dz >= neighbors.front().first)	// depth gating
+						continue;
+				}
+				add_candidate(squared_distance(p, q), static_cast<unsigned int>(i), k, neighbors);
+			}
+		}
+
+		if (neighbors.size() == k) {
+			// the rings cover all the pixels at a distance <= r from (x0, y0)
+			double hx, hy;
+			if (half_window(p, std::sqrt(static_cast<double>(neighbors.front().first)), hx, hy) && std::max(hx, hy) + 0.5 <= r)
+				break;
+		}
+	}
+	std::sort_heap(neighbors.begin(), neighbors.end());
+}
+
+
+void KdTreeSearch_Organized::query_radius(const float* p, float squared_radius, Candidates& neighbors) const {
+	neighbors.clear();
+	if (vertices_.empty())
+		return;
+	if (!has_projection_ || p[2] <= 0) {
+		query_all(p, squared_radius, static_cast<unsigned int>(vertices_.size()), neighbors);
+		return;
+	}
+
+	int x_min, x_max, y_min, y_max;
+	window(p, std::sqrt(static_cast<double>(squared_radius)), x_min, x_max, y_min, y_max);
+	for (int y = y_min; y <= y_max; ++y) {
+		const int* row = &grid_[y * width_];
+		for (int x = x_min; x <= x_max; ++x) {
+			int i = row[x];
+			if (i < 0)
+				continue;
+			const float* q = &points_[3 * i];
+			float dz = q[2] - p[2];
+			if (dz * dz > squared_radius)	// depth gating
+				continue;
+			float d = squared_distance(p, q);
+			if (d <= squared_radius)
+				neighbors.push_back(std::make_pair(d, static_cast<unsigned int>(i)));
+		}
+	}
+	for (std::size_t j = 0; j < others_.size(); ++j) {
+		float d = squared_distance(p, &points_[3 * others_[j]]);
+		if (d <= squared_radius)
+			neighbors.push_back(std::make_pair(d, others_[j]));
+	}
+	std::sort(neighbors.begin(), neighbors.end());
+}
+
+
+PointSet::Vertex* KdTreeSearch_Organized::find_closest_point(const vec3& p) const {
+	double squared_distance;
+	return find_closest_point(p, squared_distance);
+}
+
+
+PointSet::Vertex* KdTreeSearch_Organized::find_closest_point(const vec3& p, double& squared_distance) const {
+	float q[3] = { static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) };
+	Candidates neighbors;
+	query_K(q, 1, neighbors);
+	if (neighbors.empty())
+		return nil;
+	squared_distance = neighbors[0].first;
+	return vertices_[neighbors[0].second];
+}
+
+
+void KdTreeSearch_Organized::find_closest_K_points(
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors
+	)  const {
+		std::vector<double> squared_distances;
+		find_closest_K_points(p, k, neighbors, squared_distances);
+}
+
+
+void KdTreeSearch_Organized::find_closest_K_points(
+	const vec3& p, unsigned int k, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	)  const {
+		float q[3] = { static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) };
+		Candidates found;
+		query_K(q, k, found);
+		neighbors.resize(found.size());
+		squared_distances.resize(found.size());
+		for (std::size_t i = 0; i < found.size(); ++i) {
+			neighbors[i] = vertices_[found[i].second];
+			squared_distances[i] = found[i].first;
+		}
+}
+
+
+void KdTreeSearch_Organized::find_points_in_radius(
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors
+	)  const {
+		std::vector<double> squared_distances;
+		find_points_in_radius(p, squared_radius, neighbors, squared_distances);
+}
+
+
+void KdTreeSearch_Organized::find_points_in_radius(
+	const vec3& p, double squared_radius, std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+	)  const {
+		float q[3] = { static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) };
+		Candidates found;
+		query_radius(q, static_cast<float>(squared_radius), found);
+		neighbors.resize(found.size());
+		squared_distances.resize(found.size());
+		for (std::size_t i = 0; i < found.size(); ++i) {
+			neighbors[i] = vertices_[found[i].second];
+			squared_distances[i] = found[i].first;
+		}
+}
+
+
+void KdTreeSearch_Organized::batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const {
+	int num = static_cast<int>(queries.size());
+	unsigned int m = std::min(k, static_cast<unsigned int>(vertices_.size()));	// the number of neighbors of each query
+
+	result.resize(num, m);
+	if (m == 0)
+		return;
+
+#pragma omp parallel
+	{
+		Candidates found;
+		found.reserve(m);
+
+#pragma omp for schedule(dynamic, 1024)
+		for (int i = 0; i < num; ++i) {
+			float q[3] = { static_cast<float>(queries[i].x), static_cast<float>(queries[i].y), static_cast<float>(queries[i].z) };
+			query_K(q, m, found);
+
+			unsigned int* indices = &result.indices[i * m];
+			float* squared_distances = &result.squared_distances[i * m];
+			for (unsigned int j = 0; j < m; ++j) {
+				indices[j] = found[j].second;
+				squared_distances[j] = found[j].first;
+			}
+		}
+	}
+}
+
+
+void KdTreeSearch_Organized::batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const {
+	float r2 = static_cast<float>(squared_radius);
+	batch_gather_neighbors<Candidates>(static_cast<unsigned int>(queries.size()),
+		[&](Candidates& found, int i, std::vector<unsigned int>& indices, std::vector<float>& squared_distances) -> unsigned int {
+			float q[3] = { static_cast<float>(queries[i].x), static_cast<float>(queries[i].y), static_cast<float>(queries[i].z) };
+			query_radius(q, r2, found);
+
+			for (std::size_t j = 0; j < found.size(); ++j) {
+				indices.push_back(found[j].second);
+				squared_distances.push_back(found[j].first);
+			}
+			return static_cast<unsigned int>(found.size());
+		},
+		result);
+}
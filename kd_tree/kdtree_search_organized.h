@@ -0,0 +1,131 @@
+#ifndef __KDTREE_KDTREE_SEARCH_ORGANIZED__
+#define __KDTREE_KDTREE_SEARCH_ORGANIZED__
+
+#include "kdtree_common.h"
+#include "kdtree_search.h"
+
+
+/***********************************************************************
+ The neighbor search for the points of a depth image (an "organized" point
+ cloud, e.g., a frame of the Kinect): there is no tree, the points are
+ stored in the grid of the pixels they come from (see PointSetPixel), and
+ a query scans the pixels of a window around the projection of the query
+ point. The pixels whose depth differs from the depth of the query point
+ by more than the search radius (or the distance of the K-th neighbor
+ found so far) are skipped.
+
+ The projection (pinhole model) is fitted to the points and their pixels
+ by end(). The window is computed from the distances to make sure that no
+ neighbor is missed: the results are the same as with a kd-tree, but
+ "building the tree" is only filling the grid (a few milliseconds for a
+ frame of the Kinect), and the queries of the points of the image itself
+ are cheaper than with a kd-tree (a small window is enough).
+
+ The points without a pixel (or with the pixel of another point) are kept
+ aside and tested for each query, so they should be few.
+************************************************************************/
+
+class KDTREE_API KdTreeSearch_Organized : public KdTreeSearch  {
+public:
+	KdTreeSearch_Organized();
+	virtual ~KdTreeSearch_Organized();
+
+	// The size of the depth image. Default is 512 x 424 (the depth camera of
+	// the Kinect v2). Must be set before end().
+	void set_image_size(int width, int height) ;
+	int image_width() const { return width_; }
+	int image_height() const { return height_; }
+
+	//______________ tree construction __________________________
+
+	virtual void begin() ;
+	// the pixel of the point is unknown: use add_point(v, pixel) or add_vertex_set()
+	virtual void add_point(PointSet::Vertex* v) ;
+	// the pixels are given by the "pixel" attribute (see PointSetPixel)
+	virtual void add_vertex_set(PointSet* vs) ;
+	// $pixel$ is row * image_width() + column (-1 if unknown)
+	void add_point(PointSet::Vertex* v, int pixel) ;
+	virtual void end() ;
+
+	//________________ closest point ____________________________
+
+	// NOTE: *squared* distance is returned
+	virtual PointSet::Vertex* find_closest_point(const vec3& p, double& squared_distance) const ;
+	virtual PointSet::Vertex* find_closest_point(const vec3& p) const ;
+
+	//_________________ K-nearest neighbors ____________________
+
+	// NOTE: *squared* distances are returned
+	virtual void find_closest_K_points(
+		const vec3& p, unsigned int k,
+		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+		) const ;
+
+	virtual void find_closest_K_points(
+		const vec3& p, unsigned int k,
+		std::vector<PointSet::Vertex*>& neighbors
+		) const ;
+
+	//___________________ radius search __________________________
+
+	// fixed-radius kNN	search. Search for all points in the range.
+	// NOTE: *squared* radius of query ball
+	virtual void find_points_in_radius(const vec3& p, double squared_radius,
+		std::vector<PointSet::Vertex*>& neighbors
+		) const ;
+
+	virtual void find_points_in_radius(const vec3& p, double squared_radius,
+		std::vector<PointSet::Vertex*>& neighbors, std::vector<double>& squared_distances
+		) const ;
+
+	//___________________ batched queries ________________________
+
+	// The queries are distributed over all the cores (the queries are thread safe)
+	virtual void batch_find_closest_K_points(const std::vector<vec3>& queries, unsigned int k, KdTreeNeighbors& result) const ;
+	virtual void batch_find_points_in_radius(const std::vector<vec3>& queries, double squared_radius, KdTreeNeighbors& result) const ;
+
+	//_______________________ the image __________________________
+
+	// The index (see vertex()) of the point of pixel ($x$, $y$), -1 if none.
+	int point_at(int x, int y) const { return grid_.empty() ? -1 : grid_[y * width_ + x]; }
+
+	// The (sub-)pixel coordinates of the projection of $p$ (fitted by end()).
+	// Returns false if $p$ is not in front of the camera or if the projection
+	// could not be fitted.
+	bool project(const vec3& p, double& x, double& y) const ;
+
+private:
+	// (squared distance, index) pairs
+	typedef std::vector< std::pair<float, unsigned int> > Candidates ;
+
+	void fit_projection() ;
+
+	// the neighbors are sorted by distance
+	void query_K(const float* p, unsigned int k, Candidates& neighbors) const ;
+	void query_radius(const float* p, float squared_radius, Candidates& neighbors) const ;
+	void query_all(const float* p, float squared_radius, unsigned int k, Candidates& neighbors) const ;
+
+	// the half sizes (in pixels) of the window around the projection of $p$ that
+	// contains all the points at a distance smaller than $distance$ from $p$.
+	// Returns false if the window is not bounded (the whole image).
+	bool half_window(const float* p, double distance, double& hx, double& hy) const ;
+	// the pixels of this window, clipped to the image
+	void window(const float* p, double distance, int& x_min, int& x_max, int& y_min, int& y_max) const ;
+
+private:
+	int		width_;
+	int		height_;
+
+	std::vector<int>			pixels_;	// the pixel of each point
+	std::vector<float>			points_;	// the coordinates of the points (3 per point)
+	std::vector<int>			grid_;		// the index of the point of each pixel (-1 if none)
+	std::vector<unsigned int>	others_;	// the points not in the grid
+
+	// the projection: x = fx * X / Z + cx, y = fy * Y / Z + cy
+	bool	has_projection_;
+	double	fx_, cx_, fy_, cy_;
+	double	margin_;	// max distance (in pixels) between a pixel and the projection of its point
+} ;
+
+#endif
+
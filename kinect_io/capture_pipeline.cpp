@@ -0,0 +1,402 @@
+#include "capture_pipeline.h"
+#include "../geom/point_set.h"
+#include "../basic/logger.h"
+
+
+CaptureStatistics::CaptureStatistics()
+: nb_acquired(0)
+, nb_dropped(0)
+, nb_processed(0)
+, nb_saved(0)
+, nb_save_failures(0)
+, nb_displayed(0)
+, nb_skipped(0)
+, elapsed(0)
+{
+}
+
+//_________________________________________________________________________
+
+
+CapturePipeline::CapturePipeline()
+: source_(nil)
+, processor_(nil)
+, sink_(nil)
+, capacity_(8)
+, reserved_width_(0)
+, reserved_height_(0)
+, reserved_color_width_(0)
+, reserved_color_height_(0)
+, drop_policy_(DROP_OLDEST)
+, recording_(false)
+, running_(false)
+, stopping_(false)
+, acquisition_done_(true)
+, processing_done_(true)
+, persistence_done_(true)
+, source_finished_(false)
+, statistics_start_(0)
+, stop_time_(0)
+{
+}
+
+
+CapturePipeline::~CapturePipeline()
+{
+	stop();
+}
+
+
+void CapturePipeline::set_source(DepthFrameSource* source)
+{
+	if (running_) {
+		Logger::warn("CapturePipeline") << "the source cannot be changed during the capture" << std::endl;
+		return;
+	}
+	source_ = source;
+}
+
+
+void CapturePipeline::set_capacity(unsigned int n)
+{
+	if (running_) {
+		Logger::warn("CapturePipeline") << "the capacity cannot be changed during the capture" << std::endl;
+		return;
+	}
+	// one slot for each stage and one being displayed
+	capacity_ = (n < 2) ? 2 : n;
+}
+
+
+void CapturePipeline::reserve(int width, int height, int color_width, int color_height)
+{
+	reserved_width_ = width;
+	reserved_height_ = height;
+	reserved_color_width_ = color_width;
+	reserved_color_height_ = color_height;
+}
+
+
+void CapturePipeline::set_drop_policy(DropPolicy policy)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	drop_policy_ = policy;
+	slot_freed_.notify_all();
+}
+
+
+void CapturePipeline::set_recording(bool b)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	recording_ = b;
+}
+
+
+bool CapturePipeline::is_recording() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return recording_;
+}
+
+
+bool CapturePipeline::start()
+{
+	if (running_)
+		return true;
+	if (!source_) {
+		Logger::err("CapturePipeline") << "no source" << std::endl;
+		return false;
+	}
+
+	if (slots_.size() != capacity_)
+		slots_.resize(capacity_);
+	if (reserved_width_ > 0 && reserved_height_ > 0) {
+		std::size_t size = std::size_t(reserved_width_) * reserved_height_;
+		for (std::size_t i = 0; i < slots_.size(); ++i) {
+			CaptureFrame& slot = slots_[i];
+			slot.frame.resize(reserved_width_, reserved_height_);
+			slot.frame.resize_color(reserved_color_width_, reserved_color_height_);
+			slot.points.reserve(static_cast<unsigned int>(size));
+			slot.pixels.reserve(size);
+		}
+		dropped_frame_.resize(reserved_width_, reserved_height_);
+		dropped_frame_.resize_color(reserved_color_width_, reserved_color_height_);
+	}
+
+	free_.reset(capacity_);
+	acquired_.reset(capacity_);
+	processed_.reset(capacity_);
+	ready_.reset(capacity_);
+	for (unsigned int i = 0; i < capacity_; ++i)
+		free_.push(i);
+
+	stopping_ = false;
+	acquisition_done_ = false;
+	processing_done_ = false;
+	persistence_done_ = false;
+	source_finished_ = false;
+	statistics_ = CaptureStatistics();
+	clock_.start();
+	statistics_start_ = 0;
+	stop_time_ = 0;
+
+	running_ = true;
+	acquisition_thread_ = std::thread(&CapturePipeline::acquisition_loop, this);
+	processing_thread_ = std::thread(&CapturePipeline::processing_loop, this);
+	persistence_thread_ = std::thread(&CapturePipeline::persistence_loop, this);
+	return true;
+}
+
+
+void CapturePipeline::stop()
+{
+	if (!running_)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		slot_freed_.notify_all();
+	}
+	acquisition_thread_.join();
+	processing_thread_.join();
+	persistence_thread_.join();
+	stop_time_ = clock_.elapsed();
+	running_ = false;
+
+	if (sink_ && !sink_->finish()) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		++statistics_.nb_save_failures;
+	}
+}
+
+
+bool CapturePipeline::finished() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return source_finished_ && persistence_done_ && ready_.empty();
+}
+
+
+void CapturePipeline::acquisition_loop()
+{
+	// the timeout (in milliseconds) of a read: how often stop() is checked
+	const unsigned int timeout = 100;
+
+	while (true) {
+		bool has_slot = false;
+		unsigned int slot = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!stopping_) {
+				if (!free_.empty()) {
+					slot = free_.pop();
+					has_slot = true;
+					break;
+				}
+				if (drop_policy_ == DROP_NEWEST)
+					break;
+				if (drop_policy_ == DROP_OLDEST && !acquired_.empty()) {
+					slot = acquired_.pop();
+					has_slot = true;
+					++statistics_.nb_dropped;
+					break;
+				}
+				slot_freed_.wait(lock);
+			}
+			if (stopping_)
+				break;
+		}
+
+		double start = clock_.elapsed();
+		DepthFrame& frame = has_slot ? slots_[slot].frame : dropped_frame_;
+		bool ok = source_->next(frame, timeout);
+		double end = clock_.elapsed();
+
+		if (has_slot && ok) {
+			slots_[slot].has_intrinsics = source_->has_intrinsics();
+			slots_[slot].intrinsics = source_->intrinsics();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (ok) {
+			if (has_slot) {
+				slots_[slot].index = statistics_.nb_acquired;
+				slots_[slot].acquired_time = end;
+				acquired_.push(slot);
+				frame_acquired_.notify_one();
+			}
+			else
+				++statistics_.nb_dropped;
+			++statistics_.nb_acquired;
+			statistics_.acquisition.add(end - start);
+		}
+		else {
+			if (has_slot)
+				free_.push(slot);
+			if (source_->finished()) {
+				source_finished_ = true;
+				break;
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	acquisition_done_ = true;
+	frame_acquired_.notify_all();
+}
+
+
+void CapturePipeline::processing_loop()
+{
+	while (true) {
+		unsigned int slot = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (acquired_.empty() && !acquisition_done_)
+				frame_acquired_.wait(lock);
+			if (acquired_.empty())
+				break;
+			slot = acquired_.pop();
+		}
+
+		CaptureFrame& f = slots_[slot];
+		std::size_t size = std::size_t(f.frame.width()) * f.frame.height();
+		int num = 0;
+		if (size > 0) {
+			// the points are mapped in place: room for all the pixels, then shrunk
+			f.points.resize(static_cast<unsigned int>(size));
+			f.pixels.resize(size);
+			num = source_->backproject(f.frame, f.points.positions(), &f.pixels[0]);
+			if (num < 0)
+				num = 0;
+		}
+		f.points.resize(num);
+		f.pixels.resize(num);
+
+		if (processor_)
+			processor_->process(f);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		f.processed_time = clock_.elapsed();
+		statistics_.processing.add(f.processed_time - f.acquired_time);
+		++statistics_.nb_processed;
+		processed_.push(slot);
+		frame_processed_.notify_one();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	processing_done_ = true;
+	frame_processed_.notify_all();
+}
+
+
+void CapturePipeline::persistence_loop()
+{
+	while (true) {
+		unsigned int slot = 0;
+		bool recording = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (processed_.empty() && !processing_done_)
+				frame_processed_.wait(lock);
+			if (processed_.empty())
+				break;
+			slot = processed_.pop();
+			recording = recording_;
+		}
+
+		CaptureFrame& f = slots_[slot];
+		bool saved = false, failed = false;
+		if (recording && sink_) {
+			saved = sink_->write(f);
+			failed = !saved;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		f.persisted_time = clock_.elapsed();
+		statistics_.persistence.add(f.persisted_time - f.processed_time);
+		if (saved)
+			++statistics_.nb_saved;
+		if (failed)
+			++statistics_.nb_save_failures;
+
+		// only the newest frame is displayed
+		while (!ready_.empty()) {
+			free_.push(ready_.pop());
+			++statistics_.nb_skipped;
+		}
+		ready_.push(slot);
+		slot_freed_.notify_one();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	persistence_done_ = true;
+}
+
+
+bool CapturePipeline::take_latest(PointSet* pointSet)
+{
+	unsigned int slot = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (ready_.empty())
+			return false;
+		slot = ready_.pop();
+	}
+
+	// the slot is not in any queue: no stage can use it meanwhile
+	const CaptureFrame& f = slots_[slot];
+	unsigned int num = f.points.size();
+
+	// keeps the first $num$ vertices and deletes the others (their memory is
+	// kept by the point set for later use)
+	PointSet::Vertex_iterator it = pointSet->vertices_begin();
+	for (unsigned int i = 0; i < num && it != pointSet->vertices_end(); ++i)
+		++it;
+	while (it != pointSet->vertices_end()) {
+		PointSet::Vertex* v = it;
+		++it;
+		pointSet->delete_vertex(v);
+	}
+	if (static_cast<unsigned int>(pointSet->size_of_vertices()) < num) {
+		pointSet->reserve(num);
+		while (static_cast<unsigned int>(pointSet->size_of_vertices()) < num)
+			pointSet->new_vertex();
+	}
+
+	PointSetPixel pixel(pointSet);
+	const float* p = f.points.positions();
+	unsigned int idx = 0;
+	for (it = pointSet->vertices_begin(); it != pointSet->vertices_end(); ++it, ++idx) {
+		it->set_point(vec3(p + 3 * idx));
+		pixel[it] = f.pixels[idx];
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	double now = clock_.elapsed();
+	statistics_.display.add(now - f.persisted_time);
+	statistics_.total.add(now - f.acquired_time);
+	++statistics_.nb_displayed;
+	free_.push(slot);
+	slot_freed_.notify_one();
+	return true;
+}
+
+
+CaptureStatistics CapturePipeline::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	CaptureStatistics result = statistics_;
+	result.elapsed = (running_ ? clock_.elapsed() : stop_time_) - statistics_start_;
+	return result;
+}
+
+
+void CapturePipeline::reset_statistics()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	statistics_ = CaptureStatistics();
+	// not restarted: the times of the frames in the ring are relative to it
+	statistics_start_ = running_ ? clock_.elapsed() : stop_time_;
+}
@@ -0,0 +1,254 @@
+#ifndef CAPTURE_PIPELINE_H
+#define CAPTURE_PIPELINE_H
+
+#include "depth_frame_source.h"
+#include "../geom/dense_point_set.h"
+#include "../basic/stop_watch.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class PointSet;
+
+
+/***********************************************************************
+ The capture of the frames of a DepthFrameSource in three stages, each
+ running on its own thread and taking the frames in the order of their
+ acquisition:
+   - acquisition: reads the next frame from the source;
+   - processing: maps the depth image to points, then calls the
+     CaptureProcessor (if any);
+   - persistence: gives the frame to the CaptureSink (if any, and only
+     when recording).
+ The frames are then ready to be displayed: take_latest() (e.g., called
+ by the GUI at its own pace) gets the points of the newest one, the older
+ ones are skipped.
+
+ The frames are stored in a ring of slots allocated once: the buffers of
+ a slot are reused from frame to frame, so a capture does not allocate
+ memory once each slot has held a frame (or at all, see reserve()),
+ however long it is. If the stages after the acquisition fall behind, the
+ ring fills up and the DropPolicy decides what happens to the new frames.
+
+ The time spent by the frames in each stage (waiting for the stage
+ included) is measured, see statistics().
+************************************************************************/
+
+
+// A slot of the ring
+class KINECT_IO_API CaptureFrame
+{
+public:
+	CaptureFrame() : index(0), has_intrinsics(false), acquired_time(0), processed_time(0), persisted_time(0) {}
+
+	DepthFrame			frame;
+	unsigned int		index;		// in the order of acquisition (from 0)
+
+	// the intrinsics() of the source when the frame was read
+	DepthIntrinsics		intrinsics;
+	bool				has_intrinsics;
+
+	// set by the processing stage: the points of the frame and their pixels
+	DensePointSet		points;
+	std::vector<int>	pixels;
+
+	// when the frame left each stage (in seconds, from the start of the capture)
+	double	acquired_time;
+	double	processed_time;
+	double	persisted_time;
+};
+
+
+// Called by the processing stage for each frame (e.g., to estimate the normals)
+class KINECT_IO_API CaptureProcessor
+{
+public:
+	virtual ~CaptureProcessor() {}
+	virtual void process(CaptureFrame& frame) = 0;
+};
+
+
+// Called by the persistence stage for each frame (e.g., DepthFrameRecorder)
+class KINECT_IO_API CaptureSink
+{
+public:
+	virtual ~CaptureSink() {}
+	virtual bool write(const CaptureFrame& frame) = 0;
+	// Called by stop(), once the frames have all been written
+	virtual bool finish() { return true; }
+};
+
+
+// The latencies of a stage (in seconds)
+class KINECT_IO_API CaptureLatency
+{
+public:
+	CaptureLatency() : count(0), total(0), worst(0), last(0) {}
+
+	void add(double t) {
+		++count;
+		total += t;
+		last = t;
+		if (t > worst)
+			worst = t;
+	}
+	double mean() const { return count > 0 ? total / count : 0.0; }
+
+	unsigned int	count;
+	double			total;
+	double			worst;
+	double			last;
+};
+
+
+class KINECT_IO_API CaptureStatistics
+{
+public:
+	CaptureStatistics();
+
+	unsigned int	nb_acquired;
+	unsigned int	nb_dropped;			// read from the source but not kept (the ring was full)
+	unsigned int	nb_processed;
+	unsigned int	nb_saved;			// given to the sink
+	unsigned int	nb_save_failures;	// the sink returned false
+	unsigned int	nb_displayed;		// taken by take_latest()
+	unsigned int	nb_skipped;			// replaced by a newer frame before being displayed
+
+	double			elapsed;			// since the start of the capture (in seconds)
+
+	CaptureLatency	acquisition;		// reading the frame from the source
+	CaptureLatency	processing;			// from acquired to processed
+	CaptureLatency	persistence;		// from processed to persisted
+	CaptureLatency	display;			// from persisted to displayed
+	CaptureLatency	total;				// from acquired to displayed
+
+	// the frames acquired per second
+	double frame_rate() const { return elapsed > 0 ? nb_acquired / elapsed : 0.0; }
+};
+
+
+class KINECT_IO_API CapturePipeline
+{
+public:
+	// What the acquisition does when the ring is full
+	enum DropPolicy {
+		WAIT,			// waits for a free slot: no frame is dropped, the source is read more slowly (back-pressure)
+		DROP_NEWEST,	// the frames read are dropped until a slot is free
+		DROP_OLDEST		// the oldest frame not processed yet is dropped
+	};
+
+public:
+	CapturePipeline();
+	~CapturePipeline();	// stops the capture
+
+	// The source must be opened before start() (and is not owned). Cannot be
+	// changed during the capture.
+	void set_source(DepthFrameSource* source);
+	// Not owned. Must be set before start().
+	void set_processor(CaptureProcessor* processor) { processor_ = processor; }
+	void set_sink(CaptureSink* sink) { sink_ = sink; }
+
+	// The number of slots of the ring (default is 8). Must be set before start().
+	void set_capacity(unsigned int n);
+	unsigned int capacity() const { return capacity_; }
+
+	// Allocates the buffers of all the slots for frames of this size at the
+	// next start(), instead of when the slots are first used
+	void reserve(int width, int height, int color_width = 0, int color_height = 0);
+
+	// Default is DROP_OLDEST. Can be changed during the capture.
+	void set_drop_policy(DropPolicy policy);
+	DropPolicy drop_policy() const { return drop_policy_; }
+
+	// Whether the frames are given to the sink (default is false). Can be
+	// changed during the capture.
+	void set_recording(bool b);
+	bool is_recording() const;
+
+	bool start();
+	// Stops reading the source. The frames already read go through the
+	// processing and the persistence before it returns, then the sink (if
+	// any) is finished.
+	void stop();
+	bool is_running() const { return running_; }
+	// True if the source is finished and all its frames have been processed,
+	// persisted and displayed (or skipped).
+	bool finished() const;
+
+	// Replaces the points of $pointSet$ by the points of the newest frame ready
+	// (with their pixels, see PointSetPixel). The vertices of $pointSet$ are
+	// reused: there is no allocation once it has held as many points. Returns
+	// false if no frame is ready since the last call.
+	bool take_latest(PointSet* pointSet);
+
+	CaptureStatistics statistics() const;
+	void reset_statistics();
+
+private:
+	// A queue of slot indices (with room for all the slots)
+	class SlotQueue {
+	public:
+		SlotQueue() : head_(0), size_(0) {}
+		void reset(unsigned int capacity) { items_.assign(capacity, 0); head_ = 0; size_ = 0; }
+		bool empty() const { return size_ == 0; }
+		unsigned int size() const { return size_; }
+		void push(unsigned int slot) { items_[(head_ + size_) % items_.size()] = slot; ++size_; }
+		unsigned int pop() { unsigned int slot = items_[head_]; head_ = (head_ + 1) % items_.size(); --size_; return slot; }
+	private:
+		std::vector<unsigned int>	items_;
+		unsigned int	head_;
+		unsigned int	size_;
+	};
+
+	void acquisition_loop();
+	void processing_loop();
+	void persistence_loop();
+
+private:
+	DepthFrameSource*	source_;
+	CaptureProcessor*	processor_;
+	CaptureSink*		sink_;
+
+	unsigned int		capacity_;
+	int		reserved_width_;
+	int		reserved_height_;
+	int		reserved_color_width_;
+	int		reserved_color_height_;
+	DropPolicy			drop_policy_;
+	bool				recording_;
+
+	std::vector<CaptureFrame>	slots_;
+	DepthFrame					dropped_frame_;	// where the dropped frames are read
+
+	// the slots waiting for each stage (all protected by mutex_)
+	SlotQueue	free_;
+	SlotQueue	acquired_;
+	SlotQueue	processed_;
+	SlotQueue	ready_;			// at most one: the older ones are skipped
+
+	mutable std::mutex			mutex_;
+	std::condition_variable		slot_freed_;
+	std::condition_variable		frame_acquired_;
+	std::condition_variable		frame_processed_;
+
+	bool	running_;
+	bool	stopping_;
+	bool	acquisition_done_;
+	bool	processing_done_;
+	bool	persistence_done_;
+	bool	source_finished_;
+
+	std::thread		acquisition_thread_;
+	std::thread		processing_thread_;
+	std::thread		persistence_thread_;
+
+	StopWatch			clock_;
+	CaptureStatistics	statistics_;
+	double				statistics_start_;	// when the statistics were reset
+	double				stop_time_;
+};
+
+
+#endif
@@ -3,6 +3,9 @@
 #include <strsafe.h>
 #include "depth_basic.h"
 #include "../geom/point_set.h"
+#include "../geom/dense_point_set.h"
+#include "depth_frame_source.h"
+
 
 /// <summary>
 /// Constructor
@@ -15,10 +18,16 @@ rgb_height(1080),
 nDepthMinReliableDistance(500),
 nDepthMaxDistance(USHRT_MAX),
 m_pKinectSensor(NULL),
-m_pDepthFrameReader(NULL)
+m_pDepthFrameReader(NULL),
+m_pColorFrameReader(NULL),
+pCoordinateMapper(NULL)
 {
 	// create heap storage for color pixel data in RGBX format
 	m_pColorRGBX = new RGBQUAD[rgb_width * rgb_height];
+
+	// and for the points of a frame and their pixels (reused from frame to frame)
+	m_pCameraSpacePoints = new CameraSpacePoint[depth_width * depth_height];
+	m_pPixels = new int[depth_width * depth_height];
 }
 
 
@@ -29,6 +38,8 @@ CDepthBasics::~CDepthBasics()
 {
 	//release m_pDepthFrameReader
 	SafeRelease(m_pDepthFrameReader);
+	SafeRelease(m_pColorFrameReader);
+	SafeRelease(pCoordinateMapper);
 
 	// close the Kinect Sensor
 	if (m_pKinectSensor)
@@ -44,6 +55,9 @@ CDepthBasics::~CDepthBasics()
 		delete[] m_pColorRGBX;
 		m_pColorRGBX = NULL;
 	}
+
+	delete[] m_pCameraSpacePoints;
+	delete[] m_pPixels;
 }
 
 void CDepthBasics::openScanner(){
@@ -53,6 +67,8 @@ void CDepthBasics::openScanner(){
 void CDepthBasics::closeScanner(){
 	//release m_pDepthFrameReader
 	SafeRelease(m_pDepthFrameReader);
+	SafeRelease(m_pColorFrameReader);
+	SafeRelease(pCoordinateMapper);
 
 	// close the Kinect Sensor
 	if (m_pKinectSensor)
@@ -118,10 +134,46 @@ HRESULT CDepthBasics::InitializeDefaultSensor()
 }
 
 /// <summary>
-/// Main processing function
+/// Maps a depth image to camera space, keeping the points in the reliable
+/// range of depths (see the header)
 /// </summary>
-bool CDepthBasics::GetPointsOfOneFrame(PointSet* pointSet)
+bool CDepthBasics::MapDepthFrameToPoints(const UINT16* depth_data, float* xyz, int& num, int* pixels)
+{
+	num = 0;
+	if (!pCoordinateMapper)
+	{
+		return false;
+	}
+
+	CameraSpacePoint* csp = reinterpret_cast<CameraSpacePoint*>(xyz);
+	HRESULT hr = pCoordinateMapper->MapDepthFrameToCameraSpace(depth_width * depth_height, depth_data, depth_width * depth_height, csp);
+	if (FAILED(hr))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < depth_width * depth_height; i++)
+	{
+		if (csp[i].Z >= (nDepthMinReliableDistance / 1000.0) && csp[i].Z <= (nDepthMaxDistance / 1000.0)){
+			csp[num].X = -csp[i].X;
+			csp[num].Y = -csp[i].Y;
+			csp[num].Z = csp[i].Z;
+			if (pixels)
+				pixels[num] = i;
+			++num;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Acquires the latest depth frame and maps it to camera space: the valid
+/// points (X and Y negated) are compacted at the beginning of csp, and
+/// their pixels are stored in pixels (if not NULL).
+/// </summary>
+bool CDepthBasics::AcquirePointsOfOneFrame(CameraSpacePoint* csp, int& num, int* pixels)
 {
+	num = 0;
 	if (!m_pDepthFrameReader)
 	{
 		return false;
@@ -140,55 +192,103 @@ bool CDepthBasics::GetPointsOfOneFrame(PointSet* pointSet)
 
 		if (SUCCEEDED(hr) && pBuffer)
 		{
-			CameraSpacePoint* csp = new CameraSpacePoint[depth_width * depth_height];
-			HRESULT hr = pCoordinateMapper->MapDepthFrameToCameraSpace(depth_width * depth_height, pBuffer, depth_width * depth_height, csp);
-
-			if (SUCCEEDED(hr)){
-				for (int i = 0; i < depth_width * depth_height; i++)
-				{
-					if (csp[i].Z >= (nDepthMinReliableDistance / 1000.0) && csp[i].Z <= (nDepthMaxDistance / 1000.0)){
-						pointSet->new_vertex(vec3(-csp[i].X, -csp[i].Y, csp[i].Z));
-					}
-				}
-			}
-			else{
-				return false;
-			}
-			delete[] csp;
+			if (!MapDepthFrameToPoints(pBuffer, &csp[0].X, num, pixels))
+				hr = E_FAIL;
 		}
-		else{
-			return false;
+		else
+		{
+			hr = E_FAIL;
 		}
 	}
-	else{
-		return false;
-	}
 
 	SafeRelease(pDepthFrame);
+	return SUCCEEDED(hr);
+}
 
-	return true;
+/// <summary>
+/// Main processing function
+/// </summary>
+bool CDepthBasics::GetPointsOfOneFrame(PointSet* pointSet)
+{
+	CameraSpacePoint* csp = m_pCameraSpacePoints;
+	int num = 0;
+	bool ok = AcquirePointsOfOneFrame(csp, num, m_pPixels);
+	if (ok)
+	{
+		// add the valid points at once, with their pixels (see KdTreeSearch_Organized)
+		pointSet->append(&csp[0].X, num, nil, nil, m_pPixels);
+	}
+	return ok;
+}
+
+/// <summary>
+/// Same as above, for the streaming pipeline (see KinectPointSource)
+/// </summary>
+bool CDepthBasics::GetPointsOfOneFrame(DensePointSet* points)
+{
+	CameraSpacePoint* csp = m_pCameraSpacePoints;
+	int num = 0;
+	bool ok = AcquirePointsOfOneFrame(csp, num);
+	if (ok)
+	{
+		points->set_has_normals(false);
+		points->set_has_colors(false);
+		points->resize(num);
+		if (num > 0)
+			memcpy(points->positions(), &csp[0].X, num * 3 * sizeof(float));
+	}
+	return ok;
 }
 
 /// <summary>
 /// Main processing function
 /// </summary>
 bool CDepthBasics::GetDataOfOneFrame(PointSet* pointSet, UINT16* depth_data, unsigned char *rgb)
+{
+	if (!GetImagesOfOneFrame(depth_data, rgb))
+	{
+		return false;
+	}
+
+	// keep the valid points and add them at once, with their pixels (see KdTreeSearch_Organized)
+	CameraSpacePoint* csp = m_pCameraSpacePoints;
+	int num = 0;
+	bool ok = MapDepthFrameToPoints(depth_data, &csp[0].X, num, m_pPixels);
+	if (ok)
+	{
+		pointSet->append(&csp[0].X, num, nil, nil, m_pPixels);
+	}
+	return ok;
+}
+
+/// <summary>
+/// Copies the latest color frame (RGBA) and the latest depth frame
+/// </summary>
+bool CDepthBasics::GetImagesOfOneFrame(UINT16* depth_data, unsigned char *rgb)
 {
 	if (!m_pDepthFrameReader)
 	{
 		return false;
 	}
-	
-	IColorFrame* pColorFrame = NULL;
-	ColorImageFormat imageFormat = ColorImageFormat_None;
-	UINT nBufferSize = 0;
-	RGBQUAD *c_pBuffer = NULL;
 
-	HRESULT hr = m_pColorFrameReader->AcquireLatestFrame(&pColorFrame);
-	
-	if (SUCCEEDED(hr))
+	if (rgb)
 	{
-		hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
+		if (!m_pColorFrameReader)
+		{
+			return false;
+		}
+
+		IColorFrame* pColorFrame = NULL;
+		ColorImageFormat imageFormat = ColorImageFormat_None;
+		UINT nBufferSize = 0;
+		RGBQUAD *c_pBuffer = NULL;
+
+		HRESULT hr = m_pColorFrameReader->AcquireLatestFrame(&pColorFrame);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
+		}
 
 		if (SUCCEEDED(hr))
 		{
@@ -207,10 +307,7 @@ bool CDepthBasics::GetDataOfOneFrame(PointSet* pointSet, UINT16* depth_data, uns
 				hr = E_FAIL;
 			}
 		}
-		else{
-			return false;
-		}
-		
+
 		if (SUCCEEDED(hr) && c_pBuffer)
 		{
 			for (int i = 0; i < rgb_width * rgb_height; i++)
@@ -221,16 +318,17 @@ bool CDepthBasics::GetDataOfOneFrame(PointSet* pointSet, UINT16* depth_data, uns
 				rgb[4 * i + 3] = 255;
 			}
 		}
+
+		SafeRelease(pColorFrame);
+		if (FAILED(hr) || !c_pBuffer)
+		{
+			return false;
+		}
 	}
-	else{
-		return false;
-	}
-	
-	SafeRelease(pColorFrame);
 
 	IDepthFrame* pDepthFrame = NULL;
 
-	hr = m_pDepthFrameReader->AcquireLatestFrame(&pDepthFrame);
+	HRESULT hr = m_pDepthFrameReader->AcquireLatestFrame(&pDepthFrame);
 	
 	if (SUCCEEDED(hr))
 	{
@@ -241,37 +339,42 @@ bool CDepthBasics::GetDataOfOneFrame(PointSet* pointSet, UINT16* depth_data, uns
 
 		if (SUCCEEDED(hr) && pBuffer)
 		{
-			for (int i = 0; i < depth_width * depth_height; i++)
-			{
-				depth_data[i] = pBuffer[i];
-				//depth_data[i] = (pBuffer[i] >= nDepthMinReliableDistance) && (pBuffer[i] <= nDepthMaxDistance) ? pBuffer[i] : 0;
-			}
-
-			CameraSpacePoint* csp = new CameraSpacePoint[depth_width * depth_height];
-			HRESULT hr = pCoordinateMapper->MapDepthFrameToCameraSpace(depth_width * depth_height, pBuffer, depth_width * depth_height, csp);
-
-			if (SUCCEEDED(hr)){
-				for (int i = 0; i < depth_width * depth_height; i++)
-				{
-					if (csp[i].Z >= (nDepthMinReliableDistance / 1000.0) && csp[i].Z <= (nDepthMaxDistance / 1000.0)){
-						pointSet->new_vertex(vec3(-csp[i].X, -csp[i].Y, csp[i].Z));
-					}
-				}
-			}
-			else{
-				return false;
-			}
-			delete[] csp;
+			memcpy(depth_data, pBuffer, depth_width * depth_height * sizeof(UINT16));
 		}
-		else{
-			return false;
+		else
+		{
+			hr = E_FAIL;
 		}
 	}
-	else{
+
+	SafeRelease(pDepthFrame);
+	return SUCCEEDED(hr);
+}
+
+/// <summary>
+/// The intrinsics of the depth camera, from the coordinate mapper
+/// </summary>
+bool CDepthBasics::GetDepthIntrinsics(DepthIntrinsics& intrinsics)
+{
+	if (!pCoordinateMapper)
+	{
+		return false;
+	}
+
+	CameraIntrinsics ci;
+	HRESULT hr = pCoordinateMapper->GetDepthCameraIntrinsics(&ci);
+	// all zero until the sensor has sent frames
+	if (FAILED(hr) || ci.FocalLengthX == 0 || ci.FocalLengthY == 0)
+	{
 		return false;
 	}
-	
-	SafeRelease(pDepthFrame);
+
+	intrinsics.fx = ci.FocalLengthX;
+	intrinsics.fy = ci.FocalLengthY;
+	intrinsics.cx = ci.PrincipalPointX;
+	intrinsics.cy = ci.PrincipalPointY;
+	intrinsics.min_depth = nDepthMinReliableDistance / 1000.0;
+	intrinsics.max_depth = nDepthMaxDistance / 1000.0;
 	return true;
 }
 
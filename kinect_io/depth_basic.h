@@ -11,6 +11,8 @@
 #include "kinect_io_common.h"
 
 class PointSet;
+class DensePointSet;
+class DepthIntrinsics;
 
 class KINECT_IO_API CDepthBasics
 {
@@ -21,12 +23,24 @@ public:
 	void openScanner();
 	void closeScanner();
 
-	//get points of one frame
+	//get points of one frame (with their pixels, see PointSetPixel)
 	bool GetPointsOfOneFrame(PointSet* pointSet);
+	bool GetPointsOfOneFrame(DensePointSet* points);
 
-	//get depth image, rgb image and point cloud of one frame
+	//get depth image, rgb image and point cloud of one frame (with the pixels of the points)
 	bool GetDataOfOneFrame(PointSet* pointSet, UINT16* depth_data, unsigned char *rgb);
 
+	//get depth image and rgb image (RGBA, skipped if rgb is NULL) of one frame (see KinectFrameSource)
+	bool GetImagesOfOneFrame(UINT16* depth_data, unsigned char *rgb);
+
+	//maps a depth image to camera space: the valid points (X and Y negated) are
+	//compacted at the beginning of xyz (3 floats per point), and their pixels 
+	//are stored in pixels (if not NULL). Both must have room for one entry per pixel.
+	bool MapDepthFrameToPoints(const UINT16* depth_data, float* xyz, int& num, int* pixels = NULL);
+
+	//the pinhole model of the depth camera (known once the sensor has sent frames)
+	bool GetDepthIntrinsics(DepthIntrinsics& intrinsics);
+
 	int getDepthWidth();
 	int getDepthHeight();
 	int getRGBWidth();
@@ -57,12 +71,18 @@ private:
 
 	RGBQUAD* m_pColorRGBX;
 
+	CameraSpacePoint* m_pCameraSpacePoints;
+	int* m_pPixels;
+
 	/// <summary>
 	/// Initializes the default Kinect sensor
 	/// </summary>
 	/// <returns>S_OK on success, otherwise failure code</returns>
 	HRESULT                 InitializeDefaultSensor();
 
+	// csp (and pixels) must have room for depth_width * depth_height points
+	bool AcquirePointsOfOneFrame(CameraSpacePoint* csp, int& num, int* pixels = NULL);
+
 	// Safe release for interfaces
 	template<class Interface>
 	void SafeRelease(Interface *& pInterfaceToRelease)
@@ -0,0 +1,345 @@
+#include "depth_codec.h"
+#include "../basic/basic_types.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define DEPTH_CODEC_SSE2
+#	include <emmintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	endif
+#endif
+
+
+using Numeric::uint32;
+using Numeric::uint64;
+
+
+// The differences of the depths are taken modulo 2^16, and zigzag encoded
+// (0, -1, 1, -2, ... are 0, 1, 2, 3, ...) so that the small ones are small.
+static inline unsigned short zigzag(unsigned short diff) {
+	unsigned int d = diff;
+	return static_cast<unsigned short>(((d << 1) ^ (0u - (d >> 15))) & 0xffff);
+}
+
+static inline unsigned short unzigzag(unsigned int z) {
+	return static_cast<unsigned short>(((z >> 1) ^ (0u - (z & 1))) & 0xffff);
+}
+
+
+class NibbleWriter
+{
+public:
+	NibbleWriter(unsigned char* data) : data_(data), begin_(data), bits_(0), nb_bits_(0) {}
+
+	// $value$ has at most $n$ bits (n <= 32)
+	void put_bits(uint32 value, unsigned int n) {
+		bits_ |= uint64(value) << nb_bits_;
+		nb_bits_ += n;
+		if (nb_bits_ >= 32) {
+			uint32 word = uint32(bits_);
+			std::memcpy(data_, &word, 4);
+			data_ += 4;
+			bits_ >>= 32;
+			nb_bits_ -= 32;
+		}
+	}
+
+	void put_value(uint32 value) {
+		if (value < 8) {
+			put_bits(value, 4);
+			return;
+		}
+		do {
+			uint32 nibble = value & 7;
+			value >>= 3;
+			if (value)
+				nibble |= 8;
+			put_bits(nibble, 4);
+		} while (value);
+	}
+
+	// Returns the size of the data
+	std::size_t finish() {
+		if (nb_bits_ > 0)
+			put_bits(0, 32 - nb_bits_);
+		return data_ - begin_;
+	}
+
+private:
+	unsigned char*	data_;
+	unsigned char*	begin_;
+	uint64			bits_;
+	unsigned int	nb_bits_;
+};
+
+
+class NibbleReader
+{
+public:
+	NibbleReader(const unsigned char* data, std::size_t size)
+		: data_(data), end_(data + size / 4 * 4), bits_(0), nb_bits_(0), error_(false) {
+		refill();
+	}
+
+	bool error() const { return error_; }
+
+	bool get_value(uint32& value) {
+		value = 0;
+		unsigned int shift = 0;
+		while (true) {
+			if (nb_bits_ < 4) {
+				refill();
+				if (nb_bits_ < 4) {
+					error_ = true;
+					return false;
+				}
+			}
+			uint32 nibble = uint32(bits_) & 15;
+			bits_ >>= 4;
+			nb_bits_ -= 4;
+			value |= (nibble & 7) << shift;
+			if (!(nibble & 8))
+				return true;
+			shift += 3;
+			if (shift > 30) {	// more than 32 bits
+				error_ = true;
+				return false;
+			}
+		}
+	}
+
+	// The next 8 nibbles, if any
+	bool peek_word(uint32& word) {
+		if (nb_bits_ < 32) {
+			refill();
+			if (nb_bits_ < 32)
+				return false;
+		}
+		word = uint32(bits_);
+		return true;
+	}
+	void skip_word() {
+		bits_ >>= 32;
+		nb_bits_ -= 32;
+	}
+
+private:
+	void refill() {
+		while (nb_bits_ <= 32 && data_ < end_) {
+			uint32 word;
+			std::memcpy(&word, data_, 4);
+			bits_ |= uint64(word) << nb_bits_;
+			nb_bits_ += 32;
+			data_ += 4;
+		}
+	}
+
+private:
+	const unsigned char*	data_;
+	const unsigned char*	end_;
+	uint64			bits_;
+	unsigned int	nb_bits_;
+	bool			error_;
+};
+
+//_________________________________________________________________________
+
+#ifdef DEPTH_CODEC_SSE2
+
+static inline unsigned int first_bit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+#endif
+
+
+// The number of unknown depths (0) at the start of $depth$
+static std::size_t count_unknown(const unsigned short* depth, std::size_t num)
+{
+	std::size_t k = 0;
+#ifdef DEPTH_CODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; k + 8 <= num; k += 8) {
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + k));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(d, zero));
+		if (mask != 0xffff)
+			return k + first_bit(~mask & 0xffff) / 2;
+	}
+#endif
+	while (k < num && depth[k] == 0)
+		++k;
+	return k;
+}
+
+
+// The number of known depths at the start of $depth$
+static std::size_t count_known(const unsigned short* depth, std::size_t num)
+{
+	std::size_t k = 0;
+#ifdef DEPTH_CODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; k + 8 <= num; k += 8) {
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + k));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(d, zero));
+		if (mask != 0)
+			return k + first_bit(mask) / 2;
+	}
+#endif
+	while (k < num && depth[k] != 0)
+		++k;
+	return k;
+}
+
+
+// Writes the differences of a run of $num$ known depths; $prev$ is the
+// last known depth before the run, and is updated.
+static void encode_run(const unsigned short* depth, std::size_t num, unsigned short& prev, NibbleWriter& writer)
+{
+	if (num == 0)
+		return;
+	writer.put_value(zigzag(static_cast<unsigned short>(depth[0] - prev)));
+
+	std::size_t j = 1;
+#ifdef DEPTH_CODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high_bits = _mm_set1_epi16(short(0xfff8));
+	const __m128i low_byte = _mm_set1_epi16(0x00ff);
+	for (; j + 8 <= num; j += 8) {
+		__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + j));
+		__m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + j - 1));
+		__m128i diff = _mm_sub_epi16(current, before);
+		__m128i z = _mm_xor_si128(_mm_slli_epi16(diff, 1), _mm_srai_epi16(diff, 15));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(z, high_bits), zero)) == 0xffff) {
+			// each one is a nibble: two per byte, the 8 of them in a word
+			__m128i bytes = _mm_packus_epi16(z, z);
+			__m128i pairs = _mm_and_si128(_mm_or_si128(bytes, _mm_srli_epi16(bytes, 4)), low_byte);
+			writer.put_bits(uint32(_mm_cvtsi128_si32(_mm_packus_epi16(pairs, pairs))), 32);
+		}
+		else {
+			unsigned short values[8];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values), z);
+			for (int k = 0; k < 8; ++k)
+				writer.put_value(values[k]);
+		}
+	}
+#endif
+	for (; j < num; ++j)
+		writer.put_value(zigzag(static_cast<unsigned short>(depth[j] - depth[j - 1])));
+	prev = depth[num - 1];
+}
+
+
+// Reads the differences of a run of $num$ known depths (see encode_run())
+static bool decode_run(NibbleReader& reader, unsigned short* depth, std::size_t num, unsigned short& prev)
+{
+	if (num == 0)
+		return true;
+	uint32 z;
+	if (!reader.get_value(z))
+		return false;
+	depth[0] = static_cast<unsigned short>(prev + unzigzag(z));
+
+	std::size_t j = 1;
+#ifdef DEPTH_CODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i low_nibble = _mm_set1_epi8(0x0f);
+	while (j + 8 <= num) {
+		uint32 word;
+		if (!reader.peek_word(word) || (word & 0x88888888u)) {
+			// not 8 single nibbles
+			if (!reader.get_value(z))
+				return false;
+			depth[j] = static_cast<unsigned short>(depth[j - 1] + unzigzag(z));
+			++j;
+			continue;
+		}
+		reader.skip_word();
+
+		__m128i x = _mm_cvtsi32_si128(int(word));
+		__m128i lo = _mm_and_si128(x, low_nibble);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), low_nibble);
+		__m128i values = _mm_unpacklo_epi8(_mm_unpacklo_epi8(lo, hi), zero);
+		__m128i diff = _mm_xor_si128(_mm_srli_epi16(values, 1), _mm_sub_epi16(zero, _mm_and_si128(values, one)));
+		// the prefix sums of the differences
+		diff = _mm_add_epi16(diff, _mm_slli_si128(diff, 2));
+		diff = _mm_add_epi16(diff, _mm_slli_si128(diff, 4));
+		diff = _mm_add_epi16(diff, _mm_slli_si128(diff, 8));
+		diff = _mm_add_epi16(diff, _mm_set1_epi16(short(depth[j - 1])));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(depth + j), diff);
+		j += 8;
+	}
+#endif
+	for (; j < num; ++j) {
+		if (!reader.get_value(z))
+			return false;
+		depth[j] = static_cast<unsigned short>(depth[j - 1] + unzigzag(z));
+	}
+	prev = depth[num - 1];
+	return true;
+}
+
+//_________________________________________________________________________
+
+
+std::size_t DepthCodec::max_encoded_size(std::size_t num)
+{
+	// per depth at most 6 nibbles for the difference (16 bits) and 3 for the
+	// lengths of the runs, rounded up to words
+	return (9 * num + 2 + 7) / 8 * 4 + 4;
+}
+
+
+std::size_t DepthCodec::encode(const unsigned short* depth, std::size_t num, std::vector<unsigned char>& data)
+{
+	std::size_t start = data.size();
+	data.resize(start + max_encoded_size(num));
+
+	NibbleWriter writer(&data[start]);
+	unsigned short prev = 0;
+	std::size_t i = 0;
+	while (i < num) {
+		std::size_t unknown = count_unknown(depth + i, num - i);
+		std::size_t known = count_known(depth + i + unknown, num - i - unknown);
+		writer.put_value(uint32(unknown));
+		writer.put_value(uint32(known));
+		encode_run(depth + i + unknown, known, prev, writer);
+		i += unknown + known;
+	}
+
+	std::size_t size = writer.finish();
+	data.resize(start + size);
+	return size;
+}
+
+
+bool DepthCodec::decode(const unsigned char* data, std::size_t size, unsigned short* depth, std::size_t num)
+{
+	NibbleReader reader(data, size);
+	unsigned short prev = 0;
+	std::size_t i = 0;
+	while (i < num) {
+		uint32 unknown, known;
+		if (!reader.get_value(unknown) || !reader.get_value(known))
+			return false;
+		if (unknown + std::size_t(known) == 0 || unknown > num - i || known > num - i - unknown)
+			return false;
+
+		std::fill(depth + i, depth + i + unknown, static_cast<unsigned short>(0));
+		i += unknown;
+		if (!decode_run(reader, depth + i, known, prev))
+			return false;
+		i += known;
+	}
+	return !reader.error();
+}
@@ -0,0 +1,44 @@
+#ifndef DEPTH_CODEC_H
+#define DEPTH_CODEC_H
+
+#include "kinect_io_common.h"
+
+#include <vector>
+#include <cstddef>
+
+
+/***********************************************************************
+ A lossless compression of the depth images, after RVL (Wilson, "Fast
+ lossless depth image compression", 2017): the image is a sequence of
+ runs of unknown depths (0) and of known depths, and each known depth is
+ stored as the difference to the previous known one. The run lengths and
+ the differences (zigzag encoded, modulo 2^16) are written with a
+ variable length code of 4-bit nibbles (3 bits of the value and a
+ continuation bit), packed in 32-bit words (the first nibble in the low
+ bits). The depth images of the Kinect are usually compressed 3 to 5
+ times, at a few hundred frames per second.
+
+ With SSE2, the runs are found 8 pixels at a time, and 8 consecutive
+ differences that each fit in a nibble (the common case on smooth
+ surfaces) are encoded and decoded at once. The compressed data is the
+ same with and without SSE2.
+************************************************************************/
+
+
+class KINECT_IO_API DepthCodec
+{
+public:
+	// Appends the compression of the $num$ depths to $data$. Returns the size
+	// of the compressed depths (a multiple of 4 bytes).
+	static std::size_t encode(const unsigned short* depth, std::size_t num, std::vector<unsigned char>& data);
+
+	// Decompresses $num$ depths. Returns false if $data$ is not the
+	// compression of $num$ depths (the content of $depth$ is then undefined).
+	static bool decode(const unsigned char* data, std::size_t size, unsigned short* depth, std::size_t num);
+
+	// An upper bound of the size of the compression of $num$ depths
+	static std::size_t max_encoded_size(std::size_t num);
+};
+
+
+#endif
@@ -0,0 +1,108 @@
+#include "depth_frame_recorder.h"
+#include "../basic/logger.h"
+
+
+DepthFrameRecorder::DepthFrameRecorder(const std::string& directory)
+: directory_(directory)
+, color_width_(640)
+, color_height_(360)
+, intrinsics_saved_(false)
+, open_failed_(false)
+{
+}
+
+
+DepthFrameRecorder::~DepthFrameRecorder()
+{
+	finish();
+}
+
+
+void DepthFrameRecorder::set_color_size(int width, int height)
+{
+	color_width_ = width;
+	color_height_ = height;
+}
+
+
+bool DepthFrameRecorder::write(const CaptureFrame& f)
+{
+	if (!sequence_.is_open()) {
+		if (open_failed_)
+			return false;
+		if (!sequence_.open(file_name())) {
+			open_failed_ = true;
+			return false;
+		}
+		intrinsics_saved_ = false;
+	}
+
+	if (!intrinsics_saved_ && f.has_intrinsics) {
+		if (!sequence_.write_intrinsics(f.intrinsics))
+			return false;
+		intrinsics_saved_ = true;
+	}
+
+	const DepthFrame& frame = f.frame;
+	if (!frame.has_color())
+		return sequence_.write_frame(frame, nil, 0, 0);
+
+	downsize_color(frame);
+	return sequence_.write_frame(frame, &rgb_[0], color_width_, color_height_);
+}
+
+
+bool DepthFrameRecorder::finish()
+{
+	open_failed_ = false;
+	if (!sequence_.is_open())
+		return true;
+	return sequence_.close();
+}
+
+
+void DepthFrameRecorder::downsize_color(const DepthFrame& frame)
+{
+	const int w = frame.color_width();
+	const int h = frame.color_height();
+	const unsigned char* rgba = frame.color();
+	rgb_.resize(std::size_t(color_width_) * color_height_ * 3);
+
+	if (w % color_width_ == 0 && h % color_height_ == 0) {
+		// the average of the block of pixels
+		const int fx = w / color_width_;
+		const int fy = h / color_height_;
+		const int area = fx * fy;
+		for (int y = 0; y < color_height_; ++y) {
+			for (int x = 0; x < color_width_; ++x) {
+				int sum[3] = { 0, 0, 0 };
+				for (int j = 0; j < fy; ++j) {
+					const unsigned char* p = rgba + 4 * ((std::size_t(y) * fy + j) * w + std::size_t(x) * fx);
+					for (int i = 0; i < fx; ++i, p += 4) {
+						sum[0] += p[0];
+						sum[1] += p[1];
+						sum[2] += p[2];
+					}
+				}
+				unsigned char* q = &rgb_[3 * (std::size_t(y) * color_width_ + x)];
+				q[0] = static_cast<unsigned char>((sum[0] + area / 2) / area);
+				q[1] = static_cast<unsigned char>((sum[1] + area / 2) / area);
+				q[2] = static_cast<unsigned char>((sum[2] + area / 2) / area);
+			}
+		}
+	}
+	else {
+		// the nearest pixel
+		for (int y = 0; y < color_height_; ++y) {
+			int sy = static_cast<int>((y + 0.5) * h / color_height_);
+			for (int x = 0; x < color_width_; ++x) {
+				int sx = static_cast<int>((x + 0.5) * w / color_width_);
+				const unsigned char* p = rgba + 4 * (std::size_t(sy) * w + sx);
+				unsigned char* q = &rgb_[3 * (std::size_t(y) * color_width_ + x)];
+				q[0] = p[0];
+				q[1] = p[1];
+				q[2] = p[2];
+			}
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef DEPTH_FRAME_RECORDER_H
+#define DEPTH_FRAME_RECORDER_H
+
+#include "capture_pipeline.h"
+#include "depth_sequence.h"
+
+#include <string>
+#include <vector>
+
+
+// Records the frames of a capture in $directory$/sequence.dseq (see
+// DepthSequenceWriter), which DepthFrameReplay reads. The depths are
+// compressed without loss (see DepthCodec), the color images are downsized
+// (640 x 360 by default) and the intrinsics are recorded as soon as they
+// are known. The frames are appended to the file by the thread of
+// a FrameWriter: write() only queues them. The sequence is ended (the file
+// is complete and synced) when the capture stops, the next frame starts a
+// new one (the file is overwritten). The directory must exist.
+class KINECT_IO_API DepthFrameRecorder : public CaptureSink
+{
+public:
+	DepthFrameRecorder(const std::string& directory);
+	~DepthFrameRecorder();
+
+	// The size of the recorded color images. Default is 640 x 360. If the
+	// color images are larger by an integer factor, the pixels are averaged,
+	// otherwise the nearest pixel is taken.
+	void set_color_size(int width, int height);
+
+	// Default is DEPTH_RVL
+	void set_depth_encoding(DepthEncoding encoding) { sequence_.set_depth_encoding(encoding); }
+	// The sequence being recorded (or the last one)
+	const DepthSequenceWriter& sequence() const { return sequence_; }
+
+	// The options of the writes (direct I/O, preallocation, syncs), see FrameWriter
+	FrameWriter& writer() { return sequence_.writer(); }
+	const FrameWriter& writer() const { return sequence_.writer(); }
+
+	std::string file_name() const { return directory_ + "/sequence.dseq"; }
+	unsigned int nb_frames() const { return sequence_.nb_frames(); }
+
+	virtual bool write(const CaptureFrame& frame);
+	// Ends the sequence
+	virtual bool finish();
+
+private:
+	void downsize_color(const DepthFrame& frame);
+
+private:
+	std::string		directory_;
+	int				color_width_;
+	int				color_height_;
+
+	DepthSequenceWriter	sequence_;
+	bool			intrinsics_saved_;
+	bool			open_failed_;	// not tried again until finish()
+
+	std::vector<unsigned char>	rgb_;	// the downsized color image (3 bytes per pixel)
+};
+
+
+#endif
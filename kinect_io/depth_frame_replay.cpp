@@ -0,0 +1,212 @@
+#include "depth_frame_replay.h"
+#include "../basic/file_utils.h"
+#include "../basic/logger.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <unistd.h>
+#endif
+
+
+static void sleep_ms(unsigned int ms)
+{
+#ifdef WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+
+// Reads the header of the images written when scanning: the width and the
+// height, each followed by a new line, then the pixels.
+static bool read_header(std::ifstream& input, int& width, int& height)
+{
+	if (!(input >> width >> height) || width <= 0 || height <= 0)
+		return false;
+	input.get();	// the end of the line of the height
+	return input.good();
+}
+
+
+DepthFrameReplay::DepthFrameReplay(const std::string& directory, bool real_time)
+: directory_(directory)
+, real_time_(real_time)
+, read_colors_(true)
+, has_intrinsics_(false)
+, current_(0)
+, from_sequence_(false)
+{
+}
+
+
+bool DepthFrameReplay::open()
+{
+	frames_.clear();
+	current_ = 0;
+	sequence_.close();
+	from_sequence_ = false;
+
+	std::string sequence_file = FileUtils::is_file(directory_) ? directory_ : directory_ + "/sequence.dseq";
+	if (FileUtils::is_file(sequence_file) && DepthSequenceReader::is_sequence(sequence_file))
+		return open_sequence(sequence_file);
+
+	std::string depth_dir = directory_ + "/depth_image";
+	if (!FileUtils::is_directory(depth_dir)) {
+		Logger::err("DepthFrameReplay") << "directory \'" << depth_dir << "\' does not exist" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> entries;
+	FileUtils::get_directory_entries(depth_dir, entries, false);
+	for (std::size_t i = 0; i < entries.size(); ++i) {
+		if (FileUtils::extension_in_lower_case(entries[i]) != "depth")
+			continue;
+		std::string name = FileUtils::base_name(entries[i]);
+		frames_.push_back(std::make_pair(std::atof(name.c_str()), name));
+	}
+	// the names are not padded: sorted by time, not alphabetically
+	std::sort(frames_.begin(), frames_.end());
+
+	if (frames_.empty()) {
+		Logger::err("DepthFrameReplay") << "no depth image in \'" << depth_dir << "\'" << std::endl;
+		return false;
+	}
+
+	intrinsics_ = DepthIntrinsics();
+	std::string intrinsics_file = depth_dir + "/intrinsics.txt";
+	if (!FileUtils::is_file(intrinsics_file)) {
+		Logger::warn("DepthFrameReplay") << "no intrinsics recorded, using the nominal ones of the Kinect v2" << std::endl;
+		has_intrinsics_ = false;
+	}
+	else
+		has_intrinsics_ = intrinsics_.load(intrinsics_file);
+
+	Logger::out("DepthFrameReplay") << frames_.size() << " frames in \'" << directory_ << "\'" << std::endl;
+	return true;
+}
+
+
+bool DepthFrameReplay::open_sequence(const std::string& file_name)
+{
+	if (!sequence_.open(file_name))
+		return false;
+	if (sequence_.nb_frames() == 0) {
+		Logger::err("DepthFrameReplay") << "no frame in \'" << file_name << "\'" << std::endl;
+		return false;
+	}
+	from_sequence_ = true;
+
+	// already in the order of the capture
+	for (unsigned int i = 0; i < sequence_.nb_frames(); ++i)
+		frames_.push_back(std::make_pair(sequence_.timestamp(i), std::string()));
+
+	has_intrinsics_ = sequence_.has_intrinsics();
+	intrinsics_ = has_intrinsics_ ? sequence_.intrinsics() : DepthIntrinsics();
+	if (!has_intrinsics_)
+		Logger::warn("DepthFrameReplay") << "no intrinsics recorded, using the nominal ones of the Kinect v2" << std::endl;
+
+	Logger::out("DepthFrameReplay") << frames_.size() << " frames in \'" << file_name << "\'" << std::endl;
+	return true;
+}
+
+
+void DepthFrameReplay::close()
+{
+	current_ = frames_.size();
+	sequence_.close();
+	std::vector<unsigned char>().swap(rgb_);
+}
+
+
+void DepthFrameReplay::rewind()
+{
+	current_ = 0;
+}
+
+
+bool DepthFrameReplay::next(DepthFrame& frame, unsigned int timeout)
+{
+	while (current_ < frames_.size()) {
+		if (real_time_) {
+			if (current_ == 0)
+				clock_.start();
+			// in milliseconds, from the first frame
+			double due = frames_[current_].first - frames_[0].first;
+			double now = clock_.elapsed() * 1000.0;
+			if (due - now > timeout) {
+				if (timeout > 0)
+					sleep_ms(timeout);
+				return false;
+			}
+			if (due > now)
+				sleep_ms(static_cast<unsigned int>(due - now));
+		}
+
+		const std::string& name = frames_[current_].second;
+		++current_;
+
+		if (from_sequence_) {
+			if (!sequence_.read_frame(static_cast<unsigned int>(current_ - 1), frame, read_colors_)) {
+				Logger::warn("DepthFrameReplay") << "could not read frame " << current_ - 1 << ", skipped" << std::endl;
+				continue;
+			}
+			return true;
+		}
+
+		if (!read_depth(directory_ + "/depth_image/" + name + ".depth", frame)) {
+			Logger::warn("DepthFrameReplay") << "could not read frame \'" << name << "\', skipped" << std::endl;
+			continue;
+		}
+		frame.set_timestamp(frames_[current_ - 1].first);
+
+		if (!read_colors_ || !read_color(directory_ + "/rgb_image/" + name + ".rgb", frame))
+			frame.resize_color(0, 0);
+		return true;
+	}
+	return false;
+}
+
+
+bool DepthFrameReplay::read_depth(const std::string& file_name, DepthFrame& frame)
+{
+	std::ifstream input(file_name.c_str(), std::ios::binary);
+	int width, height;
+	if (input.fail() || !read_header(input, width, height))
+		return false;
+
+	std::streamsize size = static_cast<std::streamsize>(std::size_t(width) * height * sizeof(unsigned short));
+	frame.resize(width, height);
+	input.read(reinterpret_cast<char*>(frame.depth()), size);
+	return input.gcount() == size;
+}
+
+
+bool DepthFrameReplay::read_color(const std::string& file_name, DepthFrame& frame)
+{
+	std::ifstream input(file_name.c_str(), std::ios::binary);
+	int width, height;
+	if (input.fail() || !read_header(input, width, height))
+		return false;
+
+	std::size_t num = std::size_t(width) * height;
+	rgb_.resize(3 * num);
+	input.read(reinterpret_cast<char*>(&rgb_[0]), std::streamsize(3 * num));
+	if (input.gcount() != std::streamsize(3 * num))
+		return false;
+
+	frame.resize_color(width, height);
+	unsigned char* rgba = frame.color();
+	for (std::size_t i = 0; i < num; ++i) {
+		rgba[4 * i] = rgb_[3 * i];
+		rgba[4 * i + 1] = rgb_[3 * i + 1];
+		rgba[4 * i + 2] = rgb_[3 * i + 2];
+		rgba[4 * i + 3] = 255;
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+#ifndef DEPTH_FRAME_REPLAY_H
+#define DEPTH_FRAME_REPLAY_H
+
+#include "depth_frame_source.h"
+#include "depth_sequence.h"
+#include "../basic/stop_watch.h"
+
+#include <string>
+#include <vector>
+
+
+// Plays the frames recorded by the viewer when scanning, either in a single
+// file (see DepthSequenceWriter):
+//   - $directory$/sequence.dseq (or $directory$ itself if it is the file);
+// or as a few files per frame (as recorded by former versions):
+//   - $directory$/depth_image/<time>.depth: the depth images, i.e., the width
+//     and the height (one text line each) followed by the raw depths (unsigned
+//     short, in millimeters);
+//   - $directory$/rgb_image/<time>.rgb: the color images (optional), same
+//     layout with 3 bytes (RGB) per pixel;
+//   - $directory$/depth_image/intrinsics.txt: the intrinsics of the depth
+//     camera (see DepthIntrinsics).
+// The nominal intrinsics of the Kinect v2 are used if none were recorded.
+// <time> is the time of the capture in milliseconds (clock() when recording):
+// the frames are played in this order and, in real time, with the recorded
+// delays. Otherwise they are played as fast as they can be read.
+class KINECT_IO_API DepthFrameReplay : public DepthFrameSource
+{
+public:
+	DepthFrameReplay(const std::string& directory, bool real_time = true);
+
+	// Lists the frames and reads the intrinsics. Returns false if there is no frame.
+	virtual bool open();
+	virtual void close();
+
+	virtual bool next(DepthFrame& frame, unsigned int timeout = 1000);
+	virtual bool finished() const { return current_ >= frames_.size(); }
+
+	virtual const DepthIntrinsics& intrinsics() const { return intrinsics_; }
+	virtual bool has_intrinsics() const { return has_intrinsics_; }
+
+	// Plays the frames from the first one again
+	void rewind();
+
+	bool real_time() const { return real_time_; }
+	void set_real_time(bool b) { real_time_ = b; }
+
+	// Whether the color images are read (default is true)
+	void set_read_colors(bool b) { read_colors_ = b; }
+
+	unsigned int nb_frames() const { return static_cast<unsigned int>(frames_.size()); }
+	unsigned int nb_frames_read() const { return static_cast<unsigned int>(current_); }
+
+private:
+	bool open_sequence(const std::string& file_name);
+	bool read_depth(const std::string& file_name, DepthFrame& frame);
+	bool read_color(const std::string& file_name, DepthFrame& frame);
+
+private:
+	std::string		directory_;
+	bool			real_time_;
+	bool			read_colors_;
+
+	DepthIntrinsics	intrinsics_;
+	bool			has_intrinsics_;
+
+	// (time, name without extension), sorted by time
+	std::vector< std::pair<double, std::string> >	frames_;
+	std::size_t		current_;
+
+	// the frames recorded in a single file (if used, the names above are empty)
+	DepthSequenceReader	sequence_;
+	bool				from_sequence_;
+
+	StopWatch		clock_;		// since the first frame was played (in real time)
+	std::vector<unsigned char>	rgb_;	// the color image as read
+};
+
+
+#endif
@@ -0,0 +1,178 @@
+#include "depth_frame_source.h"
+#include "../geom/point_set.h"
+#include "../geom/dense_point_set.h"
+#include "../basic/logger.h"
+
+#include <fstream>
+#include <sstream>
+
+
+DepthIntrinsics::DepthIntrinsics()
+: fx(365.456)
+, fy(365.456)
+, cx(254.878)
+, cy(205.395)
+, min_depth(0.5)
+, max_depth(65.535)
+{
+}
+
+
+bool DepthIntrinsics::load(const std::string& file_name)
+{
+	std::ifstream input(file_name.c_str());
+	if (input.fail()) {
+		Logger::warn("DepthIntrinsics") << "could not open file \'" << file_name << "\'" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(input, line)) {
+		std::istringstream in(line);
+		std::string name;
+		double value;
+		if (!(in >> name >> value))
+			continue;
+		if (name == "fx")				fx = value;
+		else if (name == "fy")			fy = value;
+		else if (name == "cx")			cx = value;
+		else if (name == "cy")			cy = value;
+		else if (name == "min_depth")	min_depth = value;
+		else if (name == "max_depth")	max_depth = value;
+	}
+
+	if (fx == 0 || fy == 0) {
+		Logger::warn("DepthIntrinsics") << "invalid focal length in \'" << file_name << "\'" << std::endl;
+		*this = DepthIntrinsics();
+		return false;
+	}
+	return true;
+}
+
+
+bool DepthIntrinsics::save(const std::string& file_name) const
+{
+	std::ofstream output(file_name.c_str());
+	if (output.fail()) {
+		Logger::warn("DepthIntrinsics") << "could not create file \'" << file_name << "\'" << std::endl;
+		return false;
+	}
+	output.precision(10);
+	output << "fx " << fx << std::endl;
+	output << "fy " << fy << std::endl;
+	output << "cx " << cx << std::endl;
+	output << "cy " << cy << std::endl;
+	output << "min_depth " << min_depth << std::endl;
+	output << "max_depth " << max_depth << std::endl;
+	return !output.fail();
+}
+
+//_________________________________________________________________________
+
+
+DepthFrame::DepthFrame()
+: width_(0)
+, height_(0)
+, rgb_width_(0)
+, rgb_height_(0)
+, timestamp_(0)
+{
+}
+
+
+void DepthFrame::resize(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+	depth_.resize(std::size_t(width) * height);
+}
+
+
+void DepthFrame::resize_color(int width, int height)
+{
+	rgb_width_ = width;
+	rgb_height_ = height;
+	rgb_.resize(std::size_t(width) * height * 4);
+}
+
+//_________________________________________________________________________
+
+
+int DepthFrameSource::backproject(const DepthFrame& frame, float* xyz, int* pixels) const
+{
+	const DepthIntrinsics& camera = intrinsics();
+	const unsigned short* depth = frame.depth();
+	int num = 0;
+	for (int y = 0; y < frame.height(); ++y) {
+		for (int x = 0; x < frame.width(); ++x) {
+			int i = y * frame.width() + x;
+			if (!camera.is_valid(depth[i]))
+				continue;
+			camera.unproject(x, y, depth[i], xyz + 3 * num);
+			if (pixels)
+				pixels[num] = i;
+			++num;
+		}
+	}
+	return num;
+}
+
+
+bool DepthFrameSource::to_points(const DepthFrame& frame, PointSet* pointSet) const
+{
+	std::size_t size = std::size_t(frame.width()) * frame.height();
+	if (size == 0)
+		return false;
+
+	std::vector<float> xyz(3 * size);
+	std::vector<int> pixels(size);
+	int num = backproject(frame, &xyz[0], &pixels[0]);
+	if (num < 0)
+		return false;
+
+	pointSet->append(&xyz[0], num, nil, nil, &pixels[0]);
+	return true;
+}
+
+
+bool DepthFrameSource::to_points(const DepthFrame& frame, DensePointSet* points) const
+{
+	std::size_t size = std::size_t(frame.width()) * frame.height();
+	points->set_has_normals(false);
+	points->set_has_colors(false);
+	if (size == 0) {
+		points->clear();
+		return false;
+	}
+
+	// backprojected in place: room for all the pixels, then shrunk
+	points->resize(static_cast<unsigned int>(size));
+	int num = backproject(frame, points->positions(), nil);
+	points->resize(num < 0 ? 0 : num);
+	return num >= 0;
+}
+
+//_________________________________________________________________________
+
+
+DepthFramePointSource::DepthFramePointSource(DepthFrameSource* source, unsigned int nb_frames, unsigned int timeout)
+: source_(source)
+, nb_frames_(nb_frames)
+, timeout_(timeout)
+, nb_frames_read_(0)
+{
+}
+
+
+bool DepthFramePointSource::next(DensePointSet& chunk)
+{
+	chunk.clear();
+	if (nb_frames_ > 0 && nb_frames_read_ >= nb_frames_)
+		return false;
+
+	if (!source_->next(frame_, timeout_) || !source_->to_points(frame_, &chunk))
+		return false;
+
+	++nb_frames_read_;
+	return true;
+}
@@ -0,0 +1,153 @@
+#ifndef DEPTH_FRAME_SOURCE_H
+#define DEPTH_FRAME_SOURCE_H
+
+#include "kinect_io_common.h"
+#include "../geom/point_stream.h"
+
+#include <string>
+#include <vector>
+
+class PointSet;
+class DensePointSet;
+
+
+/***********************************************************************
+ The frames of a depth camera (a depth image and optionally a color
+ image), whatever they come from: the scanner (KinectFrameSource) or a
+ recording (DepthFrameReplay, which has no dependency on the Kinect SDK).
+ The viewer and the per-frame algorithms only see a DepthFrameSource, so
+ they can be run and profiled on recorded sequences without a sensor.
+************************************************************************/
+
+
+// The pinhole model of the depth camera, to map a pixel and its depth to
+// a point (in the frame of CDepthBasics: the X and Y of the camera space
+// of the Kinect are negated). Only the depths within [min_depth, max_depth]
+// give a point. The default values are the nominal ones of the Kinect v2.
+class KINECT_IO_API DepthIntrinsics
+{
+public:
+	DepthIntrinsics();
+
+	double fx, fy;		// focal lengths (in pixels)
+	double cx, cy;		// principal point (in pixels)
+	double min_depth;	// in meters
+	double max_depth;	// in meters
+
+	// A text file with one "name value" pair per line
+	bool load(const std::string& file_name);
+	bool save(const std::string& file_name) const;
+
+	// $depth$ is in millimeters (as in the depth images)
+	bool is_valid(unsigned short depth) const {
+		return depth >= min_depth * 1000.0 && depth <= max_depth * 1000.0;
+	}
+	void unproject(int x, int y, unsigned short depth, float* p) const {
+		float z = depth * 0.001f;
+		p[0] = float(-(x - cx) * z / fx);
+		p[1] = float((y - cy) * z / fy);
+		p[2] = z;
+	}
+};
+
+
+// The depth image (in millimeters, 0 if unknown) and the color image (RGBA,
+// 4 bytes per pixel, empty if the source has no color) of a frame. The
+// images are reused from frame to frame: reading a frame of the same size
+// does not allocate.
+class KINECT_IO_API DepthFrame
+{
+public:
+	DepthFrame();
+
+	void resize(int width, int height);
+	void resize_color(int width, int height);
+
+	int  width() const { return width_; }
+	int  height() const { return height_; }
+	unsigned short* depth() { return depth_.empty() ? nil : &depth_[0]; }
+	const unsigned short* depth() const { return depth_.empty() ? nil : &depth_[0]; }
+
+	bool has_color() const { return !rgb_.empty(); }
+	int  color_width() const { return rgb_width_; }
+	int  color_height() const { return rgb_height_; }
+	unsigned char* color() { return rgb_.empty() ? nil : &rgb_[0]; }
+	const unsigned char* color() const { return rgb_.empty() ? nil : &rgb_[0]; }
+
+	// When the frame was captured, in milliseconds (the origin depends on the source)
+	double timestamp() const { return timestamp_; }
+	void set_timestamp(double t) { timestamp_ = t; }
+
+private:
+	int		width_;
+	int		height_;
+	std::vector<unsigned short>	depth_;
+
+	int		rgb_width_;
+	int		rgb_height_;
+	std::vector<unsigned char>	rgb_;
+
+	double	timestamp_;
+};
+
+
+class KINECT_IO_API DepthFrameSource
+{
+public:
+	virtual ~DepthFrameSource() {}
+
+	virtual bool open() = 0;
+	virtual void close() = 0;
+
+	// Reads the next frame into $frame$, waiting at most $timeout$ milliseconds
+	// for it (0: does not wait). Returns false if there is no new frame.
+	virtual bool next(DepthFrame& frame, unsigned int timeout = 1000) = 0;
+
+	// True if no frame will ever come (e.g., the end of a recording)
+	virtual bool finished() const = 0;
+
+	virtual const DepthIntrinsics& intrinsics() const = 0;
+	// False if the intrinsics() are the nominal ones (not measured nor recorded)
+	virtual bool has_intrinsics() const = 0;
+
+	// Maps the valid pixels of the depth image of $frame$ to points: the points
+	// are stored at the beginning of $xyz$ (3 floats per point) and their pixels
+	// (row * width + column) in $pixels$ (if not nil). Both must have room for
+	// one entry per pixel. Returns the number of points (-1 on failure). The
+	// default uses the intrinsics(). May be called on a thread while next()
+	// runs on another (see CapturePipeline).
+	virtual int backproject(const DepthFrame& frame, float* xyz, int* pixels) const;
+
+	// Appends the points of $frame$ to $pointSet$, with their pixels (see PointSetPixel)
+	bool to_points(const DepthFrame& frame, PointSet* pointSet) const;
+	// Replaces the content of $points$ by the points of $frame$
+	bool to_points(const DepthFrame& frame, DensePointSet* points) const;
+};
+
+
+// The frames of a source as a source of the streaming pipeline (see
+// PointPipeline): each chunk is the points of one frame. The frame source
+// must be opened (and is not owned).
+class KINECT_IO_API DepthFramePointSource : public PointSource
+{
+public:
+	// Stops after $nb_frames$ frames (0: no limit), at the end of the source,
+	// or when no frame arrives within $timeout$ milliseconds.
+	DepthFramePointSource(DepthFrameSource* source, unsigned int nb_frames = 0, unsigned int timeout = 1000);
+
+	virtual bool next(DensePointSet& chunk);
+	virtual bool has_normals() const { return false; }
+	virtual bool has_colors() const { return false; }
+
+	unsigned int nb_frames_read() const { return nb_frames_read_; }
+
+private:
+	DepthFrameSource*	source_;
+	DepthFrame			frame_;
+	unsigned int		nb_frames_;
+	unsigned int		timeout_;
+	unsigned int		nb_frames_read_;
+};
+
+
+#endif
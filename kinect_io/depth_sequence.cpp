@@ -0,0 +1,334 @@
+#include "depth_sequence.h"
+#include "depth_codec.h"
+#include "../basic/logger.h"
+#include "../basic/stop_watch.h"
+
+#include <cstring>
+
+
+static Numeric::uint32 make_tag(char a, char b, char c, char d) {
+	return Numeric::uint32(Numeric::uint8(a)) | (Numeric::uint32(Numeric::uint8(b)) << 8) |
+		(Numeric::uint32(Numeric::uint8(c)) << 16) | (Numeric::uint32(Numeric::uint8(d)) << 24);
+}
+
+static const Numeric::uint32 sequence_tag = make_tag('D', 'S', 'E', 'Q');
+static const Numeric::uint32 intrinsics_tag = make_tag('I', 'N', 'T', 'R');
+static const Numeric::uint32 frame_tag = make_tag('F', 'R', 'A', 'M');
+static const Numeric::uint32 sequence_version = 1;
+
+// the sizes of the record header, of the intrinsics and of the frame header
+static const std::size_t record_header_size = 8;
+static const std::size_t intrinsics_size = 6 * 8;
+static const std::size_t frame_header_size = 8 + 7 * 4;
+
+// the largest width and height of the images read (the Kinect v2 gives 512 x 424
+// depths and 1920 x 1080 colors): the frames are allocated from these sizes
+static const int max_image_size = 8192;
+
+
+template <class T> inline void put(char* buffer, std::size_t& pos, T value) {
+	std::memcpy(buffer + pos, &value, sizeof(T));
+	pos += sizeof(T);
+}
+
+template <class T> inline void get(const char* buffer, std::size_t& pos, T& value) {
+	std::memcpy(&value, buffer + pos, sizeof(T));
+	pos += sizeof(T);
+}
+
+
+DepthSequenceWriter::DepthSequenceWriter()
+: depth_encoding_(DEPTH_RVL)
+, nb_frames_(0)
+, depth_bytes_(0)
+, encoded_depth_bytes_(0)
+, encoding_time_(0)
+{
+}
+
+
+DepthSequenceWriter::~DepthSequenceWriter()
+{
+	close();
+}
+
+
+bool DepthSequenceWriter::open(const std::string& file_name)
+{
+	nb_frames_ = 0;
+	depth_bytes_ = 0;
+	encoded_depth_bytes_ = 0;
+	encoding_time_ = 0;
+	if (!writer_.open(file_name))
+		return false;
+
+	char header[8];
+	std::size_t pos = 0;
+	put(header, pos, sequence_tag);
+	put(header, pos, sequence_version);
+	return writer_.write(header, pos);
+}
+
+
+bool DepthSequenceWriter::close()
+{
+	return writer_.close();
+}
+
+
+bool DepthSequenceWriter::write_intrinsics(const DepthIntrinsics& intrinsics)
+{
+	char record[record_header_size + intrinsics_size];
+	std::size_t pos = 0;
+	put(record, pos, intrinsics_tag);
+	put(record, pos, Numeric::uint32(intrinsics_size));
+	put(record, pos, intrinsics.fx);
+	put(record, pos, intrinsics.fy);
+	put(record, pos, intrinsics.cx);
+	put(record, pos, intrinsics.cy);
+	put(record, pos, intrinsics.min_depth);
+	put(record, pos, intrinsics.max_depth);
+	return writer_.write(record, pos);
+}
+
+
+bool DepthSequenceWriter::write_frame(const DepthFrame& frame, const unsigned char* rgb, int color_width, int color_height)
+{
+	if (!rgb) {
+		color_width = 0;
+		color_height = 0;
+	}
+	std::size_t num = std::size_t(frame.width()) * frame.height();
+	Numeric::uint32 depth_size = Numeric::uint32(num * sizeof(unsigned short));
+	Numeric::uint32 color_size = Numeric::uint32(color_width) * color_height * 3;
+
+	const void* depth = frame.depth();
+	if (depth_encoding_ == DEPTH_RVL) {
+		StopWatch w;
+		encoded_.clear();
+		depth_size = Numeric::uint32(DepthCodec::encode(frame.depth(), num, encoded_));
+		depth = encoded_.empty() ? nil : &encoded_[0];
+		encoding_time_ += w.elapsed();
+	}
+
+	char header[record_header_size + frame_header_size];
+	std::size_t pos = 0;
+	put(header, pos, frame_tag);
+	put(header, pos, Numeric::uint32(frame_header_size + depth_size + color_size));
+	put(header, pos, frame.timestamp());
+	put(header, pos, Numeric::int32(frame.width()));
+	put(header, pos, Numeric::int32(frame.height()));
+	put(header, pos, Numeric::int32(depth_encoding_));
+	put(header, pos, depth_size);
+	put(header, pos, Numeric::int32(color_width));
+	put(header, pos, Numeric::int32(color_height));
+	put(header, pos, color_size);
+
+	bool ok = writer_.write(header, pos) && writer_.write(depth, depth_size);
+	if (ok && color_size > 0)
+		ok = writer_.write(rgb, color_size);
+	if (ok) {
+		++nb_frames_;
+		depth_bytes_ += num * sizeof(unsigned short);
+		encoded_depth_bytes_ += depth_size;
+	}
+	return ok;
+}
+
+//_________________________________________________________________________
+
+
+DepthSequenceReader::DepthSequenceReader()
+: has_intrinsics_(false)
+{
+}
+
+
+bool DepthSequenceReader::is_sequence(const std::string& file_name)
+{
+	std::ifstream input(file_name.c_str(), std::ios::binary);
+	Numeric::uint32 tag = 0;
+	input.read(reinterpret_cast<char*>(&tag), sizeof(tag));
+	return input.good() && tag == sequence_tag;
+}
+
+
+bool DepthSequenceReader::open(const std::string& file_name)
+{
+	close();
+	input_.open(file_name.c_str(), std::ios::binary);
+	if (input_.fail()) {
+		Logger::err("DepthSequenceReader") << "could not open file \'" << file_name << "\'" << std::endl;
+		return false;
+	}
+	file_name_ = file_name;
+
+	input_.seekg(0, std::ios::end);
+	std::streamoff file_size = input_.tellg();
+	input_.seekg(0, std::ios::beg);
+
+	char header[8];
+	std::size_t pos = 0;
+	Numeric::uint32 tag = 0, version = 0;
+	input_.read(header, sizeof(header));
+	get(header, pos, tag);
+	get(header, pos, version);
+	if (!input_.good() || tag != sequence_tag) {
+		Logger::err("DepthSequenceReader") << "\'" << file_name << "\' is not a depth sequence" << std::endl;
+		close();
+		return false;
+	}
+	if (version != sequence_version) {
+		Logger::err("DepthSequenceReader") << "unknown version " << version << " of file \'" << file_name << "\'" << std::endl;
+		close();
+		return false;
+	}
+
+	// the records are listed, only their headers are read
+	std::streamoff offset = sizeof(header);
+	bool complete = true;
+	while (offset < file_size) {
+		char record[record_header_size + (intrinsics_size > frame_header_size ? intrinsics_size : frame_header_size)];
+		if (offset + std::streamoff(record_header_size) > file_size) {
+			complete = false;
+			break;
+		}
+		input_.seekg(offset);
+		input_.read(record, record_header_size);
+		pos = 0;
+		Numeric::uint32 type = 0, size = 0;
+		get(record, pos, type);
+		get(record, pos, size);
+		std::streamoff data = offset + std::streamoff(record_header_size);
+		if (type == 0 || data + std::streamoff(size) > file_size) {	// e.g., the padding of the last write
+			complete = false;
+			break;
+		}
+
+		if (type == intrinsics_tag && size == intrinsics_size) {
+			input_.read(record + pos, intrinsics_size);
+			get(record, pos, intrinsics_.fx);
+			get(record, pos, intrinsics_.fy);
+			get(record, pos, intrinsics_.cx);
+			get(record, pos, intrinsics_.cy);
+			get(record, pos, intrinsics_.min_depth);
+			get(record, pos, intrinsics_.max_depth);
+			has_intrinsics_ = true;
+		}
+		else if (type == frame_tag && size >= frame_header_size) {
+			input_.read(record + pos, frame_header_size);
+			FrameRecord f;
+			Numeric::int32 width, height, encoding, color_width, color_height;
+			get(record, pos, f.timestamp);
+			get(record, pos, width);
+			get(record, pos, height);
+			get(record, pos, encoding);
+			get(record, pos, f.depth_size);
+			get(record, pos, color_width);
+			get(record, pos, color_height);
+			get(record, pos, f.color_size);
+			f.width = width;
+			f.height = height;
+			f.depth_encoding = encoding;
+			f.color_width = color_width;
+			f.color_height = color_height;
+			f.offset = data + std::streamoff(frame_header_size);
+			bool valid = width > 0 && height > 0 && width <= max_image_size && height <= max_image_size &&
+				color_width >= 0 && color_height >= 0 && color_width <= max_image_size && color_height <= max_image_size &&
+				frame_header_size + std::size_t(f.depth_size) + f.color_size == size;
+			// the size of the depths must fit their encoding (the largest compression for RVL)
+			std::size_t num = std::size_t(width) * height;
+			if (valid && encoding == DEPTH_RAW)
+				valid = (f.depth_size == num * sizeof(unsigned short));
+			else if (valid && encoding == DEPTH_RVL)
+				valid = (f.depth_size <= DepthCodec::max_encoded_size(num));
+			if (valid)
+				frames_.push_back(f);
+			else
+				Logger::warn("DepthSequenceReader") << "invalid frame in \'" << file_name << "\', skipped" << std::endl;
+		}
+		// the other records are ignored
+		if (!input_.good()) {
+			complete = false;
+			break;
+		}
+		offset = data + std::streamoff(size);
+	}
+	if (!complete)
+		Logger::warn("DepthSequenceReader") << "\'" << file_name << "\' ends with an incomplete record (not closed?), ignored" << std::endl;
+
+	input_.clear();
+	return true;
+}
+
+
+void DepthSequenceReader::close()
+{
+	if (input_.is_open())
+		input_.close();
+	input_.clear();
+	frames_.clear();
+	intrinsics_ = DepthIntrinsics();
+	has_intrinsics_ = false;
+	std::vector<unsigned char>().swap(encoded_);
+	std::vector<unsigned char>().swap(rgb_);
+}
+
+
+bool DepthSequenceReader::read_frame(unsigned int i, DepthFrame& frame, bool read_color)
+{
+	if (i >= frames_.size())
+		return false;
+	const FrameRecord& f = frames_[i];
+	std::size_t num = std::size_t(f.width) * f.height;
+
+	input_.clear();
+	input_.seekg(f.offset);
+	frame.resize(f.width, f.height);
+	if (f.depth_encoding == DEPTH_RAW) {
+		if (f.depth_size != num * sizeof(unsigned short))
+			return false;
+		input_.read(reinterpret_cast<char*>(frame.depth()), f.depth_size);
+		if (input_.gcount() != std::streamsize(f.depth_size))
+			return false;
+	}
+	else if (f.depth_encoding == DEPTH_RVL) {
+		encoded_.resize(f.depth_size);
+		if (f.depth_size > 0) {
+			input_.read(reinterpret_cast<char*>(&encoded_[0]), f.depth_size);
+			if (input_.gcount() != std::streamsize(f.depth_size))
+				return false;
+		}
+		if (!DepthCodec::decode(encoded_.empty() ? nil : &encoded_[0], encoded_.size(), frame.depth(), num)) {
+			Logger::err("DepthSequenceReader") << "corrupted depths in frame " << i << " of \'" << file_name_ << "\'" << std::endl;
+			return false;
+		}
+	}
+	else {
+		Logger::err("DepthSequenceReader") << "unknown encoding " << f.depth_encoding << " of the depths" << std::endl;
+		return false;
+	}
+	frame.set_timestamp(f.timestamp);
+
+	num = std::size_t(f.color_width) * f.color_height;
+	if (!read_color || f.color_size == 0 || f.color_size != 3 * num) {
+		frame.resize_color(0, 0);
+		return true;
+	}
+
+	rgb_.resize(f.color_size);
+	input_.read(reinterpret_cast<char*>(&rgb_[0]), f.color_size);
+	if (input_.gcount() != std::streamsize(f.color_size)) {
+		frame.resize_color(0, 0);
+		return true;
+	}
+	frame.resize_color(f.color_width, f.color_height);
+	unsigned char* rgba = frame.color();
+	for (std::size_t j = 0; j < num; ++j) {
+		rgba[4 * j] = rgb_[3 * j];
+		rgba[4 * j + 1] = rgb_[3 * j + 1];
+		rgba[4 * j + 2] = rgb_[3 * j + 2];
+		rgba[4 * j + 3] = 255;
+	}
+	return true;
+}
@@ -0,0 +1,129 @@
+#ifndef DEPTH_SEQUENCE_H
+#define DEPTH_SEQUENCE_H
+
+#include "depth_frame_source.h"
+#include "frame_writer.h"
+#include "../basic/basic_types.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+
+/***********************************************************************
+ A recorded sequence of frames in a single file, written by appending
+ the frames one after the other (so it can be written with a few large
+ writes, see FrameWriter, instead of a few small files per frame).
+
+ The file starts with "DSEQ" and the version (uint32), followed by
+ records, each one starting with its type and the size (uint32 each) of
+ what follows:
+   - "INTR": the intrinsics of the depth camera (6 float64: fx, fy, cx,
+     cy, min_depth, max_depth);
+   - "FRAM": a frame, i.e., its timestamp (float64), the size of the
+     depth image (2 int32), the encoding (int32, 0 for raw) and the size
+     in bytes (uint32) of the depths, the size of the color image (2
+     int32, 0 if none) and the size in bytes of the colors (uint32),
+     followed by the depths (uint16, in millimeters) and the colors (3
+     bytes per pixel, RGB).
+ All in the byte order of the machine (little endian). A sequence that
+ was not closed (e.g., the application crashed) can be read up to its
+ last complete record.
+************************************************************************/
+
+
+// How the depths of a frame are stored
+enum DepthEncoding {
+	DEPTH_RAW = 0,
+	DEPTH_RVL = 1		// compressed, see DepthCodec
+};
+
+
+class KINECT_IO_API DepthSequenceWriter
+{
+public:
+	DepthSequenceWriter();
+	~DepthSequenceWriter();	// closes the file
+
+	// The options of the writes (to set before open())
+	FrameWriter& writer() { return writer_; }
+	const FrameWriter& writer() const { return writer_; }
+
+	// Default is DEPTH_RVL
+	void set_depth_encoding(DepthEncoding encoding) { depth_encoding_ = encoding; }
+	DepthEncoding depth_encoding() const { return depth_encoding_; }
+
+	bool open(const std::string& file_name);
+	bool close();
+	bool is_open() const { return writer_.is_open(); }
+
+	bool write_intrinsics(const DepthIntrinsics& intrinsics);
+	// $rgb$ is the color image (3 bytes per pixel) or nil
+	bool write_frame(const DepthFrame& frame, const unsigned char* rgb, int color_width, int color_height);
+
+	unsigned int nb_frames() const { return nb_frames_; }
+	// The size of the depths of the frames written, before and after encoding
+	Numeric::uint64 depth_bytes() const { return depth_bytes_; }
+	Numeric::uint64 encoded_depth_bytes() const { return encoded_depth_bytes_; }
+	// In the encoding of the depths (in seconds)
+	double encoding_time() const { return encoding_time_; }
+
+private:
+	FrameWriter		writer_;
+	DepthEncoding	depth_encoding_;
+	unsigned int	nb_frames_;
+
+	std::vector<unsigned char>	encoded_;	// the depths of the frame, encoded
+	Numeric::uint64	depth_bytes_;
+	Numeric::uint64	encoded_depth_bytes_;
+	double			encoding_time_;
+};
+
+
+class KINECT_IO_API DepthSequenceReader
+{
+public:
+	DepthSequenceReader();
+
+	// Reads the records (not the images) of the sequence
+	bool open(const std::string& file_name);
+	void close();
+
+	unsigned int nb_frames() const { return static_cast<unsigned int>(frames_.size()); }
+	double timestamp(unsigned int i) const { return frames_[i].timestamp; }
+
+	// False if the sequence has no intrinsics
+	bool has_intrinsics() const { return has_intrinsics_; }
+	const DepthIntrinsics& intrinsics() const { return intrinsics_; }
+
+	// Reads the $i$-th frame (the depths are decoded, the colors are expanded to RGBA)
+	bool read_frame(unsigned int i, DepthFrame& frame, bool read_color = true);
+
+	// True if $file_name$ starts like a sequence
+	static bool is_sequence(const std::string& file_name);
+
+private:
+	struct FrameRecord {
+		std::streamoff	offset;	// of the depths
+		double			timestamp;
+		int				width, height;
+		int				depth_encoding;
+		unsigned int	depth_size;
+		int				color_width, color_height;
+		unsigned int	color_size;
+	};
+
+private:
+	std::string		file_name_;
+	std::ifstream	input_;
+	std::vector<FrameRecord>	frames_;
+
+	DepthIntrinsics	intrinsics_;
+	bool			has_intrinsics_;
+
+	std::vector<unsigned char>	encoded_;	// the depths as read (if encoded)
+	std::vector<unsigned char>	rgb_;		// the colors as read
+};
+
+
+#endif
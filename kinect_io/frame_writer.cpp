@@ -0,0 +1,514 @@
+#include "frame_writer.h"
+#include "../basic/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <errno.h>
+#endif
+
+
+// The alignment of the chunks and of their offsets for direct I/O: a
+// multiple of the sector size of the disks.
+static const std::size_t alignment = 4096;
+
+static std::size_t align_up(std::size_t n) {
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+
+FrameWriterStatistics::FrameWriterStatistics()
+: bytes_queued(0)
+, bytes_written(0)
+, bytes_durable(0)
+, backlog(0)
+, worst_backlog(0)
+, nb_writes(0)
+, nb_syncs(0)
+, nb_stalls(0)
+, nb_failures(0)
+, write_time(0)
+, worst_write(0)
+, sync_time(0)
+, worst_sync(0)
+, stall_time(0)
+, since_sync(0)
+{
+}
+
+//_________________________________________________________________________
+
+
+FrameWriter::FrameWriter()
+: open_(false)
+, direct_io_(false)
+, preallocation_(0)
+, sync_interval_(1.0)
+, queue_size_(64 * 1024 * 1024)
+, chunk_size_(4 * 1024 * 1024)
+, head_(0)
+, pending_(0)
+, chunk_(nil)
+, file_offset_(0)
+, allocated_(0)
+, taken_(0)
+, sync_target_(0)
+, closing_(false)
+, failed_(false)
+, last_sync_(0)
+#ifdef WIN32
+, file_(INVALID_HANDLE_VALUE)
+#else
+, file_(-1)
+#endif
+{
+}
+
+
+FrameWriter::~FrameWriter()
+{
+	close();
+}
+
+
+void FrameWriter::set_queue_size(std::size_t bytes)
+{
+	if (open_) {
+		Logger::warn("FrameWriter") << "the size of the queue cannot be changed while the file is open" << std::endl;
+		return;
+	}
+	queue_size_ = bytes;
+}
+
+
+void FrameWriter::set_chunk_size(std::size_t bytes)
+{
+	if (open_) {
+		Logger::warn("FrameWriter") << "the size of the chunks cannot be changed while the file is open" << std::endl;
+		return;
+	}
+	chunk_size_ = align_up(std::max(bytes, alignment));
+}
+
+
+bool FrameWriter::open(const std::string& file_name)
+{
+	close();
+	if (!open_file(file_name)) {
+		Logger::err("FrameWriter") << "could not create file \'" << file_name << "\'" << std::endl;
+		return false;
+	}
+	file_name_ = file_name;
+
+	// the queue holds at least a chunk. The buffers are kept from file to file.
+	queue_size_ = std::max(queue_size_, chunk_size_);
+	if (ring_.size() != queue_size_)
+		ring_.resize(queue_size_);
+	if (buffer_.size() != chunk_size_ + alignment)
+		buffer_.resize(chunk_size_ + alignment);
+	chunk_ = reinterpret_cast<char*>(align_up(reinterpret_cast<std::size_t>(&buffer_[0])));
+
+	head_ = 0;
+	pending_ = 0;
+	file_offset_ = 0;
+	allocated_ = 0;
+	taken_ = 0;
+	sync_target_ = 0;
+	closing_ = false;
+	failed_ = false;
+	statistics_ = FrameWriterStatistics();
+	clock_.start();
+	last_sync_ = 0;
+
+	open_ = true;
+	thread_ = std::thread(&FrameWriter::writer_loop, this);
+	return true;
+}
+
+
+bool FrameWriter::close()
+{
+	if (!open_)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closing_ = true;
+		data_queued_.notify_all();
+	}
+	thread_.join();
+	open_ = false;
+	return !failed_;
+}
+
+
+bool FrameWriter::write(const void* data, std::size_t size)
+{
+	if (!open_)
+		return false;
+
+	const char* p = static_cast<const char*>(data);
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (size > 0) {
+		if (failed_)
+			return false;
+
+		if (pending_ == ring_.size()) {
+			++statistics_.nb_stalls;
+			double start = clock_.elapsed();
+			while (pending_ == ring_.size() && !failed_)
+				room_freed_.wait(lock);
+			statistics_.stall_time += clock_.elapsed() - start;
+			continue;
+		}
+
+		std::size_t tail = (head_ + pending_) % ring_.size();
+		std::size_t n = std::min(size, std::min(ring_.size() - pending_, ring_.size() - tail));
+		// the writer thread only reads the pending bytes: the copy needs no lock
+		lock.unlock();
+		std::memcpy(&ring_[tail], p, n);
+		lock.lock();
+
+		pending_ += n;
+		p += n;
+		size -= n;
+		statistics_.bytes_queued += n;
+		statistics_.backlog = statistics_.bytes_queued - statistics_.bytes_written;
+		if (statistics_.backlog > statistics_.worst_backlog)
+			statistics_.worst_backlog = statistics_.backlog;
+		data_queued_.notify_one();
+	}
+	return true;
+}
+
+
+bool FrameWriter::sync()
+{
+	if (!open_)
+		return false;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	Numeric::uint64 target = statistics_.bytes_queued;
+	if (target > sync_target_)
+		sync_target_ = target;
+	data_queued_.notify_one();
+	while (statistics_.bytes_durable < target && !failed_)
+		synced_.wait(lock);
+	return !failed_;
+}
+
+
+FrameWriterStatistics FrameWriter::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	FrameWriterStatistics result = statistics_;
+	result.since_sync = open_ ? clock_.elapsed() - last_sync_ : 0.0;
+	return result;
+}
+
+
+void FrameWriter::writer_loop()
+{
+	// the time (in milliseconds) without new data after which the chunk is
+	// written even if it is not full
+	const int idle_delay = 50;
+
+	std::size_t staged = 0;		// the bytes in the chunk
+	bool dirty = false;			// some of them have not been written yet
+	bool done = false;
+	while (!done) {
+		std::size_t head = 0, n = 0;
+		bool idle = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			std::size_t room = chunk_size_ - staged;
+			idle = !data_queued_.wait_for(lock, std::chrono::milliseconds(idle_delay), [&]() {
+				return pending_ >= room || closing_ || sync_target_ > statistics_.bytes_durable;
+			});
+			head = head_;
+			n = std::min(pending_, std::min(room, ring_.size() - head_));
+		}
+
+		// the producer does not write over the pending bytes: the copy needs no lock
+		if (n > 0) {
+			std::memcpy(chunk_ + staged, &ring_[head], n);
+			staged += n;
+			dirty = true;
+		}
+
+		bool sync = false, flush = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			head_ = (head_ + n) % ring_.size();
+			pending_ -= n;
+			taken_ += n;
+			if (n > 0)
+				room_freed_.notify_one();
+
+			// the periodic sync does not wait for the queue to be empty: under a
+			// sustained load it may never be
+			bool caught_up = (pending_ == 0);
+			bool sync_due = sync_interval_ > 0 && clock_.elapsed() - last_sync_ >= sync_interval_;
+			bool sync_asked = sync_target_ > statistics_.bytes_durable && taken_ >= sync_target_;
+			done = closing_ && caught_up;
+			sync = done || sync_asked || sync_due;
+			flush = sync || idle;
+		}
+
+		bool ok = true;
+		if (staged == chunk_size_ || (flush && dirty)) {
+			ok = write_chunk(staged);
+			dirty = false;
+		}
+		if (ok && sync)
+			ok = sync_file();
+
+		if (!ok) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			failed_ = true;
+			room_freed_.notify_all();
+			synced_.notify_all();
+			break;
+		}
+	}
+
+	// the padding of the last chunk (direct I/O) and the preallocated space are removed
+	Numeric::uint64 size = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		size = statistics_.bytes_written;
+	}
+	if (!close_file(size)) {
+		Logger::err("FrameWriter") << "could not close file \'" << file_name_ << "\'" << std::endl;
+		std::lock_guard<std::mutex> lock(mutex_);
+		failed_ = true;
+		++statistics_.nb_failures;
+	}
+}
+
+
+bool FrameWriter::write_chunk(std::size_t& staged)
+{
+	std::size_t size = staged;
+	if (direct_io_) {
+		size = align_up(staged);
+		std::memset(chunk_ + staged, 0, size - staged);
+	}
+
+	if (preallocation_ > 0 && file_offset_ + size > allocated_) {
+		allocated_ = file_offset_ + size + preallocation_;
+		if (!preallocate(allocated_)) {
+			Logger::warn("FrameWriter") << "could not preallocate file \'" << file_name_ << "\', the file grows at each write" << std::endl;
+			preallocation_ = 0;
+		}
+	}
+
+	double start = clock_.elapsed();
+	bool ok = write_at(file_offset_, chunk_, size);
+	double time = clock_.elapsed() - start;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++statistics_.nb_writes;
+		statistics_.write_time += time;
+		if (time > statistics_.worst_write)
+			statistics_.worst_write = time;
+		if (ok) {
+			statistics_.bytes_written = file_offset_ + staged;
+			statistics_.backlog = statistics_.bytes_queued - statistics_.bytes_written;
+		}
+		else
+			++statistics_.nb_failures;
+	}
+	if (!ok) {
+		Logger::err("FrameWriter") << "could not write file \'" << file_name_ << "\'" << std::endl;
+		return false;
+	}
+
+	if (direct_io_) {
+		// the incomplete sector at the end is kept, and written again with the next data
+		std::size_t complete = staged / alignment * alignment;
+		std::memmove(chunk_, chunk_ + complete, staged - complete);
+		file_offset_ += complete;
+		staged -= complete;
+	}
+	else {
+		file_offset_ += staged;
+		staged = 0;
+	}
+	return true;
+}
+
+
+bool FrameWriter::sync_file()
+{
+	Numeric::uint64 written = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		written = statistics_.bytes_written;
+		if (statistics_.bytes_durable == written) {
+			last_sync_ = clock_.elapsed();
+			synced_.notify_all();
+			return true;
+		}
+	}
+
+	double start = clock_.elapsed();
+	bool ok = flush_file();
+	double end = clock_.elapsed();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++statistics_.nb_syncs;
+	statistics_.sync_time += end - start;
+	if (end - start > statistics_.worst_sync)
+		statistics_.worst_sync = end - start;
+	last_sync_ = end;
+	if (ok)
+		statistics_.bytes_durable = written;
+	else {
+		++statistics_.nb_failures;
+		Logger::err("FrameWriter") << "could not sync file \'" << file_name_ << "\'" << std::endl;
+	}
+	synced_.notify_all();
+	return ok;
+}
+
+//_________________________________________________________________________
+
+#ifdef WIN32
+
+bool FrameWriter::open_file(const std::string& file_name)
+{
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+	if (direct_io_)
+		flags |= FILE_FLAG_NO_BUFFERING;
+	HANDLE file = CreateFileA(file_name.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, flags, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	file_ = file;
+	return true;
+}
+
+
+bool FrameWriter::write_at(Numeric::uint64 offset, const char* data, std::size_t size)
+{
+	while (size > 0) {
+		OVERLAPPED overlapped;
+		std::memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = DWORD(offset & 0xffffffff);
+		overlapped.OffsetHigh = DWORD(offset >> 32);
+
+		DWORD n = 0;
+		DWORD to_write = DWORD(std::min<std::size_t>(size, 1 << 30));
+		if (!WriteFile(file_, data, to_write, &n, &overlapped) || n == 0)
+			return false;
+		offset += n;
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+
+bool FrameWriter::flush_file()
+{
+	return FlushFileBuffers(file_) != 0;
+}
+
+
+bool FrameWriter::preallocate(Numeric::uint64 size)
+{
+	// the clusters are reserved, the size of the file does not change
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = LONGLONG(size);
+	return SetFileInformationByHandle(file_, FileAllocationInfo, &info, sizeof(info)) != 0;
+}
+
+
+bool FrameWriter::close_file(Numeric::uint64 size)
+{
+	if (file_ == INVALID_HANDLE_VALUE)
+		return true;
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile.QuadPart = LONGLONG(size);
+	bool ok = SetFileInformationByHandle(file_, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+	ok = (CloseHandle(file_) != 0) && ok;
+	file_ = INVALID_HANDLE_VALUE;
+	return ok;
+}
+
+#else
+
+bool FrameWriter::open_file(const std::string& file_name)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+	if (direct_io_) {
+		file_ = ::open(file_name.c_str(), flags | O_DIRECT, 0644);
+		if (file_ >= 0)
+			return true;
+		// e.g., not supported by the file system
+		Logger::warn("FrameWriter") << "no direct I/O for file \'" << file_name << "\', the system cache is used" << std::endl;
+	}
+#endif
+	direct_io_ = false;
+	file_ = ::open(file_name.c_str(), flags, 0644);
+	return file_ >= 0;
+}
+
+
+bool FrameWriter::write_at(Numeric::uint64 offset, const char* data, std::size_t size)
+{
+	while (size > 0) {
+		ssize_t n = ::pwrite(file_, data, size, off_t(offset));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		offset += n;
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+
+bool FrameWriter::flush_file()
+{
+#ifdef __linux__
+	return ::fdatasync(file_) == 0;
+#else
+	return ::fsync(file_) == 0;
+#endif
+}
+
+
+bool FrameWriter::preallocate(Numeric::uint64 size)
+{
+#ifdef __linux__
+	// the blocks are reserved, the size of the file does not change
+	return ::fallocate(file_, FALLOC_FL_KEEP_SIZE, 0, off_t(size)) == 0;
+#else
+	return false;
+#endif
+}
+
+
+bool FrameWriter::close_file(Numeric::uint64 size)
+{
+	if (file_ < 0)
+		return true;
+	bool ok = ::ftruncate(file_, off_t(size)) == 0;
+	ok = (::close(file_) == 0) && ok;
+	file_ = -1;
+	return ok;
+}
+
+#endif
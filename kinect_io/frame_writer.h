@@ -0,0 +1,158 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include "kinect_io_common.h"
+#include "../basic/basic_types.h"
+#include "../basic/stop_watch.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+/***********************************************************************
+ Appends data to a file from a single thread, which lives as long as the
+ file is open:
+   - write() copies the data into a queue (a ring allocated once) and
+     returns; it only waits if the queue is full (back-pressure);
+   - the thread coalesces the queued data into chunks (4 MB by default),
+     so the file is written with a few large sequential writes whatever
+     the size of the pieces given to write();
+   - the file can be opened for direct I/O (no system cache: the chunks
+     are aligned on 4 KB and the end of the file is fixed on close) and
+     preallocated ahead of the writes;
+   - the data is synced to the disk periodically (every second by
+     default) and by sync(): statistics() tells how much of what was
+     queued is written, and how much is durable.
+ write() and sync() are called by one thread (the producer).
+************************************************************************/
+
+
+class KINECT_IO_API FrameWriterStatistics
+{
+public:
+	FrameWriterStatistics();
+
+	Numeric::uint64	bytes_queued;	// accepted by write()
+	Numeric::uint64	bytes_written;	// given to the system
+	Numeric::uint64	bytes_durable;	// flushed to the disk by a sync
+	Numeric::uint64	backlog;		// queued but not written yet
+	Numeric::uint64	worst_backlog;
+
+	unsigned int	nb_writes;		// the writes to the system (i.e., the chunks)
+	unsigned int	nb_syncs;
+	unsigned int	nb_stalls;		// write() waited for room in the queue
+	unsigned int	nb_failures;	// failed writes or syncs
+
+	double			write_time;		// in the writes to the system (in seconds)
+	double			worst_write;
+	double			sync_time;		// in the syncs (in seconds)
+	double			worst_sync;
+	double			stall_time;		// waited by write() (in seconds)
+	double			since_sync;		// since the last sync (in seconds)
+
+	// the bytes queued but not durable yet (lost if the system crashes now)
+	Numeric::uint64 at_risk() const { return bytes_queued - bytes_durable; }
+	// in bytes per second, of the writes to the system
+	double write_rate() const { return write_time > 0 ? bytes_written / write_time : 0.0; }
+};
+
+
+class KINECT_IO_API FrameWriter
+{
+public:
+	FrameWriter();
+	~FrameWriter();	// closes the file
+
+	// The size of the queue (default is 64 MB). Must be set before open().
+	void set_queue_size(std::size_t bytes);
+	// The size of the writes (default is 4 MB). Must be set before open().
+	void set_chunk_size(std::size_t bytes);
+	// Bypasses the system cache (default is false). Must be set before open().
+	void set_direct_io(bool b) { direct_io_ = b; }
+	// If not 0, the file is allocated this much ahead of the writes, in one
+	// go, instead of growing at each write (default is 0). Must be set before
+	// open().
+	void set_preallocation(std::size_t bytes) { preallocation_ = bytes; }
+	// How often the data is synced to the disk (in seconds, default is 1).
+	// 0 for only when sync() or close() is called.
+	void set_sync_interval(double seconds) { sync_interval_ = seconds; }
+
+	// Creates the file (or truncates it) and starts the thread
+	bool open(const std::string& file_name);
+	// Writes what is queued, syncs and closes the file. Returns false if any
+	// write failed since open().
+	bool close();
+	bool is_open() const { return open_; }
+	const std::string& file_name() const { return file_name_; }
+
+	// Queues the data. Returns false if the file is not open or if a write
+	// failed (nothing is written after a failure).
+	bool write(const void* data, std::size_t size);
+	// Waits until everything queued so far is durable
+	bool sync();
+
+	FrameWriterStatistics statistics() const;
+
+private:
+	void writer_loop();
+	// writes the $staged$ bytes of the chunk at the end of the file
+	bool write_chunk(std::size_t& staged);
+	bool sync_file();
+
+	// the system layer (see frame_writer.cpp)
+	bool open_file(const std::string& file_name);
+	bool write_at(Numeric::uint64 offset, const char* data, std::size_t size);
+	bool flush_file();
+	bool preallocate(Numeric::uint64 size);
+	bool close_file(Numeric::uint64 size);
+
+private:
+	std::string		file_name_;
+	bool			open_;
+	bool			direct_io_;
+	std::size_t		preallocation_;
+	double			sync_interval_;
+
+	std::size_t			queue_size_;
+	std::size_t			chunk_size_;
+	std::vector<char>	ring_;		// the queue
+	std::size_t			head_;		// of the data in the ring
+	std::size_t			pending_;	// the bytes in the ring
+
+	std::vector<char>	buffer_;	// the chunk (and room to align it)
+	char*				chunk_;
+	Numeric::uint64		file_offset_;	// where the chunk is written
+	Numeric::uint64		allocated_;		// the size preallocated
+
+	// all protected by mutex_
+	Numeric::uint64	taken_;			// the bytes moved from the ring to the chunk
+	Numeric::uint64	sync_target_;	// the bytes to make durable (see sync())
+	bool			closing_;
+	bool			failed_;
+	FrameWriterStatistics	statistics_;
+	double			last_sync_;
+
+	mutable std::mutex			mutex_;
+	std::condition_variable		data_queued_;
+	std::condition_variable		room_freed_;
+	std::condition_variable		synced_;
+
+	std::thread		thread_;
+	StopWatch		clock_;
+
+#ifdef WIN32
+	void*	file_;
+#else
+	int		file_;
+#endif
+
+private:
+	FrameWriter(const FrameWriter&);
+	FrameWriter& operator=(const FrameWriter&);
+};
+
+
+#endif
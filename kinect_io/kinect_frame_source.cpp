@@ -0,0 +1,60 @@
+#include "kinect_frame_source.h"
+#include "depth_basic.h"
+
+#include <ctime>
+
+
+KinectFrameSource::KinectFrameSource(CDepthBasics* scanner, bool read_colors)
+: scanner_(scanner)
+, read_colors_(read_colors)
+, has_intrinsics_(false)
+{
+}
+
+
+bool KinectFrameSource::open()
+{
+	scanner_->openScanner();
+	has_intrinsics_ = false;
+	intrinsics_ = DepthIntrinsics();
+	return true;
+}
+
+
+void KinectFrameSource::close()
+{
+	scanner_->closeScanner();
+}
+
+
+bool KinectFrameSource::next(DepthFrame& frame, unsigned int timeout)
+{
+	frame.resize(scanner_->getDepthWidth(), scanner_->getDepthHeight());
+	if (read_colors_)
+		frame.resize_color(scanner_->getRGBWidth(), scanner_->getRGBHeight());
+	else
+		frame.resize_color(0, 0);
+
+	// a new frame is available about every 33 ms
+	DWORD start = GetTickCount();
+	while (!scanner_->GetImagesOfOneFrame(frame.depth(), frame.color()))
+	{
+		if (GetTickCount() - start >= timeout)
+			return false;
+		Sleep(5);
+	}
+	frame.set_timestamp(clock() * 1000.0 / CLOCKS_PER_SEC);
+
+	if (!has_intrinsics_)
+		has_intrinsics_ = scanner_->GetDepthIntrinsics(intrinsics_);
+	return true;
+}
+
+
+int KinectFrameSource::backproject(const DepthFrame& frame, float* xyz, int* pixels) const
+{
+	int num = 0;
+	if (!scanner_->MapDepthFrameToPoints(frame.depth(), xyz, num, pixels))
+		return -1;
+	return num;
+}
@@ -0,0 +1,36 @@
+#ifndef KINECT_FRAME_SOURCE_H
+#define KINECT_FRAME_SOURCE_H
+
+#include "depth_frame_source.h"
+
+class CDepthBasics;
+
+// The frames of the scanner (the depth images of 512 x 424 pixels and, if
+// requested, the color images of 1920 x 1080 pixels). The points are mapped
+// by the SDK (which also corrects the distortion of the lens). The scanner
+// is not owned.
+class KINECT_IO_API KinectFrameSource : public DepthFrameSource
+{
+public:
+	KinectFrameSource(CDepthBasics* scanner, bool read_colors = true);
+
+	virtual bool open();
+	virtual void close();
+
+	virtual bool next(DepthFrame& frame, unsigned int timeout = 1000);
+	virtual bool finished() const { return false; }
+
+	// The nominal ones until the scanner has sent a frame
+	virtual const DepthIntrinsics& intrinsics() const { return intrinsics_; }
+	virtual bool has_intrinsics() const { return has_intrinsics_; }
+
+	virtual int backproject(const DepthFrame& frame, float* xyz, int* pixels) const;
+
+private:
+	CDepthBasics*	scanner_;
+	bool			read_colors_;
+	bool			has_intrinsics_;
+	DepthIntrinsics	intrinsics_;
+};
+
+#endif
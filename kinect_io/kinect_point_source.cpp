@@ -0,0 +1,31 @@
+#include "kinect_point_source.h"
+#include "depth_basic.h"
+
+
+KinectPointSource::KinectPointSource(CDepthBasics* scanner, unsigned int nb_frames, unsigned int timeout)
+: scanner_(scanner)
+, nb_frames_(nb_frames)
+, timeout_(timeout)
+, nb_frames_read_(0)
+{
+}
+
+
+bool KinectPointSource::next(DensePointSet& chunk)
+{
+	chunk.clear();
+	if (nb_frames_ > 0 && nb_frames_read_ >= nb_frames_)
+		return false;
+
+	// a new frame is available about every 33 ms
+	DWORD start = GetTickCount();
+	while (!scanner_->GetPointsOfOneFrame(&chunk))
+	{
+		if (GetTickCount() - start > timeout_)
+			return false;
+		Sleep(5);
+	}
+
+	++nb_frames_read_;
+	return true;
+}
@@ -0,0 +1,32 @@
+#ifndef KINECT_POINT_SOURCE_H
+#define KINECT_POINT_SOURCE_H
+
+#include "kinect_io_common.h"
+#include "../geom/point_stream.h"
+
+class CDepthBasics;
+
+// The frames of the scanner as a source of the streaming pipeline (see
+// PointPipeline): each chunk is the points of one frame. The scanner must
+// be opened (and is not owned).
+class KINECT_IO_API KinectPointSource : public PointSource
+{
+public:
+	// Stops after $nb_frames$ frames (0: no limit), or when no frame arrives 
+	// within $timeout$ milliseconds.
+	KinectPointSource(CDepthBasics* scanner, unsigned int nb_frames = 0, unsigned int timeout = 1000);
+
+	virtual bool next(DensePointSet& chunk);
+	virtual bool has_normals() const { return false; }
+	virtual bool has_colors() const { return false; }
+
+	unsigned int nb_frames_read() const { return nb_frames_read_; }
+
+private:
+	CDepthBasics*	scanner_;
+	unsigned int	nb_frames_;
+	unsigned int	timeout_;
+	unsigned int	nb_frames_read_;
+};
+
+#endif
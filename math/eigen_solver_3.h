@@ -0,0 +1,162 @@
+#ifndef _MATH_EIGEN_SOLVER_3_H_
+#define _MATH_EIGEN_SOLVER_3_H_
+
+#include <cmath>
+#include <limits>
+
+#include "math_common.h"
+#include "vecg.h"
+
+
+// Closed-form eigen decomposition of a symmetric 3x3 matrix (e.g., a covariance
+// matrix). The eigenvalues are the roots of the characteristic polynomial,
+// computed with the trigonometric method of O. K. Smith ("Eigenvalues of a
+// symmetric 3x3 matrix", Communications of the ACM, 1961). It is much cheaper
+// than the iterative solver of GenericPlane3::FitToPoints() (tred2/tqli) and
+// does not allocate anything, so it can be called from several threads.
+//
+// The matrix is given by its upper triangle:
+//		| m[0]  m[1]  m[2] |
+//		| m[1]  m[3]  m[4] |
+//		| m[2]  m[4]  m[5] |
+
+template <class FT>
+class SymmetricEigenSolver3
+{
+public:
+	typedef vecng<3, FT>	Vector;
+
+	// Computes the eigenvalues in increasing order. Returns false if the matrix is
+	// zero (then all the eigenvalues are 0).
+	static bool eigen_values(const FT m[6], FT values[3]);
+
+	// Computes the eigenvalues (in increasing order) and the unit eigenvector of the
+	// smallest one, i.e., the normal of the plane fitted to the points whose
+	// covariance matrix is $m$. Returns false if this eigenvector is not defined
+	// (all the eigenvalues are equal).
+	static bool smallest_eigen_vector(const FT m[6], FT values[3], Vector& v);
+
+private:
+	// the largest absolute value of the coefficients. Scaling the matrix by it avoids
+	// overflow/underflow in the cubic.
+	static FT max_coefficient(const FT m[6]);
+	// the eigenvalues of the scaled matrix
+	static void scaled_eigen_values(const FT a[6], FT values[3]);
+};
+
+
+template <class FT> inline
+FT SymmetricEigenSolver3<FT>::max_coefficient(const FT m[6]) {
+	FT scale = 0;
+	for (int i = 0; i < 6; ++i) {
+		FT v = std::fabs(m[i]);
+		if (v > scale)
+			scale = v;
+	}
+	return scale;
+}
+
+
+template <class FT> inline
+void SymmetricEigenSolver3<FT>::scaled_eigen_values(const FT a[6], FT values[3]) {
+	FT q = (a[0] + a[3] + a[5]) / 3;
+	FT b0 = a[0] - q;
+	FT b3 = a[3] - q;
+	FT b5 = a[5] - q;
+	FT p2 = b0 * b0 + b3 * b3 + b5 * b5 + 2 * (a[1] * a[1] + a[2] * a[2] + a[4] * a[4]);
+	FT p = std::sqrt(p2 / 6);
+	if (p <= 0) {	// a multiple of the identity
+		values[0] = values[1] = values[2] = q;
+		return;
+	}
+
+	// r = det(B / p) / 2, with B = A - qI
+	FT det = b0 * (b3 * b5 - a[4] * a[4]) - a[1] * (a[1] * b5 - a[4] * a[2]) + a[2] * (a[1] * a[4] - b3 * a[2]);
+	FT r = det / (2 * p * p * p);
+	if (r <= -1)	r = -1;		// rounding errors
+	else if (r >= 1) r = 1;
+
+	const FT two_pi_over_3 = FT(2.0943951023931954923);
+	FT phi = std::acos(r) / 3;
+	values[2] = q + 2 * p * std::cos(phi);
+	values[0] = q + 2 * p * std::cos(phi + two_pi_over_3);
+	values[1] = 3 * q - values[0] - values[2];
+}
+
+
+template <class FT> inline
+bool SymmetricEigenSolver3<FT>::eigen_values(const FT m[6], FT values[3]) {
+	FT scale = max_coefficient(m);
+	if (scale <= 0) {
+		values[0] = values[1] = values[2] = 0;
+		return false;
+	}
+
+	FT a[6];
+	for (int i = 0; i < 6; ++i)
+		a[i] = m[i] / scale;
+	scaled_eigen_values(a, values);
+	for (int i = 0; i < 3; ++i)
+		values[i] *= scale;
+	return true;
+}
+
+
+template <class FT> inline
+bool SymmetricEigenSolver3<FT>::smallest_eigen_vector(const FT m[6], FT values[3], Vector& v) {
+	FT scale = max_coefficient(m);
+	if (scale <= 0) {
+		values[0] = values[1] = values[2] = 0;
+		return false;
+	}
+
+	FT a[6];
+	for (int i = 0; i < 6; ++i)
+		a[i] = m[i] / scale;
+	scaled_eigen_values(a, values);
+
+	// The rows of A - lambda * I are orthogonal to the eigenvector, so it is given by
+	// the cross product of two of them (the largest one is the most accurate).
+	FT lambda = values[0];
+	Vector rows[3] = {
+		Vector(a[0] - lambda, a[1], a[2]),
+		Vector(a[1], a[3] - lambda, a[4]),
+		Vector(a[2], a[4], a[5] - lambda)
+	};
+	for (int i = 0; i < 3; ++i)
+		values[i] *= scale;
+
+	Vector crosses[3] = {
+		cross(rows[0], rows[1]),
+		cross(rows[0], rows[2]),
+		cross(rows[1], rows[2])
+	};
+	int best_cross = 0, best_row = 0;
+	for (int i = 1; i < 3; ++i) {
+		if (crosses[i].length2() > crosses[best_cross].length2())	best_cross = i;
+		if (rows[i].length2() > rows[best_row].length2())			best_row = i;
+	}
+
+	FT max_cross2 = crosses[best_cross].length2();
+	FT max_row2 = rows[best_row].length2();
+	if (max_row2 <= 0)
+		return false;	// all the eigenvalues are equal
+
+	if (max_cross2 > std::numeric_limits<FT>::epsilon() * max_row2 * max_row2) {
+		v = crosses[best_cross] / std::sqrt(max_cross2);
+		return true;
+	}
+
+	// The two smallest eigenvalues are equal: the rows are all parallel to the
+	// eigenvector of the largest one and any vector orthogonal to it will do.
+	const Vector& u = rows[best_row];
+	Vector w = (std::fabs(u.x) < std::fabs(u.y)) ?
+		((std::fabs(u.x) < std::fabs(u.z)) ? Vector(1, 0, 0) : Vector(0, 0, 1)) :
+		((std::fabs(u.y) < std::fabs(u.z)) ? Vector(0, 1, 0) : Vector(0, 0, 1));
+	v = cross(u, w);
+	v = v / v.length();
+	return true;
+}
+
+
+#endif
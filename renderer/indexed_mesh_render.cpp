@@ -0,0 +1,205 @@
+#include "indexed_mesh_render.h"
+#include "../geom/indexed_mesh.h"
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+
+
+IndexedMeshRender::IndexedMeshRender(IndexedMesh* obj)
+: Render(obj)
+, flat_mesh_(nil)
+, flat_revision_(0)
+{
+	smooth_shading_ = false;
+	use_color_attribute_ = true;
+
+	surface_style_.visible = true ;
+	surface_style_.color = Color(0.33f, 0.67f, 1.0f, 0.5f);
+
+	mesh_style_.visible = false ;
+	mesh_style_.color   = Color(0.0f, 0.0f, 0.0f, 1.0f); 
+	mesh_style_.width   = 1 ;
+}
+
+
+IndexedMesh* IndexedMeshRender::target() const {
+	return dynamic_cast<IndexedMesh*>(object());
+}
+
+
+void IndexedMeshRender::draw() {
+	if (target()->nb_facets() == 0)
+		return;
+
+	if(surface_style_.visible) {
+		if (mesh_style_.visible) {
+			// Makes the depth coordinates of the filled primitives smaller, so that
+			// displaying the mesh and the surface does not cause Z-fighting.
+			glEnable(GL_POLYGON_OFFSET_FILL) ;
+			glPolygonOffset(0.5f, -0.0001f) ;
+		}
+
+		draw_surface() ;
+
+		if (mesh_style_.visible)
+			glDisable(GL_POLYGON_OFFSET_FILL);
+	}
+
+	if(mesh_style_.visible)
+		draw_mesh() ;
+}
+
+
+void IndexedMeshRender::draw_polygons() {
+	IndexedMesh* mesh = target();
+	if (mesh->is_triangulated()) 
+		glDrawElements(GL_TRIANGLES, mesh->nb_indices(), GL_UNSIGNED_INT, mesh->indices());
+	else {
+		for (unsigned int f = 0; f < mesh->nb_facets(); ++f)
+			glDrawElements(GL_POLYGON, mesh->facet_size(f), GL_UNSIGNED_INT, mesh->facet_vertices(f));
+	}
+}
+
+
+void IndexedMeshRender::draw_surface() {
+	IndexedMesh* mesh = target();
+	bool has_colors = use_color_attribute_ && mesh->has_colors();
+
+	glEnable(GL_LIGHTING);
+	glColor4fv(surface_style_.color.data());
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	if (smooth_shading_) {
+		if (!mesh->has_normals())
+			mesh->compute_vertex_normals();
+
+		glShadeModel(GL_SMOOTH);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, 0, mesh->positions());
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, 0, mesh->normals());
+		if (has_colors) {
+			glEnableClientState(GL_COLOR_ARRAY);
+			glColorPointer(3, GL_FLOAT, 0, mesh->colors());
+		}
+
+		draw_polygons();
+
+		if (has_colors)
+			glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+	} 
+	else {
+		update_flat_arrays(has_colors);
+		if (flat_positions_.empty())
+			return;
+
+		glShadeModel(has_colors ? GL_SMOOTH : GL_FLAT);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, 0, &flat_positions_[0]);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, 0, &flat_normals_[0]);
+		if (has_colors) {
+			glEnableClientState(GL_COLOR_ARRAY);
+			glColorPointer(3, GL_FLOAT, 0, &flat_colors_[0]);
+		}
+
+		glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(flat_positions_.size() / 3));
+
+		if (has_colors)
+			glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+	}
+}
+
+
+void IndexedMeshRender::update_flat_arrays(bool with_colors) {
+	IndexedMesh* mesh = target();
+	bool valid = 
+		flat_mesh_ == mesh && 
+		flat_revision_ == mesh->revision() &&
+		(!with_colors || !flat_colors_.empty());
+	if (valid)
+		return;
+
+	unsigned int nb_triangles = 0;
+	for (unsigned int f = 0; f < mesh->nb_facets(); ++f) {
+		if (mesh->facet_size(f) >= 3)
+			nb_triangles += mesh->facet_size(f) - 2;
+	}
+	flat_positions_.resize(9 * nb_triangles);
+	flat_normals_.resize(9 * nb_triangles);
+	flat_colors_.resize(with_colors ? 9 * nb_triangles : 0);
+
+	const float* positions = mesh->positions();
+	const float* colors = mesh->colors();
+	std::size_t k = 0;
+	for (unsigned int f = 0; f < mesh->nb_facets(); ++f) {
+		const unsigned int* v = mesh->facet_vertices(f);
+		unsigned int n = mesh->facet_size(f);
+		if (n < 3)
+			continue;
+
+		// the normal of Newell
+		vec3 normal(0, 0, 0);
+		for (unsigned int i = 0; i < n; ++i) {
+			vec3 p = mesh->point(v[i]);
+			vec3 q = mesh->point(v[(i + 1) % n]);
+			normal.x += (p.y - q.y) * (p.z + q.z);
+			normal.y += (p.z - q.z) * (p.x + q.x);
+			normal.z += (p.x - q.x) * (p.y + q.y);
+		}
+		if (normal.length() > 0)
+			normal = normalize(normal);
+
+		for (unsigned int i = 1; i + 1 < n; ++i) {
+			unsigned int corners[3] = { v[0], v[i], v[i + 1] };
+			for (int j = 0; j < 3; ++j, k += 3) {
+				const float* p = positions + 3 * corners[j];
+				flat_positions_[k] = p[0];	flat_positions_[k + 1] = p[1];	flat_positions_[k + 2] = p[2];
+				flat_normals_[k] = float(normal.x);	flat_normals_[k + 1] = float(normal.y);	flat_normals_[k + 2] = float(normal.z);
+				if (with_colors) {
+					const float* c = colors + 3 * corners[j];
+					flat_colors_[k] = c[0];	flat_colors_[k + 1] = c[1];	flat_colors_[k + 2] = c[2];
+				}
+			}
+		}
+	}
+
+	flat_mesh_ = mesh;
+	flat_revision_ = mesh->revision();
+}
+
+
+void IndexedMeshRender::draw_mesh() {
+	IndexedMesh* mesh = target();
+
+	glDisable(GL_LIGHTING);
+	glLineWidth(mesh_style_.width);
+	glColor4fv(mesh_style_.color.data());
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, mesh->positions());
+	draw_polygons();
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+
+void IndexedMeshRender::blink() {
+	bool visible = mesh_style_.visible;
+	mesh_style_.visible = !visible;
+	target()->update() ;
+	sleep(200);
+
+	mesh_style_.visible = visible;
+	target()->update() ;
+}
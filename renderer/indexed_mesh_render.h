@@ -0,0 +1,73 @@
+
+#ifndef _RENDERER_INDEXED_MESH_RENDER_H_
+#define _RENDERER_INDEXED_MESH_RENDER_H_
+
+#include "renderer_common.h"
+#include "rendering_styles.h"
+#include "render.h"
+
+#include <vector>
+
+
+class IndexedMesh;
+
+// Draws an IndexedMesh directly from its arrays (OpenGL vertex arrays), 
+// without the halfedge structure.
+class RENDERER_API IndexedMeshRender : public Render
+{
+public:
+	IndexedMeshRender(IndexedMesh* obj) ;
+
+	RenderType type() const { return PLAIN_INDEXED_MESH_RENDER; }
+
+	IndexedMesh* target() const;
+
+	virtual void draw() ;
+	virtual void blink() ;
+
+	//___________________________________________________________
+
+	bool smooth_shading() const { return smooth_shading_ ; }
+	void set_smooth_shading(bool x) { smooth_shading_ = x ; }
+
+	bool use_color_attribute() const { return use_color_attribute_ ; }
+	void set_use_color_attribute(bool x) { use_color_attribute_ = x ; }
+
+	const SurfaceStyle& surface_style() const { return surface_style_ ; }
+	void set_surface_style(const SurfaceStyle& x) { surface_style_ = x ; }
+
+	const EdgeStyle& mesh_style() const { return mesh_style_ ; }
+	void set_mesh_style(const EdgeStyle& x) { mesh_style_ = x ; }
+
+	// The flat shading draws triangles from arrays where each facet has its own
+	// copies of its vertices (with the normal of the facet). These arrays are
+	// rebuilt when the mesh is modified (see IndexedMesh::revision()).
+	void invalidate_flat_arrays() { flat_mesh_ = nil ; }
+
+protected:
+	virtual void draw_surface() ;
+	virtual void draw_mesh() ;
+
+	// draws the facets one by one with the vertex arrays enabled
+	void draw_polygons() ;
+
+	// (re)builds the arrays of the flat shading if needed
+	void update_flat_arrays(bool with_colors) ;
+
+protected:
+	bool         smooth_shading_ ;
+	bool         use_color_attribute_ ;
+
+	SurfaceStyle surface_style_ ;
+	EdgeStyle    mesh_style_ ;
+
+	// the facets triangulated (as fans), 3 vertices per triangle
+	std::vector<float>	flat_positions_ ;
+	std::vector<float>	flat_normals_ ;
+	std::vector<float>	flat_colors_ ;
+	// what the arrays were built from
+	const IndexedMesh*	flat_mesh_ ;
+	unsigned int		flat_revision_ ;
+} ;
+
+#endif
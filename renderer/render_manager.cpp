@@ -3,9 +3,11 @@
 #include "scalar_surface_render.h"
 #include "plain_point_set_render.h"
 #include "scalar_point_set_render.h"
+#include "indexed_mesh_render.h"
 #include "../basic/logger.h"
 #include "../geom/map.h"
 #include "../geom/point_set.h"
+#include "../geom/indexed_mesh.h"
 
 
 RenderManager::RenderManager(Object* obj) : visible_(true) {
@@ -31,6 +33,12 @@ void RenderManager::create_renders() {
 		applicable_renders_.push_back("Plain");
 		applicable_renders_.push_back("Scalar");
 	} 
+	else if (dynamic_cast<IndexedMesh*>(target())) {
+		IndexedMesh* mesh = dynamic_cast<IndexedMesh*>(target());
+		renders_[PLAIN_INDEXED_MESH_RENDER] = new IndexedMeshRender(mesh);
+		set_render(PLAIN_INDEXED_MESH_RENDER);
+		applicable_renders_.push_back("Plain");
+	}
 	else if (dynamic_cast<PointSet*>(target())) {
 		PointSet* pset = dynamic_cast<PointSet*>(target());
 		renders_[PLAIN_POINT_SET_RENDER] = new PlainPointSetRender(pset);
@@ -69,6 +77,12 @@ void RenderManager::set_render(const std::string& s) {
 		else
 			Logger::err(title()) << "render \'" << s << "\' not applicable for current object" << std::endl;
 	} 
+	else if (dynamic_cast<IndexedMesh*>(target())) {
+		if (s == "Plain") 
+			set_render(PLAIN_INDEXED_MESH_RENDER);
+		else
+			Logger::err(title()) << "render \'" << s << "\' not applicable for current object" << std::endl;
+	}
 	else if (dynamic_cast<PointSet*>(target())) {
 		if (s == "Plain") 
 			set_render(PLAIN_POINT_SET_RENDER);
@@ -13,6 +13,10 @@ enum RenderType {
 	VECTORS_SURFACE_RENDER,		// "vectors_surface_render"
 	TEXTURED_SURFACE_RENDER,	// "textured_surface_render"
 
+	//------------ IndexedMesh ------------
+
+	PLAIN_INDEXED_MESH_RENDER,	// "plain_indexed_mesh_render"
+
 	//------------- PointSet --------------
 
 	PLAIN_POINT_SET_RENDER,		//	"plain_point_set_render"